@@ -10,4 +10,7 @@ static const int bufferClearThreadGroupSize = 32;
 static const int textureClearThreadGroupSizeX = 8;
 static const int textureClearThreadGroupSizeY = 8;
 
-static const int specularCubeMapsArrayMaxIndex = 255; // maximum index is also invalid index
\ No newline at end of file
+static const int specularCubeMapsArrayMaxIndex = 255; // maximum index is also invalid index
+
+static const int globalBufferBlockOffsetBitCount = 28; // upper bits of a global buffer offset select the block, lower bits are the offset within the block
+static const int globalBufferBlocksMaxCount = 8;
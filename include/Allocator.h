@@ -1,30 +1,38 @@
 #pragma once
 #include "MathHelpers.h"
+#include "MemoryTelemetry.h"
+#include "TlsfAllocator.h"
+#include "VirtualMemory.h"
 
-template <typename T>
+//Size is the type of chunk sizes and offsets, 64 bits for arenas which may exceed 4 GB
+template <typename T, typename Size = uint32_t>
 struct ChunkAllocator
 {
-	std::function<T(uint32_t)> allocationFunction; 
+	//the allocation function is stored inline instead of in a std::function, so initializing and copying never touch the heap
+	static constexpr uint32_t allocationFunctionMaxSize = 16;
+
+	alignas(8) uint8_t allocationFunctionStorage[allocationFunctionMaxSize];
+	T(*invokeAllocationFunction)(void* allocationFunction, Size size) = nullptr;
 	std::vector<T> allChunks;
-	uint32_t chunkSize;
+	Size chunkSize;
 
 	struct Allocation 
 	{
 		T chunk; 
-		uint32_t offset = 0; // offset in current chunk
+		Size offset = 0; // offset in current chunk
 	};
 
 	struct Marker
 	{
 		int chunkIndex = 0;
-		uint32_t offset = 0;
+		Size offset = 0;
 	};
 
 	Marker current;
 
 	template <typename S>
-	void Init(S allocationFunction, uint32_t chunkSize, uint32_t initialChunkCount);
-	Allocation Allocate(uint32_t size);
+	void Init(S allocationFunction, Size chunkSize, uint32_t initialChunkCount);
+	Allocation Allocate(Size size);
 	void Reset(const Marker& marker = {});
 
 	Marker GetMarker() const;
@@ -32,29 +40,40 @@ struct ChunkAllocator
 	template <typename S>
 	void Destroy(S freeFunction);
 
-	uint32_t GetReservedMemoryBytes() const
+	Size GetReservedMemoryBytes() const
+	{
+		return static_cast<Size>(allChunks.size()) * chunkSize;
+	}
+
+private:
+	T AllocateChunk()
 	{
-		return static_cast<uint32_t>(allChunks.size()) * chunkSize;
+		return invokeAllocationFunction(allocationFunctionStorage, chunkSize);
 	}
 };
 
-template<typename T>
+template<typename T, typename Size>
 template<typename S>
-inline void ChunkAllocator<T>::Init(S allocationFunction, uint32_t chunkSize, uint32_t initialChunkCount)
+inline void ChunkAllocator<T, Size>::Init(S allocationFunction, Size chunkSize, uint32_t initialChunkCount)
 {
-	this->allocationFunction = allocationFunction;
+	static_assert(sizeof(S) <= allocationFunctionMaxSize && alignof(S) <= 8 && std::is_trivially_copyable_v<S>, "allocation function needs to be a small lambda capturing pointers or values only");
+	new (allocationFunctionStorage) S(allocationFunction);
+	invokeAllocationFunction = [](void* allocationFunction, Size size) -> T
+	{
+		return (*static_cast<S*>(allocationFunction))(size);
+	};
 	this->chunkSize = chunkSize;
 	Reset();
 
 	allChunks.reserve(initialChunkCount);
 	for (uint32_t i = 0; i < initialChunkCount; i++)
 	{
-		allChunks.push_back(allocationFunction(chunkSize));
+		allChunks.push_back(AllocateChunk());
 	}
 }
 
-template<typename T>
-inline ChunkAllocator<T>::Allocation ChunkAllocator<T>::Allocate(uint32_t size)
+template<typename T, typename Size>
+inline ChunkAllocator<T, Size>::Allocation ChunkAllocator<T, Size>::Allocate(Size size)
 {
 	assert(size <= chunkSize); 
 
@@ -65,7 +84,7 @@ inline ChunkAllocator<T>::Allocation ChunkAllocator<T>::Allocate(uint32_t size)
 
 		if (current.chunkIndex == allChunks.size()) // if no chunks are free, allocate a new chunk
 		{
-			allChunks.push_back(allocationFunction(chunkSize));
+			allChunks.push_back(AllocateChunk());
 		}
 	}
 	
@@ -78,15 +97,15 @@ inline ChunkAllocator<T>::Allocation ChunkAllocator<T>::Allocate(uint32_t size)
 	return allocation;
 }
 
-template<typename T>
-inline void ChunkAllocator<T>::Reset(const Marker& marker)
+template<typename T, typename Size>
+inline void ChunkAllocator<T, Size>::Reset(const Marker& marker)
 {
 	current = marker;
 }
 
-template<typename T>
+template<typename T, typename Size>
 template<typename S>
-inline void ChunkAllocator<T>::Destroy(S freeFunction)
+inline void ChunkAllocator<T, Size>::Destroy(S freeFunction)
 {
 	for (auto& chunk : allChunks)
 	{
@@ -94,12 +113,144 @@ inline void ChunkAllocator<T>::Destroy(S freeFunction)
 	}
 }
 
-template<typename T>
-inline ChunkAllocator<T>::Marker ChunkAllocator<T>::GetMarker() const
+template<typename T, typename Size>
+inline ChunkAllocator<T, Size>::Marker ChunkAllocator<T, Size>::GetMarker() const
 {
 	return current;
 }
 
+//Hands out offsets of one contiguous range in FIFO order and wraps around at its end. Allocations are grouped by frame and the whole frame gets retired once the GPU passed its fence value.
+//@note: manages offsets only, so it can be used for buffer memory and descriptors alike
+struct RingAllocator
+{
+	static constexpr uint32_t InvalidOffset = uint32_t(-1);
+
+	struct FrameMarker
+	{
+		uint64_t fenceValue;
+		uint32_t size; //including padding and the skipped tail on wrap around
+	};
+
+	//used to size the ring from real data
+	struct Stats
+	{
+		uint32_t lastFrameSize = 0;
+		uint32_t maxFrameSize = 0;
+		uint32_t maxUsedSize = 0; //peak over all frames in flight, the ring needs to be at least this large
+		uint32_t lastFramePaddingSize = 0;
+		uint32_t wrapCount = 0;
+		uint32_t waitCount = 0; //allocations which had to wait for a frame in flight, the ring is too small if this keeps growing
+		uint32_t overflowCount = 0; //allocations which did not fit even with all frames retired, counted by the owner of the ring
+	};
+
+	uint32_t baseOffset = 0;
+	uint32_t size = 0;
+	uint32_t head = 0;
+	uint32_t usedSize = 0;
+	uint32_t frameSize = 0;
+	uint32_t framePaddingSize = 0;
+	std::vector<FrameMarker> pendingFrames;
+	Stats stats;
+
+	void Init(uint32_t baseOffset, uint32_t size)
+	{
+		this->baseOffset = baseOffset;
+		this->size = size;
+		head = 0;
+		usedSize = 0;
+		frameSize = 0;
+		framePaddingSize = 0;
+		pendingFrames.clear();
+		stats = {};
+	}
+
+	//returns InvalidOffset if the frames in flight still occupy too much of the ring, or if the allocation is larger than the ring
+	uint32_t Allocate(uint32_t allocationSize, uint32_t alignment = 1)
+	{
+		if (allocationSize > size)
+		{
+			return InvalidOffset;
+		}
+
+		//alignment is applied to the final offset, the base of the range does not need to be aligned
+		uint32_t localOffset = static_cast<uint32_t>(Align(baseOffset + head, alignment)) - baseOffset;
+		uint32_t consumedSize = localOffset - head + allocationSize;
+		const bool isWrapping = localOffset + allocationSize > size;
+		if (isWrapping)
+		{
+			localOffset = static_cast<uint32_t>(Align(baseOffset, alignment)) - baseOffset;
+			consumedSize = (size - head) + localOffset + allocationSize;
+			if (localOffset + allocationSize > size)
+			{
+				return InvalidOffset;
+			}
+		}
+
+		if (usedSize + consumedSize > size)
+		{
+			return InvalidOffset;
+		}
+
+		stats.wrapCount += isWrapping ? 1 : 0;
+		head = localOffset + allocationSize;
+		usedSize += consumedSize;
+		frameSize += consumedSize;
+		framePaddingSize += consumedSize - allocationSize;
+		stats.maxUsedSize = Max(stats.maxUsedSize, usedSize);
+
+		return baseOffset + localOffset;
+	}
+
+	//Allocate(), but as long as the frames in flight occupy too much of the ring, waits for the oldest one and retires it. waitForFence(fenceValue) blocks until the GPU passed fenceValue and returns the completed fence value.
+	//Still returns InvalidOffset if the current frame alone does not fit
+	template<typename F>
+	uint32_t AllocateOrWait(uint32_t allocationSize, uint32_t alignment, F&& waitForFence)
+	{
+		uint32_t offset = Allocate(allocationSize, alignment);
+		while (offset == InvalidOffset && allocationSize <= size && !pendingFrames.empty())
+		{
+			stats.waitCount++;
+			Retire(waitForFence(pendingFrames.front().fenceValue));
+			offset = Allocate(allocationSize, alignment);
+		}
+
+		return offset;
+	}
+
+	//to be called once per frame, after the frame's fence value got signaled
+	void EndFrame(uint64_t fenceValue)
+	{
+		pendingFrames.push_back({ .fenceValue = fenceValue, .size = frameSize });
+		stats.lastFrameSize = frameSize;
+		stats.maxFrameSize = Max(stats.maxFrameSize, frameSize);
+		stats.lastFramePaddingSize = framePaddingSize;
+		frameSize = 0;
+		framePaddingSize = 0;
+	}
+
+	//frees the memory of all frames whose fence value is not larger than completedFenceValue
+	void Retire(uint64_t completedFenceValue)
+	{
+		uint32_t retiredFramesCount = 0;
+		for (const FrameMarker& frame : pendingFrames)
+		{
+			if (frame.fenceValue > completedFenceValue)
+			{
+				break;
+			}
+			usedSize -= frame.size;
+			retiredFramesCount++;
+		}
+		pendingFrames.erase(pendingFrames.begin(), pendingFrames.begin() + retiredFramesCount);
+
+		//restart at the beginning once empty, so allocations of up to the full ring size can succeed
+		if (usedSize == 0)
+		{
+			head = 0;
+		}
+	}
+};
+
 
 template<size_t pageSize>
 struct PoolAllocator
@@ -198,18 +349,342 @@ inline void PoolAllocator<pageSize>::Free(T* ptr)
 	Free((void*)ptr);
 }
 
+//Thread-safe variant of PoolAllocator. Free elements are kept in a Treiber stack whose head packs index and generation into 64 bits to avoid ABA.
+//Pages live in a reserved address range and the pool grows by committing another slab instead of running out.
+//Optional per-thread magazines cache free indices locally, such that the common case does not touch any shared cache line.
+//A thread holds one of poolThreadSlotsMaxCount slots while it is alive and gives it back on exit, so threads which come and go, e.g. with JobSystem re-Init(), don't use up the slots.
+//Threads beyond that have no magazine and go through the shared free list.
+static constexpr uint32_t poolThreadSlotsMaxCount = 64;
+static constexpr uint32_t poolThreadNoSlot = uint32_t(-1);
+inline std::atomic<uint64_t> poolThreadSlotsMask = 0; //bit set = slot taken
+
+struct PoolThreadSlot
+{
+	uint32_t index = poolThreadNoSlot;
+
+	PoolThreadSlot()
+	{
+		uint64_t mask = poolThreadSlotsMask.load(std::memory_order_relaxed);
+		while (mask != ~0ull)
+		{
+			const uint32_t freeIndex = std::countr_one(mask);
+			if (poolThreadSlotsMask.compare_exchange_weak(mask, mask | (1ull << freeIndex), std::memory_order_acquire, std::memory_order_relaxed))
+			{
+				index = freeIndex;
+				return;
+			}
+		}
+	}
+
+	//the magazines of the slot stay filled with free indices and get taken over by the next thread
+	~PoolThreadSlot()
+	{
+		if (index != poolThreadNoSlot)
+		{
+			poolThreadSlotsMask.fetch_and(~(1ull << index), std::memory_order_release);
+		}
+	}
+};
+
+//poolThreadNoSlot if all slots are taken
+inline uint32_t GetPoolThreadIndex()
+{
+	thread_local PoolThreadSlot slot;
+	return slot.index;
+}
+
+template<size_t pageSize>
+struct ConcurrentPoolAllocator
+{
+	static_assert(pageSize >= sizeof(uint32_t));
+
+	static constexpr uint32_t InvalidIndex = uint32_t(-1);
+	static constexpr uint32_t magazineCapacity = 32;
+	static constexpr uint32_t magazinesMaxCount = poolThreadSlotsMaxCount;
+
+	struct Page
+	{
+		union
+		{
+			uint8_t data[pageSize];
+			uint32_t nextFreeIndex;
+		};
+	};
+
+	//132 B padded to 192 B, magazines of different threads never share a cache line
+	struct alignas(64) Magazine
+	{
+		uint32_t count = 0;
+		uint32_t indices[magazineCapacity];
+	};
+
+	alignas(64) std::atomic<uint64_t> freeListHead = InvalidIndex; // lower 32 bits: index of first free page, upper 32 bits: generation
+	alignas(64) std::mutex growMutex;
+
+	Page* pages = nullptr;
+	VirtualMemoryRange memory;
+	Magazine* magazines = nullptr;
+	uint32_t slabElementCount;
+	uint32_t elementMaxCount; //reserved pages, whole slabs
+	uint32_t elementCount = 0; //@note: number of pages in committed slabs, only modified while holding growMutex
+
+	//elementMaxCount is the number of elements alive at once. The reservation adds the free elements magazines may hold back and gets rounded up to whole slabs
+	void Init(uint32_t slabElementCount, uint32_t elementMaxCount, bool useMagazines = true);
+
+	void* Allocate();
+
+	template<typename T>
+	T* Allocate();
+
+	void Free(void* ptr);
+
+	template<typename T>
+	void Free(T* ptr);
+
+	//@note: not thread-safe, all allocations become invalid
+	void Reset();
+
+	void Destroy();
+
+	uint32_t IndexOf(const void* ptr) const
+	{
+		return static_cast<uint32_t>(static_cast<const Page*>(ptr) - pages);
+	}
+
+	uint32_t PopFreeIndex();
+	void PushFreeList(uint32_t firstIndex, uint32_t lastIndex);
+	void Grow();
+	void Refill(Magazine& magazine);
+	void Flush(Magazine& magazine, uint32_t count);
+};
+
+template<size_t pageSize>
+inline void ConcurrentPoolAllocator<pageSize>::Init(uint32_t slabElementCount, uint32_t elementMaxCount, bool useMagazines)
+{
+	assert(slabElementCount > 0 && elementMaxCount > 0);
+	const uint64_t magazineElementCount = useMagazines ? uint64_t(magazinesMaxCount) * magazineCapacity : 0;
+	const uint64_t reservedElementCount = (uint64_t(elementMaxCount) + magazineElementCount + slabElementCount - 1) / slabElementCount * slabElementCount;
+	if (reservedElementCount >= InvalidIndex)
+	{
+		FatalError("ConcurrentPoolAllocator: too many elements");
+	}
+
+	this->slabElementCount = slabElementCount;
+	this->elementMaxCount = static_cast<uint32_t>(reservedElementCount);
+	elementCount = 0;
+	freeListHead.store(InvalidIndex);
+
+	memory.Init(size_t(this->elementMaxCount) * sizeof(Page));
+	pages = reinterpret_cast<Page*>(memory.base);
+
+	if (useMagazines)
+	{
+		magazines = new Magazine[magazinesMaxCount];
+	}
+}
+
+template<size_t pageSize>
+inline uint32_t ConcurrentPoolAllocator<pageSize>::PopFreeIndex()
+{
+	uint64_t head = freeListHead.load(std::memory_order_acquire);
+	for (;;)
+	{
+		const uint32_t index = static_cast<uint32_t>(head);
+		if (index == InvalidIndex)
+		{
+			return InvalidIndex;
+		}
+
+		//@note: the page might concurrently be popped and overwritten by another thread, in which case the stale value is discarded since the generation changed
+		const uint32_t nextIndex = std::atomic_ref(pages[index].nextFreeIndex).load(std::memory_order_relaxed);
+		const uint64_t newHead = nextIndex | (((head >> 32) + 1) << 32);
+		if (freeListHead.compare_exchange_weak(head, newHead, std::memory_order_acquire, std::memory_order_acquire))
+		{
+			return index;
+		}
+	}
+}
+
+template<size_t pageSize>
+inline void ConcurrentPoolAllocator<pageSize>::PushFreeList(uint32_t firstIndex, uint32_t lastIndex)
+{
+	uint64_t head = freeListHead.load(std::memory_order_relaxed);
+	uint64_t newHead;
+	do
+	{
+		std::atomic_ref(pages[lastIndex].nextFreeIndex).store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+		newHead = firstIndex | (((head >> 32) + 1) << 32);
+	} while (!freeListHead.compare_exchange_weak(head, newHead, std::memory_order_release, std::memory_order_relaxed));
+}
+
+template<size_t pageSize>
+inline void ConcurrentPoolAllocator<pageSize>::Grow()
+{
+	std::lock_guard lock(growMutex);
+	if (static_cast<uint32_t>(freeListHead.load(std::memory_order_acquire)) != InvalidIndex)
+	{
+		return; //another thread grew the pool or freed pages in the meantime
+	}
+
+	if (elementCount + slabElementCount > elementMaxCount)
+	{
+		FatalError("ConcurrentPoolAllocator: reserved virtual memory range exhausted");
+	}
+	const uint32_t firstIndex = elementCount;
+	const uint32_t lastIndex = firstIndex + slabElementCount - 1;
+	memory.Commit(size_t(lastIndex + 1) * sizeof(Page));
+
+	for (uint32_t i = firstIndex; i < lastIndex; i++)
+	{
+		pages[i].nextFreeIndex = i + 1;
+	}
+	elementCount = lastIndex + 1;
+
+	PushFreeList(firstIndex, lastIndex);
+}
+
+template<size_t pageSize>
+inline void ConcurrentPoolAllocator<pageSize>::Refill(Magazine& magazine)
+{
+	while (magazine.count < magazineCapacity / 2)
+	{
+		const uint32_t index = PopFreeIndex();
+		if (index == InvalidIndex)
+		{
+			if (magazine.count > 0)
+			{
+				return;
+			}
+			Grow();
+			continue;
+		}
+		magazine.indices[magazine.count++] = index;
+	}
+}
+
+template<size_t pageSize>
+inline void ConcurrentPoolAllocator<pageSize>::Flush(Magazine& magazine, uint32_t count)
+{
+	assert(count > 0 && count <= magazine.count);
+	const uint32_t* indices = &magazine.indices[magazine.count - count];
+	for (uint32_t i = 0; i + 1 < count; i++)
+	{
+		pages[indices[i]].nextFreeIndex = indices[i + 1];
+	}
+	PushFreeList(indices[0], indices[count - 1]);
+	magazine.count -= count;
+}
+
+template<size_t pageSize>
+inline void* ConcurrentPoolAllocator<pageSize>::Allocate()
+{
+	uint32_t index;
+	const uint32_t threadIndex = magazines ? GetPoolThreadIndex() : poolThreadNoSlot;
+	if (threadIndex < magazinesMaxCount)
+	{
+		Magazine& magazine = magazines[threadIndex];
+		if (magazine.count == 0)
+		{
+			Refill(magazine);
+		}
+		index = magazine.indices[--magazine.count];
+	}
+	else
+	{
+		while ((index = PopFreeIndex()) == InvalidIndex)
+		{
+			Grow();
+		}
+	}
+
+	return pages[index].data;
+}
+
+template<size_t pageSize>
+inline void ConcurrentPoolAllocator<pageSize>::Free(void* ptr)
+{
+	const uint32_t index = IndexOf(ptr);
+	assert(index < elementMaxCount);
+
+	const uint32_t threadIndex = magazines ? GetPoolThreadIndex() : poolThreadNoSlot;
+	if (threadIndex < magazinesMaxCount)
+	{
+		Magazine& magazine = magazines[threadIndex];
+		if (magazine.count == magazineCapacity)
+		{
+			Flush(magazine, magazineCapacity / 2);
+		}
+		magazine.indices[magazine.count++] = index;
+	}
+	else
+	{
+		PushFreeList(index, index);
+	}
+}
+
+template<size_t pageSize>
+inline void ConcurrentPoolAllocator<pageSize>::Reset()
+{
+	freeListHead.store(InvalidIndex);
+	if (magazines)
+	{
+		for (uint32_t i = 0; i < magazinesMaxCount; i++)
+		{
+			magazines[i].count = 0;
+		}
+	}
+
+	if (elementCount > 0)
+	{
+		for (uint32_t i = 1; i < elementCount; i++)
+		{
+			pages[i - 1].nextFreeIndex = i;
+		}
+		PushFreeList(0, elementCount - 1);
+	}
+}
+
+template<size_t pageSize>
+inline void ConcurrentPoolAllocator<pageSize>::Destroy()
+{
+	memory.Destroy();
+	pages = nullptr;
+	delete[] magazines;
+	magazines = nullptr;
+}
+
+template<size_t pageSize>
+template<typename T>
+inline T* ConcurrentPoolAllocator<pageSize>::Allocate()
+{
+	static_assert(sizeof(T) <= pageSize);
+
+	void* rawMemory = Allocate();
+	return new(rawMemory) T;
+}
+
+template<size_t pageSize>
+template<typename T>
+inline void ConcurrentPoolAllocator<pageSize>::Free(T* ptr)
+{
+	ptr->~T();
+	Free((void*)ptr);
+}
+
 struct LinearAllocator
 {
 	//@todo: to properly support aligned allocations, the chunks need to use aligned allocations as well with an alignment equal to a maximum supported alignment
-	ChunkAllocator<uint8_t*> allocator;
+	ChunkAllocator<uint8_t*, size_t> allocator;
+	VirtualMemoryRange virtualMemory; //@note: only valid if initialized via InitVirtual(), in which case the allocator consists of a single chunk spanning the whole reserved range
+	MemoryTelemetry::Heap telemetryHeap = MemoryTelemetry::Heap::Count; //Count means allocations are not recorded
 
 	struct Diagnosis
 	{
-		uint32_t maxSizeInUseByte = 0;
+		size_t maxSizeInUseByte = 0;
 		void Update(const LinearAllocator& allocator)
 		{
 			const auto& chunkAllocator = allocator.allocator;
-			uint32_t sizeInUseByte = chunkAllocator.current.chunkIndex * chunkAllocator.chunkSize + chunkAllocator.current.offset;
+			size_t sizeInUseByte = chunkAllocator.current.chunkIndex * chunkAllocator.chunkSize + chunkAllocator.current.offset;
 			maxSizeInUseByte = Max(maxSizeInUseByte, sizeInUseByte);
 		}
 	} diagnosis;
@@ -220,7 +695,7 @@ struct LinearAllocator
 	{
 		diagnosis = {};
 		allocator.Init(
-			[](uint32_t size)
+			[](size_t size)
 			{
 				return (uint8_t*)malloc(size);
 			},
@@ -229,12 +704,43 @@ struct LinearAllocator
 		);
 	}
 
+	//reserves address space for reservedSizeBytes once, pages only get committed when actually used. Single allocations stay below 4 GB, the range may be larger
+	void InitVirtual(size_t reservedSizeBytes, const VirtualMemoryDesc& desc = {})
+	{
+		diagnosis = {};
+		virtualMemory.Init(reservedSizeBytes, desc);
+		allocator.Init(
+			[base = virtualMemory.base, isFirstChunk = true](size_t size) mutable
+			{
+				//a second chunk would alias the first one and overwrite live allocations
+				if (!isFirstChunk)
+				{
+					FatalError("LinearAllocator: reserved virtual memory range exhausted");
+				}
+				isFirstChunk = false;
+				return base;
+			},
+			reservedSizeBytes,
+			1
+		);
+	}
+
 	void* AllocateRaw(uint32_t sizeBytes, uint32_t alignBytes = 1)
 	{
 		uint32_t worstCaseSize = sizeBytes + alignBytes - 1;
 		auto allocation = allocator.Allocate(worstCaseSize);
 		diagnosis.Update(*this); 
 
+		if (telemetryHeap != MemoryTelemetry::Heap::Count)
+		{
+			MemoryTelemetry::RecordAllocation(telemetryHeap, MemoryTelemetry::CurrentTag(), sizeBytes);
+		}
+
+		if (virtualMemory.IsValid())
+		{
+			virtualMemory.Commit(allocation.offset + worstCaseSize);
+		}
+
 		uintptr_t address = (uintptr_t)allocation.chunk + allocation.offset;
 		return (void*)Align(address, alignBytes);
 	}
@@ -242,8 +748,7 @@ struct LinearAllocator
 	template<typename T>
 	T* Allocate(uint32_t elementCount = 1) 
 	{
-		//static_assert(std::is_implicit_lifetime<T>_v); //@note: C++23 feature
-		T* result = (T*)AllocateRaw(elementCount * sizeof(T), alignof(T));
+		T* result = AllocateUninitialized<T>(elementCount);
 		for (uint32_t i = 0; i < elementCount; i++)
 		{
 			result[i] = {};
@@ -252,9 +757,95 @@ struct LinearAllocator
 		return result;
 	}
 
+	//for arrays which get completely overwritten anyways, saves touching the memory twice
+	template<typename T>
+	T* AllocateUninitialized(uint32_t elementCount = 1)
+	{
+		//static_assert(std::is_implicit_lifetime<T>_v); //@note: C++23 feature
+		static_assert(std::is_trivially_copyable_v<T> && std::is_trivially_destructible_v<T>);
+		assert(elementCount * sizeof(T) <= UINT32_MAX);
+		return (T*)AllocateRaw(static_cast<uint32_t>(elementCount * sizeof(T)), alignof(T));
+	}
+
+	//end of the most recent allocation
+	uint8_t* GetTop() const
+	{
+		return allocator.allChunks[allocator.current.chunkIndex] + allocator.current.offset;
+	}
+
+	//Extends the most recent allocation, which ends at allocationEnd. Fails if anything got allocated since or the chunk has no space left
+	//@note: growing and shrinking is not reported to MemoryTelemetry
+	bool TryGrow(const uint8_t* allocationEnd, uint32_t additionalBytes)
+	{
+		if (allocationEnd != GetTop() || allocator.current.offset + additionalBytes >= allocator.chunkSize)
+		{
+			return false;
+		}
+
+		allocator.current.offset += additionalBytes;
+		diagnosis.Update(*this);
+		if (virtualMemory.IsValid())
+		{
+			virtualMemory.Commit(allocator.current.offset);
+		}
+
+		return true;
+	}
+
+	//Gives the tail [newEnd, allocationEnd) of the most recent allocation back, e.g. to trim worst case reservations. Does nothing if anything got allocated since
+	bool Shrink(const uint8_t* allocationEnd, const uint8_t* newEnd)
+	{
+		assert(newEnd <= allocationEnd);
+		if (allocationEnd != GetTop() || allocationEnd - newEnd > allocator.current.offset)
+		{
+			return false;
+		}
+
+		allocator.current.offset -= static_cast<size_t>(allocationEnd - newEnd);
+		return true;
+	}
+
+	Marker GetMarker() const
+	{
+		return allocator.GetMarker();
+	}
+
+	//releases everything allocated since the marker was taken, unlike Reset() this keeps the committed memory
+	void Rewind(const Marker& marker)
+	{
+		allocator.Reset(marker);
+	}
+
+	//release all allocations, also gives the virtual memory range the chance to decommit unused pages
+	void Reset()
+	{
+		allocator.Reset();
+		if (virtualMemory.IsValid())
+		{
+			virtualMemory.Trim();
+		}
+	}
+
 	void Destroy()
 	{
-		allocator.Destroy(free);
+		if (virtualMemory.IsValid())
+		{
+			virtualMemory.Destroy();
+		}
+		else
+		{
+			allocator.Destroy(free);
+		}
+	}
+
+	size_t GetReservedMemoryBytes() const
+	{
+		return virtualMemory.IsValid() ? virtualMemory.reservedBytes : allocator.GetReservedMemoryBytes();
+	}
+
+	size_t GetCommittedMemoryBytes() const
+	{
+		return virtualMemory.IsValid() ? virtualMemory.committedBytes : allocator.GetReservedMemoryBytes();
 	}
 };
 
@@ -283,6 +874,11 @@ struct StackAllocator : private LinearAllocator //@note: the sole purpose of thi
 		LinearAllocator::Init(chunkSize, initialChunkCount);
 	}
 
+	void InitVirtual(size_t reservedSizeBytes, const VirtualMemoryDesc& desc = {})
+	{
+		LinearAllocator::InitVirtual(reservedSizeBytes, desc);
+	}
+
 	void Destroy()
 	{
 		LinearAllocator::Destroy();
@@ -290,33 +886,52 @@ struct StackAllocator : private LinearAllocator //@note: the sole purpose of thi
 	
 	void Reset()
 	{
-		allocator.Reset();
+		LinearAllocator::Reset();
 	}
 
 	//diagnosis helper
-	uint32_t GetMaxUsageBytes() const
+	size_t GetMaxUsageBytes() const
 	{
 		return diagnosis.maxSizeInUseByte;
 	}
 
-	uint32_t GetReservedMemoryBytes() const
+	size_t GetReservedMemoryBytes() const
+	{
+		return LinearAllocator::GetReservedMemoryBytes();
+	}
+
+	size_t GetCommittedMemoryBytes() const
+	{
+		return LinearAllocator::GetCommittedMemoryBytes();
+	}
+
+	//bytes left in the reserved range, allocators made of chunks grow without limit
+	size_t GetAvailableBytes() const
 	{
-		return allocator.GetReservedMemoryBytes();
+		return virtualMemory.IsValid() ? allocator.chunkSize - allocator.current.offset : SIZE_MAX;
 	}
 };
 
 namespace D3D
 {
 	extern StackAllocator stackAllocator;
+	inline thread_local StackAllocator* threadStackAllocator = nullptr; //set for worker threads registered via Frame::RegisterWorkerThread()
+
+	//main thread uses the global stack allocator, every registered worker thread its own
+	inline StackAllocator& GetThreadStackAllocator()
+	{
+		return threadStackAllocator ? *threadStackAllocator : stackAllocator;
+	}
 }
 
 //A local variable of type StackContext can be defined in a scope to automatically reset all allocations from the linear allocator, when leaving the scope in which the stack context was defined
+//@note: by default binds to the stack allocator of the calling thread, so it can be used from any registered worker thread without synchronization
 struct StackContext
 {
 	StackAllocator& allocator; 
 	StackAllocator::Marker marker;
 
-	StackContext(StackAllocator& allocator = D3D::stackAllocator) : allocator{ allocator }, marker{ allocator.allocator.GetMarker() } {}
+	StackContext(StackAllocator& allocator = D3D::GetThreadStackAllocator()) : allocator{ allocator }, marker{ allocator.allocator.GetMarker() } {}
 
 	~StackContext()
 	{
@@ -333,33 +948,267 @@ struct StackContext
 	{
 		return allocator.Allocate<T>(elementCount);
 	}
-};
 
+	template<typename T>
+	T* AllocateUninitialized(uint32_t elementCount = 1)
+	{
+		return allocator.AllocateUninitialized<T>(elementCount);
+	}
 
+	//for ArenaVector and the other helpers working on a LinearAllocator
+	LinearAllocator& GetArena()
+	{
+		return allocator;
+	}
+};
+
+//Growable array in a LinearAllocator. Grows in place while it is the most recent allocation, otherwise it moves to a new allocation of twice the capacity. The old allocation stays until the allocator gets reset or rewound.
+//@note: only for implicit lifetime types, elements are neither constructed nor destroyed. Resize() and Append() leave new elements uninitialized
 template <typename T>
+struct ArenaVector
+{
+	static_assert(std::is_trivially_copyable_v<T> && std::is_trivially_destructible_v<T>);
+
+	LinearAllocator* allocator;
+	T* data = nullptr;
+	uint32_t size = 0;
+	uint32_t capacity = 0;
+	const uint8_t* allocationEnd = nullptr;
+
+	ArenaVector(LinearAllocator& allocator, uint32_t initialCapacity = 0) : allocator(&allocator)
+	{
+		Reserve(initialCapacity);
+	}
+
+	ArenaVector(StackContext& context, uint32_t initialCapacity = 0) : ArenaVector(context.GetArena(), initialCapacity) {}
+
+	void Reserve(uint32_t newCapacity)
+	{
+		if (newCapacity <= capacity)
+		{
+			return;
+		}
+
+		if (data)
+		{
+			//the allocation may already extend past the capacity due to alignment padding
+			const uint8_t* newEnd = reinterpret_cast<const uint8_t*>(data + newCapacity);
+			const uint32_t additionalBytes = newEnd > allocationEnd ? static_cast<uint32_t>(newEnd - allocationEnd) : 0;
+			if (allocator->TryGrow(allocationEnd, additionalBytes))
+			{
+				allocationEnd += additionalBytes;
+				capacity = newCapacity;
+				return;
+			}
+		}
+
+		T* newData = allocator->AllocateUninitialized<T>(newCapacity);
+		if (size > 0)
+		{
+			std::memcpy(newData, data, size * sizeof(T));
+		}
+		data = newData;
+		capacity = newCapacity;
+		allocationEnd = allocator->GetTop();
+	}
+
+	//returns the first of count new, uninitialized elements
+	T* Append(uint32_t count)
+	{
+		if (size + count > capacity)
+		{
+			Reserve(Max(size + count, capacity * 2));
+		}
+
+		T* result = data + size;
+		size += count;
+		return result;
+	}
+
+	T& PushBack(const T& element)
+	{
+		T* result = Append(1);
+		*result = element;
+		return *result;
+	}
+
+	void Resize(uint32_t newSize)
+	{
+		Reserve(newSize);
+		size = newSize;
+	}
+
+	void Clear()
+	{
+		size = 0;
+	}
+
+	//gives the unused capacity back to the allocator, only possible while the vector is the most recent allocation
+	void ShrinkToFit()
+	{
+		const uint8_t* newEnd = reinterpret_cast<const uint8_t*>(data + size);
+		if (data && allocator->Shrink(allocationEnd, newEnd))
+		{
+			allocationEnd = newEnd;
+			capacity = size;
+		}
+	}
+
+	uint32_t Size() const
+	{
+		return size;
+	}
+
+	bool IsEmpty() const
+	{
+		return size == 0;
+	}
+
+	T& operator[](uint32_t index)
+	{
+		assert(index < size);
+		return data[index];
+	}
+
+	const T& operator[](uint32_t index) const
+	{
+		assert(index < size);
+		return data[index];
+	}
+
+	T* begin()
+	{
+		return data;
+	}
+
+	T* end()
+	{
+		return data + size;
+	}
+
+	const T* begin() const
+	{
+		return data;
+	}
+
+	const T* end() const
+	{
+		return data + size;
+	}
+
+	operator std::span<T>()
+	{
+		return { data, size };
+	}
+
+	operator std::span<const T>() const
+	{
+		return { data, size };
+	}
+};
+
+
+//Backends of AllocatorBase hand out offsets into a range of a fixed size, they share the interface and the allocation handle of OffsetAllocator.
+//allocateAligned() returns a raw allocation which contains an aligned range of the requested size starting at Align(offset, alignment).
+
+//OffsetAllocator has no aligned allocation, so every request gets padded by its alignment
+struct OffsetAllocatorBackend : OffsetAllocator::Allocator
+{
+	using OffsetAllocator::Allocator::Allocator;
+
+	OffsetAllocator::Allocation allocateAligned(uint32_t size, uint32_t alignment)
+	{
+		return allocate(size + alignment);
+	}
+};
+
+using TlsfAllocatorBackend = TlsfAllocator;
+
+//backend selection, see AllocatorBenchmark for a comparison on recorded allocation traces. BufferHeap gets many placement aligned allocations, which TLSF serves without padding
+using BufferHeapBackend = TlsfAllocatorBackend;
+using PersistentAllocatorBackend = OffsetAllocatorBackend;
+using DescriptorHeapBackend = OffsetAllocatorBackend;
+
+template <typename T, typename Backend = OffsetAllocatorBackend>
 struct AllocatorBase
 {
+	using RawAllocator = Backend;
 	using Offset = BufferHeapOffset;
 	inline static const Offset InvalidOffset = BufferHeapInvalidOffset;
 
+	//Optional size class front end for small allocations, see EnableSlabs(). Every slab is carved from one allocation of the derived allocator and tracks its free slots in a two level bitmap,
+	//so small allocations are O(1) and need neither an OffsetAllocator node nor alignment padding. Size classes go from 16 B to 4 KB with four classes per power of two, which bounds rounding waste to 25 %
+	static constexpr uint32_t slabSizeClassCount = 33;
+	static constexpr uint32_t slabSlotsTargetCount = 32;
+	static constexpr uint32_t slabMinSize = 4 * 1024;
+	static constexpr uint32_t slabMaxSize = 64 * 1024;
+	static constexpr uint32_t slabSlotWordsMaxCount = (slabMinSize / 16 + 63) / 64;
+	static_assert(slabSlotWordsMaxCount <= 64, "free words of a slab need to fit into a single summary word");
+
+	static constexpr uint32_t SlabClassSize(uint32_t classIndex)
+	{
+		const uint32_t base = 16u << (classIndex / 4);
+		return base + (classIndex % 4) * (base / 4);
+	}
+
+	//smallest class with SlabClassSize() >= size, slabSizeClassCount or more if size exceeds the largest class
+	static uint32_t SlabClassIndex(uint32_t size)
+	{
+		if (size <= 16)
+		{
+			return 0;
+		}
+
+		const uint32_t exponent = static_cast<uint32_t>(std::bit_width(size - 1)) - 1; //base < size <= 2 * base
+		const uint32_t base = 1u << exponent;
+		const uint32_t step = base / 4;
+		return (exponent - 4) * 4 + (size - base + step - 1) / step;
+	}
+
+	static constexpr uint32_t SlabSize(uint32_t classIndex)
+	{
+		return Min(Max(SlabClassSize(classIndex) * slabSlotsTargetCount, slabMinSize), slabMaxSize);
+	}
+
+	//marks allocations served by a slab, rawAllocation.offset then holds the slab index
+	static constexpr uint32_t slabAllocationMetadata = OffsetAllocator::Allocation::NO_SPACE - 1;
+
 	struct Allocation
 	{
 		T* allocator;
 		OffsetAllocator::Allocation rawAllocation;
 		Offset offset = InvalidOffset;
+		uint32_t alignment = 4;
+		MemoryTelemetry::Tag tag = MemoryTelemetry::Tag::Untagged;
 
 		void Free()
 		{
 			if (IsValid())
 			{
-				allocator->allocator.free(rawAllocation);
+				std::lock_guard lock(allocator->mutex);
+				MemoryTelemetry::RecordFree(T::telemetryHeap, tag, Size());
+				MemoryTelemetry::TraceFree(T::telemetryHeap, allocator, offset);
+				allocator->OnFree(*this);
+				if (IsSlabAllocation())
+				{
+					allocator->FreeSlabSlot(*this);
+				}
+				else
+				{
+					allocator->GetRawAllocator(offset).free(rawAllocation);
+				}
 				offset = InvalidOffset;
 			}
 		}
 
 		uint32_t Size() const
 		{
-			const uint32_t rawAllocationSize = allocator->allocator.allocationSize(rawAllocation);
+			if (IsSlabAllocation())
+			{
+				return allocator->slabs[rawAllocation.offset].slotSize;
+			}
+
+			const uint32_t rawAllocationSize = allocator->GetRawAllocator(offset).allocationSize(rawAllocation);
 			return rawAllocationSize - (offset - rawAllocation.offset);
 		}
 
@@ -367,23 +1216,216 @@ struct AllocatorBase
 		{
 			return offset != InvalidOffset;
 		}
+
+		bool IsSlabAllocation() const
+		{
+			return rawAllocation.metadata == slabAllocationMetadata;
+		}
+	};
+
+	struct Slab
+	{
+		Allocation memory;
+		uint32_t slotSize;
+		uint32_t slotCount;
+		uint32_t freeSlotCount;
+		bool isPartial; //listed in partialSlabs of its size class
+		uint64_t freeWordsMask; //bit i is set if freeSlots[i] has a free slot
+		uint64_t freeSlots[slabSlotWordsMaxCount]; //bit set = slot is free
 	};
 
-	OffsetAllocator::Allocator allocator;
+	struct SlabStats
+	{
+		uint32_t slabCount;
+		uint64_t slabBytes;
+		uint64_t liveSlotBytes;
+		uint64_t metadataBytes;
+	};
+
+	Backend allocator;
+	//Allocate() and Free() may be called from several threads, e.g. by the subsystem inits during the parallel startup. Recursive since slabs get carved from an allocation of the derived allocator
+	std::recursive_mutex mutex;
+
+	bool useSlabs = false;
+	bool isAllocatingSlab = false; //the slab backing allocations are neither served by slabs themselves nor traced
+	std::vector<Slab> slabs;
+	std::array<std::vector<uint32_t>, slabSizeClassCount> partialSlabs; //may contain slabs which became full since, those get dropped lazily
+
+	//Call after the derived allocator got initialized.
+	//@note: slabs are never returned to the underlying allocator and pin their memory, so BufferHeap::Compact() skips slab allocations
+	void EnableSlabs()
+	{
+		useSlabs = true;
+	}
+
+	SlabStats GetSlabStats() const
+	{
+		SlabStats stats = { .slabCount = static_cast<uint32_t>(slabs.size()) };
+		for (const Slab& slab : slabs)
+		{
+			stats.slabBytes += static_cast<uint64_t>(slab.slotCount) * slab.slotSize;
+			stats.liveSlotBytes += static_cast<uint64_t>(slab.slotCount - slab.freeSlotCount) * slab.slotSize;
+		}
+		stats.metadataBytes = slabs.capacity() * sizeof(Slab);
+		for (const auto& partialSlabIndices : partialSlabs)
+		{
+			stats.metadataBytes += partialSlabIndices.capacity() * sizeof(uint32_t);
+		}
+
+		return stats;
+	}
+
+	//hook for derived allocators which need to track the lifetime of allocations
+	void OnFree(const Allocation& allocation) {}
+
+	void TraceAllocation(const Allocation& allocation, uint32_t size)
+	{
+		if (!isAllocatingSlab)
+		{
+			MemoryTelemetry::TraceAllocation(T::telemetryHeap, allocation.allocator, allocation.offset, size, allocation.alignment);
+		}
+	}
+
+	//hook for derived allocators which spread their allocations over several backend allocators
+	Backend& GetRawAllocator(Offset offset)
+	{
+		return allocator;
+	}
+
+	//returns an invalid allocation if slabs are disabled or size / alignment are not served by a size class
+	Allocation AllocateFromSlab(uint32_t size, uint32_t alignment, MemoryTelemetry::Tag tag)
+	{
+		if (!useSlabs || isAllocatingSlab || !std::has_single_bit(alignment))
+		{
+			return {};
+		}
+
+		//slots are aligned to the largest power of two dividing their size, the next power of two class always qualifies
+		uint32_t classIndex = SlabClassIndex(Max(size, alignment));
+		while (classIndex < slabSizeClassCount && (SlabClassSize(classIndex) & (alignment - 1)) != 0)
+		{
+			classIndex++;
+		}
+		if (classIndex >= slabSizeClassCount)
+		{
+			return {};
+		}
+
+		std::vector<uint32_t>& partialSlabIndices = partialSlabs[classIndex];
+		while (!partialSlabIndices.empty() && slabs[partialSlabIndices.back()].freeSlotCount == 0)
+		{
+			slabs[partialSlabIndices.back()].isPartial = false;
+			partialSlabIndices.pop_back();
+		}
+
+		if (partialSlabIndices.empty())
+		{
+			//small slabs would otherwise end up in a slab themselves
+			const uint32_t slotSize = SlabClassSize(classIndex);
+			isAllocatingSlab = true;
+			Allocation memory = static_cast<T*>(this)->Allocate(SlabSize(classIndex), Max(slotSize & (0u - slotSize), 4u), tag);
+			isAllocatingSlab = false;
+			if (!memory.IsValid())
+			{
+				return {};
+			}
+			//the slab itself is not reported, its slots get reported individually instead
+			MemoryTelemetry::RecordFree(T::telemetryHeap, tag, memory.Size());
+
+			const uint32_t slotCount = SlabSize(classIndex) / slotSize;
+			Slab& slab = slabs.emplace_back(Slab{ .memory = memory, .slotSize = slotSize, .slotCount = slotCount, .freeSlotCount = slotCount, .isPartial = true });
+			const uint32_t wordCount = (slotCount + 63) / 64;
+			for (uint32_t wordIndex = 0; wordIndex < wordCount; wordIndex++)
+			{
+				const uint32_t slotsInWord = Min(slotCount - wordIndex * 64, 64u);
+				slab.freeSlots[wordIndex] = slotsInWord == 64 ? ~0ull : (1ull << slotsInWord) - 1;
+			}
+			slab.freeWordsMask = wordCount == 64 ? ~0ull : (1ull << wordCount) - 1;
+			partialSlabIndices.push_back(static_cast<uint32_t>(slabs.size() - 1));
+		}
+
+		const uint32_t slabIndex = partialSlabIndices.back();
+		Slab& slab = slabs[slabIndex];
+		const uint32_t wordIndex = std::countr_zero(slab.freeWordsMask);
+		const uint32_t bitIndex = std::countr_zero(slab.freeSlots[wordIndex]);
+		slab.freeSlots[wordIndex] &= ~(1ull << bitIndex);
+		if (slab.freeSlots[wordIndex] == 0)
+		{
+			slab.freeWordsMask &= ~(1ull << wordIndex);
+		}
+		slab.freeSlotCount--;
+
+		Allocation allocation =
+		{
+			.allocator = static_cast<T*>(this),
+			.rawAllocation = { .offset = slabIndex, .metadata = slabAllocationMetadata },
+			.offset = slab.memory.offset + (wordIndex * 64 + bitIndex) * slab.slotSize,
+			.alignment = alignment,
+			.tag = tag
+		};
+		MemoryTelemetry::RecordAllocation(T::telemetryHeap, tag, slab.slotSize);
+
+		return allocation;
+	}
+
+	void FreeSlabSlot(const Allocation& allocation)
+	{
+		const uint32_t slabIndex = allocation.rawAllocation.offset;
+		Slab& slab = slabs[slabIndex];
+		const uint32_t slotIndex = (allocation.offset - slab.memory.offset) / slab.slotSize;
+		assert((slab.freeSlots[slotIndex / 64] & (1ull << (slotIndex % 64))) == 0);
+
+		slab.freeSlots[slotIndex / 64] |= 1ull << (slotIndex % 64);
+		slab.freeWordsMask |= 1ull << (slotIndex / 64);
+		slab.freeSlotCount++;
+
+		if (!slab.isPartial)
+		{
+			slab.isPartial = true;
+			partialSlabs[SlabClassIndex(slab.slotSize)].push_back(slabIndex);
+		}
+	}
+
+	void ResetSlabs()
+	{
+		slabs.clear();
+		for (auto& partialSlabIndices : partialSlabs)
+		{
+			partialSlabIndices.clear();
+		}
+	}
 
-	Allocation Allocate(uint32_t size, uint32_t alignment = 4)
+	Allocation Allocate(uint32_t size, uint32_t alignment = 4, MemoryTelemetry::Tag tag = MemoryTelemetry::CurrentTag())
 	{
-		size += alignment;
-		Allocation allocation = { .allocator = static_cast<T*>(this), .rawAllocation = allocator.allocate(size) }; 
+		std::lock_guard lock(mutex);
+		if (Allocation allocation = AllocateFromSlab(size, alignment, tag); allocation.IsValid())
+		{
+			TraceAllocation(allocation, size);
+			return allocation;
+		}
+
+		Allocation allocation = { .allocator = static_cast<T*>(this), .rawAllocation = allocator.allocateAligned(size, alignment), .alignment = alignment, .tag = tag }; 
 
 		allocation.offset = static_cast<uint32_t>(Align(allocation.rawAllocation.offset, alignment));
 
+		if (allocation.rawAllocation.offset != OffsetAllocator::Allocation::NO_SPACE)
+		{
+			MemoryTelemetry::RecordAllocation(T::telemetryHeap, tag, allocation.Size());
+			TraceAllocation(allocation, size);
+		}
+		else
+		{
+			allocation.offset = InvalidOffset;
+		}
+
 		return allocation;
 	}
 };
 
-struct PersistentAllocator : AllocatorBase<PersistentAllocator>
+struct PersistentAllocator : AllocatorBase<PersistentAllocator, PersistentAllocatorBackend>
 {
+	static constexpr MemoryTelemetry::Heap telemetryHeap = MemoryTelemetry::Heap::PersistentAllocator;
+
 	uint32_t totalSize;
 	//@todo: to properly support aligned allocations, the chunks need to use aligned allocations as well with an alignment equal to a maximum supported alignment
 	void* Ptr(PersistentAllocator::Allocation& allocation)
@@ -397,12 +1439,34 @@ struct PersistentAllocator : AllocatorBase<PersistentAllocator>
 	}
 
 	void* rawMemory;
+	VirtualMemoryRange virtualMemory;
 
-	void Init(uint32_t size)
+	void Init(uint32_t size, const VirtualMemoryDesc& desc = {})
 	{
 		totalSize = size;
 		allocator = { size };
-		rawMemory = malloc(size);
+		virtualMemory.Init(size, desc);
+		rawMemory = virtualMemory.base;
+	}
+
+	//@note: commit grows with the highest allocated offset. Since free space can be anywhere in the range, memory is never decommitted
+	Allocation Allocate(uint32_t size, uint32_t alignment = 4, MemoryTelemetry::Tag tag = MemoryTelemetry::CurrentTag())
+	{
+		std::lock_guard lock(mutex);
+		Allocation allocation = AllocatorBase<PersistentAllocator, PersistentAllocatorBackend>::Allocate(size, alignment, tag);
+		if (allocation.IsValid())
+		{
+			virtualMemory.Commit(allocation.offset + size);
+		}
+
+		return allocation;
+	}
+
+	void Destroy()
+	{
+		virtualMemory.Destroy();
+		rawMemory = nullptr;
+		ResetSlabs();
 	}
 };
 
@@ -423,6 +1487,7 @@ struct PersistentMemory
 {
 	using type = T;
 	PersistentAllocator::Allocation allocation;
+	uint32_t count = 0; //requested element count, the allocation may be larger, e.g. a slab slot of the next size class
 
 	T& Get(uint32_t elementIndex = 0)
 	{
@@ -438,12 +1503,13 @@ struct PersistentMemory
 
 	const uint32_t Count() const
 	{
-		return allocation.Size() / sizeof(T);
+		return count;
 	}
 	
 	void Free()
 	{
 		allocation.Free();
+		count = 0;
 	}
 };
 
@@ -452,6 +1518,6 @@ inline PersistentMemory<T> AllocatePersistentMemory(PersistentAllocator& allocat
 {
 	PersistentAllocator::Allocation allocation = allocator.Allocate(elementCount * sizeof(T), alignof(T));
 
-	return { .allocation = allocation };
+	return { .allocation = allocation, .count = allocation.IsValid() ? elementCount : 0 };
 }
 
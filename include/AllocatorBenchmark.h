@@ -0,0 +1,35 @@
+#pragma once
+
+//CPU only micro benchmarks for the allocators in Allocator.h and BufferMemory.h. GPU backed heaps are replaced by CPU backed ones, so no device is needed.
+//The persistent buffer traces report the memory footprint of the BufferHeap with and without the small allocation slabs.
+//The pool contention trace sweeps 1 to 64 threads sharing one pool: ConcurrentPoolAllocator with and without magazines, the single-threaded PoolAllocator behind a mutex and malloc.
+//Also compares plain copies against the write combining aware upload path (UploadWriter.h) on cached and on write combined memory.
+//The backend traces replay the same allocations against OffsetAllocator and TLSF, synthetic ones and the ones recorded with -allocationtrace (see MemoryTelemetry::OpenAllocationTrace()).
+//Every allocator replays the same deterministic traces. Results are written as CSV with one line per allocator and trace, so runs of different builds can be diffed directly.
+namespace AllocatorBenchmark
+{
+	//recorded allocation traces get picked up from here, if present
+	inline constexpr const char* allocationTraceFilePath = "AllocationTrace.bin";
+
+	struct Result
+	{
+		const char* allocator;
+		const char* trace;
+		uint32_t threadCount;
+		uint64_t operationCount;
+		double totalMs;
+
+		//footprint, only filled in by the persistent buffer and backend traces. The backend traces report peak values
+		uint64_t requestedBytes = 0;
+		uint64_t reservedBytes = 0; //including alignment padding, size class rounding and partially used slabs
+		uint64_t allocatorNodeCount = 0; //OffsetAllocator allocations, TLSF nodes
+		uint64_t metadataBytes = 0; //slab bookkeeping, backend nodes
+		uint64_t highWaterBytes = 0; //highest offset in use
+		double fragmentation = 0.0; //share of the range below the high water mark which is free at the end of the trace
+	};
+
+	std::vector<Result> Run();
+
+	void WriteCsv(FILE* file, std::span<const Result> results);
+	bool RunAndWriteCsv(const char* filePath);
+}
@@ -12,7 +12,7 @@ namespace Frame
 
 namespace UI
 {
-	extern bool mouseOverUI;
+	extern std::atomic<bool> mouseOverUI;
 }
 
 namespace App
@@ -36,6 +36,7 @@ namespace App
 		BufferHeap& bufferHeap,
 		RWBufferResource& scratchBuffer);
 
-	RenderData Update(LinearAllocator& frameAllocator, const Frame::TimingData& timingData);
+	//runs on the simulation thread of the frame pipeline, so it only writes app state and the snapshot arena. Meshes get the simulated instance data once the render thread applies the snapshot
+	RenderData Simulate(LinearAllocator& snapshotArena, const Frame::TimingData& timingData);
 }
 
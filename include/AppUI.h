@@ -25,6 +25,7 @@ namespace App
 	struct UIContext : UI::AppMenuBase
 	{
 		LightSettings lightSettings;
+		std::mutex mutex; //the menu edits the settings on the render thread while the simulation reads them
 		void Update();
 		virtual void MenuEntry() override;
 	};
@@ -0,0 +1,168 @@
+#pragma once
+#include <condition_variable>
+#include <coroutine>
+#include <thread>
+
+struct RWBufferResource;
+
+//Asset loading as C++20 coroutines. A load hops between a pool of streaming threads for the CPU work (parsing, decoding, mip generation, writing into CPU visible memory)
+//and the render thread for everything which is not thread safe (resource and descriptor creation, BufferHeap allocations, publishing). The render thread resumes its part in Update(), once per frame, so results always appear at a frame boundary.
+//@note: the streaming threads are not registered with Frame, a load may take many frames and Frame::End() resets the arenas of registered workers. Each one gets its own stack allocator instead, no StackContext on it may be alive across a co_await
+namespace AssetStreaming
+{
+	//valid while continuations run on the render thread
+	struct RenderThreadContext
+	{
+		ID3D12Device10* device = nullptr;
+		ID3D12GraphicsCommandList10* commandList = nullptr;
+		const RWBufferResource* scratchBuffer = nullptr; //for acceleration structure builds
+	};
+
+	struct Desc
+	{
+		uint32_t threadCount = 0; //0: one per hardware thread besides the render thread
+	};
+
+	void Init(const Desc& desc = {});
+	//finishes the work queued for the streaming threads and joins them. @note: loads still waiting for the render thread are abandoned
+	void Shutdown();
+
+	//resumes the loads waiting for the render thread. Loads which ask for the render thread again during Update() continue right away
+	void Update(const RenderThreadContext& context);
+
+	//started and not yet finished loads
+	uint32_t GetInFlightCount();
+	uint32_t GetThreadCount();
+
+	void ScheduleOnStreamingThread(std::coroutine_handle<> handle);
+	void ScheduleOnRenderThread(std::coroutine_handle<> handle);
+	bool IsInRenderThreadUpdate();
+	const RenderThreadContext& GetRenderThreadContext();
+
+	//fire and forget coroutine, runs on the calling thread until its first co_await. The frame destroys itself when the coroutine is done
+	struct Task
+	{
+		struct promise_type
+		{
+			promise_type();
+			~promise_type();
+
+			Task get_return_object() { return {}; }
+			std::suspend_never initial_suspend() noexcept { return {}; }
+			std::suspend_never final_suspend() noexcept { return {}; }
+			void return_void() {}
+			void unhandled_exception() { assert(false); }
+		};
+	};
+
+	struct StreamingThreadAwaitable
+	{
+		bool await_ready() const noexcept { return false; }
+		void await_suspend(std::coroutine_handle<> handle) const { ScheduleOnStreamingThread(handle); }
+		void await_resume() const noexcept {}
+	};
+
+	struct RenderThreadAwaitable
+	{
+		bool await_ready() const noexcept { return IsInRenderThreadUpdate(); }
+		void await_suspend(std::coroutine_handle<> handle) const { ScheduleOnRenderThread(handle); }
+		const RenderThreadContext& await_resume() const noexcept { return GetRenderThreadContext(); }
+	};
+
+	//co_await continues the coroutine on one of the streaming threads
+	inline StreamingThreadAwaitable ResumeOnStreamingThread()
+	{
+		return {};
+	}
+
+	//co_await continues the coroutine on the render thread in the next Update() and returns its context
+	inline RenderThreadAwaitable ResumeOnRenderThread()
+	{
+		return {};
+	}
+
+	//Shared result of a load. The loader fills the value and publishes it, afterwards it belongs to the render thread. The value stays at a fixed address for the lifetime of the handle
+	template <typename T>
+	struct AssetHandle
+	{
+		struct State
+		{
+			T value = {};
+			std::atomic<bool> isReady = false;
+			std::mutex mutex;
+			std::vector<std::coroutine_handle<>> waiters;
+		};
+
+		std::shared_ptr<State> state;
+
+		static AssetHandle Create()
+		{
+			return { std::make_shared<State>() };
+		}
+
+		bool IsValid() const
+		{
+			return state != nullptr;
+		}
+
+		bool IsReady() const
+		{
+			return state && state->isReady.load(std::memory_order_acquire);
+		}
+
+		//@note: only the loader may use it before IsReady()
+		T& Get() const
+		{
+			assert(state);
+			return state->value;
+		}
+
+		//called by the loader once the value is complete. Coroutines awaiting the handle resume on the calling thread
+		void Publish() const
+		{
+			std::vector<std::coroutine_handle<>> waiters;
+			{
+				std::lock_guard lock(state->mutex);
+				assert(!state->isReady.load(std::memory_order_relaxed));
+				state->isReady.store(true, std::memory_order_release);
+				waiters.swap(state->waiters);
+			}
+			for (std::coroutine_handle<> waiter : waiters)
+			{
+				waiter.resume();
+			}
+		}
+
+		struct Awaitable
+		{
+			State& state;
+
+			bool await_ready() const noexcept
+			{
+				return state.isReady.load(std::memory_order_acquire);
+			}
+
+			bool await_suspend(std::coroutine_handle<> handle) const
+			{
+				std::lock_guard lock(state.mutex);
+				if (state.isReady.load(std::memory_order_relaxed))
+				{
+					return false;
+				}
+				state.waiters.push_back(handle);
+				return true;
+			}
+
+			T& await_resume() const noexcept
+			{
+				return state.value;
+			}
+		};
+
+		Awaitable operator co_await() const
+		{
+			assert(state);
+			return { *state };
+		}
+	};
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+//Throughput of the CPU side of asset streaming: parsing .obj files and building their index and vertex streams, decoding textures and generating their mips.
+//The streaming coroutines run with 1 to N streaming threads and without a device, so no GPU is needed. Results are written as CSV with one line per workload and thread count, speedup is relative to the run with a single thread.
+namespace AssetStreamingBenchmark
+{
+	struct Result
+	{
+		const char* workload;
+		uint32_t threadCount;
+		uint64_t itemCount;
+		uint64_t inputSizeBytes; //of the files read
+		double totalMs; //best of several repetitions
+		double speedup;
+	};
+
+	//maxThreadCount 0 means one thread per hardware thread
+	std::vector<Result> Run(uint32_t maxThreadCount = 0);
+
+	void WriteCsv(FILE* file, std::span<const Result> results);
+	bool RunAndWriteCsv(const char* filePath, uint32_t maxThreadCount = 0);
+}
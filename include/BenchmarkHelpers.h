@@ -0,0 +1,40 @@
+#pragma once
+
+//Shared by the *Benchmark modules. Each one runs from a command line flag in WinMain without a window or device and writes its results as CSV
+namespace Benchmark
+{
+	static constexpr uint32_t defaultRepetitionCount = 5;
+	//the main thread is not registered with Frame, so benchmarks running on it bring their own stack allocator
+	static constexpr uint32_t stackMemoryReservedSize = 1024 * 1024 * 1024;
+	inline const wchar_t* meshFileNames[] = { L"content\\geometry\\sponza2.obj", L"content\\geometry\\sphere.obj" };
+
+	//best of several runs in ms, i.e. the run least disturbed by the rest of the system
+	template <typename F>
+	double MeasureBest(F&& function, uint32_t repetitionCount = defaultRepetitionCount)
+	{
+		double bestMs = DBL_MAX;
+		for (uint32_t i = 0; i < repetitionCount; i++)
+		{
+			const auto begin = std::chrono::high_resolution_clock::now();
+			function();
+			const auto end = std::chrono::high_resolution_clock::now();
+			bestMs = Min(bestMs, std::chrono::duration<double, std::milli>(end - begin).count());
+		}
+		return bestMs;
+	}
+
+	//writes the results with the WriteCsv() of the benchmark to a new file
+	template <typename Result>
+	bool WriteCsvFile(const char* filePath, const std::vector<Result>& results, void (*writeCsv)(FILE*, std::span<const Result>))
+	{
+		FILE* file = nullptr;
+		if (fopen_s(&file, filePath, "w") != 0)
+		{
+			return false;
+		}
+
+		writeCsv(file, results);
+		fclose(file);
+		return true;
+	}
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+//BufferHeap with CPU backed blocks, so the multi block allocation and addressing can be checked without a device.
+//Small blocks force the heap to grow to all of its blocks. Every allocation checks the decoded block index and offset against its block, the round trip through MakeOffset() and CpuPtr(),
+//its content after all other allocations have been written (overlaps), the fall through to free space in earlier blocks and the block table at offset 0.
+//Results are written as CSV with one line per workload.
+namespace BufferHeapBenchmark
+{
+	struct Result
+	{
+		const char* workload;
+		uint32_t blockCount;
+		uint32_t allocationCount;
+		double totalMs; //allocations and writes
+		uint32_t addressingViolationCount; //offsets outside of their block, misaligned, not round tripping or not falling through to earlier blocks
+		uint32_t contentViolationCount; //allocations overwritten by others
+		uint32_t blockTableViolationCount;
+	};
+
+	std::vector<Result> Run();
+
+	void WriteCsv(FILE* file, std::span<const Result> results);
+	//fails on any violation, or if a workload did not grow to all blocks
+	bool RunAndWriteCsv(const char* filePath);
+}
@@ -1,18 +1,352 @@
 #include "stdafx.h"
 #include "BufferMemory.h"
 
-void BufferHeap::Init(ID3D12Device10* device, uint32_t size, LPCWSTR name, D3D12_HEAP_TYPE heapType)
+#include "Frame.h"
+
+void BufferHeap::Init(ID3D12Device10* device, DescriptorHeap& descriptorHeap, uint32_t initialBlockSize, uint32_t growBlockSize, LPCWSTR name, D3D12_HEAP_TYPE heapType)
+{
+	this->device = device;
+	this->descriptorHeap = &descriptorHeap;
+	this->name = name;
+	this->heapType = heapType;
+	InitCpuBacked(initialBlockSize, growBlockSize);
+}
+
+void BufferHeap::InitCpuBacked(uint32_t initialBlockSize, uint32_t growBlockSize)
+{
+	assert(initialBlockSize <= blockMaxSize && growBlockSize <= blockMaxSize);
+	this->growBlockSize = growBlockSize;
+	AddBlock(initialBlockSize);
+
+	//shaders expect the block table at the very beginning of the first block
+	blockTable = Allocate(blocksMaxCount * sizeof(DescriptorHeap::Id), 4, MemoryTelemetry::Tag::Engine);
+	assert(blockTable.offset == 0);
+}
+
+void BufferHeap::Destroy()
+{
+	for (uint32_t blockIndex = 0; blockIndex < blockCount; blockIndex++)
+	{
+		Block& block = blocks[blockIndex];
+		if (!device)
+		{
+			free(block.buffer.cpuPtr);
+		}
+		if (block.srvId.IsValid())
+		{
+			block.srvId.Free();
+		}
+		block = {};
+	}
+	blockCount = 0;
+	relocatableAllocations.clear();
+	relocatableIndices.clear();
+	isCompactionStalled = false;
+	ResetSlabs();
+}
+
+uint32_t BufferHeap::AddBlock(uint32_t size)
 {
-	allocator = { size };
-	parentBuffer = CreateBufferResource(device, { .size = size, .name = name }, heapType, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
-	assert((parentBuffer.resource->GetGPUVirtualAddress() & 3)  == 0);  
+	assert(blockCount < blocksMaxCount && size <= blockMaxSize);
+	const uint32_t blockIndex = blockCount++;
+	Block& block = blocks[blockIndex];
+	block.allocator = { size };
+
+	if (device)
+	{
+		block.buffer = CreateBufferResource(device, { .size = size, .name = name }, heapType, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+		assert((block.buffer.resource->GetGPUVirtualAddress() & 3) == 0);
+	}
+	else
+	{
+		block.buffer.cpuPtr = malloc(size);
+		block.buffer.size = size;
+	}
+
+	//the first block is bound directly, so it does not need a descriptor. Without a device there are no descriptors, the table holds the block index instead, so its layout can be checked headless
+	if (blockIndex > 0)
+	{
+		DescriptorHeap::Id srvId = blockIndex;
+		if (device)
+		{
+			block.srvId = CreateSrvOnHeap(*descriptorHeap, block.buffer);
+			srvId = block.srvId.Id();
+		}
+		WriteRaw(blockTable.offset + blockIndex * sizeof(DescriptorHeap::Id), &srvId, sizeof(srvId));
+	}
+
+	return blockIndex;
+}
+
+OffsetAllocator::Allocation BufferHeap::AllocateRaw(uint32_t blockIndex, uint32_t size, uint32_t alignment)
+{
+	OffsetAllocator::Allocation rawAllocation = blocks[blockIndex].allocator.allocateAligned(size, alignment);
+	if (rawAllocation.offset != OffsetAllocator::Allocation::NO_SPACE)
+	{
+		//@note: backends only use the metadata to free, so the offset can carry the block index as well. The block index lives in the upper bits, so aligned offsets stay aligned
+		rawAllocation.offset = MakeOffset(blockIndex, rawAllocation.offset);
+	}
+
+	return rawAllocation;
+}
+
+BufferHeap::Allocation BufferHeap::Allocate(uint32_t size, uint32_t alignment, MemoryTelemetry::Tag tag)
+{
+	std::lock_guard lock(mutex);
+	isCompactionStalled = false;
+	if (Allocation allocation = AllocateFromSlab(size, alignment, tag); allocation.IsValid())
+	{
+		TraceAllocation(allocation, size);
+		return allocation;
+	}
+
+	Allocation allocation = { .allocator = this, .alignment = alignment, .tag = tag };
+
+	for (uint32_t blockIndex = 0; blockIndex < blockCount; blockIndex++)
+	{
+		allocation.rawAllocation = AllocateRaw(blockIndex, size, alignment);
+		if (allocation.rawAllocation.offset != OffsetAllocator::Allocation::NO_SPACE)
+		{
+			allocation.offset = static_cast<Offset>(Align(allocation.rawAllocation.offset, alignment));
+			MemoryTelemetry::RecordAllocation(telemetryHeap, tag, allocation.Size());
+			TraceAllocation(allocation, size);
+			return allocation;
+		}
+	}
+
+	if (blockCount == blocksMaxCount)
+	{
+		assert(false && "BufferHeap is out of blocks");
+		return allocation;
+	}
+
+	//allocations larger than the regular block size get a block of their own
+	const uint32_t blockIndex = AddBlock(Max(growBlockSize, static_cast<uint32_t>(Align(size + alignment, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT))));
+	allocation.rawAllocation = AllocateRaw(blockIndex, size, alignment);
+	assert(allocation.rawAllocation.offset != OffsetAllocator::Allocation::NO_SPACE);
+	allocation.offset = static_cast<Offset>(Align(allocation.rawAllocation.offset, alignment));
+	MemoryTelemetry::RecordAllocation(telemetryHeap, tag, allocation.Size());
+	TraceAllocation(allocation, size);
+
+	return allocation;
+}
+
+BufferHeapBackend& BufferHeap::GetRawAllocator(Offset offset)
+{
+	assert(BlockIndex(offset) < blockCount);
+	return blocks[BlockIndex(offset)].allocator;
 }
 
 void BufferHeap::WriteRaw(Offset offset, const void* sourcePtr, uint32_t size) const 
 {
-	assert(offset + size <= parentBuffer.size);
-	uint8_t* destinationPtr = (uint8_t*)parentBuffer.cpuPtr + offset;
-	std::memcpy(destinationPtr, sourcePtr, size);
+	assert(BlockOffset(offset) + size <= blocks[BlockIndex(offset)].buffer.size);
+	if (IsWriteCombined())
+	{
+		WriteCombinedCopy(CpuPtr(offset), sourcePtr, size);
+	}
+	else
+	{
+		std::memcpy(CpuPtr(offset), sourcePtr, size);
+	}
+}
+
+void* BufferHeap::CpuPtr(Offset offset) const
+{
+	assert(BlockIndex(offset) < blockCount);
+	return static_cast<uint8_t*>(blocks[BlockIndex(offset)].buffer.cpuPtr) + BlockOffset(offset);
+}
+
+bool BufferHeap::IsWriteCombined() const
+{
+	return device && (heapType == D3D12_HEAP_TYPE_GPU_UPLOAD || heapType == D3D12_HEAP_TYPE_UPLOAD);
+}
+
+D3D12_GPU_VIRTUAL_ADDRESS BufferHeap::GPUAddress(Offset offset) const
+{
+	assert(device && BlockIndex(offset) < blockCount);
+	return blocks[BlockIndex(offset)].buffer.resource->GetGPUVirtualAddress() + BlockOffset(offset);
+}
+
+uint32_t BufferHeap::GetSize() const
+{
+	uint32_t size = 0;
+	for (uint32_t blockIndex = 0; blockIndex < blockCount; blockIndex++)
+	{
+		size += blocks[blockIndex].buffer.size;
+	}
+
+	return size;
+}
+
+uint32_t BufferHeap::GetUsedSize() const
+{
+	uint32_t usedSize = 0;
+	for (uint32_t blockIndex = 0; blockIndex < blockCount; blockIndex++)
+	{
+		usedSize += blocks[blockIndex].buffer.size - blocks[blockIndex].allocator.storageReport().totalFreeSpace;
+	}
+
+	return usedSize;
+}
+
+void BufferHeap::RegisterRelocatable(Allocation& allocation, RelocationCallback onRelocated, std::span<const std::byte> shadow)
+{
+	std::lock_guard lock(mutex);
+	assert(allocation.IsValid() && allocation.allocator == this && shadow.size() <= allocation.Size());
+	assert(!relocatableIndices.contains(&allocation));
+	relocatableIndices[&allocation] = static_cast<uint32_t>(relocatableAllocations.size());
+	relocatableAllocations.push_back({ .allocation = &allocation, .onRelocated = std::move(onRelocated), .shadow = shadow });
+	isCompactionStalled = false;
+}
+
+void BufferHeap::UnregisterRelocatable(const Allocation& allocation)
+{
+	std::lock_guard lock(mutex);
+	auto it = relocatableIndices.find(&allocation);
+	if (it == relocatableIndices.end())
+	{
+		return;
+	}
+
+	const uint32_t index = it->second;
+	relocatableIndices.erase(it);
+	if (index != relocatableAllocations.size() - 1)
+	{
+		relocatableAllocations[index] = std::move(relocatableAllocations.back());
+		relocatableIndices[relocatableAllocations[index].allocation] = index;
+	}
+	relocatableAllocations.pop_back();
+}
+
+void BufferHeap::OnFree(const Allocation& allocation)
+{
+	std::lock_guard lock(mutex);
+	isCompactionStalled = false;
+	if (!relocatableAllocations.empty())
+	{
+		UnregisterRelocatable(allocation);
+	}
+}
+
+uint32_t BufferHeap::Compact(uint32_t byteBudget, ID3D12GraphicsCommandList10* commandList)
+{
+	std::lock_guard lock(mutex);
+	assert(commandList || !device);
+	//move allocations from the end of the heap first, since those are the ones splitting the free space
+	std::sort(relocatableAllocations.begin(), relocatableAllocations.end(),
+		[](const RelocatableAllocation& a, const RelocatableAllocation& b)
+		{
+			return a.allocation->offset > b.allocation->offset;
+		});
+	for (uint32_t i = 0; i < relocatableAllocations.size(); i++)
+	{
+		relocatableIndices[relocatableAllocations[i].allocation] = i;
+	}
+
+	uint32_t movedBytes = 0;
+	uint64_t copiedBlocksMask = 0;
+	static_assert(blocksMaxCount <= 64);
+	for (RelocatableAllocation& element : relocatableAllocations)
+	{
+		Allocation& allocation = *element.allocation;
+		if (!allocation.IsValid() || allocation.IsSlabAllocation())
+		{
+			continue;
+		}
+
+		const uint32_t blockIndex = BlockIndex(allocation.offset);
+		BufferHeapBackend& blockAllocator = blocks[blockIndex].allocator;
+		const uint32_t size = allocation.Size();
+		if (movedBytes + size > byteBudget)
+		{
+			continue;
+		}
+
+		//@note: allocations only move within their block
+		const OffsetAllocator::Allocation newRawAllocation = AllocateRaw(blockIndex, size, allocation.alignment);
+		if (newRawAllocation.offset == OffsetAllocator::Allocation::NO_SPACE)
+		{
+			continue;
+		}
+		if (newRawAllocation.offset >= allocation.rawAllocation.offset)
+		{
+			blockAllocator.free(newRawAllocation); //would not move towards the start
+			continue;
+		}
+
+		const Offset newOffset = static_cast<Offset>(Align(newRawAllocation.offset, allocation.alignment));
+
+		//@note: ranges cannot overlap since both are live at the same time. Upload heap memory is never read on the CPU, it is too slow for that
+		if (!element.shadow.empty())
+		{
+			WriteRaw(newOffset, element.shadow.data(), static_cast<uint32_t>(element.shadow.size()));
+		}
+		else if (device)
+		{
+			ID3D12Resource* resource = blocks[blockIndex].buffer.resource.Get();
+			commandList->CopyBufferRegion(resource, BlockOffset(newOffset), resource, BlockOffset(allocation.offset), size);
+			copiedBlocksMask |= 1ull << blockIndex;
+		}
+		else
+		{
+			std::memcpy(CpuPtr(newOffset), CpuPtr(allocation.offset), size);
+		}
+
+		Allocation oldAllocation = allocation;
+		allocation.rawAllocation = newRawAllocation;
+		allocation.offset = newOffset;
+		MemoryTelemetry::RecordAllocation(telemetryHeap, allocation.tag, allocation.Size()); //the old range gets recorded as freed once released
+		TraceAllocation(allocation, size);
+
+		if (element.onRelocated)
+		{
+			element.onRelocated(oldAllocation.offset, newOffset);
+		}
+
+		Frame::SafeRelease(oldAllocation);
+		movedBytes += size;
+	}
+
+	//the copies need to land before anything later in the command list reads the new ranges
+	for (uint32_t blockIndex = 0; copiedBlocksMask != 0; blockIndex++, copiedBlocksMask >>= 1)
+	{
+		if (copiedBlocksMask & 1)
+		{
+			ResourceTransitions(commandList, { blocks[blockIndex].buffer.Barrier(ResourceState::CopyDestination, ResourceState::Any) });
+		}
+	}
+
+	isCompactionStalled = movedBytes == 0;
+	return movedBytes;
+}
+
+uint32_t BufferHeap::CompactIfFragmented(float largestFreeBlockRatioThreshold, uint32_t byteBudget, ID3D12GraphicsCommandList10* commandList)
+{
+	if (isCompactionStalled || GetLargestFreeBlockRatio() >= largestFreeBlockRatioThreshold)
+	{
+		return 0;
+	}
+
+	return Compact(byteBudget, commandList);
+}
+
+float BufferHeap::GetLargestFreeBlockRatio() const
+{
+	uint32_t totalFreeSpace = 0;
+	uint32_t largestFreeRegion = 0;
+	for (uint32_t blockIndex = 0; blockIndex < blockCount; blockIndex++)
+	{
+		const OffsetAllocator::StorageReport report = blocks[blockIndex].allocator.storageReport();
+		totalFreeSpace += report.totalFreeSpace;
+		largestFreeRegion = Max(largestFreeRegion, report.largestFreeRegion);
+	}
+
+	if (totalFreeSpace == 0)
+	{
+		return 1.0f;
+	}
+
+	return static_cast<float>(largestFreeRegion) / totalFreeSpace;
 }
 
 void ScratchHeap::Init(BufferHeap& parentHeap, uint32_t chunkSizeBytes, uint32_t initialChunkCount)
@@ -21,13 +355,40 @@ void ScratchHeap::Init(BufferHeap& parentHeap, uint32_t chunkSizeBytes, uint32_t
 	allocator.Init(
 		[&parentHeap](uint32_t size)
 		{
-			return parentHeap.Allocate(size);
+			return parentHeap.Allocate(size, 4, MemoryTelemetry::Tag::Frame);
 		},
 		chunkSizeBytes, initialChunkCount);
 }
 
+void ScratchHeap::InitRing(BufferHeap& parentHeap, RingAllocator& ring)
+{
+	this->parentHeap = &parentHeap;
+	this->ring = &ring;
+}
+
 ScratchHeap::Allocation ScratchHeap::Allocate(uint32_t sizeBytes, uint32_t alignmentBytes)
 {
+	std::lock_guard lock(mutex);
+	if (ring)
+	{
+		BufferHeap::Offset offset = ring->AllocateOrWait(sizeBytes, alignmentBytes, Frame::WaitForFence);
+		if (offset == RingAllocator::InvalidOffset)
+		{
+			//the frame alone does not fit into the ring, the overflow comes from the parent heap and lives until the GPU finished the frame
+			ring->stats.overflowCount++;
+			BufferHeap::Allocation overflowAllocation = parentHeap->Allocate(sizeBytes, alignmentBytes, MemoryTelemetry::Tag::Frame);
+			offset = overflowAllocation.offset;
+			Frame::SafeRelease(overflowAllocation);
+		}
+		MemoryTelemetry::RecordAllocation(MemoryTelemetry::Heap::ScratchHeap, MemoryTelemetry::CurrentTag(), sizeBytes);
+		return
+		{
+			.offset = offset,
+			.size = sizeBytes
+		};
+	}
+
+	MemoryTelemetry::RecordAllocation(MemoryTelemetry::Heap::ScratchHeap, MemoryTelemetry::CurrentTag(), sizeBytes);
 	uint32_t alignedSizeBytes = sizeBytes + alignmentBytes;
 	auto allocation = allocator.Allocate(alignedSizeBytes);
 	uint32_t totalOffset = allocation.chunk.offset + allocation.offset;
@@ -38,3 +399,193 @@ ScratchHeap::Allocation ScratchHeap::Allocate(uint32_t sizeBytes, uint32_t align
 		.size = sizeBytes
 	};
 }
+
+void ScratchHeap::Reset()
+{
+	if (!ring)
+	{
+		allocator.Reset();
+	}
+}
+
+void DirtyRangeSet::Add(uint32_t begin, uint32_t end, uint32_t mergeDistance)
+{
+	assert(begin < end);
+
+	//first range that ends close enough to begin to be merged, all following ones that start close enough to end get merged as well
+	auto first = std::lower_bound(ranges.begin(), ranges.end(), begin,
+		[mergeDistance](const Range& range, uint32_t value)
+		{
+			return range.end + mergeDistance < value;
+		});
+
+	auto last = first;
+	while (last != ranges.end() && last->begin <= end + mergeDistance)
+	{
+		begin = Min(begin, last->begin);
+		end = Max(end, last->end);
+		++last;
+	}
+
+	if (first == last)
+	{
+		ranges.insert(first, { begin, end });
+	}
+	else
+	{
+		*first = { begin, end };
+		ranges.erase(first + 1, last);
+	}
+}
+
+static std::vector<MirroredBufferBase*> queuedMirroredBuffers;
+static std::mutex queuedMirroredBuffersMutex;
+
+MirroredBufferBase::MirroredBufferBase(MirroredBufferBase&& other) noexcept
+{
+	*this = std::move(other);
+}
+
+MirroredBufferBase& MirroredBufferBase::operator=(MirroredBufferBase&& other) noexcept
+{
+	if (this == &other)
+	{
+		return *this;
+	}
+
+	Dequeue();
+	gpuAllocation = other.gpuAllocation;
+	shadowAllocation = other.shadowAllocation;
+	sizeBytes = other.sizeBytes;
+	dirtyRanges = std::move(other.dirtyRanges);
+	pendingWrites = std::move(other.pendingWrites);
+	staging = std::move(other.staging);
+
+	if (other.isQueued)
+	{
+		std::lock_guard lock(queuedMirroredBuffersMutex);
+		*std::find(queuedMirroredBuffers.begin(), queuedMirroredBuffers.end(), &other) = this;
+		isQueued = true;
+		other.isQueued = false;
+	}
+
+	other.gpuAllocation.offset = BufferHeap::InvalidOffset;
+	other.shadowAllocation.offset = PersistentAllocator::InvalidOffset;
+	other.sizeBytes = 0;
+
+	return *this;
+}
+
+void MirroredBufferBase::WriteRaw(uint32_t byteOffset, const void* sourcePtr, uint32_t size)
+{
+	assert(IsValid() && byteOffset + size <= sizeBytes);
+	if (size == 0)
+	{
+		return;
+	}
+
+	if (HasShadow())
+	{
+		std::memcpy(EditRaw(byteOffset, size), sourcePtr, size);
+		return;
+	}
+
+	const uint32_t stagingOffset = static_cast<uint32_t>(staging.size());
+	staging.resize(stagingOffset + size);
+	std::memcpy(staging.data() + stagingOffset, sourcePtr, size);
+	pendingWrites.push_back({ .offset = byteOffset, .size = size, .stagingOffset = stagingOffset });
+	Queue();
+}
+
+void* MirroredBufferBase::EditRaw(uint32_t byteOffset, uint32_t size)
+{
+	assert(HasShadow() && byteOffset + size <= sizeBytes);
+	MarkDirty(byteOffset, size);
+
+	return static_cast<uint8_t*>(GetAllocationPtr(shadowAllocation)) + byteOffset;
+}
+
+void MirroredBufferBase::MarkDirty(uint32_t byteOffset, uint32_t size)
+{
+	if (size > 0)
+	{
+		dirtyRanges.Add(byteOffset, byteOffset + size);
+		Queue();
+	}
+}
+
+void MirroredBufferBase::Flush()
+{
+	if (!isQueued)
+	{
+		return;
+	}
+
+	BufferHeap& heap = *gpuAllocation.allocator;
+	if (HasShadow())
+	{
+		const uint8_t* shadowPtr = static_cast<const uint8_t*>(GetAllocationPtr(shadowAllocation));
+		for (const DirtyRangeSet::Range& range : dirtyRanges.ranges)
+		{
+			//merged ranges may reach past the end of the buffer by up to the merge distance
+			const uint32_t end = Min(range.end, sizeBytes);
+			heap.WriteRaw(gpuAllocation.offset + range.begin, shadowPtr + range.begin, end - range.begin);
+		}
+		dirtyRanges.Clear();
+	}
+	else
+	{
+		//consecutive writes get coalesced by the writer, later writes to the same range still win since order is kept
+		UploadWriter writer(heap.CpuPtr(gpuAllocation.offset), sizeBytes);
+		for (const PendingWrite& pendingWrite : pendingWrites)
+		{
+			writer.Write(pendingWrite.offset, staging.data() + pendingWrite.stagingOffset, pendingWrite.size);
+		}
+		pendingWrites.clear();
+		staging.clear();
+	}
+
+	isQueued = false;
+}
+
+void MirroredBufferBase::Free()
+{
+	Dequeue();
+	dirtyRanges.Clear();
+	pendingWrites.clear();
+	staging.clear();
+	gpuAllocation.Free();
+	shadowAllocation.Free();
+	sizeBytes = 0;
+}
+
+void MirroredBufferBase::Queue()
+{
+	if (!isQueued)
+	{
+		std::lock_guard lock(queuedMirroredBuffersMutex);
+		queuedMirroredBuffers.push_back(this);
+		isQueued = true;
+	}
+}
+
+void MirroredBufferBase::Dequeue()
+{
+	if (isQueued)
+	{
+		std::lock_guard lock(queuedMirroredBuffersMutex);
+		std::erase(queuedMirroredBuffers, this);
+		isQueued = false;
+	}
+}
+
+void FlushMirroredBuffers()
+{
+	//held for the whole flush, a buffer freed or moved on another thread dequeues itself under the same lock
+	std::lock_guard lock(queuedMirroredBuffersMutex);
+	for (MirroredBufferBase* buffer : queuedMirroredBuffers)
+	{
+		buffer->Flush();
+	}
+	queuedMirroredBuffers.clear();
+}
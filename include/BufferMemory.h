@@ -1,6 +1,10 @@
 #pragma once
 #include "Buffer.h"
 #include "Allocator.h"
+#include "SharedDefines.h"
+#include "UploadWriter.h"
+
+#include <unordered_map>
 
 #define BufferMemberOffset(buffer, member)\
 	(buffer.Offset() + offsetof(typename decltype(buffer)::type, member))
@@ -9,16 +13,107 @@
 #define WriteBufferMember(buffer, member, data)\
 	(buffer.parentHeap->WriteRaw(BufferMemberOffset(buffer, member), &data, sizeof(data)))
 
-struct BufferHeap : AllocatorBase<BufferHeap>
+//Spans several buffer blocks, which are created on demand once the existing ones run out of space.
+//Offsets carry the block index in their upper bits, see BufferLoad() in GlobalBuffer.hlsli for the shader side.
+//@note: the block table at offset 0 holds the descriptor ids of all blocks except the first one, which gets bound as root srv
+struct BufferHeap : AllocatorBase<BufferHeap, BufferHeapBackend>
 {
+	static constexpr MemoryTelemetry::Heap telemetryHeap = MemoryTelemetry::Heap::GlobalBuffer;
 	static const uint32_t maximumSupportedAlignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
-	BufferResource parentBuffer;
+	static const uint32_t blockOffsetBitCount = globalBufferBlockOffsetBitCount;
+	static const uint32_t blockMaxSize = 1u << blockOffsetBitCount;
+	static const uint32_t blocksMaxCount = globalBufferBlocksMaxCount;
+
+	//@note: AllocatorBase::allocator is not used, every block has its own allocator
+	struct Block
+	{
+		BufferHeapBackend allocator;
+		BufferResource buffer;
+		DescriptorHeap::Allocation srvId;
+	};
 
-	void Init(ID3D12Device10* device, 
-	uint32_t size, LPCWSTR name = L"", 
+	std::array<Block, blocksMaxCount> blocks;
+	uint32_t blockCount = 0;
+	uint32_t growBlockSize = 0;
+	Allocation blockTable;
+
+	ID3D12Device10* device = nullptr; //nullptr if blocks are backed by CPU memory only
+	DescriptorHeap* descriptorHeap = nullptr;
+	LPCWSTR name = L"";
+	D3D12_HEAP_TYPE heapType = D3D12_HEAP_TYPE_GPU_UPLOAD;
+
+	void Init(ID3D12Device10* device,
+	DescriptorHeap& descriptorHeap,
+	uint32_t initialBlockSize, uint32_t growBlockSize,
+	LPCWSTR name = L"", 
 	D3D12_HEAP_TYPE heapType = D3D12_HEAP_TYPE_GPU_UPLOAD);
 
+	//Blocks are allocated in main memory instead, so allocation and addressing can be used without a device. GPUAddress() is not available then and the block table holds block indices instead of descriptor ids
+	void InitCpuBacked(uint32_t initialBlockSize, uint32_t growBlockSize);
+	void Destroy();
+
+	//Falls through the existing blocks in order and creates a new block if none of them has enough space left
+	Allocation Allocate(uint32_t size, uint32_t alignment = 4, MemoryTelemetry::Tag tag = MemoryTelemetry::CurrentTag());
+	BufferHeapBackend& GetRawAllocator(Offset offset);
+
+	//goes through WriteCombinedCopy() for upload heaps. Many small writes in a row are better batched with an UploadWriter on CpuPtr()
 	void WriteRaw(Offset offset, const void* sourcePtr, uint32_t size) const;
+	void* CpuPtr(Offset offset) const;
+	bool IsWriteCombined() const;
+	D3D12_GPU_VIRTUAL_ADDRESS GPUAddress(Offset offset) const;
+
+	uint32_t GetSize() const;
+	uint32_t GetUsedSize() const;
+
+	static uint32_t BlockIndex(Offset offset)
+	{
+		return offset >> blockOffsetBitCount;
+	}
+
+	static uint32_t BlockOffset(Offset offset)
+	{
+		return offset & (blockMaxSize - 1);
+	}
+
+	static Offset MakeOffset(uint32_t blockIndex, uint32_t blockOffset)
+	{
+		assert(blockIndex < blocksMaxCount && blockOffset < blockMaxSize);
+		return (blockIndex << blockOffsetBitCount) | blockOffset;
+	}
+
+	//Compaction support: only registered allocations are moved by Compact(), everything else is treated as pinned.
+	//The registered allocation object is patched in place, so it must not move in memory while registered. Owners storing derived offsets elsewhere patch them in the callback.
+	//Allocations registered with a shadow, i.e. a CPU copy of their whole content, get rewritten from it. The others get copied on the GPU, so the CPU must not write them in the frame they move.
+	using RelocationCallback = std::function<void(Offset oldOffset, Offset newOffset)>;
+
+	struct RelocatableAllocation
+	{
+		Allocation* allocation;
+		RelocationCallback onRelocated;
+		std::span<const std::byte> shadow;
+	};
+
+	std::vector<RelocatableAllocation> relocatableAllocations;
+	std::unordered_map<const Allocation*, uint32_t> relocatableIndices; //index into relocatableAllocations
+	std::atomic<bool> isCompactionStalled = false; //the last pass moved nothing, set back once allocations come or go. Atomic since CompactIfFragmented reads it without the lock
+
+	void RegisterRelocatable(Allocation& allocation, RelocationCallback onRelocated = {}, std::span<const std::byte> shadow = {});
+	void UnregisterRelocatable(const Allocation& allocation);
+
+	//Moves registered allocations towards the start of the heap, copying at most byteBudget bytes. Old ranges are released via Frame::SafeRelease, so in-flight frames can still read them. Returns number of bytes moved.
+	//The GPU copies get recorded into commandList, which is only optional for heaps backed by CPU memory
+	uint32_t Compact(uint32_t byteBudget, ID3D12GraphicsCommandList10* commandList = nullptr);
+	//does nothing after a pass which moved nothing, until the allocations change, so pinned allocations keeping the heap fragmented don't trigger a pass every frame
+	uint32_t CompactIfFragmented(float largestFreeBlockRatioThreshold, uint32_t byteBudget, ID3D12GraphicsCommandList10* commandList = nullptr);
+
+	//largest free block / total free space, 1.0 means no fragmentation
+	float GetLargestFreeBlockRatio() const;
+
+	void OnFree(const Allocation& allocation);
+
+private:
+	uint32_t AddBlock(uint32_t size);
+	OffsetAllocator::Allocation AllocateRaw(uint32_t blockIndex, uint32_t size, uint32_t alignment);
 };
 
 template <typename T>
@@ -43,7 +138,7 @@ struct PersistentBuffer : BufferHeap::Allocation
 
 	D3D12_GPU_VIRTUAL_ADDRESS GPUAddress(uint32_t elementIndex = 0) const
 	{
-		return Offset(elementIndex) + allocator->parentBuffer.resource->GetGPUVirtualAddress();
+		return allocator->GPUAddress(Offset(elementIndex));
 	}
 };
 
@@ -57,6 +152,153 @@ PersistentBuffer<T> CreatePersistentBuffer(BufferHeap& heap, uint32_t elementCou
 	return buffer;
 }
 
+//Sorted, non overlapping byte ranges. Ranges closer than mergeDistance get merged, so uploading them does not split write combined lines
+struct DirtyRangeSet
+{
+	struct Range
+	{
+		uint32_t begin;
+		uint32_t end;
+	};
+
+	std::vector<Range> ranges;
+
+	void Add(uint32_t begin, uint32_t end, uint32_t mergeDistance = writeCombiningLineSize);
+
+	void Clear()
+	{
+		ranges.clear();
+	}
+
+	bool IsEmpty() const
+	{
+		return ranges.empty();
+	}
+};
+
+//Persistent GPU buffer whose writes are batched: they only get recorded and reach GPU memory with the next FlushMirroredBuffers(), all dirty buffers in one pass.
+//With a shadow copy (CPU memory from the PersistentAllocator) the buffer can be read and edited in place and only the merged dirty ranges get uploaded.
+//Without one (write only data) the written bytes are staged until the flush and uploaded in write order.
+//@note: a buffer with pending writes must not move in memory until the next flush. Different buffers may be written from different threads, a single buffer is not thread safe
+struct MirroredBufferBase
+{
+	struct PendingWrite
+	{
+		uint32_t offset;
+		uint32_t size;
+		uint32_t stagingOffset;
+	};
+
+	BufferHeap::Allocation gpuAllocation;
+	PersistentAllocator::Allocation shadowAllocation; //invalid for write only buffers
+	uint32_t sizeBytes = 0;
+
+	DirtyRangeSet dirtyRanges;
+	std::vector<PendingWrite> pendingWrites; //write only buffers
+	std::vector<uint8_t> staging; //write only buffers, keeps its capacity across flushes
+	bool isQueued = false;
+
+	MirroredBufferBase() = default;
+	//moving keeps pending writes queued, copies are not allowed since they would be flushed twice
+	MirroredBufferBase(MirroredBufferBase&& other) noexcept;
+	MirroredBufferBase& operator=(MirroredBufferBase&& other) noexcept;
+	MirroredBufferBase(const MirroredBufferBase&) = delete;
+	MirroredBufferBase& operator=(const MirroredBufferBase&) = delete;
+
+	bool HasShadow() const
+	{
+		return shadowAllocation.IsValid();
+	}
+
+	bool IsValid() const
+	{
+		return gpuAllocation.IsValid();
+	}
+
+	//whole content of the buffer, empty for write only buffers. Passed to BufferHeap::RegisterRelocatable(), so moving the buffer does not read GPU memory
+	std::span<const std::byte> Shadow() const
+	{
+		return HasShadow() ? std::span(static_cast<const std::byte*>(GetAllocationPtr(shadowAllocation)), sizeBytes) : std::span<const std::byte>();
+	}
+
+	void WriteRaw(uint32_t byteOffset, const void* sourcePtr, uint32_t size);
+	//only with shadow copy: marks the range dirty and returns the shadow memory, so the caller can modify it in place
+	void* EditRaw(uint32_t byteOffset, uint32_t size);
+	void Flush();
+	void Free();
+
+protected:
+	void MarkDirty(uint32_t byteOffset, uint32_t size);
+	void Queue();
+	void Dequeue();
+};
+
+template <typename T>
+struct MirroredBuffer : MirroredBufferBase
+{
+	using type = T;
+
+	void Write(const T& element, uint32_t elementOffset = 0)
+	{
+		WriteRaw(elementOffset * sizeof(T), &element, sizeof(T));
+	}
+
+	void Write(std::span<const T> elements, uint32_t elementOffset = 0)
+	{
+		WriteRaw(elementOffset * sizeof(T), elements.data(), static_cast<uint32_t>(elements.size_bytes()));
+	}
+
+	T& Edit(uint32_t elementIndex = 0)
+	{
+		return *static_cast<T*>(EditRaw(elementIndex * sizeof(T), sizeof(T)));
+	}
+
+	const T& Get(uint32_t elementIndex = 0) const
+	{
+		assert(HasShadow() && elementIndex < Count());
+		return static_cast<const T*>(GetAllocationPtr(shadowAllocation))[elementIndex];
+	}
+
+	uint32_t Count() const
+	{
+		return sizeBytes / sizeof(T);
+	}
+
+	BufferHeap::Offset Offset(uint32_t elementIndex = 0) const
+	{
+		return gpuAllocation.offset + elementIndex * sizeof(T);
+	}
+
+	D3D12_GPU_VIRTUAL_ADDRESS GPUAddress(uint32_t elementIndex = 0) const
+	{
+		return gpuAllocation.allocator->GPUAddress(Offset(elementIndex));
+	}
+};
+
+template <typename T>
+MirroredBuffer<T> CreateMirroredBuffer(BufferHeap& heap, PersistentAllocator& shadowAllocator, uint32_t elementCount = 1, uint32_t alignment = alignof(T))
+{
+	MirroredBuffer<T> buffer;
+	buffer.sizeBytes = elementCount * sizeof(T);
+	buffer.gpuAllocation = heap.Allocate(buffer.sizeBytes, Max(alignment, 4u));
+	buffer.shadowAllocation = shadowAllocator.Allocate(buffer.sizeBytes, alignof(T));
+
+	return buffer;
+}
+
+template <typename T>
+MirroredBuffer<T> CreateWriteOnlyMirroredBuffer(BufferHeap& heap, uint32_t elementCount = 1, uint32_t alignment = alignof(T))
+{
+	MirroredBuffer<T> buffer;
+	buffer.sizeBytes = elementCount * sizeof(T);
+	buffer.gpuAllocation = heap.Allocate(buffer.sizeBytes, Max(alignment, 4u));
+
+	return buffer;
+}
+
+//Uploads the pending writes of all mirrored buffers. Needs to happen once per frame before the command list gets submitted
+void FlushMirroredBuffers();
+
 struct ScratchHeap 
 {
 	struct Allocation
@@ -66,10 +308,18 @@ struct ScratchHeap
 	};
 
 	void Init(BufferHeap& parentHeap, uint32_t chunkSizeBytes = 10 * 1024, uint32_t initialChunkCount = 10);
+	//Alternative backend: allocations come from a ring, which may be shared with other heaps. The offsets handed out by the ring need to lie in parentHeap
+	void InitRing(BufferHeap& parentHeap, RingAllocator& ring);
+
+	//thread safe, so the stages of the frame preparation can allocate from worker threads. A shared ring must only be used by one heap at a time
 	Allocation Allocate(uint32_t sizeBytes, uint32_t alignmentBytes);
+	//only needed for the chunk backend, ring memory gets retired by fence value
+	void Reset();
 
 	BufferHeap* parentHeap;
 	ChunkAllocator<BufferHeap::Allocation> allocator;
+	RingAllocator* ring = nullptr;
+	std::mutex mutex;
 };
 
 template <typename T>
@@ -99,7 +349,7 @@ struct TemporaryBuffer : ScratchHeap::Allocation
 
 	D3D12_GPU_VIRTUAL_ADDRESS GPUAddress(uint32_t elementIndex = 0) const
 	{
-		return Offset(elementIndex) + parentHeap->parentBuffer.resource->GetGPUVirtualAddress();
+		return parentHeap->GPUAddress(Offset(elementIndex));
 	}
 };
 
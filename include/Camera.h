@@ -94,5 +94,7 @@ struct MovementSpeed
 };
 
 Camera::Transform ProcessInput(float deltaTime, bool bCaptureMouse = true, const MovementSpeed& controler = {});
+//with the mouse movement given by the caller, e.g. from Input::ConsumeMouseDelta()
+Camera::Transform ProcessInput(float deltaTime, float mouseDeltaX, float mouseDeltaY, bool bCaptureMouse = true, const MovementSpeed& controler = {});
 
 DirectX::XMFLOAT2 HaltonSubPixelJitter(uint32_t width, uint32_t height, uint64_t frameId);
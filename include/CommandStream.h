@@ -0,0 +1,224 @@
+#pragma once
+#include "Allocator.h"
+
+//Compact, recordable subset of ID3D12GraphicsCommandList10. Commands get appended as header plus payload to a single reserved range, so recording is a bump allocation and a copy,
+//and a stream can be recorded on any thread without touching D3D12. The recording methods have the signatures of the command list, helpers written against a CommandList template parameter work with both.
+//Backends: Translate() replays a stream into a real command list, ReplayOnCpu() decodes it without a device for validation and statistics.
+//@note: pointers in the stream (PSOs, event names) are stored as is, they need to stay alive until the stream got translated. Root signature and descriptor heaps are not part of the stream, see D3D::PrepareCommandList()
+struct CommandStream
+{
+	static constexpr uint32_t defaultReservedSizeBytes = 16 * 1024 * 1024;
+	static constexpr uint32_t commandAlignment = 8; //payloads holding pointers and 64 bit values can be read in place
+
+	enum class CommandType : uint32_t
+	{
+		SetPipelineState,
+		SetComputeRootConstants,
+		SetGraphicsRootConstants,
+		Dispatch,
+		DrawIndexedInstanced,
+		Barrier,
+		SetIndexBuffer,
+		SetPrimitiveTopology,
+		SetRenderTargets,
+		SetViewports,
+		SetScissorRects,
+		ClearRenderTarget,
+		ClearDepthStencil,
+		BeginEvent,
+		EndEvent,
+
+		Count
+	};
+
+	inline static const char* commandTypeNames[] =
+	{
+		"SetPipelineState",
+		"SetComputeRootConstants",
+		"SetGraphicsRootConstants",
+		"Dispatch",
+		"DrawIndexedInstanced",
+		"Barrier",
+		"SetIndexBuffer",
+		"SetPrimitiveTopology",
+		"SetRenderTargets",
+		"SetViewports",
+		"SetScissorRects",
+		"ClearRenderTarget",
+		"ClearDepthStencil",
+		"BeginEvent",
+		"EndEvent"
+	};
+	static_assert(_countof(commandTypeNames) == static_cast<uint32_t>(CommandType::Count));
+
+	//sizeBytes includes the header and the padding up to the next command
+	struct CommandHeader
+	{
+		CommandType type;
+		uint32_t sizeBytes;
+	};
+
+	//payloads, variable sized data follows the payload directly
+	struct SetPipelineStateCommand
+	{
+		ID3D12PipelineState* pso;
+	};
+
+	//followed by count values
+	struct RootConstantsCommand
+	{
+		uint32_t rootParameterIndex;
+		uint32_t count;
+		uint32_t destinationOffset;
+	};
+
+	struct DispatchCommand
+	{
+		uint32_t threadGroupCountX;
+		uint32_t threadGroupCountY;
+		uint32_t threadGroupCountZ;
+	};
+
+	struct DrawIndexedInstancedCommand
+	{
+		uint32_t indexCountPerInstance;
+		uint32_t instanceCount;
+		uint32_t startIndexLocation;
+		int32_t baseVertexLocation;
+		uint32_t startInstanceLocation;
+	};
+
+	//followed by the groups and then the barriers of all groups. The group pointers point into the stream, so the groups can be handed to the command list as they are
+	struct BarrierCommand
+	{
+		uint32_t groupCount;
+	};
+
+	struct SetIndexBufferCommand
+	{
+		D3D12_INDEX_BUFFER_VIEW view;
+	};
+
+	struct SetPrimitiveTopologyCommand
+	{
+		D3D12_PRIMITIVE_TOPOLOGY topology;
+	};
+
+	//followed by the render target handles, just one if isSingleHandleToDescriptorRange is set
+	struct SetRenderTargetsCommand
+	{
+		D3D12_CPU_DESCRIPTOR_HANDLE depthStencil; //ptr 0 if none is bound
+		uint32_t renderTargetCount;
+		BOOL isSingleHandleToDescriptorRange;
+	};
+
+	//followed by count viewports or rects
+	struct SetViewportsCommand
+	{
+		uint32_t count;
+	};
+
+	struct SetScissorRectsCommand
+	{
+		uint32_t count;
+	};
+
+	struct ClearRenderTargetCommand
+	{
+		D3D12_CPU_DESCRIPTOR_HANDLE renderTarget;
+		float color[4];
+	};
+
+	struct ClearDepthStencilCommand
+	{
+		D3D12_CPU_DESCRIPTOR_HANDLE depthStencil;
+		D3D12_CLEAR_FLAGS flags;
+		float depth;
+		uint8_t stencil;
+	};
+
+	struct BeginEventCommand
+	{
+		LPCWSTR name;
+	};
+
+	LinearAllocator memory;
+	uint32_t commandCount = 0;
+
+	void Init(uint32_t reservedSizeBytes = defaultReservedSizeBytes);
+	void Destroy();
+	//drops all commands, the memory stays reserved
+	void Reset();
+
+	uint32_t GetSizeBytes() const;
+
+	//recording
+	void SetPipelineState(ID3D12PipelineState* pso);
+	void SetComputeRoot32BitConstants(UINT rootParameterIndex, UINT count, const void* data, UINT destinationOffset);
+	void SetGraphicsRoot32BitConstants(UINT rootParameterIndex, UINT count, const void* data, UINT destinationOffset);
+	void Dispatch(UINT threadGroupCountX, UINT threadGroupCountY, UINT threadGroupCountZ);
+	void DrawIndexedInstanced(UINT indexCountPerInstance, UINT instanceCount, UINT startIndexLocation, INT baseVertexLocation, UINT startInstanceLocation);
+	void Barrier(UINT32 groupCount, const D3D12_BARRIER_GROUP* groups);
+	void IASetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW* view);
+	void IASetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY topology);
+	void OMSetRenderTargets(UINT renderTargetCount, const D3D12_CPU_DESCRIPTOR_HANDLE* renderTargets, BOOL isSingleHandleToDescriptorRange, const D3D12_CPU_DESCRIPTOR_HANDLE* depthStencil);
+	void RSSetViewports(UINT count, const D3D12_VIEWPORT* viewports);
+	void RSSetScissorRects(UINT count, const D3D12_RECT* rects);
+	//@note: clearing sub rects is not supported, rectCount needs to be 0
+	void ClearRenderTargetView(D3D12_CPU_DESCRIPTOR_HANDLE renderTarget, const FLOAT color[4], UINT rectCount, const D3D12_RECT* rects);
+	void ClearDepthStencilView(D3D12_CPU_DESCRIPTOR_HANDLE depthStencil, D3D12_CLEAR_FLAGS flags, FLOAT depth, UINT8 stencil, UINT rectCount, const D3D12_RECT* rects);
+	//name needs to outlive the stream, usually a literal
+	void BeginEvent(LPCWSTR name);
+	void EndEvent();
+
+	//replays the stream into the command list, in recording order
+	void Translate(ID3D12GraphicsCommandList10* commandList) const;
+
+	template <typename F>
+	void ForEachCommand(F&& function) const
+	{
+		const uint8_t* command = static_cast<const uint8_t*>(memory.virtualMemory.base);
+		const uint8_t* end = memory.GetTop();
+		while (command < end)
+		{
+			const CommandHeader* header = reinterpret_cast<const CommandHeader*>(command);
+			function(*header, command + sizeof(CommandHeader));
+			command += header->sizeBytes;
+		}
+	}
+
+private:
+	template <typename T>
+	T* Append(CommandType type, uint32_t trailingSizeBytes = 0);
+	void AppendRootConstants(CommandType type, UINT rootParameterIndex, UINT count, const void* data, UINT destinationOffset);
+};
+
+//for helpers written against a CommandList template parameter, see ScopedEvent in D3DUtility.h
+inline void BeginEvent(CommandStream* commandStream, LPCWSTR name)
+{
+	commandStream->BeginEvent(name);
+}
+
+inline void EndEvent(CommandStream* commandStream)
+{
+	commandStream->EndEvent();
+}
+
+//Translates stream i into commandLists[i], one job per stream. The lists need to be open and prepared, they get executed in order by the caller
+void TranslateParallel(std::span<const CommandStream* const> commandStreams, std::span<ID3D12GraphicsCommandList10* const> commandLists);
+
+//CPU backend: decodes a stream without a device and checks it against the state a command list would have. Assumes the stream is self contained, i.e. it sets every state it depends on
+struct CommandStreamStatistics
+{
+	uint32_t commandCounts[static_cast<uint32_t>(CommandStream::CommandType::Count)];
+	uint32_t commandCount;
+	uint32_t sizeBytes;
+	uint64_t threadGroupCount;
+	uint64_t indexCount; //over all instances
+	uint32_t barrierCount;
+	uint32_t redundantPipelineStateCount; //pipeline state set again while already bound
+	uint32_t validationErrorCount;
+};
+
+//every validation error gets reported to validationLog if given
+CommandStreamStatistics ReplayOnCpu(const CommandStream& commandStream, FILE* validationLog = nullptr);
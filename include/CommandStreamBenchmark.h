@@ -0,0 +1,22 @@
+#pragma once
+
+//Recording cost of command streams without a device: synthetic compute and draw passes get recorded into one stream per thread with 1 to N threads, then decoded by the CPU backend.
+//Results are written as CSV with one line per workload and thread count, speedup is relative to the run with a single thread.
+namespace CommandStreamBenchmark
+{
+	struct Result
+	{
+		const char* workload;
+		uint32_t threadCount;
+		uint64_t commandCount;
+		uint64_t streamSizeBytes; //over all streams
+		double totalMs; //best of several repetitions
+		double speedup;
+	};
+
+	//maxThreadCount 0 means one thread per hardware thread
+	std::vector<Result> Run(uint32_t maxThreadCount = 0);
+
+	void WriteCsv(FILE* file, std::span<const Result> results);
+	bool RunAndWriteCsv(const char* filePath, uint32_t maxThreadCount = 0);
+}
@@ -5,13 +5,16 @@
 #include "BlueNoisePregeneratedData.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cmath>
+#include <cstdlib>
 #include <bit>
 #include <filesystem>
 #include <functional>
 #include <malloc.h>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <span>
 #include <string>
@@ -59,6 +62,14 @@ inline const uint32_t BufferHeapInvalidOffset = uint32_t(-1);
 	}\
 }
 
+//for states the program can't continue from, unlike assert() also active in release builds
+[[noreturn]] inline void FatalError(const char* message)
+{
+	OutputDebugStringA(message);
+	OutputDebugStringA("\n");
+	std::abort();
+}
+
 template <typename T> 
 T* Coalesce(T* ptr, T* fallbackPtr)
 {
@@ -38,8 +38,9 @@ template<typename T, size_t N> uint32_t RemoveEmptyBarriers(const T(&input)[N],
 	return i;
 }
 
-template <typename... Ts, uint32_t... Sizes>
-inline void ResourceTransitions(ID3D12GraphicsCommandList10* commandList, const Ts(&...barriers)[Sizes]) 
+//CommandList is ID3D12GraphicsCommandList10 or CommandStream
+template <typename CommandList, typename... Ts, uint32_t... Sizes>
+inline void ResourceTransitions(CommandList* commandList, const Ts(&...barriers)[Sizes]) 
 {
 	constexpr uint32_t barrierGroupCount = sizeof...(Ts);
 	D3D12_BARRIER_GROUP barrierGroups[barrierGroupCount];
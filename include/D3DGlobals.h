@@ -13,6 +13,10 @@ namespace D3D
 	constexpr float nearZ = .1f;
 	constexpr float farZ = 50.0f;
 	constexpr DXGI_FORMAT depthStencilFormat = DXGI_FORMAT_D32_FLOAT;
+
+	//global static buffer gets compacted incrementally once the largest free block drops below this fraction of the total free space
+	constexpr float globalStaticBufferCompactionThreshold = 0.5f;
+	constexpr uint32_t globalStaticBufferCompactionBudgetBytes = 1024 * 1024;
 }
 
 struct BufferHeap;
@@ -72,20 +72,46 @@ ComPtr<ID3D12PipelineState> CreateComputePso(ID3D12Device10* device, const Compu
 
 ComPtr<IDxcBlobEncoding> LoadShaderBinary(LPCWSTR filename);
 
-typedef void (ID3D12GraphicsCommandList10::* SetRootConstantsType)(UINT, UINT, const void*, UINT);
+//Recording helpers take the command list as template parameter, so they work with ID3D12GraphicsCommandList10 and CommandStream alike
+template <uint32_t firstRootConstantOffset = 0, typename CommandList, typename...T>
+inline void BindGraphicsRootConstants(CommandList* commandList, const T&... rootConstants)
+{
+	SetRootConstants<firstRootConstantOffset>(&CommandList::SetGraphicsRoot32BitConstants, commandList, rootConstants...);
+}
 
-template <uint32_t firstRootConstantOffset = 0, typename...T>
-inline void BindGraphicsRootConstants(ID3D12GraphicsCommandList10* commandList, const T&... rootConstants)
+template <uint32_t firstRootConstantOffset = 0, typename CommandList, typename...T>
+inline void BindComputeRootConstants(CommandList* commandList, const T&... rootConstants)
 {
-	SetRootConstants<firstRootConstantOffset>(&ID3D12GraphicsCommandList10::SetGraphicsRoot32BitConstants, commandList, rootConstants...);
+	SetRootConstants<firstRootConstantOffset>(&CommandList::SetComputeRoot32BitConstants, commandList, rootConstants...);
 }
 
-template <uint32_t firstRootConstantOffset = 0, typename...T>
-inline void BindComputeRootConstants(ID3D12GraphicsCommandList10* commandList, const T&... rootConstants)
+//PIX events, the overloads for CommandStream are in CommandStream.h
+inline void BeginEvent(ID3D12GraphicsCommandList10* commandList, LPCWSTR name)
 {
-	SetRootConstants<firstRootConstantOffset>(&ID3D12GraphicsCommandList10::SetComputeRoot32BitConstants, commandList, rootConstants...);
+	PIXBeginEvent(commandList, PIX_COLOR_DEFAULT, name);
 }
 
+inline void EndEvent(ID3D12GraphicsCommandList10* commandList)
+{
+	PIXEndEvent(commandList);
+}
+
+template <typename CommandList>
+struct ScopedEvent
+{
+	CommandList* commandList;
+
+	ScopedEvent(CommandList* commandList, LPCWSTR name) : commandList(commandList)
+	{
+		BeginEvent(commandList, name);
+	}
+
+	~ScopedEvent()
+	{
+		EndEvent(commandList);
+	}
+};
+
 struct ThreadDimensions
 {
 	uint32_t dispatchX = 1;
@@ -99,8 +125,8 @@ struct ThreadDimensions
 template <typename...T>
 concept NotDescriptorHeapAllocation = (!std::same_as<DescriptorHeap::Allocation, T> && ...);
 
-template <uint32_t firstRootConstantOffset = 0, typename...T>
-inline void SetRootConstants(SetRootConstantsType function, ID3D12GraphicsCommandList10* commandList, const T&...args) requires NotDescriptorHeapAllocation<T...>
+template <uint32_t firstRootConstantOffset = 0, typename SetRootConstantsFunction, typename CommandList, typename...T>
+inline void SetRootConstants(SetRootConstantsFunction function, CommandList* commandList, const T&...args) requires NotDescriptorHeapAllocation<T...>
 {
 	constexpr size_t size = (0 + ... + Max(sizeof(uint32_t), sizeof(T))); //Max because everthing will be padded to 4B
 
@@ -131,8 +157,8 @@ inline void SetRootConstants(SetRootConstantsType function, ID3D12GraphicsComman
 	}
 }
 
-template <uint32_t firstRootConstantOffset = 0, typename... T>
-inline void DispatchComputePass(ID3D12GraphicsCommandList10* commandList,
+template <uint32_t firstRootConstantOffset = 0, typename CommandList, typename... T>
+inline void DispatchComputePass(CommandList* commandList,
 	ID3D12PipelineState* pso,
 	ThreadDimensions&& threadDimensions,
 	LPCWSTR debugName = L"",
@@ -141,7 +167,7 @@ inline void DispatchComputePass(ID3D12GraphicsCommandList10* commandList,
 	const bool emitPixEvent = debugName[0] != L'\0';
 	if (emitPixEvent)
 	{
-		PIXBeginEvent(commandList, PIX_COLOR_DEFAULT, debugName);
+		BeginEvent(commandList, debugName);
 	}
 
 	if (pso)
@@ -156,12 +182,12 @@ inline void DispatchComputePass(ID3D12GraphicsCommandList10* commandList,
 
 	if (emitPixEvent)
 	{
-		PIXEndEvent(commandList);
+		EndEvent(commandList);
 	}
 }
 
-template <uint32_t firstRootConstantOffset = 0, typename... T>
-inline void DispatchComputePass(ID3D12GraphicsCommandList10* commandList,
+template <uint32_t firstRootConstantOffset = 0, typename CommandList, typename... T>
+inline void DispatchComputePass(CommandList* commandList,
 	ID3D12PipelineState* pso,
 	ThreadDimensions&& threadDimensions,
 	const T&... rootConstants)
@@ -169,8 +195,8 @@ inline void DispatchComputePass(ID3D12GraphicsCommandList10* commandList,
 	DispatchComputePass<firstRootConstantOffset>(commandList, pso, std::move(threadDimensions), L"", rootConstants...);
 }
 
-template <size_t rootConstantsCount>
-inline void DispatchComputePass(ID3D12GraphicsCommandList10* commandList,
+template <size_t rootConstantsCount, typename CommandList>
+inline void DispatchComputePass(CommandList* commandList,
 	ID3D12PipelineState* pso,
 	const uint32_t(&rootConstants)[rootConstantsCount],
 	ThreadDimensions&& threadDimensions,
@@ -0,0 +1,86 @@
+#pragma once
+#include <deque>
+
+//Type erased queue of deferred releases, each keyed by the fence value after which the GPU no longer uses the released object.
+//Entries live in a preallocated ring of fixed size slots, so enqueueing does not allocate. Enqueue is lock free and may be called from any thread, Retire() only from a single consumer thread.
+//@note: independent of D3D, the fence is just a monotonically increasing value. Entries are retired in enqueue order: an entry with a higher fence value holds back the ones behind it,
+//which only delays releases, since fence values of concurrent producers are at most one frame apart. A full ring spills into a locked overflow list, which does allocate.
+struct DeferredReleaseQueue
+{
+	static constexpr uint32_t payloadSize = 48;
+	static constexpr uint32_t payloadAlignment = 16;
+
+	//runs the release if isRetired is set, always destroys the payload
+	using ReleaseFunction = void(*)(void* payload, bool isRetired);
+
+	struct Entry
+	{
+		std::atomic<uint64_t> sequence;
+		uint64_t fenceValue;
+		ReleaseFunction release;
+		alignas(payloadAlignment) uint8_t payload[payloadSize];
+	};
+
+	struct OverflowEntry
+	{
+		std::atomic<bool> isPublished = false;
+		uint64_t fenceValue;
+		ReleaseFunction release;
+		alignas(payloadAlignment) uint8_t payload[payloadSize];
+	};
+
+	std::unique_ptr<Entry[]> entries;
+	uint32_t capacity = 0;
+	alignas(64) std::atomic<uint64_t> enqueuePosition = 0;
+	alignas(64) uint64_t dequeuePosition = 0;
+
+	std::deque<OverflowEntry> overflowEntries;
+	mutable std::mutex overflowMutex;
+	std::atomic<uint32_t> overflowCount = 0; //overflown entries since Init(), a hint to increase the capacity
+
+	DeferredReleaseQueue() = default;
+	DeferredReleaseQueue(const DeferredReleaseQueue&) = delete;
+	DeferredReleaseQueue& operator=(const DeferredReleaseQueue&) = delete;
+
+	~DeferredReleaseQueue()
+	{
+		Destroy();
+	}
+
+	//capacity needs to be a power of two
+	void Init(uint32_t capacity);
+	//destroys pending entries without running their releases, i.e. objects are dropped but allocations are not returned to their heaps
+	void Destroy();
+
+	//release gets invoked once the completed fence value reaches fenceValue. Any callable fitting into payloadSize, typically a lambda owning the released object
+	template <typename F>
+	void Enqueue(uint64_t fenceValue, F&& release)
+	{
+		using Function = std::decay_t<F>;
+		static_assert(sizeof(Function) <= payloadSize && alignof(Function) <= payloadAlignment, "release does not fit into a queue entry");
+
+		const ReleaseFunction releaseFunction = [](void* payload, bool isRetired)
+		{
+			Function& function = *static_cast<Function*>(payload);
+			if (isRetired)
+			{
+				function();
+			}
+			function.~Function();
+		};
+
+		void* payload = BeginEnqueue(fenceValue, releaseFunction);
+		new (payload) Function(std::forward<F>(release));
+		EndEnqueue(payload);
+	}
+
+	//runs the releases of all entries whose fence value has been completed, returns the number of released entries
+	uint32_t Retire(uint64_t completedFenceValue);
+
+	uint32_t GetPendingCount() const;
+
+private:
+	//reserves a slot and returns its payload, which needs to be constructed before EndEnqueue() publishes it
+	void* BeginEnqueue(uint64_t fenceValue, ReleaseFunction release);
+	void EndEnqueue(void* payload);
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+//DeferredReleaseQueue driven by a fake fence that completes a fixed number of frames behind the producers, without a device.
+//Every release is checked: not before its fence completed, not later than the first Retire() after it, exactly once, and for a single producer in enqueue order across wrap-arounds of the ring.
+//The overflow workloads use a ring smaller than the releases in flight, so most of them go through the overflow list.
+//Results are written as CSV with one line per workload and thread count.
+namespace DeferredReleaseQueueBenchmark
+{
+	struct Result
+	{
+		const char* workload;
+		uint32_t threadCount;
+		uint32_t capacity;
+		uint64_t releaseCount;
+		double totalMs; //best of several repetitions
+		uint32_t overflowCount; //of the last repetition
+		bool isOverflowExpected;
+		//summed over the repetitions
+		uint32_t orderViolationCount;
+		uint32_t earlyReleaseCount;
+		uint32_t lateReleaseCount;
+		uint32_t missingReleaseCount; //entries not released exactly once after the final Retire()
+	};
+
+	//maxThreadCount 0 means one thread per hardware thread
+	std::vector<Result> Run(uint32_t maxThreadCount = 0);
+
+	void WriteCsv(FILE* file, std::span<const Result> results);
+	//fails if a release was out of order, early, late or missing, or if an overflow workload did not overflow
+	bool RunAndWriteCsv(const char* filePath, uint32_t maxThreadCount = 0);
+}
@@ -11,7 +11,8 @@ namespace D3D
 struct DescriptorHeapBase
 {
 	ComPtr<ID3D12DescriptorHeap> heap;
-	OffsetAllocator::Allocator allocator;
+	DescriptorHeapBackend allocator;
+	std::mutex mutex; //guards allocator, the subsystems allocate from several threads during the parallel startup
 
 	uint32_t elementMaxCount;
 	ID3D12Device10* device;
@@ -96,6 +97,7 @@ struct DescriptorHeap : DescriptorHeapBase //@note: using just the term Descript
 		static DescriptorHeap* const parentHeapPtr;
 
 		OffsetAllocator::Allocation allocation = { InvalidId };
+		MemoryTelemetry::Tag tag = MemoryTelemetry::Tag::Untagged;
 
 		operator DescriptorHeap::Id() const
 		{
@@ -120,6 +122,9 @@ struct DescriptorHeap : DescriptorHeapBase //@note: using just the term Descript
 		void Free()
 		{
 			assert(IsValid());
+			std::lock_guard lock(parentHeapPtr->mutex);
+			MemoryTelemetry::RecordFree(MemoryTelemetry::Heap::DescriptorHeap, tag, parentHeapPtr->allocator.allocationSize(allocation));
+			MemoryTelemetry::TraceFree(MemoryTelemetry::Heap::DescriptorHeap, parentHeapPtr, allocation.offset);
 			parentHeapPtr->allocator.free(allocation);
 		}
 	};
@@ -128,7 +133,7 @@ struct DescriptorHeap : DescriptorHeapBase //@note: using just the term Descript
 
 	void Init(ID3D12Device10* device, uint32_t elementMaxCount, D3D12_DESCRIPTOR_HEAP_FLAGS flag = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE);
 
-	Allocation Allocate(uint32_t elementCount = 1);
+	Allocation Allocate(uint32_t elementCount = 1, MemoryTelemetry::Tag tag = MemoryTelemetry::CurrentTag());
 
 	DescriptorHandle GetDescriptorHandleAt(uint32_t offset) const;
 };
@@ -154,6 +159,7 @@ struct RtvHeap : DescriptorHeapBase
 		void Free()
 		{
 			assert(IsValid());
+			std::lock_guard lock(parentHeapPtr->mutex);
 			parentHeapPtr->allocator.free(allocation);
 		}
 	};
@@ -188,6 +194,7 @@ struct DsvHeap : DescriptorHeapBase
 		void Free()
 		{
 			assert(IsValid());
+			std::lock_guard lock(parentHeapPtr->mutex);
 			parentHeapPtr->allocator.free(allocation);
 		}
 	};
@@ -220,10 +227,15 @@ struct TemporaryDescriptorHeap
 {
 	ChunkAllocator<OffsetAllocator::Allocation> allocator;
 	DescriptorHeap* parentHeap;
+	RingAllocator* ring = nullptr;
 
 	void Init(DescriptorHeap& parentHeap, uint32_t chunkSizeBytes = 512, uint32_t initialChunkCount = 1);
+	//Alternative backend: descriptors come from a ring, which may be shared with other heaps. The offsets handed out by the ring need to lie in parentHeap
+	void InitRing(DescriptorHeap& parentHeap, RingAllocator& ring);
 
 	DescriptorHeap::Id Allocate(uint32_t elementCount = 1);
+	//only needed for the chunk backend, ring descriptors get retired by fence value
+	void Reset();
 
 	DescriptorHandle GetDescriptorHandleAt(uint32_t offset) const;
 };
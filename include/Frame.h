@@ -1,11 +1,24 @@
 #pragma once
 #include "BufferMemory.h"
 #include "DescriptorHeap.h"
+#include "DeferredReleaseQueue.h"
 
 namespace Frame
 {
 	constexpr uint32_t framesInFlightCount = 2;
-	constexpr uint32_t cpuMemoryChunkSize = 1024 * 1024;
+	constexpr uint32_t cpuMemoryReservedSize = 256 * 1024 * 1024;
+	constexpr VirtualMemoryDesc cpuMemoryDesc = { .decommitDelayFrames = 120, .useLargePages = false };
+	constexpr uint32_t workerThreadsMaxCount = 64;
+	constexpr uint32_t workerCpuMemoryReservedSize = 64 * 1024 * 1024;
+	constexpr uint32_t workerStackMemoryReservedSize = 64 * 1024 * 1024;
+
+	//backend selection for the per frame gpu memory and descriptors: chunks per frame slot or one ring shared by all frames in flight
+	constexpr bool useGpuMemoryRing = true;
+	constexpr uint32_t gpuMemoryRingSize = 16 * 1024 * 1024;
+	constexpr uint32_t gpuMemoryChunkSize = 1024 * 1024;
+	constexpr bool useDescriptorRing = true;
+	constexpr uint32_t descriptorRingSize = 2048;
+	constexpr uint32_t deferredReleaseCapacity = 4096;
 
 	inline struct TimingData
 	{
@@ -31,17 +44,35 @@ namespace Frame
 		LinearAllocator cpuMemory;
 		ScratchHeap gpuMemory;
 		TemporaryDescriptorHeap descriptorHeap;
-
-		std::vector<ComPtr<ID3D12Resource1>> releasedResources;
-		std::vector<ComPtr<ID3D12PipelineState>> releasedPsos;
-		std::vector<BufferHeap::Allocation> releasedBufferHeapAllocations;
-		std::vector<DescriptorHeap::Allocation> releasedDescriptorHeapAllocations;
-		std::vector<RtvHeap::Allocation> releasedRtvHeapAllocations;
-		std::vector<DsvHeap::Allocation> releasedDsvHeapAllocations;
 	};
 
 	inline FrameData* current;
 
+	//only used if the respective ring backend is selected
+	inline RingAllocator gpuMemoryRing;
+	inline RingAllocator descriptorRing;
+
+	//releases of objects the GPU may still use, retired by the completed fence value in End() and FlushCommandQueue()
+	inline DeferredReleaseQueue releaseQueue;
+
+	//Arenas owned by a single worker thread, so allocating from them needs no synchronization. All registered arenas are reset together in End(), i.e. workers must be idle at that point and must not keep allocations across frames
+	struct ThreadArena
+	{
+		LinearAllocator cpuMemory[framesInFlightCount];
+		StackAllocator stackMemory;
+	};
+
+	inline thread_local ThreadArena* threadArena = nullptr;
+
+	//needs to be called once on every worker thread before it uses GetThreadCpuMemory() or a StackContext
+	void RegisterWorkerThread();
+
+	//per frame cpu memory of the calling thread, falls back to the main thread's frame memory for unregistered threads
+	inline LinearAllocator& GetThreadCpuMemory()
+	{
+		return threadArena ? threadArena->cpuMemory[current->index] : current->cpuMemory;
+	}
+
 	void Init(ID3D12Device10* device, BufferHeap& parentBufferHeap, DescriptorHeap& parentDescriptorHeap);
 
 	void Begin();
@@ -50,9 +81,24 @@ namespace Frame
 
 	void FlushCommandQueue();
 
+	//fence value signaled at the end of the frame currently being recorded
+	uint64_t GetPendingFenceValue();
+
+	//blocks until the GPU passed fenceValue, returns the completed fence value. May be called from any thread
+	uint64_t WaitForFence(uint64_t fenceValue);
+
+	//runs release once the GPU finished the current frame. May be called from any thread
+	template <typename F>
+	void DeferRelease(F&& release)
+	{
+		releaseQueue.Enqueue(GetPendingFenceValue(), std::forward<F>(release));
+	}
+
+	//@note: releasing ComPtrs is safe from any thread, releasing heap allocations needs the heap to be accessible by the calling thread, as freeing them happens on the main thread
 	void SafeRelease(ComPtr<ID3D12Resource1>&& resource);
 	void SafeRelease(ComPtr<ID3D12PipelineState>&& pso);
 	void SafeRelease(BufferHeap::Allocation& bufferHeapAllocation);
+	void SafeRelease(MirroredBufferBase& mirroredBuffer);
 	void SafeRelease(DescriptorHeap::Allocation& descriptorHeapAllocation);
 	void SafeRelease(RtvHeap::Allocation& rtvHeapAllocation);
 	void SafeRelease(DsvHeap::Allocation& dsvHeapAllocation);
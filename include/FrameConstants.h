@@ -39,8 +39,8 @@ struct FrameConstants
 	UI::SharedSettings sharedSettings;
 };
 
-inline TemporaryBuffer<FrameConstants> UpdateFrameConstants(ID3D12GraphicsCommandList10* commandList,
-	ScratchHeap& bufferHeap,
+//CPU part of UpdateFrameConstants(), only writes the constants to temporary memory
+inline TemporaryBuffer<FrameConstants> WriteFrameConstants(ScratchHeap& bufferHeap,
 	const Camera& camera,
 	const Texture2DDimensions& mainRenderTargetDimensions,
 	const Texture& blueNoiseTexture,
@@ -57,16 +57,33 @@ inline TemporaryBuffer<FrameConstants> UpdateFrameConstants(ID3D12GraphicsComman
 		.gBufferSrvIds = gBufferSrvIds,
 		.blueNoiseBufferSrvId = blueNoiseTexture.srvId,
 		.blueNoiseTextureSize = blueNoiseTexture.properties.width,
-		.frameTimings = Frame::timingData,
+		.frameTimings = timingData,
 		.sharedSettings = sharedSettings,
 	};
 
 	TemporaryBuffer<FrameConstants> frameConstantsBuffer = CreateTemporaryBuffer<FrameConstants>(bufferHeap);
 	frameConstantsBuffer.Write(frameConstants);
 
+	return frameConstantsBuffer;
+}
+
+inline void BindFrameConstants(ID3D12GraphicsCommandList10* commandList, const TemporaryBuffer<FrameConstants>& frameConstantsBuffer)
+{
 	commandList->SetComputeRoot32BitConstant(2, frameConstantsBuffer.Offset(), 0);
 	commandList->SetGraphicsRoot32BitConstant(2, frameConstantsBuffer.Offset(), 0);
+}
+
+inline TemporaryBuffer<FrameConstants> UpdateFrameConstants(ID3D12GraphicsCommandList10* commandList,
+	ScratchHeap& bufferHeap,
+	const Camera& camera,
+	const Texture2DDimensions& mainRenderTargetDimensions,
+	const Texture& blueNoiseTexture,
+	const GBuffer::SrvIds& gBufferSrvIds,
+	const Frame::TimingData& timingData,
+	const UI::SharedSettings& sharedSettings)
+{
+	TemporaryBuffer<FrameConstants> frameConstantsBuffer = WriteFrameConstants(bufferHeap, camera, mainRenderTargetDimensions, blueNoiseTexture, gBufferSrvIds, timingData, sharedSettings);
+	BindFrameConstants(commandList, frameConstantsBuffer);
 	
 	return frameConstantsBuffer;
 }
-
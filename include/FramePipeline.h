@@ -0,0 +1,118 @@
+#pragma once
+#include "Allocator.h"
+
+#include <condition_variable>
+#include <thread>
+
+//Two stage pipeline between a simulation thread and the render thread. The simulation fills snapshots for frame N+1 while the render thread consumes frame N.
+//Every snapshot owns an arena, all data of a frame lives in it. Ownership moves free -> simulation -> ready -> render -> free, so the snapshot data is handed over, never copied.
+//Back-pressure bounds how far the simulation may run ahead, which bounds the added latency. Latency is tracked from the begin of the simulation of a snapshot to the point the render thread acquires and releases it.
+//@note: no D3D dependencies, so it can run headless. The lockstep mode simulates on the render thread in AcquireForRender(), i.e. the behaviour without pipelining
+struct FramePipeline
+{
+	static constexpr uint32_t snapshotsMaxCount = 3;
+
+	enum class Mode
+	{
+		Lockstep,
+		Pipelined
+	};
+
+	enum class BackPressure
+	{
+		Block, //simulation waits once maxFramesAhead snapshots are ready, no simulated frame gets lost
+		DropOldest //simulation never waits for the render thread, the oldest ready snapshot gets recycled and the render thread always takes the newest one. Needs 3 snapshots
+	};
+
+	enum class State : uint32_t
+	{
+		Free,
+		Simulating,
+		Ready,
+		Rendering
+	};
+
+	struct Snapshot
+	{
+		LinearAllocator arena; //reset before every simulation
+		void* data = nullptr; //set by the simulate function, usually allocated from the arena
+		State state = State::Free;
+
+		uint64_t frameId = 0; //counts simulated frames
+		double elapsedTimeMs = 0.0; //simulation time, since Init()
+		float deltaTimeMs = 0.0f;
+
+		double simulationBeginMs = 0.0;
+		double simulationEndMs = 0.0;
+		double renderBeginMs = 0.0;
+
+		template <typename T>
+		T& Get() const
+		{
+			assert(data);
+			return *static_cast<T*>(data);
+		}
+	};
+
+	struct Desc
+	{
+		Mode mode = Mode::Pipelined;
+		BackPressure backPressure = BackPressure::Block;
+		uint32_t snapshotCount = snapshotsMaxCount;
+		uint32_t maxFramesAhead = 1; //ready snapshots the simulation may produce before it blocks, only for BackPressure::Block
+		uint32_t arenaReservedSizeBytes = 64 * 1024 * 1024;
+		void(*onSimulationThreadStart)() = nullptr;
+		std::function<void(Snapshot& snapshot)> simulate;
+	};
+
+	struct Statistics
+	{
+		uint64_t simulatedCount;
+		uint64_t renderedCount;
+		uint64_t droppedCount;
+		double simulationBlockedMs; //simulation waiting for a free snapshot
+		double renderStarvedMs; //render thread waiting for a ready snapshot
+		double averageLatencyMs; //simulation begin to render end
+		double maxLatencyMs;
+		double averageFramesAhead; //simulated frames the rendered snapshot was behind the newest simulated one
+	};
+
+	void Init(const Desc& desc);
+	//stops the simulation thread, snapshots held by the render thread must be released before
+	void Shutdown();
+
+	//blocks until a snapshot is ready and hands it to the caller
+	Snapshot* AcquireForRender();
+	//the snapshot and everything in its arena must no longer be used afterwards
+	void Release(Snapshot* snapshot);
+
+	Statistics GetStatistics() const;
+	void ResetStatistics();
+	void WriteStatistics(FILE* file) const;
+
+	double GetTimeMs() const;
+
+private:
+	Desc desc;
+	Snapshot snapshots[snapshotsMaxCount];
+
+	mutable std::mutex mutex;
+	std::condition_variable snapshotReleased;
+	std::condition_variable snapshotReady;
+	std::thread simulationThread;
+	bool isRunning = false;
+
+	uint64_t simulatedFrameCount = 0;
+	double lastSimulationBeginMs = 0.0;
+	std::chrono::steady_clock::time_point initTime;
+
+	Statistics statistics = {};
+	double totalLatencyMs = 0.0;
+	uint64_t totalFramesAhead = 0;
+
+	Snapshot* AcquireForSimulation(std::unique_lock<std::mutex>& lock);
+	Snapshot* FindReady(bool isNewest) const;
+	uint32_t CountInState(State state) const;
+	void Simulate(Snapshot& snapshot);
+	void SimulationThreadMain();
+};
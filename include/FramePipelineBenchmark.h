@@ -0,0 +1,27 @@
+#pragma once
+#include "FramePipeline.h"
+
+//FramePipeline without a window or device: a simulation and a render stage with fixed busy costs run through Lockstep, Block and DropOldest.
+//Every frame validates the handoff: the render thread gets the snapshot filled for its frame id, nothing writes it while it is rendered, frame ids only increase and Block loses no frame.
+//The latency accounting is compared against latencies measured by the render thread itself.
+//Results are written as CSV with one line per workload.
+namespace FramePipelineBenchmark
+{
+	struct Result
+	{
+		const char* workload;
+		uint32_t frameCount; //rendered
+		double totalMs;
+		double frameMs; //average per rendered frame
+		FramePipeline::Statistics statistics;
+		//over all rendered frames
+		uint32_t handoffViolationCount; //wrong snapshot data, data changed while rendering, frame ids out of order, or frames lost without DropOldest
+		uint32_t accountingViolationCount; //statistics not matching the frames the render thread saw
+	};
+
+	std::vector<Result> Run();
+
+	void WriteCsv(FILE* file, std::span<const Result> results);
+	//fails on any handoff or accounting violation
+	bool RunAndWriteCsv(const char* filePath);
+}
@@ -1,7 +1,9 @@
 #pragma once
 #include "Allocator.h"
+#include "AssetStreaming.h"
 #include "BufferMemory.h"
 #include "DescriptorHeap.h"
+#include "MeshOptimizer.h"
 #include "Texture.h"
 
 struct Geometry 
@@ -25,6 +27,28 @@ struct Geometry
 	D3D12_GPU_VIRTUAL_ADDRESS GetIndexBufferAddress() const;
 };
 
+//Meshlets of a mesh in a single gpu buffer, the streams of Meshlets::MeshletData in that order: meshlets, bounds, vertices, triangles. The meshlet vertices index the vertex streams of the mesh's Geometry
+struct MeshletGeometry
+{
+	uint32_t meshletCount = 0;
+	uint32_t vertexCount = 0;
+	uint32_t triangleCount = 0;
+
+	BufferHeap::Allocation memory;
+
+	bool IsValid() const
+	{
+		return meshletCount > 0;
+	}
+
+	void Free();
+
+	BufferHeap::Offset GetMeshletsOffset() const;
+	BufferHeap::Offset GetBoundsOffset() const;
+	BufferHeap::Offset GetVerticesOffset() const;
+	BufferHeap::Offset GetTrianglesOffset() const;
+};
+
 //Create a single gpu buffer containing indices, positions, normals, and uvs of the mesh in SAO format
 Geometry CreateGeometry(BufferHeap& heap,
 	std::span<const uint32_t> indices,
@@ -32,6 +56,29 @@ Geometry CreateGeometry(BufferHeap& heap,
 	std::span<const DirectX::XMFLOAT3> normals,
 	std::span<const DirectX::XMFLOAT2> uvs);
 
+//The stages of CreateGeometry(), for streaming. The allocation has to happen on the render thread, the write may happen on any thread as long as the allocation is not registered as relocatable
+Geometry AllocateGeometry(BufferHeap& heap, uint32_t indexCount, uint32_t vertexCount);
+void WriteGeometry(Geometry& geometry,
+	std::span<const uint32_t> indices,
+	std::span<const DirectX::XMFLOAT3> positions,
+	std::span<const DirectX::XMFLOAT3> normals,
+	std::span<const DirectX::XMFLOAT2> uvs);
+//for streams which are already laid out like above, e.g. the geometry section of a mesh cache file: a single copy, no per vertex work
+void WriteGeometry(Geometry& geometry, std::span<const uint8_t> streams, const DirectX::BoundingBox& aabb);
+
+//same split as above for the meshlets, the streams are laid out like in MeshletGeometry, e.g. the meshlet section of a mesh cache file
+MeshletGeometry AllocateMeshletGeometry(BufferHeap& heap, uint32_t meshletCount, uint32_t vertexCount, uint32_t triangleCount);
+void WriteMeshletGeometry(MeshletGeometry& meshletGeometry, std::span<const uint8_t> streams);
+
+//vertex and index streams of a mesh in CPU memory
+struct GeometryData
+{
+	std::span<const uint32_t> indices;
+	std::span<const DirectX::XMFLOAT3> positions;
+	std::span<const DirectX::XMFLOAT3> normals;
+	std::span<const DirectX::XMFLOAT2> uvs;
+};
+
 enum RaytracingGeometryType
 {
 	Opaque,
@@ -77,15 +124,16 @@ struct PbrMesh
 	BufferResource rayTracingBlas;
 
 	PersistentMemory<Submesh> submeshes; 
+	MeshletGeometry meshlets;
+	PersistentMemory<uint32_t> submeshMeshletOffsets; //the meshlets of submesh i are [submeshMeshletOffsets[i], submeshMeshletOffsets[i + 1])
 	std::vector<Texture> textures;
-	PersistentBuffer<MaterialConstants> materialConstantsBuffer;
-	PersistentBuffer<InstanceData> instanceDataBuffer;
+	MirroredBuffer<MaterialConstants> materialConstantsBuffer;
 	PersistentBuffer<Submesh> submeshDataBuffer;
 
-	PersistentMemory<InstanceData> instanceData;
+	MirroredBuffer<InstanceData> instanceData;
 	uint32_t instanceCount = 1; 
 	BufferHeap::Offset instanceDataOffset = BufferHeap::InvalidOffset;
-	InstanceData* instanceDataPtr = nullptr; //@note: the additional offset and pointer exist in order for the PbrMesh also be able to use data temporary data instead of persistent
+	const InstanceData* instanceDataPtr = nullptr; //@note: the additional offset and pointer exist in order for the PbrMesh also be able to use data temporary data instead of persistent
 
 	void Draw(ID3D12GraphicsCommandList10* commandList) const;
 
@@ -114,18 +162,55 @@ struct PbrMesh
 };
 
 //Loads geomtry from a given .obj file and uploads vertices and indices to the GPU. //@note: Meshes need to be triangulated!
+//@note: goes through the mesh cache, see MeshCache.h. The .obj only gets parsed if its cache file is missing or stale
 PbrMesh LoadMesh(ID3D12Device10* device,
 	PersistentAllocator& allocator,
 	DescriptorHeap & descriptorHeap,
 	BufferHeap& bufferHeap,
 	LPCWSTR fileName);
 
+//Streaming version of LoadMesh(), parsing, texture decoding and writing the buffers happen on the streaming threads. The mesh gets published with a placeholder material, i.e. without textures, its textures get patched in as they arrive
+AssetStreaming::AssetHandle<PbrMesh> LoadMeshAsync(PersistentAllocator& allocator,
+	DescriptorHeap& descriptorHeap,
+	BufferHeap& bufferHeap,
+	std::wstring fileName);
+
 Geometry LoadGeometryData(BufferHeap& bufferHeap, LPCWSTR fileName);
 
+enum class VertexWelding
+{
+	Sort, //sorts the vertices of a shape, the unique vertices end up ordered by their .obj indices
+	Hash //open addressing hash table, afterwards only the unique vertices get sorted, so the result is the same as with Sort
+};
+
+struct VertexWeldingDesc
+{
+	VertexWelding welding = VertexWelding::Hash;
+	float positionEpsilon = 0.0f; //if > 0, positions falling into the same cell of a grid with this cell size count as one position even with different .obj indices, for meshes with split attributes
+};
+
+//CPU part of loading an .obj file, used when cooking the mesh cache: identifies the unique vertices and builds the index and vertex streams. They get allocated from the stack context, no D3D calls, so it may run on any thread.
+//The welding scratch memory (24 bytes per index with hash welding, 16 with sort welding) is released before the vertex streams get allocated, see GetCookStackMemorySize() in MeshCache.cpp for the peak.
+//Every shape gets its own contiguous vertex range and the indices are absolute, so no base vertex location is needed. The shapes get welded in parallel if called from a job system thread.
+//Afterwards the triangles and vertices of every shape get reordered as enabled in optimizationDesc, see MeshOptimizer.h
+GeometryData BuildGeometryData(StackContext& stackContext, const rapidobj::Result& model, std::span<PbrMesh::Submesh> submeshes = {}, const VertexWeldingDesc& weldingDesc = {}, const MeshOptimizer::Desc& optimizationDesc = {});
+
 void SetMaterial(PbrMesh& mesh, const PbrMesh::MaterialConstants& material);
 
+//Allows BufferHeap::Compact() to move the buffers of the mesh. The mesh must stay at a fixed address until it is freed.
+void RegisterRelocatable(PbrMesh& mesh);
+
 void SetTemporaryInstanceData(PbrMesh& mesh, LinearAllocator& allocator, ScratchHeap& bufferHeap, const PbrMesh::InstanceData& instanceData);
 void SetTemporaryInstanceData(PbrMesh& mesh, LinearAllocator& allocator, ScratchHeap& bufferHeap, std::span<const PbrMesh::InstanceData> instanceData);
+//instance data produced by the simulation for a mesh. It stays in the memory of the snapshot, only the GPU copy gets written when applied
+struct InstanceDataUpdate
+{
+	PbrMesh* mesh;
+	std::span<const PbrMesh::InstanceData> instanceData;
+};
+
+//sets the temporary instance data of the meshes, the instance data must stay alive until the frame is recorded
+void ApplyInstanceDataUpdates(std::span<const InstanceDataUpdate> updates, ScratchHeap& bufferHeap);
 void InitPersistentInstanceData(PbrMesh& mesh, PersistentAllocator& allocator, BufferHeap& bufferHeap, std::span<PbrMesh::InstanceData> instanceData);
 void UpdatePersistentInstanceData(PbrMesh& mesh, const PbrMesh::InstanceData& instanceData, uint32_t elementIndex);
 void UpdatePersistentInstanceData(PbrMesh& mesh, std::span<const PbrMesh::InstanceData> instanceData);
@@ -179,7 +264,16 @@ struct TemporaryTlas
 	BufferResource accelerationStructureBuffer;
 	BufferHeap::Offset instanceGeometryDataOffset;
 	DescriptorHeap::Id srvId;
+	D3D12_GPU_VIRTUAL_ADDRESS instanceDataAddress = 0;
+	uint32_t instanceCount = 0;
 
+	//CPU part of the build, only writes the instance data to temporary memory, so it may run on a worker
+	void WriteInstances(ScratchHeap& bufferHeap, std::span<const PbrMesh*> meshes);
+	//records the build from the instances of the last WriteInstances()
+	void Build(ID3D12Device10* device,
+		ID3D12GraphicsCommandList10* commandList,
+		TemporaryDescriptorHeap& descriptorHeap,
+		const RWBufferResource& scratchBuffer);
 	void Build(ID3D12Device10* device,
 		ID3D12GraphicsCommandList10* commandList,
 		TemporaryDescriptorHeap& descriptorHeap,
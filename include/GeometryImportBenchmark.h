@@ -0,0 +1,23 @@
+#pragma once
+
+//Vertex welding throughput of BuildGeometryData(): sort and hash welding, with 1 to N threads, on already parsed .obj files, so parsing is not part of the timings.
+//Results are written as CSV with one line per workload, mesh and thread count, speedup is relative to sort welding on a single thread.
+namespace GeometryImportBenchmark
+{
+	struct Result
+	{
+		const char* workload;
+		std::string meshFileName;
+		uint32_t threadCount;
+		uint64_t triangleCount;
+		uint64_t vertexCount; //after welding
+		double totalMs; //best of several repetitions
+		double speedup;
+	};
+
+	//maxThreadCount 0 means one thread per hardware thread
+	std::vector<Result> Run(uint32_t maxThreadCount = 0);
+
+	void WriteCsv(FILE* file, std::span<const Result> results);
+	bool RunAndWriteCsv(const char* filePath, uint32_t maxThreadCount = 0);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+//Counts allocations through the global operator new (and malloc in debug builds, via the CRT allocation hook) per thread, meant for keeping the steady state frame free of heap allocations.
+//Every sampleInterval-th allocation of a thread gets its backtrace captured for call site attribution, allocations inside a zero allocation region always do.
+//@note: only counts allocations of this module, the D3D runtime and drivers allocate through their own heaps. Counting is off until Enable() is called and costs one relaxed load per allocation then
+namespace HeapTracking
+{
+	constexpr uint32_t threadsMaxCount = 64; //further threads share the last counters
+	constexpr uint32_t samplesMaxCount = 4096; //ring, older samples get overwritten
+	constexpr uint32_t backtraceMaxDepth = 16;
+	constexpr uint32_t frameHistoryCount = 1024;
+
+	struct Desc
+	{
+		uint32_t warmupFrameCount = 60; //frames before the steady state begins, i.e. before regions are checked
+		uint32_t sampleInterval = 64;
+	};
+
+	struct ThreadCounters
+	{
+		std::atomic<uint64_t> allocationCount;
+		std::atomic<uint64_t> allocatedBytes;
+		std::atomic<uint64_t> freeCount;
+	};
+
+	struct Sample
+	{
+		uint64_t frameId;
+		uint64_t size;
+		uint32_t threadIndex;
+		uint32_t backtraceDepth;
+		bool isInsideZeroAllocationRegion;
+		void* backtrace[backtraceMaxDepth];
+	};
+
+	inline std::atomic<bool> isTracking = false;
+
+	void Enable(const Desc& desc = {});
+	void Disable();
+
+	//sums the counters of all threads
+	uint64_t GetAllocationCount();
+	uint64_t GetAllocatedBytes();
+
+	//marks a part of the calling thread's frame which must not allocate once the steady state is reached. Allocations inside it are reported as violations.
+	//Regions nest, e.g. a TaskGraph node run by the main thread while it waits inside a region of its own, the allocations count against the outermost region of the thread
+	void BeginZeroAllocationRegion(const char* name);
+	void EndZeroAllocationRegion();
+
+	//records the allocations of the frame, needs to be called once per frame from the main thread
+	void EndFrame(uint64_t frameId);
+
+	//number of allocations inside zero allocation regions of steady state frames
+	uint32_t GetViolationCount();
+
+	//per frame counts and the sampled call sites grouped by backtrace, symbolized via DbgHelp. Suspends tracking on the calling thread while writing
+	void WriteReport(FILE* file);
+	bool DumpReport(const char* filePath);
+
+	//hooks, called by the replaced global operator new and delete
+	void RecordAllocation(size_t size);
+	void RecordFree();
+}
@@ -28,7 +28,7 @@ namespace UI
 		void Update(TemporaryDescriptorHeap& descriptorHeap);
 	};
 
-	inline bool mouseOverUI = false;
+	inline std::atomic<bool> mouseOverUI = false; //read by the simulation thread
 
 	void Init(HWND mainWindow,
 		ID3D12Device10* device,
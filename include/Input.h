@@ -13,6 +13,9 @@ namespace Input
 
 	void Update(float mouseX, float mouseY);
 	int GetTwoWayAction(int posKey, int negKey);
+	//movement since the last Update()
 	void GetMouseDelta(float& velocityX, float& velocityY);
+	//movement since the last call, so a simulation running at its own rate neither loses nor repeats movement. May be called from any thread
+	void ConsumeMouseDelta(float& deltaX, float& deltaY);
 	bool IsPressed(MouseButton button);
 }
\ No newline at end of file
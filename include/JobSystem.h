@@ -0,0 +1,139 @@
+#pragma once
+
+//Work stealing job system. Every thread owns a Chase-Lev deque: it pushes and pops its own jobs at the bottom (LIFO, cache friendly), idle threads steal from the top of random victims (FIFO, i.e. the largest remaining parts of a split range).
+//The main thread is thread 0 and only runs jobs while it waits for a counter with WaitMode::Help. Jobs live in a preallocated ring per thread and their functions are stored inline, so running jobs does not allocate.
+//@note: only the thread which called Init() and the workers may run jobs and wait. The job system itself only uses std threads and atomics, but like every module it is built through stdafx.h, i.e. with the Windows headers
+namespace JobSystem
+{
+	constexpr uint32_t workersMaxCount = 63;
+	constexpr uint32_t workerCountAuto = ~0u;
+	constexpr uint32_t jobQueueCapacity = 4096; //per thread, pushing to a full deque runs the job inline
+	constexpr uint32_t jobPoolSize = 4096; //per thread, jobs are recycled in ring order, so no more than this many jobs of a thread may be in flight
+	constexpr uint32_t jobPayloadSize = 112;
+	constexpr uint32_t counterDependentsMaxCount = 16;
+
+	struct Job;
+
+	//counts unfinished jobs. Jobs added as dependents get queued once the count drops to zero
+	struct Counter
+	{
+		std::atomic<uint32_t> pendingCount = 0;
+		std::atomic_flag dependentsLock;
+		uint32_t dependentsCount = 0;
+		Job* dependents[counterDependentsMaxCount];
+
+		bool IsDone() const
+		{
+			return pendingCount.load(std::memory_order_acquire) == 0;
+		}
+	};
+
+	struct alignas(64) Job
+	{
+		void(*function)(void* payload);
+		Counter* counter;
+		alignas(16) uint8_t payload[jobPayloadSize];
+	};
+
+	//fixed capacity Chase-Lev deque (Le et al., "Correct and Efficient Work-Stealing for Weak Memory Models"). Push and Pop only from the owning thread, Steal from any thread
+	struct JobQueue
+	{
+		alignas(64) std::atomic<int64_t> top = 0;
+		alignas(64) std::atomic<int64_t> bottom = 0;
+		std::atomic<Job*> jobs[jobQueueCapacity];
+
+		bool Push(Job* job);
+		Job* Pop();
+		Job* Steal();
+	};
+
+	enum class WaitMode
+	{
+		Help, //runs pending jobs until the counter is done
+		Block //yields until the counter is done, i.e. the workers do all the work
+	};
+
+	struct Desc
+	{
+		uint32_t workerCount = workerCountAuto; //one worker per hardware thread besides the calling one
+		void(*onWorkerStart)(uint32_t threadIndex) = nullptr; //e.g. Frame::RegisterWorkerThread
+	};
+
+	void Init(const Desc& desc = {});
+	//waits until all queues are empty and joins the workers
+	void Shutdown();
+
+	uint32_t GetWorkerCount();
+	//0 for the main thread, 1... for the workers
+	uint32_t GetThreadIndex();
+	//true on the threads which may run jobs and wait, false e.g. on the streaming threads or before Init()
+	bool IsJobThread();
+
+	Job* AllocateJob();
+	//queues the job on the calling thread's deque, increments counter if given
+	void Submit(Job* job, Counter* counter);
+	//the job gets submitted once dependency is done, right away if it already is
+	void SubmitAfter(Job* job, Counter* counter, Counter& dependency);
+
+	void Wait(Counter& counter, WaitMode waitMode = WaitMode::Help);
+
+	//tries to run one pending job of any thread, returns false if there was none
+	bool RunPendingJob();
+
+	template <typename F>
+	Job* CreateJob(F&& function)
+	{
+		using Function = std::decay_t<F>;
+		static_assert(sizeof(Function) <= jobPayloadSize && alignof(Function) <= 16, "job function does not fit into a job");
+
+		Job* job = AllocateJob();
+		new (job->payload) Function(std::forward<F>(function));
+		job->function = [](void* payload)
+		{
+			Function& function = *static_cast<Function*>(payload);
+			function();
+			function.~Function();
+		};
+		return job;
+	}
+
+	template <typename F>
+	void Run(F&& function, Counter* counter = nullptr)
+	{
+		Submit(CreateJob(std::forward<F>(function)), counter);
+	}
+
+	template <typename F>
+	void RunAfter(Counter& dependency, F&& function, Counter* counter = nullptr)
+	{
+		SubmitAfter(CreateJob(std::forward<F>(function)), counter, dependency);
+	}
+
+	template <typename F>
+	void ParallelForRange(uint32_t begin, uint32_t end, uint32_t grainSize, const F& function, Counter& counter)
+	{
+		//splits off the upper half as job until the range is small enough, idle threads steal the largest halves first
+		while (end - begin > grainSize)
+		{
+			const uint32_t middle = begin + (end - begin) / 2;
+			Run([middle, end, grainSize, &function, &counter]() { ParallelForRange(middle, end, grainSize, function, counter); }, &counter);
+			end = middle;
+		}
+		function(begin, end);
+	}
+
+	//calls function(begin, end) for ranges of at most grainSize elements covering [0, count) and returns once all are done
+	template <typename F>
+	void ParallelFor(uint32_t count, uint32_t grainSize, F&& function, WaitMode waitMode = WaitMode::Help)
+	{
+		assert(grainSize > 0);
+		if (count == 0)
+		{
+			return;
+		}
+
+		Counter counter;
+		ParallelForRange(0, count, grainSize, function, counter);
+		Wait(counter, waitMode);
+	}
+}
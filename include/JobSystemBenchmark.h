@@ -0,0 +1,23 @@
+#pragma once
+
+//Scalability benchmarks of the job system: the same workloads run with 1 to N threads (the main thread helping plus 0 to N-1 workers). Runs from -jobsystembenchmark without a window or device, so results of different Windows machines can be compared.
+//Results are written as CSV with one line per workload and thread count, speedup is relative to the run with a single thread.
+namespace JobSystemBenchmark
+{
+	struct Result
+	{
+		const char* workload;
+		uint32_t threadCount;
+		uint64_t itemCount;
+		double totalMs; //best of several repetitions
+		double speedup;
+		uint32_t orderViolationCount; //TaskGraph::CountOrderViolations() summed over the repetitions, 0 for workloads without a graph
+	};
+
+	//maxThreadCount 0 means one thread per hardware thread
+	std::vector<Result> Run(uint32_t maxThreadCount = 0);
+
+	void WriteCsv(FILE* file, std::span<const Result> results);
+	//fails if a TaskGraph workload ran a node before its predecessors finished
+	bool RunAndWriteCsv(const char* filePath, uint32_t maxThreadCount = 0);
+}
@@ -85,9 +85,9 @@ struct ShadowMaps
 	ComPtr<ID3D12PipelineState> pso;
 	LPCWSTR name = L"";
 
-	//GPU resident buffer
-	FrameBuffered<PersistentBuffer<ShadowedLight>> lightsBuffer;
-	FrameBuffered<PersistentBuffer<DirectX::XMFLOAT4X4>> transformsBuffer;
+	//GPU resident buffer, rewritten every frame
+	FrameBuffered<MirroredBuffer<ShadowedLight>> lightsBuffer;
+	FrameBuffered<MirroredBuffer<DirectX::XMFLOAT4X4>> transformsBuffer;
 };
 
 void UpdateLightDataCascade(std::span<const Light> lights,
@@ -108,6 +108,20 @@ namespace UI
 {
 	struct LightSettings;
 }
+//the stages of ComputeLightsData(), so they can run as separate tasks. UpdateCascadeData() returns the offset of the cascade bounding boxes
+BufferHeap::Offset UpdateCascadeData(ScratchHeap& bufferHeap,
+	const Camera& camera,
+	std::span<const Light> directionalLights,
+	const DirectX::BoundingBox& boundingBoxGeometry,
+	ShadowMaps& cascadedShadowMaps);
+
+//everything but the per frame offsets, i.e. cascadeDataOffset and pointLightsBufferOffset
+LightsData GetLightsData(std::span<const Light> directionalLights,
+	std::span<const Light> shadowedPointLights,
+	std::span<const Light> pointLights,
+	const ShadowMaps& cascadedShadowMaps,
+	const ShadowMaps& pointLightShadowMaps);
+
 LightsData ComputeLightsData(ScratchHeap& bufferHeap,
 	const Camera& camera,
 	std::span<const Light> directionalLights,
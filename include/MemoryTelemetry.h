@@ -0,0 +1,243 @@
+#pragma once
+
+//Live / peak bytes, allocation counts and size histograms per heap and tag. Allocations pick up the tag of the innermost TagScope of the calling thread unless a tag is given explicitly.
+//@note: counters are relaxed atomics, so recording is allowed from any thread. Transient heaps (scratch memory, frame arenas) report the usage of the last frame as live bytes,
+//their allocations are the hot ones and get accumulated per thread without read-modify-writes, EndFrame() folds them in. Define MEMORY_TELEMETRY 0 to compile the recording out.
+#ifndef MEMORY_TELEMETRY
+#define MEMORY_TELEMETRY 1
+#endif
+
+namespace MemoryTelemetry
+{
+	constexpr bool isEnabled = MEMORY_TELEMETRY;
+
+	enum class Heap : uint8_t
+	{
+		GlobalBuffer,
+		PersistentAllocator,
+		DescriptorHeap,
+		ScratchHeap, //transient heaps last, see IsTransient()
+		FrameArena,
+		Count
+	};
+
+	enum class Tag : uint8_t
+	{
+		Untagged,
+		Engine,
+		Frame,
+		Scene,
+		Rendering,
+		Shadows,
+		GlobalIllumination,
+		Debug,
+		Ui,
+		Count
+	};
+
+	constexpr uint32_t heapCount = static_cast<uint32_t>(Heap::Count);
+	constexpr uint32_t tagCount = static_cast<uint32_t>(Tag::Count);
+	constexpr uint32_t histogramBucketCount = 32; //bucket i counts allocations with a size in [2^(i-1), 2^i)
+	constexpr uint32_t transientHeapCount = heapCount - static_cast<uint32_t>(Heap::ScratchHeap);
+	constexpr uint32_t threadSlotsMaxCount = 64; //further threads share one slot and record with read-modify-writes
+
+	constexpr bool IsTransient(Heap heap)
+	{
+		return heap >= Heap::ScratchHeap;
+	}
+
+	struct Counters
+	{
+		std::atomic<uint64_t> liveBytes;
+		std::atomic<uint64_t> peakBytes;
+		std::atomic<uint64_t> allocationCount;
+		std::atomic<uint64_t> liveAllocationCount;
+		std::atomic<uint64_t> histogram[histogramBucketCount];
+	};
+
+	inline Counters counters[heapCount][tagCount];
+	inline thread_local Tag currentTag = Tag::Untagged;
+
+	//allocations of the transient heaps since the last EndFrame(), per thread slot. Only the owning thread writes a slot, apart from the shared one
+	struct FrameCounters
+	{
+		std::atomic<uint64_t> bytes;
+		std::atomic<uint64_t> allocationCount;
+		std::atomic<uint64_t> histogram[histogramBucketCount];
+	};
+
+	struct alignas(64) ThreadFrameCounters
+	{
+		FrameCounters counters[transientHeapCount][tagCount];
+	};
+
+	constexpr uint32_t sharedThreadSlot = threadSlotsMaxCount;
+	inline ThreadFrameCounters threadFrameCounters[threadSlotsMaxCount + 1];
+	inline std::atomic<uint64_t> threadSlotsMask = 0; //bit set = slot taken
+	inline std::atomic<uint64_t> usedThreadSlotsMask = 0; //bit set = slot may hold counters, EndFrame() only visits these
+
+	//a thread holds its slot while it is alive, counters it leaves behind get folded in by the next EndFrame() all the same
+	struct ThreadSlot
+	{
+		uint32_t index = sharedThreadSlot;
+
+		ThreadSlot()
+		{
+			uint64_t mask = threadSlotsMask.load(std::memory_order_relaxed);
+			while (mask != ~0ull)
+			{
+				const uint32_t freeIndex = std::countr_one(mask);
+				if (threadSlotsMask.compare_exchange_weak(mask, mask | (1ull << freeIndex), std::memory_order_acquire, std::memory_order_relaxed))
+				{
+					index = freeIndex;
+					usedThreadSlotsMask.fetch_or(1ull << freeIndex, std::memory_order_relaxed);
+					return;
+				}
+			}
+		}
+
+		~ThreadSlot()
+		{
+			if (index != sharedThreadSlot)
+			{
+				threadSlotsMask.fetch_and(~(1ull << index), std::memory_order_release);
+			}
+		}
+	};
+
+	inline uint32_t GetThreadSlot()
+	{
+		thread_local ThreadSlot slot;
+		return slot.index;
+	}
+
+	struct TagScope
+	{
+		Tag previousTag;
+
+		TagScope(Tag tag) : previousTag(currentTag)
+		{
+			currentTag = tag;
+		}
+
+		~TagScope()
+		{
+			currentTag = previousTag;
+		}
+
+		TagScope(const TagScope&) = delete;
+		TagScope& operator=(const TagScope&) = delete;
+	};
+
+	inline Tag CurrentTag()
+	{
+		return currentTag;
+	}
+
+	inline Counters& GetCounters(Heap heap, Tag tag)
+	{
+		return counters[static_cast<uint32_t>(heap)][static_cast<uint32_t>(tag)];
+	}
+
+	inline uint32_t GetHistogramBucket(uint64_t size)
+	{
+		return Min(static_cast<uint32_t>(std::bit_width(size)), histogramBucketCount - 1);
+	}
+
+	inline void RecordTransientAllocation(Heap heap, Tag tag, uint64_t size)
+	{
+		const uint32_t threadSlot = GetThreadSlot();
+		FrameCounters& entry = threadFrameCounters[threadSlot].counters[static_cast<uint32_t>(heap) - static_cast<uint32_t>(Heap::ScratchHeap)][static_cast<uint32_t>(tag)];
+		std::atomic<uint64_t>& bucket = entry.histogram[GetHistogramBucket(size)];
+		if (threadSlot == sharedThreadSlot)
+		{
+			entry.bytes.fetch_add(size, std::memory_order_relaxed);
+			entry.allocationCount.fetch_add(1, std::memory_order_relaxed);
+			bucket.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		//single writer, plain loads and stores are enough
+		entry.bytes.store(entry.bytes.load(std::memory_order_relaxed) + size, std::memory_order_relaxed);
+		entry.allocationCount.store(entry.allocationCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+	inline void RecordAllocation(Heap heap, Tag tag, uint64_t size)
+	{
+		if constexpr (isEnabled)
+		{
+			if (IsTransient(heap))
+			{
+				RecordTransientAllocation(heap, tag, size);
+				return;
+			}
+
+			Counters& entry = GetCounters(heap, tag);
+			const uint64_t liveBytes = entry.liveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+			uint64_t peakBytes = entry.peakBytes.load(std::memory_order_relaxed);
+			while (liveBytes > peakBytes && !entry.peakBytes.compare_exchange_weak(peakBytes, liveBytes, std::memory_order_relaxed));
+
+			entry.allocationCount.fetch_add(1, std::memory_order_relaxed);
+			entry.liveAllocationCount.fetch_add(1, std::memory_order_relaxed);
+			entry.histogram[GetHistogramBucket(size)].fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	inline void RecordFree(Heap heap, Tag tag, uint64_t size)
+	{
+		if constexpr (isEnabled)
+		{
+			assert(!IsTransient(heap)); //transient heaps are reset as a whole
+			Counters& entry = GetCounters(heap, tag);
+			entry.liveBytes.fetch_sub(size, std::memory_order_relaxed);
+			entry.liveAllocationCount.fetch_sub(1, std::memory_order_relaxed);
+		}
+	}
+
+	const char* GetName(Heap heap);
+	const char* GetName(Tag tag);
+
+	//folds the per thread counters of the transient heaps into the live and peak counters and appends the current state to the per frame dump, if one is open. Worker threads must be idle
+	void EndFrame(uint64_t frameId);
+
+	//writes one JSON object per frame (JSON lines), meant for tracking memory regressions in automated runs
+	bool OpenPerFrameDump(const char* filePath);
+	void ClosePerFrameDump();
+
+	void WriteJson(FILE* file, uint64_t frameId);
+	bool DumpJson(const char* filePath, uint64_t frameId);
+
+	//Allocation traces: allocations and frees of the BufferHeaps, the PersistentAllocator and the DescriptorHeap get appended to a binary file, AllocatorBenchmark replays them against the allocator backends
+	struct TraceEvent
+	{
+		uint64_t allocatorId; //address of the allocator, tells apart several heaps of the same kind
+		uint32_t offset;
+		uint32_t size; //0 for frees
+		uint32_t alignment;
+		Heap heap;
+	};
+
+	inline std::atomic<bool> isTracingAllocations = false;
+
+	bool OpenAllocationTrace(const char* filePath);
+	void CloseAllocationTrace();
+	void WriteTraceEvent(const TraceEvent& event);
+	std::vector<TraceEvent> ReadAllocationTrace(const char* filePath);
+
+	inline void TraceAllocation(Heap heap, const void* allocator, uint32_t offset, uint32_t size, uint32_t alignment)
+	{
+		if (isTracingAllocations.load(std::memory_order_relaxed))
+		{
+			WriteTraceEvent({ .allocatorId = reinterpret_cast<uintptr_t>(allocator), .offset = offset, .size = size, .alignment = alignment, .heap = heap });
+		}
+	}
+
+	inline void TraceFree(Heap heap, const void* allocator, uint32_t offset)
+	{
+		if (isTracingAllocations.load(std::memory_order_relaxed))
+		{
+			WriteTraceEvent({ .allocatorId = reinterpret_cast<uintptr_t>(allocator), .offset = offset, .size = 0, .alignment = 0, .heap = heap });
+		}
+	}
+}
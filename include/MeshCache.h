@@ -0,0 +1,100 @@
+#pragma once
+#include "Geometry.h"
+#include "Meshlets.h"
+
+//Cooked binary version of an .obj mesh, so loading skips parsing, vertex welding, optimization and meshlet building. The geometry section holds the streams in the layout WriteGeometry() puts into the BufferHeap (indices, positions, normals, uvs),
+//it gets copied to the heap as one block straight out of the mapped file, the meshlet section likewise for MeshletGeometry. A cache file sits next to its source and is keyed by a content hash of the .obj and its material libraries, it gets cooked again whenever the hash does not match.
+//Cooking and loading don't use D3D, so they may run on any thread.
+namespace MeshCache
+{
+	static constexpr uint32_t magic = 0x4853454D; //"MESH"
+	static constexpr uint32_t version = 3; //2: streams optimized by MeshOptimizer, 3: meshlets
+	static constexpr uint32_t sectionAlignment = 16;
+	inline const wchar_t* fileExtension = L".meshcache";
+
+	//offsets are relative to the start of the file
+	struct Header
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t sourceHash;
+		uint64_t fileSizeBytes;
+		uint32_t indexCount;
+		uint32_t vertexCount;
+		uint32_t submeshCount;
+		uint32_t materialCount;
+		DirectX::BoundingBox aabb;
+		uint64_t geometryOffset;
+		uint64_t submeshesOffset; //PbrMesh::Submesh, materialConstantsOffset holds the material index like after BuildGeometryData()
+		uint64_t materialsOffset;
+		uint64_t stringsOffset;
+		uint64_t stringsSizeBytes;
+		uint32_t meshletCount;
+		uint32_t meshletVertexCount;
+		uint32_t meshletTriangleCount;
+		uint64_t meshletsOffset; //the streams of MeshletGeometry
+		uint64_t submeshMeshletOffsetsOffset; //submeshCount + 1 elements, see Meshlets::MeshletData
+	};
+
+	//texture file names as offsets into the string section
+	struct Material
+	{
+		static constexpr uint32_t noTexture = uint32_t(-1);
+
+		uint32_t albedoTexture = noTexture;
+		uint32_t normalTexture = noTexture;
+		uint32_t roughnessTexture = noTexture;
+		uint32_t metallicTexture = noTexture;
+	};
+
+	//read only mapping of a whole file
+	struct MappedFile
+	{
+		const uint8_t* data = nullptr;
+		size_t sizeBytes = 0;
+#ifdef _WIN32
+		HANDLE file = INVALID_HANDLE_VALUE;
+		HANDLE mapping = nullptr;
+#endif
+
+		bool Open(const std::filesystem::path& fileName);
+		void Close();
+	};
+
+	//a mapped cache file, the spans point into the mapping and are valid until Close()
+	struct View
+	{
+		MappedFile file;
+		const Header* header = nullptr;
+		std::span<const uint8_t> geometry;
+		std::span<const PbrMesh::Submesh> submeshes;
+		std::span<const Material> materials;
+		const char* strings = nullptr;
+		std::span<const uint8_t> meshlets;
+		std::span<const uint32_t> submeshMeshletOffsets;
+
+		Meshlets::MeshletData GetMeshletData() const
+		{
+			return Meshlets::GetMeshletData(meshlets, header->meshletCount, header->meshletVertexCount, header->meshletTriangleCount, submeshMeshletOffsets);
+		}
+
+		//nullptr if the material has no such texture
+		const char* GetTextureName(uint32_t stringOffset) const
+		{
+			return stringOffset != Material::noTexture ? strings + stringOffset : nullptr;
+		}
+
+		void Close();
+	};
+
+	std::filesystem::path GetCacheFileName(const std::filesystem::path& objFileName);
+	//hash of the .obj and the material libraries it references, empty if the .obj can't be read
+	std::optional<uint64_t> HashSource(const std::filesystem::path& objFileName);
+
+	//parses the .obj, builds its streams and writes the cache file. The file gets written under a temporary name and renamed when complete, so a cache file is never seen half written
+	bool Cook(const std::filesystem::path& objFileName, const std::filesystem::path& cacheFileName, uint64_t sourceHash);
+	//maps a cache file, fails if it is missing, malformed, of another version or cooked from another source
+	bool Open(View& view, const std::filesystem::path& cacheFileName, uint64_t sourceHash);
+	//Open(), cooks the cache file first if it is missing or stale
+	bool OpenOrCook(View& view, const std::filesystem::path& objFileName);
+}
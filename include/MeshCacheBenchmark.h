@@ -0,0 +1,20 @@
+#pragma once
+
+//Load time of meshes from the mesh cache compared to parsing the .obj. Both paths end with the streams copied to a CPU buffer standing in for the BufferHeap, so no device is needed.
+//Results are written as CSV with one line per workload and mesh, speedup is relative to loading the .obj.
+namespace MeshCacheBenchmark
+{
+	struct Result
+	{
+		const char* workload;
+		std::string meshFileName;
+		uint64_t inputSizeBytes; //of the file read
+		double totalMs; //best of several repetitions, i.e. with the file in the OS file cache
+		double speedup;
+	};
+
+	std::vector<Result> Run();
+
+	void WriteCsv(FILE* file, std::span<const Result> results);
+	bool RunAndWriteCsv(const char* filePath);
+}
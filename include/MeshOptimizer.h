@@ -0,0 +1,67 @@
+#pragma once
+#include "Allocator.h"
+
+//Reorders the triangles and vertices of an indexed triangle list for the GPU, pure CPU code working on the streams of a single submesh with submesh local indices.
+//The stages are meant to run in this order: OptimizeVertexCache() for post transform cache reuse, OptimizeOverdraw() which reorders clusters of that order, and OptimizeVertexFetch() renumbering the vertices in first use order for memory locality.
+//Scratch memory comes from the stack context, the indices get rewritten in place.
+namespace MeshOptimizer
+{
+	static constexpr uint32_t cacheMaxSize = 64;
+	static constexpr uint32_t scratchBytesPerIndex = 64; //upper bound of the scratch Optimize() takes, OptimizeVertexCache() peaks at about 33 bytes per index
+	static constexpr uint32_t scratchBaseSize = 4096; //alignment padding
+
+	struct Desc
+	{
+		bool optimizeVertexCache = true;
+		bool optimizeOverdraw = true;
+		bool optimizeVertexFetch = true;
+		uint32_t cacheSize = 16; //post transform cache size the triangle order gets optimized for
+		float overdrawThreshold = 1.05f; //how much the ACMR may get worse by splitting the triangles into more clusters for overdraw ordering, 1.0 keeps the clusters of the vertex cache order
+	};
+
+	//Tipsify (Sander et al. 2007): fans around the most recent vertex still in the cache, skips to the most recently used vertex with remaining triangles at dead ends
+	void OptimizeVertexCache(StackContext& stackContext, std::span<uint32_t> indices, uint32_t vertexCount, uint32_t cacheSize = 16);
+
+	//Splits the triangles into clusters where their simulated FIFO cache restarts, and further where the ACMR of a cluster so far is within threshold of the ACMR of the whole cluster.
+	//The clusters get sorted by how much they face away from the mesh centroid, so the outside of the mesh tends to be drawn first and occludes the inside
+	void OptimizeOverdraw(StackContext& stackContext, std::span<uint32_t> indices, std::span<const DirectX::XMFLOAT3> positions, uint32_t cacheSize = 16, float threshold = 1.05f);
+
+	//Renumbers the vertices in the order of their first use and returns the number of referenced vertices. remap gets the new index of every old vertex, unreferenced vertices end up behind the referenced ones.
+	//The vertex streams need to be reordered with RemapVertices() afterwards
+	uint32_t OptimizeVertexFetch(std::span<uint32_t> indices, uint32_t vertexCount, uint32_t* remap);
+
+	template <typename T>
+	void RemapVertices(StackContext& stackContext, std::span<T> vertices, const uint32_t* remap)
+	{
+		const uint32_t vertexCount = static_cast<uint32_t>(vertices.size());
+		T* copy = stackContext.AllocateUninitialized<T>(vertexCount);
+		std::copy(vertices.begin(), vertices.end(), copy);
+		for (uint32_t i = 0; i < vertexCount; i++)
+		{
+			vertices[remap[i]] = copy[i];
+		}
+	}
+
+	//all of the stages enabled in desc
+	void Optimize(StackContext& stackContext, const Desc& desc, std::span<uint32_t> indices, std::span<DirectX::XMFLOAT3> positions, std::span<DirectX::XMFLOAT3> normals, std::span<DirectX::XMFLOAT2> uvs);
+
+	enum class CacheModel
+	{
+		Fifo, //fixed function hardware
+		Lru
+	};
+
+	//simulated post transform cache: ACMR is transformed vertices per triangle, ATVR transformed vertices per vertex. 0.5 and 1.0 are the optimum for a regular grid
+	struct VertexCacheStatistics
+	{
+		uint32_t transformedVertexCount;
+		float acmr;
+		float atvr;
+	};
+
+	VertexCacheStatistics AnalyzeVertexCache(std::span<const uint32_t> indices, uint32_t vertexCount, uint32_t cacheSize = 16, CacheModel cacheModel = CacheModel::Fifo);
+
+	//Bytes fetched from a vertex stream with the given stride through a simulated direct mapped cache, divided by the size of the stream. 1.0 means every cache line got fetched once.
+	//The SAO streams are separate, but all of them are accessed by the same indices, so one stream tells about all of them
+	float AnalyzeVertexFetch(std::span<const uint32_t> indices, uint32_t vertexCount, uint32_t vertexStrideBytes);
+}
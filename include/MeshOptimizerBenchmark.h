@@ -0,0 +1,24 @@
+#pragma once
+#include "MeshOptimizer.h"
+
+//Effect of the MeshOptimizer stages on imported meshes, measured with simulated caches so no GPU is needed: ACMR/ATVR of a FIFO and an LRU post transform cache, and the overfetch of the position stream.
+//Results are written as CSV with one line per workload and mesh, the unoptimized workload is the baseline the stages get added to one by one.
+namespace MeshOptimizerBenchmark
+{
+	struct Result
+	{
+		const char* workload;
+		std::string meshFileName;
+		uint64_t triangleCount;
+		uint64_t vertexCount;
+		double buildMs; //BuildGeometryData() including the optimization, best of several repetitions
+		MeshOptimizer::VertexCacheStatistics fifo;
+		MeshOptimizer::VertexCacheStatistics lru;
+		float overfetch;
+	};
+
+	std::vector<Result> Run();
+
+	void WriteCsv(FILE* file, std::span<const Result> results);
+	bool RunAndWriteCsv(const char* filePath);
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include "Meshlets.h"
+
+//Meshlet building and CPU cluster culling on the content meshes, no device needed. The meshes are viewed from a ring of cameras around them and from their center.
+//Results are written as CSV with one line per mesh and view, with the share of the triangles culled by the frustum and by the backface cones.
+namespace MeshletBenchmark
+{
+	struct Result
+	{
+		std::string meshFileName;
+		std::string view;
+		uint32_t meshletCount;
+		uint64_t triangleCount;
+		double buildMs; //Meshlets::BuildMeshlets() for the whole mesh, best of several repetitions
+		double cullUs; //Meshlets::Cull() for the view, best of several repetitions
+		Meshlets::CullingStatistics statistics;
+	};
+
+	std::vector<Result> Run();
+
+	void WriteCsv(FILE* file, std::span<const Result> results);
+	bool RunAndWriteCsv(const char* filePath);
+}
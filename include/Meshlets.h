@@ -0,0 +1,80 @@
+#pragma once
+#include "Camera.h"
+#include "Geometry.h"
+
+//Clusters of a few triangles of a submesh, the unit of culling below whole submeshes. The limits are the ones preferred by mesh shaders.
+//Every meshlet has a vertex list indexing the vertex streams of the mesh and a small local index buffer into that list. The bounds are in mesh space, like the positions
+namespace Meshlets
+{
+	static constexpr uint32_t vertexMaxCount = 64;
+	static constexpr uint32_t triangleMaxCount = 124;
+	static constexpr float coneDisabledCutoff = 2.0f; //larger than any dot product, for meshlets whose normals are spread too wide for the cone test
+
+	//vertices[vertexOffset, vertexOffset + vertexCount) are the vertices of the meshlet, triangles[triangleOffset, triangleOffset + triangleCount) its triangles
+	struct Meshlet
+	{
+		uint32_t vertexOffset;
+		uint32_t vertexCount;
+		uint32_t triangleOffset;
+		uint32_t triangleCount;
+	};
+
+	//all triangles of the meshlet face away from a camera at position c if dot(normalize(coneApex - c), coneAxis) >= coneCutoff
+	struct Bounds
+	{
+		DirectX::XMFLOAT4 boundingSphere; //center, radius
+		DirectX::XMFLOAT3 aabbCenter;
+		float coneCutoff; //sine of the half angle of the normal cone
+		DirectX::XMFLOAT3 aabbExtents;
+		uint32_t padding0;
+		DirectX::XMFLOAT3 coneApex;
+		uint32_t padding1;
+		DirectX::XMFLOAT3 coneAxis;
+		uint32_t padding2;
+	};
+	static_assert(sizeof(Bounds) % 16 == 0);
+
+	//local indices of a triangle, 8 bits each
+	inline uint32_t PackTriangle(uint32_t a, uint32_t b, uint32_t c)
+	{
+		return a | (b << 8) | (c << 16);
+	}
+
+	inline uint32_t GetTriangleCorner(uint32_t packedTriangle, uint32_t corner)
+	{
+		return (packedTriangle >> (8 * corner)) & 0xFF;
+	}
+
+	//the meshlets of submesh i are meshlets[submeshMeshletOffsets[i], submeshMeshletOffsets[i + 1]). meshlets, bounds, vertices and triangles are the streams of MeshletGeometry in that order
+	struct MeshletData
+	{
+		std::span<const Meshlet> meshlets;
+		std::span<const Bounds> bounds;
+		std::span<const uint32_t> vertices;
+		std::span<const uint32_t> triangles;
+		std::span<const uint32_t> submeshMeshletOffsets;
+	};
+
+	//Greedy in index order: a meshlet gets closed once the next triangle doesn't fit, so the triangles should already be ordered for locality, see MeshOptimizer. Allocates from the stack context, no D3D calls
+	MeshletData BuildMeshlets(StackContext& stackContext, std::span<const uint32_t> indices, std::span<const DirectX::XMFLOAT3> positions, std::span<const PbrMesh::Submesh> submeshes);
+
+	//size of the streams as laid out in MeshletGeometry
+	uint64_t GetStreamsSizeBytes(uint32_t meshletCount, uint32_t vertexCount, uint32_t triangleCount);
+
+	//spans into streams laid out like MeshletGeometry
+	MeshletData GetMeshletData(std::span<const uint8_t> streams, uint32_t meshletCount, uint32_t vertexCount, uint32_t triangleCount, std::span<const uint32_t> submeshMeshletOffsets);
+
+	struct CullingStatistics
+	{
+		uint32_t meshletCount;
+		uint32_t frustumCulledMeshletCount;
+		uint32_t coneCulledMeshletCount; //of the meshlets within the frustum
+		uint64_t triangleCount;
+		uint64_t frustumCulledTriangleCount;
+		uint64_t coneCulledTriangleCount;
+	};
+
+	//CPU reference of cluster culling, the frustum test is the one of IsWithinFrustum() in ViewHelpers.hlsli. viewMatrix transforms from mesh space to view space and is stored transposed like Camera::Constants::viewMatrix, cameraPosition is in mesh space.
+	//isVisible gets the result per meshlet if given
+	CullingStatistics Cull(const MeshletData& meshletData, const DirectX::XMFLOAT4X4& viewMatrix, const Camera::FrustumData& frustumData, const DirectX::XMFLOAT3& cameraPosition, std::span<bool> isVisible = {});
+}
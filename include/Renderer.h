@@ -2,6 +2,7 @@
 #include "BufferMemory.h"
 #include "Camera.h"
 #include "DescriptorHeap.h"
+#include "Geometry.h"
 #include "Light.h"
 
 struct RenderSettings
@@ -22,7 +23,6 @@ struct RenderSettings
 	uint32_t accelerationStructureScratchBufferSizeBytes = 64 * 1024 * 1024;
 };
 
-struct PbrMesh;
 namespace UI
 {
 	struct AppMenuBase;
@@ -36,6 +36,7 @@ struct RenderData
 	std::span<const Light> directionalLights;
 	std::span<const Light> pointLights;
 	std::span<const Light> shadowedPointLights;
+	std::span<const InstanceDataUpdate> instanceDataUpdates; //applied by the render thread, see ApplyInstanceDataUpdates()
 	uint32_t activeCubeMapsCount;
 	BufferHeap::Offset cubeMapsTransformsOffset;
 	DescriptorHeap::Id skyBoxSrvId;
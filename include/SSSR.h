@@ -3,12 +3,14 @@
 #include "DescriptorHeap.h"
 
 struct DescriptorHeap;
+struct CommandStream;
 namespace SSSR
 {
 	inline DescriptorHeap::Id bufferSrvId;
 
 	void Init(ID3D12Device10* device, uint32_t renderTargetWidth, uint32_t renderTargetHeight, DescriptorHeap& descriptorHeap, BufferHeap& bufferHeap);
-	void Render(ID3D12GraphicsCommandList10* commandList, DescriptorHeap::Id previousLitBufferSrvId, BufferHeap::Offset lightsDataBufferOffset);
+	//only dispatches compute work, so it gets recorded into a command stream on the job system
+	void Render(CommandStream* commandList, DescriptorHeap::Id previousLitBufferSrvId, BufferHeap::Offset lightsDataBufferOffset);
 	void FrameEnd(ID3D12GraphicsCommandList10* commandList);
 }
 
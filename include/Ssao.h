@@ -3,12 +3,14 @@
 #include "DescriptorHeap.h"
 
 struct BufferHeap;
+struct CommandStream;
 namespace SSAO
 {
 	inline DescriptorHeap::Id bufferSrvId;
 
 	void Init(ID3D12Device10* device, DescriptorHeap& descriptorHeap, uint32_t width, uint32_t height);
-	void Render(ID3D12GraphicsCommandList10* commandList, BufferHeap::Offset ddgiDataOffset, DescriptorHeap::Id litBufferSrvId);
+	//only dispatches compute work, so it gets recorded into a command stream on the job system
+	void Render(CommandStream* commandList, BufferHeap::Offset ddgiDataOffset, DescriptorHeap::Id litBufferSrvId);
 	[[nodiscard]]
 	D3D12_TEXTURE_BARRIER Done();
 }
@@ -0,0 +1,70 @@
+#pragma once
+#include "JobSystem.h"
+
+#include <chrono>
+
+//Declarative graph of CPU stages, built once and run every frame on the job system. Every node declares the resources it reads and writes, the edges follow from the declaration order:
+//a reader depends on the last writer of a resource, a writer on the last writer and all readers since then. Compile() derives the edges and a topological order, which is reused by every Run().
+//Nodes record their begin and end times each run, so the critical path of the last run can be reported, and their begin and end in a sequence shared by all nodes, so the dependency order of the last run can be checked.
+//@note: resources are just ids with a name, the graph does not know what they stand for. Running does not allocate, node functions are only stored at build time
+struct TaskGraph
+{
+	using ResourceId = uint32_t;
+	using NodeId = uint32_t;
+
+	struct Node
+	{
+		const char* name;
+		std::function<void()> function;
+		std::vector<ResourceId> reads;
+		std::vector<ResourceId> writes;
+		std::vector<NodeId> predecessors;
+		std::vector<NodeId> successors;
+	};
+
+	struct NodeTiming
+	{
+		double beginMs; //relative to the begin of the run
+		double endMs;
+		uint32_t threadIndex;
+		uint32_t beginSequence;
+		uint32_t endSequence;
+	};
+
+	std::vector<const char*> resourceNames;
+	std::vector<Node> nodes;
+	std::vector<NodeId> order;
+	std::vector<NodeId> roots;
+	std::unique_ptr<std::atomic<uint32_t>[]> pendingPredecessorCounts;
+	std::vector<NodeTiming> timings;
+	double lastRunMs = 0.0;
+	bool isCompiled = false;
+	bool isZeroAllocation = false; //every node runs in a HeapTracking zero allocation region named after it, on whichever thread runs it
+
+	ResourceId AddResource(const char* name);
+	NodeId AddNode(const char* name, std::initializer_list<ResourceId> reads, std::initializer_list<ResourceId> writes, std::function<void()> function);
+
+	void Compile();
+
+	//runs the nodes as jobs, every node gets submitted by the last of its predecessors to finish
+	void Run(JobSystem::WaitMode waitMode = JobSystem::WaitMode::Help);
+	//Run() in two halves, the calling thread can do other work in between while the workers run the graph
+	void Start();
+	void Wait(JobSystem::WaitMode waitMode = JobSystem::WaitMode::Help);
+	//runs the nodes in topological order on the calling thread, as reference for Run()
+	void RunSerial();
+
+	//longest chain of the last run by measured node durations, returns its duration and optionally the nodes on it
+	double ComputeCriticalPath(std::vector<NodeId>* path = nullptr) const;
+	//number of edges of the last run whose successor began before its predecessor ended, anything but 0 means the scheduling is broken
+	uint32_t CountOrderViolations() const;
+	void WriteTimings(FILE* file) const;
+
+private:
+	std::chrono::high_resolution_clock::time_point runBegin;
+	std::atomic<uint32_t> sequence = 0;
+	JobSystem::Counter counter;
+
+	void RunNode(NodeId nodeId);
+	void ExecuteNode(NodeId nodeId);
+};
@@ -1,4 +1,5 @@
 #pragma once
+#include "AssetStreaming.h"
 #include "BufferMemory.h"
 #include "D3DUtility.h"
 #include "DescriptorHeap.h"
@@ -60,6 +61,13 @@ enum class ColorMode
 
 Texture LoadTexture(LPCWSTR filename, ID3D12Device10* device, DescriptorHeap& srvHeap, ColorMode colorMode = ColorMode::NotSpecified, bool bNoMip = false);
 
+//The stages of LoadTexture(), split for streaming. Decoding and writing only touch CPU memory and the CPU visible texture, so they may run on any thread. CreateTexture() allocates the descriptor and has to run on the render thread
+DirectX::ScratchImage DecodeTexture(LPCWSTR filename, bool bNoMip = false);
+Texture CreateTexture(ID3D12Device10* device, const DirectX::TexMetadata& metadata, DescriptorHeap& srvHeap, LPCWSTR name, ColorMode colorMode = ColorMode::NotSpecified);
+void WriteTextureData(const Texture& texture, const DirectX::ScratchImage& image);
+//Streaming version of LoadTexture(), decoding and mip generation happen on the streaming threads
+AssetStreaming::AssetHandle<Texture> LoadTextureAsync(std::wstring fileName, DescriptorHeap& srvHeap, ColorMode colorMode = ColorMode::NotSpecified, bool bNoMip = false);
+
 //Translates the depth buffer format to a suitable regular texture format.
 constexpr DXGI_FORMAT TranslateDepthBufferFormat(DXGI_FORMAT depthBufferFormat)
 {
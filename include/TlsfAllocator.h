@@ -0,0 +1,71 @@
+#pragma once
+
+//Two level segregated fit allocator for offsets into a range of a fixed size, no memory is touched. Allocation and free are O(1): free blocks are kept in
+//size class lists, the first level splits sizes by power of two, the second level splits every power of two linearly into 16 classes. Neighboring free blocks get merged on free.
+//Unlike OffsetAllocator it supports aligned allocation natively: the free space in front of an aligned allocation is split off and stays usable, so there is no alignment padding.
+//@note: mirrors the interface of OffsetAllocator::Allocator and shares its allocation handle, so both can be used interchangeably as backend of AllocatorBase
+struct TlsfAllocator
+{
+	static constexpr uint32_t secondLevelBitCount = 4;
+	static constexpr uint32_t secondLevelCount = 1u << secondLevelBitCount;
+	static constexpr uint32_t firstLevelCount = 32 - secondLevelBitCount + 1;
+	static constexpr uint32_t InvalidNode = ~0u;
+
+	struct Node
+	{
+		uint32_t offset;
+		uint32_t size;
+		uint32_t previousPhysical = InvalidNode;
+		uint32_t nextPhysical = InvalidNode;
+		uint32_t previousFree = InvalidNode;
+		uint32_t nextFree = InvalidNode; //also links unused nodes
+		bool isFree = false;
+	};
+
+	uint32_t size = 0;
+	uint32_t freeSpace = 0;
+
+	std::vector<Node> nodes;
+	uint32_t firstUnusedNode = InvalidNode;
+
+	uint32_t firstLevelMask = 0;
+	uint32_t secondLevelMasks[firstLevelCount] = {};
+	uint32_t freeLists[firstLevelCount][secondLevelCount];
+
+	TlsfAllocator() = default;
+	TlsfAllocator(uint32_t size, uint32_t reservedNodeCount = 0);
+
+	void reset();
+
+	OffsetAllocator::Allocation allocate(uint32_t size)
+	{
+		return allocateAligned(size, 1);
+	}
+
+	//the returned offset is a multiple of alignment, which needs to be a power of two
+	OffsetAllocator::Allocation allocateAligned(uint32_t size, uint32_t alignment);
+	void free(OffsetAllocator::Allocation allocation);
+
+	uint32_t allocationSize(OffsetAllocator::Allocation allocation) const
+	{
+		return nodes[allocation.metadata].size;
+	}
+
+	OffsetAllocator::StorageReport storageReport() const;
+
+	uint32_t GetNodeCount() const
+	{
+		return static_cast<uint32_t>(nodes.size());
+	}
+
+private:
+	static void MapSize(uint32_t size, uint32_t& firstLevel, uint32_t& secondLevel);
+	uint32_t FindFreeNode(uint32_t size) const;
+
+	uint32_t CreateNode(uint32_t offset, uint32_t size);
+	void ReleaseNode(uint32_t nodeIndex);
+	void InsertFreeNode(uint32_t nodeIndex);
+	void RemoveFreeNode(uint32_t nodeIndex);
+	//splits the range starting at splitOffset off into a new node, which is returned and not in any free list yet
+	uint32_t Split(uint32_t nodeIndex, uint32_t splitOffset);
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+//Upload heaps are mapped write combined: every partially written 64 byte line costs a separate bus transaction and reads are uncached.
+//The helpers below write destination memory strictly sequentially in full lines where possible and never read it back.
+
+static constexpr uint32_t writeCombiningLineSize = 64;
+
+//Copies with non temporal SSE stores once the copy is large enough to amortize the fence, otherwise falls back to memcpy
+void WriteCombinedCopy(void* destination, const void* source, size_t size);
+
+//Stages small writes and forwards them as one long sequential copy, so many tiny writes (one instance desc at a time, ...) turn into full line writes.
+//A write continuing the staged range gets appended, any other write flushes the staged range first. Writes larger than the staging buffer bypass it.
+//@note: data only reaches the destination on Flush() or destruction
+struct UploadWriter
+{
+	static constexpr uint32_t stagingSize = 4 * 1024;
+
+	uint8_t* destination;
+	size_t destinationSize;
+
+	size_t stagedOffset = 0;
+	size_t stagedSize = 0;
+	//mirrors the line alignment of the destination, so staged lines map one to one to destination lines
+	alignas(writeCombiningLineSize) uint8_t staging[stagingSize + writeCombiningLineSize];
+
+	UploadWriter(void* destination, size_t destinationSize) : destination(static_cast<uint8_t*>(destination)), destinationSize(destinationSize) {}
+
+	~UploadWriter()
+	{
+		Flush();
+	}
+
+	UploadWriter(const UploadWriter&) = delete;
+	UploadWriter& operator=(const UploadWriter&) = delete;
+
+	void Write(size_t offset, const void* source, size_t size);
+
+	template <typename T>
+	void Write(size_t offset, const T& data)
+	{
+		Write(offset, &data, sizeof(T));
+	}
+
+	void Flush();
+
+private:
+	size_t StagingLineOffset() const
+	{
+		return reinterpret_cast<uintptr_t>(destination + stagedOffset) & (writeCombiningLineSize - 1);
+	}
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+struct VirtualMemoryDesc
+{
+	uint32_t decommitDelayFrames = 120; //number of consecutive resets the usage needs to stay below the committed size before the surplus gets decommitted
+	bool useLargePages = false; //@note: large pages cannot be committed lazily, so the whole range gets committed upfront. Falls back to regular pages if not available.
+};
+
+//Reserves a contiguous range of address space once and commits pages lazily as the high-water mark of the owning allocator rises
+struct VirtualMemoryRange
+{
+	static constexpr size_t commitGranularityBytes = 64 * 1024;
+
+	uint8_t* base = nullptr;
+	size_t reservedBytes = 0;
+	size_t committedBytes = 0;
+
+	size_t highWaterMarkBytes = 0; // since last Trim()
+	size_t windowHighWaterMarkBytes = 0; // since last decommit decision
+	uint32_t framesBelowCommittedCount = 0;
+	uint32_t decommitDelayFrames = 0;
+	bool isLargePages = false;
+	bool isFallback = false; //reservation failed and range is backed by malloc instead
+
+	void Init(size_t sizeBytes, const VirtualMemoryDesc& desc = {});
+	void Destroy();
+
+	bool IsValid() const
+	{
+		return base != nullptr;
+	}
+
+	//makes sure that [0, endOffsetBytes) is backed by physical memory
+	void Commit(size_t endOffsetBytes)
+	{
+		highWaterMarkBytes = Max(highWaterMarkBytes, endOffsetBytes);
+		if (endOffsetBytes > committedBytes)
+		{
+			Grow(endOffsetBytes);
+		}
+	}
+
+	//to be called whenever the owning allocator gets reset, i.e. once per frame
+	void Trim();
+
+	void Grow(size_t endOffsetBytes);
+};
@@ -1,6 +1,7 @@
 #pragma once
+#include "../SharedDefines.h"
 
-ByteAddressBuffer globalBuffer : register(t0);
+ByteAddressBuffer globalBuffer : register(t0); //first block of the global buffer, begins with the descriptor ids of the remaining blocks
 
 //Wrapper around templateted loads / stores with offset in given in number of elements of type T instead of bytes.
 template <typename T>
@@ -45,6 +46,15 @@ struct RWBufferWithCounter
 template<typename T>
 T BufferLoad(uint bufferOffset, uint elementIndex = 0)
 {
-    return globalBuffer.Load< T > (bufferOffset + sizeof(T) * elementIndex);
-
+    const uint offset = bufferOffset + sizeof(T) * elementIndex;
+    const uint blockIndex = offset >> globalBufferBlockOffsetBitCount;
+    const uint blockOffset = offset & ((1u << globalBufferBlockOffsetBitCount) - 1);
+    
+    if (blockIndex == 0)
+    {
+        return globalBuffer.Load< T > (blockOffset);
+    }
+    
+    ByteAddressBuffer block = ResourceDescriptorHeap[NonUniformResourceIndex(globalBuffer.Load(blockIndex * 4))];
+    return block.Load< T > (blockOffset);
 }
@@ -0,0 +1,884 @@
+#include "stdafx.h"
+#include "AllocatorBenchmark.h"
+
+#include "BenchmarkHelpers.h"
+#include "BufferMemory.h"
+
+#include <deque>
+#include <thread>
+#include <unordered_map>
+
+namespace AllocatorBenchmark
+{
+	static constexpr uint32_t frameCount = 200;
+	static constexpr uint32_t allocationsPerFrame = 10000;
+	static constexpr uint32_t churnSlotCount = 4096;
+	static constexpr uint32_t churnOperationCount = 1000000;
+	static constexpr uint32_t threadCount = 8;
+	static constexpr uint32_t threadFrameCount = 50;
+	static constexpr uint32_t contentionThreadCounts[] = { 1, 2, 4, 8, 16, 32, 64 };
+	static constexpr uint32_t contentionFrameCount = 20;
+	static constexpr uint32_t poolElementSize = 64;
+	static constexpr uint32_t ringFramesInFlightCount = 2;
+
+	//keeps the compiler from removing allocations whose result is otherwise unused
+	static volatile uintptr_t sink;
+
+	//xorshift, so traces are identical across runs, compilers and platforms
+	struct Random
+	{
+		uint64_t state;
+
+		uint32_t Next()
+		{
+			state ^= state << 13;
+			state ^= state >> 7;
+			state ^= state << 17;
+			return static_cast<uint32_t>(state >> 32);
+		}
+
+		uint32_t Range(uint32_t min, uint32_t max)
+		{
+			return min + Next() % (max - min);
+		}
+	};
+
+	struct TraceEntry
+	{
+		uint32_t size;
+		uint32_t alignment;
+		uint32_t slot; //only used by churn traces
+	};
+
+	//sizes are distributed uniformly over size classes, i.e. small allocations are much more likely than large ones. Alignments are 4, 8, 16... with alignmentClassCount classes
+	static std::vector<TraceEntry> CreateTrace(uint32_t count, uint32_t sizeMinLog2, uint32_t sizeMaxLog2, uint32_t alignmentClassCount, uint64_t seed)
+	{
+		Random random = { seed };
+		std::vector<TraceEntry> trace(count);
+		for (TraceEntry& entry : trace)
+		{
+			const uint32_t sizeClass = random.Range(sizeMinLog2, sizeMaxLog2);
+			entry.size = random.Range(1u << sizeClass, 2u << sizeClass);
+			entry.alignment = 4u << random.Range(0, alignmentClassCount);
+			entry.slot = random.Range(0, churnSlotCount);
+		}
+
+		return trace;
+	}
+
+	template <typename F>
+	static Result Measure(const char* allocator, const char* trace, uint32_t threadCount, uint64_t operationCount, F&& function)
+	{
+		const auto begin = std::chrono::high_resolution_clock::now();
+		function();
+		const auto end = std::chrono::high_resolution_clock::now();
+
+		return
+		{
+			.allocator = allocator,
+			.trace = trace,
+			.threadCount = threadCount,
+			.operationCount = operationCount,
+			.totalMs = std::chrono::duration<double, std::milli>(end - begin).count()
+		};
+	}
+
+	//all allocations of a frame get released together at the end of the frame
+	static void RunFrameBurst(std::vector<Result>& results)
+	{
+		const char* traceName = "FrameBurst";
+		const std::vector<TraceEntry> trace = CreateTrace(allocationsPerFrame, 4, 10, 4, 1);
+		const uint64_t operationCount = uint64_t(frameCount) * allocationsPerFrame;
+
+		LinearAllocator linearAllocator;
+		linearAllocator.InitVirtual(64 * 1024 * 1024);
+		results.push_back(Measure("LinearAllocator", traceName, 1, operationCount, [&]()
+			{
+				for (uint32_t frame = 0; frame < frameCount; frame++)
+				{
+					for (const TraceEntry& entry : trace)
+					{
+						sink = sink ^ (uintptr_t)linearAllocator.AllocateRaw(entry.size, entry.alignment);
+					}
+					linearAllocator.Reset();
+				}
+			}));
+		linearAllocator.Destroy();
+
+		StackAllocator stackAllocator;
+		stackAllocator.InitVirtual(64 * 1024 * 1024);
+		results.push_back(Measure("StackContext", traceName, 1, operationCount, [&]()
+			{
+				for (uint32_t frame = 0; frame < frameCount; frame++)
+				{
+					StackContext context(stackAllocator);
+					for (const TraceEntry& entry : trace)
+					{
+						sink = sink ^ (uintptr_t)context.AllocateRaw(entry.size, entry.alignment);
+					}
+				}
+			}));
+		stackAllocator.Destroy();
+
+		ChunkAllocator<uint8_t*> chunkAllocator;
+		chunkAllocator.Init([](uint32_t size) { return (uint8_t*)malloc(size); }, 64 * 1024, 16);
+		results.push_back(Measure("ChunkAllocator", traceName, 1, operationCount, [&]()
+			{
+				for (uint32_t frame = 0; frame < frameCount; frame++)
+				{
+					for (const TraceEntry& entry : trace)
+					{
+						auto allocation = chunkAllocator.Allocate(entry.size + entry.alignment);
+						sink = sink ^ (uintptr_t)Align((uintptr_t)allocation.chunk + allocation.offset, entry.alignment);
+					}
+					chunkAllocator.Reset();
+				}
+			}));
+		chunkAllocator.Destroy(free);
+
+		BufferHeap bufferHeap;
+		bufferHeap.InitCpuBacked(64 * 1024 * 1024, 64 * 1024 * 1024);
+
+		ScratchHeap chunkedScratchHeap;
+		chunkedScratchHeap.Init(bufferHeap, 1024 * 1024, 10);
+		results.push_back(Measure("ScratchHeap (Chunks)", traceName, 1, operationCount, [&]()
+			{
+				for (uint32_t frame = 0; frame < frameCount; frame++)
+				{
+					for (const TraceEntry& entry : trace)
+					{
+						sink = sink ^ chunkedScratchHeap.Allocate(entry.size, entry.alignment).offset;
+					}
+					chunkedScratchHeap.Reset();
+				}
+			}));
+
+		const uint32_t ringSize = 16 * 1024 * 1024;
+		BufferHeap::Allocation ringAllocation = bufferHeap.Allocate(ringSize);
+		RingAllocator ring;
+		ring.Init(ringAllocation.offset, ringSize);
+		ScratchHeap ringScratchHeap;
+		ringScratchHeap.InitRing(bufferHeap, ring);
+		results.push_back(Measure("ScratchHeap (Ring)", traceName, 1, operationCount, [&]()
+			{
+				for (uint32_t frame = 0; frame < frameCount; frame++)
+				{
+					for (const TraceEntry& entry : trace)
+					{
+						sink = sink ^ ringScratchHeap.Allocate(entry.size, entry.alignment).offset;
+					}
+					ring.EndFrame(frame + 1);
+					if (frame + 1 >= ringFramesInFlightCount)
+					{
+						ring.Retire(frame + 1 - ringFramesInFlightCount);
+					}
+				}
+			}));
+		ringAllocation.Free();
+		bufferHeap.Destroy();
+
+		std::vector<void*> pointers(allocationsPerFrame);
+		results.push_back(Measure("malloc", traceName, 1, operationCount, [&]()
+			{
+				for (uint32_t frame = 0; frame < frameCount; frame++)
+				{
+					for (uint32_t i = 0; i < allocationsPerFrame; i++)
+					{
+						pointers[i] = _aligned_malloc(trace[i].size, trace[i].alignment);
+					}
+					for (void* ptr : pointers)
+					{
+						_aligned_free(ptr);
+					}
+				}
+			}));
+	}
+
+	//a fixed number of slots, each operation replaces the allocation of a random slot. Mixed sizes and alignments fragment the heaps over time
+	template <typename Allocation, typename AllocateFunction, typename FreeFunction>
+	static void ReplayChurn(std::span<const TraceEntry> trace, AllocateFunction&& allocateFunction, FreeFunction&& freeFunction)
+	{
+		std::vector<Allocation> slots(churnSlotCount);
+		std::vector<bool> isSlotUsed(churnSlotCount, false);
+		for (const TraceEntry& entry : trace)
+		{
+			if (isSlotUsed[entry.slot])
+			{
+				freeFunction(slots[entry.slot]);
+			}
+			slots[entry.slot] = allocateFunction(entry);
+			isSlotUsed[entry.slot] = true;
+		}
+
+		for (uint32_t i = 0; i < churnSlotCount; i++)
+		{
+			if (isSlotUsed[i])
+			{
+				freeFunction(slots[i]);
+			}
+		}
+	}
+
+	static void RunChurn(std::vector<Result>& results)
+	{
+		const char* traceName = "MixedChurn";
+		const std::vector<TraceEntry> trace = CreateTrace(churnOperationCount, 4, 16, 7, 2);
+
+		PersistentAllocator persistentAllocator;
+		persistentAllocator.Init(512 * 1024 * 1024);
+		results.push_back(Measure("PersistentAllocator", traceName, 1, churnOperationCount, [&]()
+			{
+				ReplayChurn<PersistentAllocator::Allocation>(trace,
+					[&](const TraceEntry& entry) { return persistentAllocator.Allocate(entry.size, entry.alignment); },
+					[](PersistentAllocator::Allocation& allocation) { allocation.Free(); });
+			}));
+		persistentAllocator.Destroy();
+
+		BufferHeap bufferHeap;
+		bufferHeap.InitCpuBacked(64 * 1024 * 1024, 64 * 1024 * 1024);
+		results.push_back(Measure("BufferHeap", traceName, 1, churnOperationCount, [&]()
+			{
+				ReplayChurn<BufferHeap::Allocation>(trace,
+					[&](const TraceEntry& entry) { return bufferHeap.Allocate(entry.size, entry.alignment); },
+					[](BufferHeap::Allocation& allocation) { allocation.Free(); });
+			}));
+		bufferHeap.Destroy();
+
+		results.push_back(Measure("malloc", traceName, 1, churnOperationCount, [&]()
+			{
+				ReplayChurn<void*>(trace,
+					[](const TraceEntry& entry) { return _aligned_malloc(entry.size, entry.alignment); },
+					[](void* ptr) { _aligned_free(ptr); });
+			}));
+
+		//descriptor allocations are counts of descriptors instead of bytes, mostly single descriptors and small tables
+		const char* descriptorTraceName = "DescriptorChurn";
+		const std::vector<TraceEntry> descriptorTrace = CreateTrace(churnOperationCount, 0, 4, 1, 3);
+		OffsetAllocator::Allocator descriptorAllocator(1024 * 1024);
+		results.push_back(Measure("DescriptorHeap (OffsetAllocator)", descriptorTraceName, 1, churnOperationCount, [&]()
+			{
+				ReplayChurn<OffsetAllocator::Allocation>(descriptorTrace,
+					[&](const TraceEntry& entry) { return descriptorAllocator.allocate(entry.size); },
+					[&](OffsetAllocator::Allocation allocation) { descriptorAllocator.free(allocation); });
+			}));
+	}
+
+	static void RunPoolChurn(std::vector<Result>& results)
+	{
+		const char* traceName = "PoolChurn";
+		const std::vector<TraceEntry> trace = CreateTrace(churnOperationCount, 4, 6, 1, 4);
+
+		PoolAllocator<poolElementSize> poolAllocator;
+		poolAllocator.Init(churnSlotCount + 1); //@note: the last page terminates the free list and cannot be handed out
+		results.push_back(Measure("PoolAllocator", traceName, 1, churnOperationCount, [&]()
+			{
+				ReplayChurn<void*>(trace,
+					[&](const TraceEntry&) { return poolAllocator.Allocate(); },
+					[&](void* ptr) { poolAllocator.Free(ptr); });
+			}));
+		poolAllocator.Destroy();
+
+		ConcurrentPoolAllocator<poolElementSize> concurrentPoolAllocator;
+		concurrentPoolAllocator.Init(1024, churnSlotCount);
+		results.push_back(Measure("ConcurrentPoolAllocator", traceName, 1, churnOperationCount, [&]()
+			{
+				ReplayChurn<void*>(trace,
+					[&](const TraceEntry&) { return concurrentPoolAllocator.Allocate(); },
+					[&](void* ptr) { concurrentPoolAllocator.Free(ptr); });
+			}));
+		concurrentPoolAllocator.Destroy();
+
+		results.push_back(Measure("malloc", traceName, 1, churnOperationCount, [&]()
+			{
+				ReplayChurn<void*>(trace,
+					[](const TraceEntry&) { return malloc(poolElementSize); },
+					[](void* ptr) { free(ptr); });
+			}));
+	}
+
+	template <typename F>
+	static void RunOnThreads(uint32_t threadCount, F&& function)
+	{
+		std::vector<std::thread> threads;
+		for (uint32_t threadIndex = 0; threadIndex < threadCount; threadIndex++)
+		{
+			threads.emplace_back(function, threadIndex);
+		}
+
+		for (std::thread& thread : threads)
+		{
+			thread.join();
+		}
+	}
+
+	//every thread allocates a burst per frame and releases it at the end of the frame, like jobs using per frame memory
+	static void RunMultiThreaded(std::vector<Result>& results)
+	{
+		const char* traceName = "MultiThreadedBurst";
+		const std::vector<TraceEntry> trace = CreateTrace(allocationsPerFrame, 4, 10, 4, 5);
+		const uint64_t operationCount = uint64_t(threadCount) * threadFrameCount * allocationsPerFrame;
+
+		LinearAllocator threadAllocators[threadCount];
+		for (LinearAllocator& allocator : threadAllocators)
+		{
+			allocator.InitVirtual(64 * 1024 * 1024);
+		}
+		results.push_back(Measure("LinearAllocator (per thread)", traceName, threadCount, operationCount, [&]()
+			{
+				RunOnThreads(threadCount, [&](uint32_t threadIndex)
+					{
+						LinearAllocator& allocator = threadAllocators[threadIndex];
+						for (uint32_t frame = 0; frame < threadFrameCount; frame++)
+						{
+							for (const TraceEntry& entry : trace)
+							{
+								sink = sink ^ (uintptr_t)allocator.AllocateRaw(entry.size, entry.alignment);
+							}
+							allocator.Reset();
+						}
+					});
+			}));
+		for (LinearAllocator& allocator : threadAllocators)
+		{
+			allocator.Destroy();
+		}
+
+		for (bool useMagazines : { false, true })
+		{
+			ConcurrentPoolAllocator<poolElementSize> poolAllocator;
+			poolAllocator.Init(4096, threadCount * allocationsPerFrame, useMagazines);
+			results.push_back(Measure(useMagazines ? "ConcurrentPoolAllocator (magazines)" : "ConcurrentPoolAllocator", traceName, threadCount, operationCount, [&]()
+				{
+					RunOnThreads(threadCount, [&](uint32_t)
+						{
+							std::vector<void*> pointers(allocationsPerFrame);
+							for (uint32_t frame = 0; frame < threadFrameCount; frame++)
+							{
+								for (void*& ptr : pointers)
+								{
+									ptr = poolAllocator.Allocate();
+								}
+								for (void* ptr : pointers)
+								{
+									poolAllocator.Free(ptr);
+								}
+							}
+						});
+				}));
+			poolAllocator.Destroy();
+		}
+
+		results.push_back(Measure("malloc", traceName, threadCount, operationCount, [&]()
+			{
+				RunOnThreads(threadCount, [&](uint32_t)
+					{
+						std::vector<void*> pointers(allocationsPerFrame);
+						for (uint32_t frame = 0; frame < threadFrameCount; frame++)
+						{
+							for (uint32_t i = 0; i < allocationsPerFrame; i++)
+							{
+								pointers[i] = _aligned_malloc(trace[i].size, trace[i].alignment);
+							}
+							for (void* ptr : pointers)
+							{
+								_aligned_free(ptr);
+							}
+						}
+					});
+			}));
+	}
+
+	//every thread allocates and frees pool elements in bursts, all threads share one pool. The single-threaded PoolAllocator can only be shared behind a mutex
+	static void RunContention(std::vector<Result>& results)
+	{
+		const char* traceName = "PoolContention";
+		for (const uint32_t threadCount : contentionThreadCounts)
+		{
+			const uint64_t operationCount = uint64_t(threadCount) * contentionFrameCount * allocationsPerFrame;
+			auto RunBursts = [threadCount](auto&& allocateFunction, auto&& freeFunction)
+			{
+				RunOnThreads(threadCount, [&allocateFunction, &freeFunction](uint32_t)
+					{
+						std::vector<void*> pointers(allocationsPerFrame);
+						for (uint32_t frame = 0; frame < contentionFrameCount; frame++)
+						{
+							for (void*& ptr : pointers)
+							{
+								ptr = allocateFunction();
+							}
+							for (void* ptr : pointers)
+							{
+								freeFunction(ptr);
+							}
+						}
+					});
+			};
+
+			for (bool useMagazines : { false, true })
+			{
+				ConcurrentPoolAllocator<poolElementSize> poolAllocator;
+				poolAllocator.Init(4096, threadCount * allocationsPerFrame, useMagazines);
+				results.push_back(Measure(useMagazines ? "ConcurrentPoolAllocator (magazines)" : "ConcurrentPoolAllocator", traceName, threadCount, operationCount, [&]()
+					{
+						RunBursts([&poolAllocator]() { return poolAllocator.Allocate(); }, [&poolAllocator](void* ptr) { poolAllocator.Free(ptr); });
+					}));
+				poolAllocator.Destroy();
+			}
+
+			PoolAllocator<poolElementSize> lockedPoolAllocator;
+			lockedPoolAllocator.Init(threadCount * allocationsPerFrame + 1); //@note: the last page terminates the free list and cannot be handed out
+			std::mutex poolMutex;
+			results.push_back(Measure("PoolAllocator (mutex)", traceName, threadCount, operationCount, [&]()
+				{
+					RunBursts(
+						[&lockedPoolAllocator, &poolMutex]()
+						{
+							std::lock_guard lock(poolMutex);
+							return lockedPoolAllocator.Allocate();
+						},
+						[&lockedPoolAllocator, &poolMutex](void* ptr)
+						{
+							std::lock_guard lock(poolMutex);
+							lockedPoolAllocator.Free(ptr);
+						});
+				}));
+			lockedPoolAllocator.Destroy();
+
+			results.push_back(Measure("malloc", traceName, threadCount, operationCount, [&]()
+				{
+					RunBursts([]() { return malloc(poolElementSize); }, [](void* ptr) { free(ptr); });
+				}));
+		}
+	}
+
+	struct PersistentBufferEntry
+	{
+		uint32_t size;
+		uint32_t alignment;
+		uint32_t count;
+	};
+
+	//approximation of the persistent buffers created for the default scene (sponza and sphere), sizes follow the structs in Geometry.h, ClusteredShading.h, DDGI.h, ...
+	static const PersistentBufferEntry scenePersistentBuffers[] =
+	{
+		{ 44, 4, 26 }, //PbrMesh::MaterialConstants, one buffer per mesh
+		{ 12 * 25, 4, 1 }, //PbrMesh::Submesh array of sponza
+		{ 12, 4, 1 }, //PbrMesh::Submesh array of sphere
+		{ 128, 4, 1 }, //PbrMesh::InstanceData
+		{ 64, 16, 2 }, //D3D12_RAYTRACING_INSTANCE_DESC
+		{ 20, 4, 2 }, //RaytracingInstanceGeometryData
+		{ 8, 4, 2 }, //Texture2DDimensions
+		{ 64, 4, 1 }, //ClusterData
+		{ 128, 4, 1 }, //DDGI::GpuData
+		{ 48 * 4, 4, 6 }, //ShadowedLight and transforms, per frame in flight
+		{ 256 * 1024, 4, 3 }, //blue noise tables
+	};
+
+	static constexpr uint32_t manyMaterialsMeshCount = 4000;
+
+	static std::vector<PersistentBufferEntry> CreateManyMaterialsScene()
+	{
+		Random random = { 0x3c6ef372fe94f82b };
+		std::vector<PersistentBufferEntry> entries;
+		for (uint32_t meshIndex = 0; meshIndex < manyMaterialsMeshCount; meshIndex++)
+		{
+			const uint32_t materialCount = random.Range(1, 17);
+			entries.push_back({ 44 * materialCount, 4, 1 });
+			entries.push_back({ 12 * materialCount, 4, 1 });
+			entries.push_back({ 128 * random.Range(1, 5), 4, 1 });
+			entries.push_back({ 20, 4, 1 });
+		}
+
+		return entries;
+	}
+
+	static Result MeasurePersistentBuffers(const char* trace, std::span<const PersistentBufferEntry> entries, bool useSlabs)
+	{
+		BufferHeap heap;
+		heap.InitCpuBacked(64 * 1024 * 1024, 64 * 1024 * 1024);
+		if (useSlabs)
+		{
+			heap.EnableSlabs();
+		}
+
+		uint64_t operationCount = 0;
+		for (const PersistentBufferEntry& entry : entries)
+		{
+			operationCount += entry.count;
+		}
+
+		std::vector<BufferHeap::Allocation> allocations;
+		allocations.reserve(operationCount);
+		uint64_t requestedBytes = 0;
+		Result result = Measure(useSlabs ? "BufferHeap (Slabs)" : "BufferHeap", trace, 1, operationCount, [&]()
+			{
+				for (const PersistentBufferEntry& entry : entries)
+				{
+					for (uint32_t i = 0; i < entry.count; i++)
+					{
+						allocations.push_back(heap.Allocate(entry.size, entry.alignment));
+						requestedBytes += entry.size;
+					}
+				}
+			});
+		result.requestedBytes = requestedBytes;
+
+		for (const BufferHeap::Allocation& allocation : allocations)
+		{
+			if (!allocation.IsSlabAllocation())
+			{
+				result.reservedBytes += heap.GetRawAllocator(allocation.offset).allocationSize(allocation.rawAllocation);
+				result.allocatorNodeCount++;
+			}
+		}
+		for (const BufferHeap::Slab& slab : heap.slabs)
+		{
+			result.reservedBytes += heap.GetRawAllocator(slab.memory.offset).allocationSize(slab.memory.rawAllocation);
+			result.allocatorNodeCount++;
+		}
+		result.metadataBytes = heap.GetSlabStats().metadataBytes;
+
+		for (BufferHeap::Allocation& allocation : allocations)
+		{
+			allocation.Free();
+		}
+		heap.Destroy();
+
+		return result;
+	}
+
+	static void RunPersistentBuffers(std::vector<Result>& results)
+	{
+		const std::vector<PersistentBufferEntry> manyMaterialsScene = CreateManyMaterialsScene();
+		for (const bool useSlabs : { false, true })
+		{
+			results.push_back(MeasurePersistentBuffers("PersistentBuffers (Scene)", scenePersistentBuffers, useSlabs));
+			results.push_back(MeasurePersistentBuffers("PersistentBuffers (ManyMaterials)", manyMaterialsScene, useSlabs));
+		}
+	}
+
+	//Backend traces: every operation either allocates into a slot or frees it. Recorded traces may hold several allocators of the same kind, every one gets a backend of its own
+	struct BackendOperation
+	{
+		uint32_t instance;
+		uint32_t slot;
+		uint32_t size; //0 frees the slot
+		uint32_t alignment;
+	};
+
+	struct BackendTrace
+	{
+		std::vector<BackendOperation> operations;
+		uint32_t instanceCount = 1;
+		uint32_t slotCount = 0;
+		uint32_t rangeSize;
+	};
+
+	static constexpr uint32_t backendByteRangeSize = 1u << 30;
+	static constexpr uint32_t backendDescriptorRangeSize = 1024 * 1024;
+	//OffsetAllocator preallocates its nodes and free list for maxAllocs (default 128K) allocations, 32 bytes each
+	static constexpr uint64_t offsetAllocatorMetadataBytes = 128 * 1024 * 32;
+
+	//alignment 0 keeps the alignment of the churn trace
+	static BackendTrace CreateBackendTrace(std::span<const TraceEntry> churnTrace, uint32_t rangeSize, uint32_t alignment = 0)
+	{
+		BackendTrace trace = { .slotCount = churnSlotCount, .rangeSize = rangeSize };
+		std::vector<bool> isSlotUsed(churnSlotCount, false);
+		for (const TraceEntry& entry : churnTrace)
+		{
+			if (isSlotUsed[entry.slot])
+			{
+				trace.operations.push_back({ .instance = 0, .slot = entry.slot, .size = 0 });
+			}
+			trace.operations.push_back({ .instance = 0, .slot = entry.slot, .size = entry.size, .alignment = alignment > 0 ? alignment : entry.alignment });
+			isSlotUsed[entry.slot] = true;
+		}
+
+		return trace;
+	}
+
+	//frees of allocations made before the recording started are dropped
+	static BackendTrace CreateBackendTrace(std::span<const MemoryTelemetry::TraceEvent> events, MemoryTelemetry::Heap heap, uint32_t rangeSize)
+	{
+		BackendTrace trace = { .instanceCount = 0, .rangeSize = rangeSize };
+		std::unordered_map<uint64_t, uint32_t> instances;
+		std::unordered_map<uint64_t, uint32_t> liveSlots; //instance and offset to slot
+		std::vector<uint32_t> freeSlots;
+		for (const MemoryTelemetry::TraceEvent& event : events)
+		{
+			if (event.heap != heap)
+			{
+				continue;
+			}
+
+			const uint32_t instance = instances.try_emplace(event.allocatorId, static_cast<uint32_t>(instances.size())).first->second;
+			const uint64_t key = (uint64_t(instance) << 32) | event.offset;
+			if (event.size == 0)
+			{
+				auto it = liveSlots.find(key);
+				if (it != liveSlots.end())
+				{
+					trace.operations.push_back({ .instance = instance, .slot = it->second, .size = 0 });
+					freeSlots.push_back(it->second);
+					liveSlots.erase(it);
+				}
+				continue;
+			}
+
+			uint32_t slot = trace.slotCount;
+			if (!freeSlots.empty())
+			{
+				slot = freeSlots.back();
+				freeSlots.pop_back();
+			}
+			else
+			{
+				trace.slotCount++;
+			}
+			liveSlots[key] = slot;
+			trace.operations.push_back({ .instance = instance, .slot = slot, .size = event.size, .alignment = Max(event.alignment, 1u) });
+		}
+		trace.instanceCount = static_cast<uint32_t>(instances.size());
+
+		return trace;
+	}
+
+	template <typename Backend>
+	static uint64_t GetBackendMetadataBytes(const Backend& backend)
+	{
+		if constexpr (std::is_same_v<Backend, TlsfAllocatorBackend>)
+		{
+			return sizeof(TlsfAllocator) + backend.nodes.capacity() * sizeof(TlsfAllocator::Node);
+		}
+		else
+		{
+			return offsetAllocatorMetadataBytes;
+		}
+	}
+
+	//timed replay first, then an untimed one which tracks the footprint
+	template <typename Backend>
+	static Result MeasureBackend(const char* backendName, const char* traceName, const BackendTrace& trace)
+	{
+		std::vector<OffsetAllocator::Allocation> slots(trace.slotCount);
+
+		std::deque<Backend> backends;
+		for (uint32_t instance = 0; instance < trace.instanceCount; instance++)
+		{
+			backends.emplace_back(trace.rangeSize);
+		}
+		Result result = Measure(backendName, traceName, 1, trace.operations.size(), [&]()
+			{
+				for (const BackendOperation& operation : trace.operations)
+				{
+					if (operation.size == 0)
+					{
+						if (slots[operation.slot].offset != OffsetAllocator::Allocation::NO_SPACE)
+						{
+							backends[operation.instance].free(slots[operation.slot]);
+						}
+					}
+					else
+					{
+						slots[operation.slot] = backends[operation.instance].allocateAligned(operation.size, operation.alignment);
+					}
+				}
+			});
+
+		backends.clear();
+		for (uint32_t instance = 0; instance < trace.instanceCount; instance++)
+		{
+			backends.emplace_back(trace.rangeSize);
+		}
+		std::vector<uint32_t> slotSizes(trace.slotCount);
+		std::vector<uint64_t> reservedBytes(trace.instanceCount, 0);
+		std::vector<uint64_t> highWaterBytes(trace.instanceCount, 0);
+		uint64_t liveRequestedBytes = 0;
+		uint64_t liveReservedBytes = 0;
+		for (const BackendOperation& operation : trace.operations)
+		{
+			Backend& backend = backends[operation.instance];
+			OffsetAllocator::Allocation& allocation = slots[operation.slot];
+			if (operation.size == 0)
+			{
+				if (allocation.offset != OffsetAllocator::Allocation::NO_SPACE)
+				{
+					liveRequestedBytes -= slotSizes[operation.slot];
+					liveReservedBytes -= backend.allocationSize(allocation);
+					reservedBytes[operation.instance] -= backend.allocationSize(allocation);
+					backend.free(allocation);
+				}
+				continue;
+			}
+
+			allocation = backend.allocateAligned(operation.size, operation.alignment);
+			if (allocation.offset == OffsetAllocator::Allocation::NO_SPACE)
+			{
+				continue;
+			}
+
+			const uint32_t allocationSize = backend.allocationSize(allocation);
+			slotSizes[operation.slot] = operation.size;
+			liveRequestedBytes += operation.size;
+			liveReservedBytes += allocationSize;
+			reservedBytes[operation.instance] += allocationSize;
+			highWaterBytes[operation.instance] = Max(highWaterBytes[operation.instance], uint64_t(allocation.offset) + allocationSize);
+			result.requestedBytes = Max(result.requestedBytes, liveRequestedBytes);
+			result.reservedBytes = Max(result.reservedBytes, liveReservedBytes);
+		}
+
+		uint64_t freeBytesBelowHighWater = 0;
+		for (uint32_t instance = 0; instance < trace.instanceCount; instance++)
+		{
+			result.highWaterBytes += highWaterBytes[instance];
+			freeBytesBelowHighWater += highWaterBytes[instance] - reservedBytes[instance];
+			result.metadataBytes += GetBackendMetadataBytes(backends[instance]);
+			if constexpr (std::is_same_v<Backend, TlsfAllocatorBackend>)
+			{
+				result.allocatorNodeCount += backends[instance].GetNodeCount();
+			}
+		}
+		result.fragmentation = result.highWaterBytes > 0 ? double(freeBytesBelowHighWater) / result.highWaterBytes : 0.0;
+
+		return result;
+	}
+
+	static void MeasureBackends(std::vector<Result>& results, const char* traceName, const BackendTrace& trace)
+	{
+		if (trace.operations.empty())
+		{
+			return;
+		}
+
+		results.push_back(MeasureBackend<OffsetAllocatorBackend>("OffsetAllocator", traceName, trace));
+		results.push_back(MeasureBackend<TlsfAllocatorBackend>("TLSF", traceName, trace));
+	}
+
+	static void RunBackends(std::vector<Result>& results)
+	{
+		MeasureBackends(results, "Backend MixedChurn", CreateBackendTrace(CreateTrace(churnOperationCount, 4, 16, 7, 2), backendByteRangeSize));
+		//resources placed with up to 64 KB alignment next to small buffers
+		MeasureBackends(results, "Backend PlacementChurn", CreateBackendTrace(CreateTrace(churnOperationCount, 8, 18, 15, 6), backendByteRangeSize));
+		MeasureBackends(results, "Backend DescriptorChurn", CreateBackendTrace(CreateTrace(churnOperationCount, 0, 4, 1, 3), backendDescriptorRangeSize, 1));
+
+		const std::vector<MemoryTelemetry::TraceEvent> events = MemoryTelemetry::ReadAllocationTrace(allocationTraceFilePath);
+		static const char* recordedTraceNames[] = { "Recorded GlobalBuffer", "Recorded PersistentAllocator", "Recorded DescriptorHeap" };
+		static const MemoryTelemetry::Heap recordedHeaps[] = { MemoryTelemetry::Heap::GlobalBuffer, MemoryTelemetry::Heap::PersistentAllocator, MemoryTelemetry::Heap::DescriptorHeap };
+		for (uint32_t i = 0; i < std::size(recordedHeaps); i++)
+		{
+			const uint32_t rangeSize = recordedHeaps[i] == MemoryTelemetry::Heap::DescriptorHeap ? backendDescriptorRangeSize : backendByteRangeSize;
+			MeasureBackends(results, recordedTraceNames[i], CreateBackendTrace(events, recordedHeaps[i], rangeSize));
+		}
+	}
+
+	static constexpr uint32_t uploadRepeatCount = 20;
+	static constexpr uint32_t uploadSmallWriteSize = 48; //not a multiple of the line size, so plain copies keep splitting lines
+	static constexpr uint32_t uploadSmallWriteCount = 64 * 1024;
+	static constexpr uint32_t uploadBulkSize = 16 * 1024 * 1024;
+
+	//Same copies into regular cached memory and into write combined memory, which behaves like a mapped upload heap
+	static void RunUploads(std::vector<Result>& results)
+	{
+		const size_t destinationSize = Max(uploadSmallWriteSize * uploadSmallWriteCount, uploadBulkSize);
+		std::vector<uint8_t> source(destinationSize, 0xab);
+
+		for (const bool isWriteCombined : { false, true })
+		{
+			const char* smallTraceName = isWriteCombined ? "SmallUploads (WriteCombined)" : "SmallUploads (Cached)";
+			const char* bulkTraceName = isWriteCombined ? "BulkUpload (WriteCombined)" : "BulkUpload (Cached)";
+
+			uint8_t* destination = static_cast<uint8_t*>(VirtualAlloc(nullptr, destinationSize, MEM_RESERVE | MEM_COMMIT, isWriteCombined ? PAGE_READWRITE | PAGE_WRITECOMBINE : PAGE_READWRITE));
+			if (!destination)
+			{
+				continue;
+			}
+
+			const uint64_t smallOperationCount = uint64_t(uploadRepeatCount) * uploadSmallWriteCount;
+			results.push_back(Measure("memcpy", smallTraceName, 1, smallOperationCount, [&]()
+				{
+					for (uint32_t repeatIndex = 0; repeatIndex < uploadRepeatCount; repeatIndex++)
+					{
+						for (uint32_t writeIndex = 0; writeIndex < uploadSmallWriteCount; writeIndex++)
+						{
+							const size_t offset = size_t(writeIndex) * uploadSmallWriteSize;
+							std::memcpy(destination + offset, source.data() + offset, uploadSmallWriteSize);
+						}
+					}
+				}));
+
+			results.push_back(Measure("UploadWriter", smallTraceName, 1, smallOperationCount, [&]()
+				{
+					for (uint32_t repeatIndex = 0; repeatIndex < uploadRepeatCount; repeatIndex++)
+					{
+						UploadWriter writer(destination, destinationSize);
+						for (uint32_t writeIndex = 0; writeIndex < uploadSmallWriteCount; writeIndex++)
+						{
+							const size_t offset = size_t(writeIndex) * uploadSmallWriteSize;
+							writer.Write(offset, source.data() + offset, uploadSmallWriteSize);
+						}
+					}
+				}));
+
+			//one operation per 64 byte line
+			const uint64_t bulkOperationCount = uint64_t(uploadRepeatCount) * uploadBulkSize / writeCombiningLineSize;
+			results.push_back(Measure("memcpy", bulkTraceName, 1, bulkOperationCount, [&]()
+				{
+					for (uint32_t repeatIndex = 0; repeatIndex < uploadRepeatCount; repeatIndex++)
+					{
+						std::memcpy(destination, source.data(), uploadBulkSize);
+					}
+				}));
+
+			results.push_back(Measure("WriteCombinedCopy", bulkTraceName, 1, bulkOperationCount, [&]()
+				{
+					for (uint32_t repeatIndex = 0; repeatIndex < uploadRepeatCount; repeatIndex++)
+					{
+						WriteCombinedCopy(destination, source.data(), uploadBulkSize);
+					}
+				}));
+
+			VirtualFree(destination, 0, MEM_RELEASE);
+		}
+	}
+
+	std::vector<Result> Run()
+	{
+		std::vector<Result> results;
+		RunFrameBurst(results);
+		RunChurn(results);
+		RunPoolChurn(results);
+		RunMultiThreaded(results);
+		RunContention(results);
+		RunUploads(results);
+		RunPersistentBuffers(results);
+		RunBackends(results);
+
+		return results;
+	}
+
+	void WriteCsv(FILE* file, std::span<const Result> results)
+	{
+		fprintf(file, "allocator,trace,threads,operations,total_ms,ns_per_operation,requested_bytes,reserved_bytes,allocator_nodes,metadata_bytes,high_water_bytes,fragmentation\n");
+		for (const Result& result : results)
+		{
+			fprintf(file, "%s,%s,%u,%llu,%.3f,%.2f,%llu,%llu,%llu,%llu,%llu,%.4f\n",
+				result.allocator,
+				result.trace,
+				result.threadCount,
+				result.operationCount,
+				result.totalMs,
+				result.totalMs * 1e6 / result.operationCount,
+				result.requestedBytes,
+				result.reservedBytes,
+				result.allocatorNodeCount,
+				result.metadataBytes,
+				result.highWaterBytes,
+				result.fragmentation);
+		}
+	}
+
+	bool RunAndWriteCsv(const char* filePath)
+	{
+		return Benchmark::WriteCsvFile(filePath, Run(), WriteCsv);
+	}
+}
@@ -5,15 +5,17 @@
 #include "BufferMemory.h"
 #include "CubeMap.h"
 #include "Geometry.h"
+#include "Input.h"
 #include "Texture.h"
 
 namespace App
 {
-	static std::vector<const PbrMesh*> opaqueMeshes;
-	static std::vector<const PbrMesh*> shadowCasters;
+	//fixed arrays, so the spans handed out by Simulate() do not need any heap memory. They are only written in Init(), the render thread may read them any time
+	static const PbrMesh* opaqueMeshes[2];
+	static const PbrMesh* shadowCasters[2];
 	static PersistentBuffer<Camera::Constants> cubeMapsCameraData;
 
-	static PbrMesh meshSponza;
+	static AssetStreaming::AssetHandle<PbrMesh> meshSponza; //streamed, only rendered once it is published
 	static PbrMesh meshSphere;
 	static Texture textureSkybox;
 
@@ -23,8 +25,6 @@ namespace App
 	static const int unshadowedPointLightsCount = 2 * 1024;
 	static Light unshadowedPointLights[unshadowedPointLightsCount] = {};
 
-	Light directionalLights[renderSettings.directionalLightsMaxCount];
-
 	static UIContext uiContext{};
 
 	void Init(ID3D12Device10* device,
@@ -37,13 +37,14 @@ namespace App
 		menu = &uiContext;
 		textureSkybox = LoadTexture(L"content\\textures\\skybox.dds", device, descriptorHeap);
 
-		meshSponza = LoadMesh(device, allocator, descriptorHeap, bufferHeap, L"content\\geometry\\sponza2.obj");
+		meshSponza = LoadMeshAsync(allocator, descriptorHeap, bufferHeap, L"content\\geometry\\sponza2.obj");
 
 		meshSphere = LoadMesh(device, allocator, descriptorHeap, bufferHeap, L"content\\geometry\\sphere.obj");
 		SetMaterial(meshSphere, { .metallic = 1.0f, .roughness = 0.0f, .specularCubeMapsArrayIndex = 0 });
 
-		opaqueMeshes = { &meshSponza, &meshSphere };
-		shadowCasters = opaqueMeshes;
+		//the address of a streamed mesh is fixed from the start, only the count of the spans depends on it being published
+		opaqueMeshes[0] = shadowCasters[0] = &meshSphere;
+		opaqueMeshes[1] = shadowCasters[1] = &meshSponza.Get();
 
 		for (int i = 0; i < shadowedPointLightsCount; i++)
 		{
@@ -94,26 +95,40 @@ namespace App
 
 		UpdateCubeMapCameraData(bufferHeap, cubeMapsCameraData.offset, { 0, sphereY, 0 } );
 
-		meshSponza.BuildBlas(device, commandList,scratchBuffer);
+		RegisterRelocatable(meshSphere);
+
 		meshSphere.BuildBlas(device, commandList, scratchBuffer);
 	}
 
-	RenderData Update(LinearAllocator& frameAllocator, const Frame::TimingData& timingData)
+	RenderData Simulate(LinearAllocator& snapshotArena, const Frame::TimingData& timingData)
 	{
-		uint32_t activeDirectionalLightsCount = uiContext.lightSettings.ReadDirectionalLightData(directionalLights);
+		//the render thread may still read the lights of an earlier snapshot, so they live in the snapshot as well
+		Light* directionalLights = snapshotArena.Allocate<Light>(renderSettings.directionalLightsMaxCount);
+		uint32_t activeDirectionalLightsCount = 0;
+		{
+			std::lock_guard lock(uiContext.mutex);
+			activeDirectionalLightsCount = uiContext.lightSettings.ReadDirectionalLightData(directionalLights);
+		}
 		assert(activeDirectionalLightsCount <= directionalLightsMaxCount);
 
 		const float elapsedTime = static_cast<float>(timingData.elapsedTimeMs);
 
-		Camera::Transform cameraTransform = ProcessInput(timingData.deltaTimeMs, !UI::mouseOverUI);
+		float mouseDeltaX, mouseDeltaY;
+		Input::ConsumeMouseDelta(mouseDeltaX, mouseDeltaY);
+		Camera::Transform cameraTransform = ProcessInput(timingData.deltaTimeMs, mouseDeltaX, mouseDeltaY, !UI::mouseOverUI);
 
 		const float sphereX = 0 * 4 * std::sin(elapsedTime *  2.5e-3f) + 4.5f;
 		const DirectX::XMMATRIX sphereTransform = DirectX::XMMatrixTranslation(sphereX, 1.0f, 0);
-		DirectX::XMFLOAT4X4 transform, inverseTransform;
-		DirectX::XMStoreFloat4x4(&transform, DirectX::XMMatrixTranspose(sphereTransform));
-		DirectX::XMStoreFloat4x4(&inverseTransform, DirectX::XMMatrixTranspose(DirectX::XMMatrixInverse(nullptr, sphereTransform)));
-		SetTemporaryInstanceData(meshSponza, Frame::current->cpuMemory, Frame::current->gpuMemory, { { PbrMesh::InstanceDataDefault } });
-		SetTemporaryInstanceData(meshSphere, Frame::current->cpuMemory, Frame::current->gpuMemory, { { PbrMesh::InstanceData{ transform, inverseTransform } } });
+		PbrMesh::InstanceData* instanceData = snapshotArena.AllocateUninitialized<PbrMesh::InstanceData>(2);
+		DirectX::XMStoreFloat4x4(&instanceData[0].transforms, DirectX::XMMatrixTranspose(sphereTransform));
+		DirectX::XMStoreFloat4x4(&instanceData[0].inverseTransposeTransform, DirectX::XMMatrixTranspose(DirectX::XMMatrixInverse(nullptr, sphereTransform)));
+		instanceData[1] = PbrMesh::InstanceDataDefault;
+
+		//the meshes at the end of the arrays are left out until they are published
+		const uint32_t meshCount = meshSponza.IsReady() ? 2 : 1;
+		InstanceDataUpdate* instanceDataUpdates = snapshotArena.AllocateUninitialized<InstanceDataUpdate>(2);
+		instanceDataUpdates[0] = { .mesh = &meshSphere, .instanceData = { &instanceData[0], 1 } };
+		instanceDataUpdates[1] = { .mesh = &meshSponza.Get(), .instanceData = { &instanceData[1], 1 } };
 
 #if 0 //dynamic shadowed point lights
 		srand(0);
@@ -134,7 +149,7 @@ namespace App
 		// dynamic unshadowed point lights
 		srand(0);
 		const uint32_t dynamicPointLightsCount = 0 * 2 * 1024;
-		Light* dynamicPointLights = frameAllocator.Allocate<Light>(dynamicPointLightsCount);
+		Light* dynamicPointLights = snapshotArena.Allocate<Light>(dynamicPointLightsCount);
 		for (int i = 0; i < dynamicPointLightsCount; i++)
 		{
 			dynamicPointLights[i] =
@@ -148,17 +163,18 @@ namespace App
 			};
 		}
 
-		DirectX::XMFLOAT3* cubeMapPositions = frameAllocator.Allocate<DirectX::XMFLOAT3>(1);
+		DirectX::XMFLOAT3* cubeMapPositions = snapshotArena.Allocate<DirectX::XMFLOAT3>(1);
 		cubeMapPositions[0] = { sphereX, 0.0f, 0.0f };
 		return RenderData
 		{
 			.cameraTransform = cameraTransform,
-			.opaqueMeshes = opaqueMeshes,
-			.shadowCasters = shadowCasters,
+			.opaqueMeshes = { opaqueMeshes, meshCount },
+			.shadowCasters = { shadowCasters, meshCount },
 			.directionalLights = { directionalLights, activeDirectionalLightsCount },
 			.pointLights = { dynamicPointLights, dynamicPointLightsCount },
 			//.pointLights = { unshadowedPointLights, _countof(unshadowedPointLights)},
 			.shadowedPointLights =  shadowedPointLights,
+			.instanceDataUpdates = { instanceDataUpdates, meshCount },
 			.activeCubeMapsCount = 1,
 			.cubeMapsTransformsOffset = cubeMapsCameraData.offset,
 			.skyBoxSrvId = textureSkybox.srvId,
@@ -5,6 +5,7 @@ namespace App
 {
 	void UIContext::Update()
 	{
+		std::lock_guard lock(mutex);
 		lightSettings.MenuEntry();
 	}
 
@@ -58,6 +59,7 @@ namespace App
 
 	void UIContext::MenuEntry()
 	{
+		std::lock_guard lock(mutex);
 		lightSettings.MenuEntry();
 	}
 }
\ No newline at end of file
@@ -0,0 +1,156 @@
+#include "stdafx.h"
+#include "AssetStreaming.h"
+
+#include "Frame.h"
+
+#include <deque>
+
+namespace AssetStreaming
+{
+	static std::vector<std::thread> threads;
+	static std::mutex mutex;
+	static std::condition_variable workAvailable;
+	static std::deque<std::coroutine_handle<>> streamingQueue;
+	static std::vector<std::coroutine_handle<>> renderThreadQueue;
+	static std::vector<std::coroutine_handle<>> renderThreadQueueSwap; //only touched by the render thread, keeps its capacity between frames
+	static bool isRunning = false;
+
+	static std::atomic<uint32_t> inFlightCount = 0;
+
+	static RenderThreadContext renderThreadContext;
+	static thread_local bool isInRenderThreadUpdate = false;
+
+	Task::promise_type::promise_type()
+	{
+		inFlightCount.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	Task::promise_type::~promise_type()
+	{
+		inFlightCount.fetch_sub(1, std::memory_order_relaxed);
+	}
+
+	static void StreamingThreadMain()
+	{
+		//WIC decoding needs COM on the calling thread
+		CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+
+		StackAllocator stackAllocator;
+		stackAllocator.InitVirtual(Frame::workerStackMemoryReservedSize);
+		D3D::threadStackAllocator = &stackAllocator;
+
+		std::unique_lock lock(mutex);
+		while (true)
+		{
+			workAvailable.wait(lock, []() { return !streamingQueue.empty() || !isRunning; });
+			if (streamingQueue.empty())
+			{
+				break;
+			}
+
+			std::coroutine_handle<> handle = streamingQueue.front();
+			streamingQueue.pop_front();
+			lock.unlock();
+			handle.resume();
+			lock.lock();
+		}
+		lock.unlock();
+
+		D3D::threadStackAllocator = nullptr;
+		stackAllocator.Destroy();
+		CoUninitialize();
+	}
+
+	void Init(const Desc& desc)
+	{
+		assert(!isRunning);
+		const uint32_t hardwareThreadCount = Max(std::thread::hardware_concurrency(), 2u);
+		const uint32_t threadCount = desc.threadCount > 0 ? desc.threadCount : hardwareThreadCount - 1;
+
+		isRunning = true;
+		threads.reserve(threadCount);
+		for (uint32_t i = 0; i < threadCount; i++)
+		{
+			threads.emplace_back(StreamingThreadMain);
+		}
+	}
+
+	void Shutdown()
+	{
+		{
+			std::lock_guard lock(mutex);
+			if (!isRunning)
+			{
+				return;
+			}
+			isRunning = false;
+		}
+		workAvailable.notify_all();
+		for (std::thread& thread : threads)
+		{
+			thread.join();
+		}
+		threads.clear();
+
+		for (std::coroutine_handle<> handle : renderThreadQueue)
+		{
+			handle.destroy();
+		}
+		renderThreadQueue.clear();
+	}
+
+	void Update(const RenderThreadContext& context)
+	{
+		{
+			std::lock_guard lock(mutex);
+			renderThreadQueueSwap.swap(renderThreadQueue);
+		}
+
+		renderThreadContext = context;
+		isInRenderThreadUpdate = true;
+		for (std::coroutine_handle<> handle : renderThreadQueueSwap)
+		{
+			handle.resume();
+		}
+		isInRenderThreadUpdate = false;
+		renderThreadContext = {};
+		renderThreadQueueSwap.clear();
+	}
+
+	uint32_t GetInFlightCount()
+	{
+		return inFlightCount.load(std::memory_order_relaxed);
+	}
+
+	uint32_t GetThreadCount()
+	{
+		return static_cast<uint32_t>(threads.size());
+	}
+
+	void ScheduleOnStreamingThread(std::coroutine_handle<> handle)
+	{
+		{
+			std::lock_guard lock(mutex);
+			assert(!threads.empty()); //during Shutdown() the streaming threads still drain the queue
+			streamingQueue.push_back(handle);
+		}
+		workAvailable.notify_one();
+	}
+
+	void ScheduleOnRenderThread(std::coroutine_handle<> handle)
+	{
+		std::lock_guard lock(mutex);
+		renderThreadQueue.push_back(handle);
+	}
+
+	bool IsInRenderThreadUpdate()
+	{
+		return isInRenderThreadUpdate;
+	}
+
+	const RenderThreadContext& GetRenderThreadContext()
+	{
+		assert(isInRenderThreadUpdate);
+		return renderThreadContext;
+	}
+}
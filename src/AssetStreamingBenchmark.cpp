@@ -0,0 +1,182 @@
+#include "stdafx.h"
+#include "AssetStreamingBenchmark.h"
+
+#include "AssetStreaming.h"
+#include "BenchmarkHelpers.h"
+#include "Geometry.h"
+#include "Texture.h"
+
+#include <thread>
+
+namespace AssetStreamingBenchmark
+{
+	static constexpr uint32_t repetitionCount = 3;
+	static constexpr uint32_t meshLoadCount = 4; //every mesh file gets loaded this many times, so there is something to distribute besides the largest file
+	static const wchar_t* sponzaFileName = L"content\\geometry\\sponza2.obj";
+	static const wchar_t* meshFileNames[] = { sponzaFileName, L"content\\geometry\\sphere.obj" };
+
+	//items not finished yet, the calling thread waits for it to reach zero
+	static std::atomic<uint32_t> pendingCount = 0;
+
+	static void FinishItem()
+	{
+		if (pendingCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			pendingCount.notify_all();
+		}
+	}
+
+	static void WaitForItems()
+	{
+		for (uint32_t count = pendingCount.load(std::memory_order_acquire); count != 0; count = pendingCount.load(std::memory_order_acquire))
+		{
+			pendingCount.wait(count, std::memory_order_acquire);
+		}
+	}
+
+	//the CPU stages of LoadMeshAsync() and LoadTextureAsync(), without the render thread parts
+	static AssetStreaming::Task LoadMeshItem(std::wstring fileName)
+	{
+		co_await AssetStreaming::ResumeOnStreamingThread();
+		const rapidobj::Result model = rapidobj::ParseFile(fileName);
+		{
+			StackContext stackContext;
+			BuildGeometryData(stackContext, model);
+		}
+		FinishItem();
+	}
+
+	static AssetStreaming::Task LoadTextureItem(std::wstring fileName)
+	{
+		co_await AssetStreaming::ResumeOnStreamingThread();
+		DecodeTexture(fileName.c_str());
+		FinishItem();
+	}
+
+	static std::vector<std::wstring> CollectTextureFileNames(const wchar_t* meshFileName)
+	{
+		const rapidobj::Result model = rapidobj::ParseFile(meshFileName);
+		std::vector<std::string> names;
+		for (const rapidobj::Material& material : model.materials)
+		{
+			for (const std::string* name : { &material.diffuse_texname, &material.bump_texname, &material.roughness_texname, &material.metallic_texname })
+			{
+				if (!name->empty())
+				{
+					names.push_back(*name);
+				}
+			}
+		}
+		std::sort(names.begin(), names.end());
+		names.erase(std::unique(names.begin(), names.end()), names.end());
+
+		std::vector<std::wstring> result;
+		for (const std::string& name : names)
+		{
+			result.push_back(AnsiToWString(name.c_str()));
+		}
+		return result;
+	}
+
+	static uint64_t GetTotalFileSize(std::span<const std::wstring> fileNames)
+	{
+		uint64_t totalSizeBytes = 0;
+		for (const std::wstring& fileName : fileNames)
+		{
+			std::error_code error;
+			const uintmax_t sizeBytes = std::filesystem::file_size(fileName, error);
+			totalSizeBytes += error ? 0 : sizeBytes;
+		}
+		return totalSizeBytes;
+	}
+
+	static void LoadAll(std::span<const std::wstring> meshFiles, std::span<const std::wstring> textureFiles)
+	{
+		pendingCount.store(static_cast<uint32_t>(meshFiles.size() + textureFiles.size()), std::memory_order_relaxed);
+		for (const std::wstring& fileName : meshFiles)
+		{
+			LoadMeshItem(fileName);
+		}
+		for (const std::wstring& fileName : textureFiles)
+		{
+			LoadTextureItem(fileName);
+		}
+		WaitForItems();
+	}
+
+	std::vector<Result> Run(uint32_t maxThreadCount)
+	{
+		maxThreadCount = maxThreadCount > 0 ? maxThreadCount : Max(std::thread::hardware_concurrency(), 1u);
+
+		std::vector<std::wstring> meshFiles;
+		for (uint32_t i = 0; i < meshLoadCount; i++)
+		{
+			meshFiles.insert(meshFiles.end(), std::begin(meshFileNames), std::end(meshFileNames));
+		}
+		const std::vector<std::wstring> textureFiles = CollectTextureFileNames(sponzaFileName);
+		const std::vector<std::wstring> sponzaFiles = { sponzaFileName };
+
+		struct Workload
+		{
+			const char* name;
+			std::span<const std::wstring> meshFiles;
+			std::span<const std::wstring> textureFiles;
+		};
+
+		const Workload workloads[] =
+		{
+			{ "Parse and build geometry", meshFiles, {} },
+			{ "Decode textures and generate mips", {}, textureFiles },
+			{ "Sponza (mesh and textures)", sponzaFiles, textureFiles },
+		};
+
+		std::vector<Result> results;
+		for (const Workload& workload : workloads)
+		{
+			const uint64_t inputSizeBytes = GetTotalFileSize(workload.meshFiles) + GetTotalFileSize(workload.textureFiles);
+			double singleThreadMs = 0.0;
+			for (uint32_t threadCount = 1; threadCount <= maxThreadCount; threadCount++)
+			{
+				AssetStreaming::Init({ .threadCount = threadCount });
+				const double totalMs = Benchmark::MeasureBest([&workload]() { LoadAll(workload.meshFiles, workload.textureFiles); }, repetitionCount);
+				AssetStreaming::Shutdown();
+
+				singleThreadMs = threadCount == 1 ? totalMs : singleThreadMs;
+				results.push_back(
+					{
+						.workload = workload.name,
+						.threadCount = threadCount,
+						.itemCount = workload.meshFiles.size() + workload.textureFiles.size(),
+						.inputSizeBytes = inputSizeBytes,
+						.totalMs = totalMs,
+						.speedup = singleThreadMs / totalMs
+					});
+			}
+		}
+
+		return results;
+	}
+
+	void WriteCsv(FILE* file, std::span<const Result> results)
+	{
+		fprintf(file, "workload,threads,items,input_mb,total_ms,items_per_s,mb_per_s,speedup\n");
+		for (const Result& result : results)
+		{
+			const double inputMB = result.inputSizeBytes / (1024.0 * 1024.0);
+			fprintf(file, "%s,%u,%llu,%.2f,%.3f,%.2f,%.2f,%.2f\n",
+				result.workload,
+				result.threadCount,
+				result.itemCount,
+				inputMB,
+				result.totalMs,
+				result.itemCount * 1e3 / result.totalMs,
+				inputMB * 1e3 / result.totalMs,
+				result.speedup);
+		}
+	}
+
+	bool RunAndWriteCsv(const char* filePath, uint32_t maxThreadCount)
+	{
+		return Benchmark::WriteCsvFile(filePath, Run(maxThreadCount), WriteCsv);
+	}
+}
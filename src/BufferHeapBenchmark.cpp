@@ -0,0 +1,212 @@
+#include "stdafx.h"
+#include "BufferHeapBenchmark.h"
+
+#include "BenchmarkHelpers.h"
+#include "BufferMemory.h"
+
+namespace BufferHeapBenchmark
+{
+	static constexpr uint32_t smallBlockSize = 256 * 1024;
+	static constexpr uint32_t allocationMaxSize = 4096;
+	static constexpr uint32_t alignmentClassCount = 5; //4 to 64 bytes
+
+	struct Workload
+	{
+		const char* name;
+		uint32_t initialBlockSize;
+		uint32_t growBlockSize;
+		uint32_t oversizedInterval; //every n-th allocation is larger than a grown block and gets a block of its own, 0 for none
+	};
+
+	//deterministic, so every run and build checks the same layout
+	static uint32_t GetSize(uint32_t index)
+	{
+		return 4 + (index * 2654435761u >> 16) % allocationMaxSize;
+	}
+
+	static uint32_t GetAlignment(uint32_t index)
+	{
+		return 4u << (index % alignmentClassCount);
+	}
+
+	static uint8_t GetPattern(uint32_t allocationIndex, uint32_t byteIndex)
+	{
+		return static_cast<uint8_t>(allocationIndex * 31 + byteIndex);
+	}
+
+	static bool IsAddressingValid(const BufferHeap& heap, const BufferHeap::Allocation& allocation, uint32_t size, uint32_t alignment)
+	{
+		const uint32_t blockIndex = BufferHeap::BlockIndex(allocation.offset);
+		const uint32_t blockOffset = BufferHeap::BlockOffset(allocation.offset);
+		if (blockIndex >= heap.blockCount)
+		{
+			return false;
+		}
+
+		const BufferHeap::Block& block = heap.blocks[blockIndex];
+		return blockOffset + size <= block.buffer.size
+			&& blockOffset % alignment == 0
+			&& BufferHeap::MakeOffset(blockIndex, blockOffset) == allocation.offset
+			&& heap.CpuPtr(allocation.offset) == static_cast<uint8_t*>(block.buffer.cpuPtr) + blockOffset;
+	}
+
+	//block 0 has no entry, it is bound directly
+	static uint32_t CountBlockTableViolations(const BufferHeap& heap)
+	{
+		uint32_t violationCount = heap.blockTable.offset != 0;
+		for (uint32_t blockIndex = 1; blockIndex < heap.blockCount; blockIndex++)
+		{
+			DescriptorHeap::Id id;
+			std::memcpy(&id, heap.CpuPtr(heap.blockTable.offset + blockIndex * sizeof(DescriptorHeap::Id)), sizeof(id));
+			violationCount += id != blockIndex;
+		}
+		return violationCount;
+	}
+
+	//the shader side decodes with the same shifts, so every block index and the ends of the offset range have to survive the round trip
+	static uint32_t CountEncodingViolations()
+	{
+		uint32_t violationCount = 0;
+		for (uint32_t blockIndex = 0; blockIndex < BufferHeap::blocksMaxCount; blockIndex++)
+		{
+			for (const uint32_t blockOffset : { 0u, 4u, BufferHeap::blockMaxSize / 2, BufferHeap::blockMaxSize - 4, BufferHeap::blockMaxSize - 1 })
+			{
+				const BufferHeap::Offset offset = BufferHeap::MakeOffset(blockIndex, blockOffset);
+				violationCount += BufferHeap::BlockIndex(offset) != blockIndex || BufferHeap::BlockOffset(offset) != blockOffset;
+			}
+		}
+		return violationCount;
+	}
+
+	static Result RunWorkload(const Workload& workload)
+	{
+		BufferHeap heap;
+		heap.InitCpuBacked(workload.initialBlockSize, workload.growBlockSize);
+
+		struct Entry
+		{
+			BufferHeap::Allocation allocation;
+			uint32_t size;
+		};
+		std::vector<Entry> entries;
+		std::vector<uint8_t> data(Max(allocationMaxSize, workload.growBlockSize) * 2);
+		uint32_t addressingViolationCount = CountEncodingViolations();
+
+		//stops once the last block got added, the heap asserts when it runs out of blocks
+		const auto begin = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; heap.blockCount < BufferHeap::blocksMaxCount; i++)
+		{
+			const bool isOversized = workload.oversizedInterval > 0 && i % workload.oversizedInterval == workload.oversizedInterval - 1;
+			const uint32_t size = isOversized ? workload.growBlockSize + GetSize(i) : GetSize(i);
+			const uint32_t alignment = GetAlignment(i);
+			const uint32_t blockCount = heap.blockCount;
+
+			Entry& entry = entries.emplace_back(Entry{ heap.Allocate(size, alignment), size });
+			const bool isValid = IsAddressingValid(heap, entry.allocation, size, alignment);
+			addressingViolationCount += !isValid;
+			//a new block only gets added if none of the existing ones had space, an oversized allocation always lands in it
+			addressingViolationCount += isOversized && BufferHeap::BlockIndex(entry.allocation.offset) != heap.blockCount - 1;
+			addressingViolationCount += isOversized && heap.blockCount == blockCount;
+			if (!isValid)
+			{
+				entries.pop_back();
+				continue;
+			}
+
+			const uint32_t index = static_cast<uint32_t>(entries.size() - 1);
+			for (uint32_t byteIndex = 0; byteIndex < size; byteIndex++)
+			{
+				data[byteIndex] = GetPattern(index, byteIndex);
+			}
+			heap.WriteRaw(entry.allocation.offset, data.data(), size);
+		}
+		const auto end = std::chrono::high_resolution_clock::now();
+
+		uint32_t contentViolationCount = 0;
+		for (uint32_t index = 0; index < entries.size(); index++)
+		{
+			const uint8_t* ptr = static_cast<const uint8_t*>(heap.CpuPtr(entries[index].allocation.offset));
+			for (uint32_t byteIndex = 0; byteIndex < entries[index].size; byteIndex++)
+			{
+				if (ptr[byteIndex] != GetPattern(index, byteIndex))
+				{
+					contentViolationCount++;
+					break;
+				}
+			}
+		}
+
+		//once the first block is emptied, the next allocation has to fall through to it before any later block
+		for (Entry& entry : entries)
+		{
+			if (BufferHeap::BlockIndex(entry.allocation.offset) == 0)
+			{
+				entry.allocation.Free();
+			}
+		}
+		Entry& fallThroughEntry = entries.emplace_back(Entry{ heap.Allocate(allocationMaxSize), allocationMaxSize });
+		addressingViolationCount += BufferHeap::BlockIndex(fallThroughEntry.allocation.offset) != 0 || !IsAddressingValid(heap, fallThroughEntry.allocation, allocationMaxSize, 4);
+
+		const Result result =
+		{
+			.workload = workload.name,
+			.blockCount = heap.blockCount,
+			.allocationCount = static_cast<uint32_t>(entries.size()),
+			.totalMs = std::chrono::duration<double, std::milli>(end - begin).count(),
+			.addressingViolationCount = addressingViolationCount,
+			.contentViolationCount = contentViolationCount,
+			.blockTableViolationCount = CountBlockTableViolations(heap)
+		};
+
+		for (Entry& entry : entries)
+		{
+			entry.allocation.Free();
+		}
+		heap.Destroy();
+
+		return result;
+	}
+
+	std::vector<Result> Run()
+	{
+		const Workload workloads[] =
+		{
+			{ "Growth (small blocks)", smallBlockSize, smallBlockSize, 0 },
+			{ "Growth (small first block)", 64 * 1024, smallBlockSize, 0 },
+			{ "Growth (oversized allocations)", smallBlockSize, smallBlockSize, 97 },
+		};
+
+		std::vector<Result> results;
+		for (const Workload& workload : workloads)
+		{
+			results.push_back(RunWorkload(workload));
+		}
+		return results;
+	}
+
+	void WriteCsv(FILE* file, std::span<const Result> results)
+	{
+		fprintf(file, "workload,blocks,allocations,total_ms,addressing_violations,content_violations,block_table_violations\n");
+		for (const Result& result : results)
+		{
+			fprintf(file, "%s,%u,%u,%.3f,%u,%u,%u\n",
+				result.workload,
+				result.blockCount,
+				result.allocationCount,
+				result.totalMs,
+				result.addressingViolationCount,
+				result.contentViolationCount,
+				result.blockTableViolationCount);
+		}
+	}
+
+	bool RunAndWriteCsv(const char* filePath)
+	{
+		const std::vector<Result> results = Run();
+		const bool isValid = std::all_of(results.begin(), results.end(), [](const Result& result)
+			{
+				return result.blockCount == BufferHeap::blocksMaxCount && result.addressingViolationCount == 0 && result.contentViolationCount == 0 && result.blockTableViolationCount == 0;
+			});
+		return Benchmark::WriteCsvFile(filePath, results, WriteCsv) && isValid;
+	}
+}
@@ -199,16 +199,21 @@ float LinearToNonlinearDepth(float linearDepth, float nearZ, float farZ)
 }
 
 Camera::Transform ProcessInput(float deltaTime, bool bCaptureMouse, const MovementSpeed& controler)
+{
+	float dx, dy;
+	Input::GetMouseDelta(dx, dy);
+	return ProcessInput(deltaTime, dx, dy, bCaptureMouse, controler);
+}
+
+Camera::Transform ProcessInput(float deltaTime, float mouseDeltaX, float mouseDeltaY, bool bCaptureMouse, const MovementSpeed& controler)
 {
 	Camera::Transform returnValue{};
 	if (Input::IsPressed(MouseButton::Left))
 	{
 		if (bCaptureMouse)
 		{
-			float dx, dy;
-			Input::GetMouseDelta(dx, dy);
-			returnValue.pitch = controler.pitchSpeed * dy ;
-			returnValue.yaw = controler.yawSpeed * dx;
+			returnValue.pitch = controler.pitchSpeed * mouseDeltaY;
+			returnValue.yaw = controler.yawSpeed * mouseDeltaX;
 		}
 	}
 
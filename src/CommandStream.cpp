@@ -0,0 +1,460 @@
+#include "stdafx.h"
+#include "CommandStream.h"
+
+#include "JobSystem.h"
+
+void CommandStream::Init(uint32_t reservedSizeBytes)
+{
+	memory.InitVirtual(reservedSizeBytes);
+	commandCount = 0;
+}
+
+void CommandStream::Destroy()
+{
+	memory.Destroy();
+	commandCount = 0;
+}
+
+void CommandStream::Reset()
+{
+	memory.Reset();
+	commandCount = 0;
+}
+
+uint32_t CommandStream::GetSizeBytes() const
+{
+	return static_cast<uint32_t>(memory.GetTop() - memory.virtualMemory.base);
+}
+
+template <typename T>
+T* CommandStream::Append(CommandType type, uint32_t trailingSizeBytes)
+{
+	static_assert(std::is_trivially_copyable_v<T> && alignof(T) <= commandAlignment);
+
+	//@note: sizes are multiples of the alignment and allocated unaligned, so commands are packed without gaps and the stream can be walked by size
+	const uint32_t sizeBytes = static_cast<uint32_t>(Align(sizeof(CommandHeader) + sizeof(T) + trailingSizeBytes, commandAlignment));
+	uint8_t* command = static_cast<uint8_t*>(memory.AllocateRaw(sizeBytes));
+	*reinterpret_cast<CommandHeader*>(command) = { .type = type, .sizeBytes = sizeBytes };
+	commandCount++;
+
+	return reinterpret_cast<T*>(command + sizeof(CommandHeader));
+}
+
+void CommandStream::SetPipelineState(ID3D12PipelineState* pso)
+{
+	Append<SetPipelineStateCommand>(CommandType::SetPipelineState)->pso = pso;
+}
+
+void CommandStream::AppendRootConstants(CommandType type, UINT rootParameterIndex, UINT count, const void* data, UINT destinationOffset)
+{
+	RootConstantsCommand* command = Append<RootConstantsCommand>(type, count * sizeof(uint32_t));
+	*command = { .rootParameterIndex = rootParameterIndex, .count = count, .destinationOffset = destinationOffset };
+	std::memcpy(command + 1, data, count * sizeof(uint32_t));
+}
+
+void CommandStream::SetComputeRoot32BitConstants(UINT rootParameterIndex, UINT count, const void* data, UINT destinationOffset)
+{
+	AppendRootConstants(CommandType::SetComputeRootConstants, rootParameterIndex, count, data, destinationOffset);
+}
+
+void CommandStream::SetGraphicsRoot32BitConstants(UINT rootParameterIndex, UINT count, const void* data, UINT destinationOffset)
+{
+	AppendRootConstants(CommandType::SetGraphicsRootConstants, rootParameterIndex, count, data, destinationOffset);
+}
+
+void CommandStream::Dispatch(UINT threadGroupCountX, UINT threadGroupCountY, UINT threadGroupCountZ)
+{
+	*Append<DispatchCommand>(CommandType::Dispatch) = { threadGroupCountX, threadGroupCountY, threadGroupCountZ };
+}
+
+void CommandStream::DrawIndexedInstanced(UINT indexCountPerInstance, UINT instanceCount, UINT startIndexLocation, INT baseVertexLocation, UINT startInstanceLocation)
+{
+	*Append<DrawIndexedInstancedCommand>(CommandType::DrawIndexedInstanced) = { indexCountPerInstance, instanceCount, startIndexLocation, baseVertexLocation, startInstanceLocation };
+}
+
+static uint32_t BarrierSize(D3D12_BARRIER_TYPE type)
+{
+	switch (type)
+	{
+	case D3D12_BARRIER_TYPE_GLOBAL:
+		return sizeof(D3D12_GLOBAL_BARRIER);
+	case D3D12_BARRIER_TYPE_TEXTURE:
+		return sizeof(D3D12_TEXTURE_BARRIER);
+	case D3D12_BARRIER_TYPE_BUFFER:
+		return sizeof(D3D12_BUFFER_BARRIER);
+	}
+	assert(false);
+	return 0;
+}
+
+void CommandStream::Barrier(UINT32 groupCount, const D3D12_BARRIER_GROUP* groups)
+{
+	uint32_t barriersSizeBytes = 0;
+	for (uint32_t i = 0; i < groupCount; i++)
+	{
+		barriersSizeBytes += static_cast<uint32_t>(Align(groups[i].NumBarriers * BarrierSize(groups[i].Type), commandAlignment));
+	}
+
+	BarrierCommand* command = Append<BarrierCommand>(CommandType::Barrier, commandAlignment - sizeof(BarrierCommand) + groupCount * sizeof(D3D12_BARRIER_GROUP) + barriersSizeBytes);
+	command->groupCount = groupCount;
+
+	D3D12_BARRIER_GROUP* streamGroups = reinterpret_cast<D3D12_BARRIER_GROUP*>(reinterpret_cast<uint8_t*>(command) + commandAlignment);
+	uint8_t* streamBarriers = reinterpret_cast<uint8_t*>(streamGroups + groupCount);
+	for (uint32_t i = 0; i < groupCount; i++)
+	{
+		const uint32_t sizeBytes = groups[i].NumBarriers * BarrierSize(groups[i].Type);
+		streamGroups[i] = groups[i];
+		//@note: the union members of the group all alias the same pointer
+		std::memcpy(streamBarriers, groups[i].pGlobalBarriers, sizeBytes);
+		streamGroups[i].pGlobalBarriers = reinterpret_cast<const D3D12_GLOBAL_BARRIER*>(streamBarriers);
+		streamBarriers += Align(sizeBytes, commandAlignment);
+	}
+}
+
+void CommandStream::IASetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW* view)
+{
+	Append<SetIndexBufferCommand>(CommandType::SetIndexBuffer)->view = *view;
+}
+
+void CommandStream::IASetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY topology)
+{
+	Append<SetPrimitiveTopologyCommand>(CommandType::SetPrimitiveTopology)->topology = topology;
+}
+
+void CommandStream::OMSetRenderTargets(UINT renderTargetCount, const D3D12_CPU_DESCRIPTOR_HANDLE* renderTargets, BOOL isSingleHandleToDescriptorRange, const D3D12_CPU_DESCRIPTOR_HANDLE* depthStencil)
+{
+	assert(renderTargetCount <= D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT);
+	const uint32_t handleCount = isSingleHandleToDescriptorRange ? Min(renderTargetCount, 1u) : renderTargetCount;
+
+	SetRenderTargetsCommand* command = Append<SetRenderTargetsCommand>(CommandType::SetRenderTargets, handleCount * sizeof(D3D12_CPU_DESCRIPTOR_HANDLE));
+	*command =
+	{
+		.depthStencil = depthStencil ? *depthStencil : D3D12_CPU_DESCRIPTOR_HANDLE{},
+		.renderTargetCount = renderTargetCount,
+		.isSingleHandleToDescriptorRange = isSingleHandleToDescriptorRange
+	};
+	std::memcpy(command + 1, renderTargets, handleCount * sizeof(D3D12_CPU_DESCRIPTOR_HANDLE));
+}
+
+void CommandStream::RSSetViewports(UINT count, const D3D12_VIEWPORT* viewports)
+{
+	SetViewportsCommand* command = Append<SetViewportsCommand>(CommandType::SetViewports, count * sizeof(D3D12_VIEWPORT));
+	command->count = count;
+	std::memcpy(command + 1, viewports, count * sizeof(D3D12_VIEWPORT));
+}
+
+void CommandStream::RSSetScissorRects(UINT count, const D3D12_RECT* rects)
+{
+	SetScissorRectsCommand* command = Append<SetScissorRectsCommand>(CommandType::SetScissorRects, count * sizeof(D3D12_RECT));
+	command->count = count;
+	std::memcpy(command + 1, rects, count * sizeof(D3D12_RECT));
+}
+
+void CommandStream::ClearRenderTargetView(D3D12_CPU_DESCRIPTOR_HANDLE renderTarget, const FLOAT color[4], UINT rectCount, const D3D12_RECT* rects)
+{
+	assert(rectCount == 0 && "clearing sub rects is not supported");
+	*Append<ClearRenderTargetCommand>(CommandType::ClearRenderTarget) = { .renderTarget = renderTarget, .color = { color[0], color[1], color[2], color[3] } };
+}
+
+void CommandStream::ClearDepthStencilView(D3D12_CPU_DESCRIPTOR_HANDLE depthStencil, D3D12_CLEAR_FLAGS flags, FLOAT depth, UINT8 stencil, UINT rectCount, const D3D12_RECT* rects)
+{
+	assert(rectCount == 0 && "clearing sub rects is not supported");
+	*Append<ClearDepthStencilCommand>(CommandType::ClearDepthStencil) = { .depthStencil = depthStencil, .flags = flags, .depth = depth, .stencil = stencil };
+}
+
+void CommandStream::BeginEvent(LPCWSTR name)
+{
+	Append<BeginEventCommand>(CommandType::BeginEvent)->name = name;
+}
+
+void CommandStream::EndEvent()
+{
+	Append<uint32_t>(CommandType::EndEvent);
+}
+
+template <typename T>
+static const T& Payload(const uint8_t* payload)
+{
+	return *reinterpret_cast<const T*>(payload);
+}
+
+template <typename T, typename Command>
+static const T* Trailing(const Command& command)
+{
+	return reinterpret_cast<const T*>(&command + 1);
+}
+
+void CommandStream::Translate(ID3D12GraphicsCommandList10* commandList) const
+{
+	ForEachCommand([commandList](const CommandHeader& header, const uint8_t* payload)
+		{
+			switch (header.type)
+			{
+			case CommandType::SetPipelineState:
+				commandList->SetPipelineState(Payload<SetPipelineStateCommand>(payload).pso);
+				break;
+			case CommandType::SetComputeRootConstants:
+			case CommandType::SetGraphicsRootConstants:
+			{
+				const RootConstantsCommand& command = Payload<RootConstantsCommand>(payload);
+				if (header.type == CommandType::SetComputeRootConstants)
+				{
+					commandList->SetComputeRoot32BitConstants(command.rootParameterIndex, command.count, Trailing<uint32_t>(command), command.destinationOffset);
+				}
+				else
+				{
+					commandList->SetGraphicsRoot32BitConstants(command.rootParameterIndex, command.count, Trailing<uint32_t>(command), command.destinationOffset);
+				}
+				break;
+			}
+			case CommandType::Dispatch:
+			{
+				const DispatchCommand& command = Payload<DispatchCommand>(payload);
+				commandList->Dispatch(command.threadGroupCountX, command.threadGroupCountY, command.threadGroupCountZ);
+				break;
+			}
+			case CommandType::DrawIndexedInstanced:
+			{
+				const DrawIndexedInstancedCommand& command = Payload<DrawIndexedInstancedCommand>(payload);
+				commandList->DrawIndexedInstanced(command.indexCountPerInstance, command.instanceCount, command.startIndexLocation, command.baseVertexLocation, command.startInstanceLocation);
+				break;
+			}
+			case CommandType::Barrier:
+				commandList->Barrier(Payload<BarrierCommand>(payload).groupCount, reinterpret_cast<const D3D12_BARRIER_GROUP*>(payload + commandAlignment));
+				break;
+			case CommandType::SetIndexBuffer:
+				commandList->IASetIndexBuffer(&Payload<SetIndexBufferCommand>(payload).view);
+				break;
+			case CommandType::SetPrimitiveTopology:
+				commandList->IASetPrimitiveTopology(Payload<SetPrimitiveTopologyCommand>(payload).topology);
+				break;
+			case CommandType::SetRenderTargets:
+			{
+				const SetRenderTargetsCommand& command = Payload<SetRenderTargetsCommand>(payload);
+				commandList->OMSetRenderTargets(command.renderTargetCount,
+					command.renderTargetCount > 0 ? Trailing<D3D12_CPU_DESCRIPTOR_HANDLE>(command) : nullptr,
+					command.isSingleHandleToDescriptorRange,
+					command.depthStencil.ptr ? &command.depthStencil : nullptr);
+				break;
+			}
+			case CommandType::SetViewports:
+			{
+				const SetViewportsCommand& command = Payload<SetViewportsCommand>(payload);
+				commandList->RSSetViewports(command.count, Trailing<D3D12_VIEWPORT>(command));
+				break;
+			}
+			case CommandType::SetScissorRects:
+			{
+				const SetScissorRectsCommand& command = Payload<SetScissorRectsCommand>(payload);
+				commandList->RSSetScissorRects(command.count, Trailing<D3D12_RECT>(command));
+				break;
+			}
+			case CommandType::ClearRenderTarget:
+			{
+				const ClearRenderTargetCommand& command = Payload<ClearRenderTargetCommand>(payload);
+				commandList->ClearRenderTargetView(command.renderTarget, command.color, 0, nullptr);
+				break;
+			}
+			case CommandType::ClearDepthStencil:
+			{
+				const ClearDepthStencilCommand& command = Payload<ClearDepthStencilCommand>(payload);
+				commandList->ClearDepthStencilView(command.depthStencil, command.flags, command.depth, command.stencil, 0, nullptr);
+				break;
+			}
+			case CommandType::BeginEvent:
+				PIXBeginEvent(commandList, PIX_COLOR_DEFAULT, Payload<BeginEventCommand>(payload).name);
+				break;
+			case CommandType::EndEvent:
+				PIXEndEvent(commandList);
+				break;
+			default:
+				assert(false && "unknown command");
+			}
+		});
+}
+
+void TranslateParallel(std::span<const CommandStream* const> commandStreams, std::span<ID3D12GraphicsCommandList10* const> commandLists)
+{
+	assert(commandStreams.size() == commandLists.size());
+	JobSystem::ParallelFor(static_cast<uint32_t>(commandStreams.size()), 1, [commandStreams, commandLists](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t i = begin; i < end; i++)
+			{
+				commandStreams[i]->Translate(commandLists[i]);
+			}
+		});
+}
+
+//root constants of the universal root signature per root parameter, see UniversalRootSignature.hlsli. Parameter 1 is the global buffer srv
+static constexpr uint32_t rootConstantsCounts[] = { 11, 0, 1 };
+
+CommandStreamStatistics ReplayOnCpu(const CommandStream& commandStream, FILE* validationLog)
+{
+	using CommandType = CommandStream::CommandType;
+
+	CommandStreamStatistics statistics = { .sizeBytes = commandStream.GetSizeBytes() };
+
+	struct State
+	{
+		const ID3D12PipelineState* pso = nullptr;
+		bool hasIndexBuffer = false;
+		bool hasRenderTargets = false;
+		bool hasViewport = false;
+		bool hasScissorRect = false;
+		uint32_t openEventCount = 0;
+	} state;
+
+	uint32_t commandIndex = 0;
+	auto ReportError = [&](const char* message)
+	{
+		statistics.validationErrorCount++;
+		if (validationLog)
+		{
+			fprintf(validationLog, "command %u: %s\n", commandIndex, message);
+		}
+	};
+
+	commandStream.ForEachCommand([&](const CommandStream::CommandHeader& header, const uint8_t* payload)
+		{
+			assert(header.type < CommandType::Count);
+			statistics.commandCounts[static_cast<uint32_t>(header.type)]++;
+
+			switch (header.type)
+			{
+			case CommandType::SetPipelineState:
+			{
+				const ID3D12PipelineState* pso = Payload<CommandStream::SetPipelineStateCommand>(payload).pso;
+				if (!pso)
+				{
+					ReportError("SetPipelineState with null pipeline state");
+				}
+				statistics.redundantPipelineStateCount += pso && pso == state.pso ? 1 : 0;
+				state.pso = pso;
+				break;
+			}
+			case CommandType::SetComputeRootConstants:
+			case CommandType::SetGraphicsRootConstants:
+			{
+				const CommandStream::RootConstantsCommand& command = Payload<CommandStream::RootConstantsCommand>(payload);
+				if (command.rootParameterIndex >= _countof(rootConstantsCounts) || command.destinationOffset + command.count > rootConstantsCounts[command.rootParameterIndex])
+				{
+					ReportError("root constants exceed the root parameter");
+				}
+				break;
+			}
+			case CommandType::Dispatch:
+			{
+				const CommandStream::DispatchCommand& command = Payload<CommandStream::DispatchCommand>(payload);
+				if (!state.pso)
+				{
+					ReportError("Dispatch without pipeline state");
+				}
+				if (command.threadGroupCountX == 0 || command.threadGroupCountY == 0 || command.threadGroupCountZ == 0)
+				{
+					ReportError("Dispatch of zero thread groups");
+				}
+				if (command.threadGroupCountX > D3D12_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION ||
+					command.threadGroupCountY > D3D12_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION ||
+					command.threadGroupCountZ > D3D12_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION)
+				{
+					ReportError("Dispatch exceeds the thread group count limit");
+				}
+				statistics.threadGroupCount += uint64_t(command.threadGroupCountX) * command.threadGroupCountY * command.threadGroupCountZ;
+				break;
+			}
+			case CommandType::DrawIndexedInstanced:
+			{
+				const CommandStream::DrawIndexedInstancedCommand& command = Payload<CommandStream::DrawIndexedInstancedCommand>(payload);
+				if (!state.pso)
+				{
+					ReportError("Draw without pipeline state");
+				}
+				if (!state.hasIndexBuffer)
+				{
+					ReportError("Draw without index buffer");
+				}
+				if (!state.hasRenderTargets)
+				{
+					ReportError("Draw without render target or depth stencil");
+				}
+				if (!state.hasViewport || !state.hasScissorRect)
+				{
+					ReportError("Draw without viewport or scissor rect");
+				}
+				statistics.indexCount += uint64_t(command.indexCountPerInstance) * command.instanceCount;
+				break;
+			}
+			case CommandType::Barrier:
+			{
+				const uint32_t groupCount = Payload<CommandStream::BarrierCommand>(payload).groupCount;
+				const D3D12_BARRIER_GROUP* groups = reinterpret_cast<const D3D12_BARRIER_GROUP*>(payload + CommandStream::commandAlignment);
+				for (uint32_t i = 0; i < groupCount; i++)
+				{
+					const D3D12_BARRIER_GROUP& group = groups[i];
+					if (group.NumBarriers == 0)
+					{
+						ReportError("empty barrier group");
+					}
+					for (uint32_t j = 0; j < group.NumBarriers; j++)
+					{
+						const bool hasResource =
+							group.Type == D3D12_BARRIER_TYPE_GLOBAL ||
+							(group.Type == D3D12_BARRIER_TYPE_TEXTURE && group.pTextureBarriers[j].pResource) ||
+							(group.Type == D3D12_BARRIER_TYPE_BUFFER && group.pBufferBarriers[j].pResource);
+						if (!hasResource)
+						{
+							ReportError("barrier without resource");
+						}
+					}
+					statistics.barrierCount += group.NumBarriers;
+				}
+				break;
+			}
+			case CommandType::SetIndexBuffer:
+			{
+				const D3D12_INDEX_BUFFER_VIEW& view = Payload<CommandStream::SetIndexBufferCommand>(payload).view;
+				if (view.Format != DXGI_FORMAT_R16_UINT && view.Format != DXGI_FORMAT_R32_UINT)
+				{
+					ReportError("index buffer format needs to be R16_UINT or R32_UINT");
+				}
+				state.hasIndexBuffer = view.BufferLocation != 0;
+				break;
+			}
+			case CommandType::SetRenderTargets:
+			{
+				const CommandStream::SetRenderTargetsCommand& command = Payload<CommandStream::SetRenderTargetsCommand>(payload);
+				state.hasRenderTargets = command.renderTargetCount > 0 || command.depthStencil.ptr != 0;
+				break;
+			}
+			case CommandType::SetViewports:
+				state.hasViewport = Payload<CommandStream::SetViewportsCommand>(payload).count > 0;
+				break;
+			case CommandType::SetScissorRects:
+				state.hasScissorRect = Payload<CommandStream::SetScissorRectsCommand>(payload).count > 0;
+				break;
+			case CommandType::BeginEvent:
+				state.openEventCount++;
+				break;
+			case CommandType::EndEvent:
+				if (state.openEventCount == 0)
+				{
+					ReportError("EndEvent without BeginEvent");
+				}
+				state.openEventCount -= state.openEventCount > 0 ? 1 : 0;
+				break;
+			default:
+				break;
+			}
+
+			commandIndex++;
+		});
+
+	if (state.openEventCount > 0)
+	{
+		ReportError("BeginEvent without EndEvent");
+	}
+
+	statistics.commandCount = commandIndex;
+	assert(statistics.commandCount == commandStream.commandCount);
+	return statistics;
+}
@@ -0,0 +1,213 @@
+#include "stdafx.h"
+#include "CommandStreamBenchmark.h"
+
+#include "BenchmarkHelpers.h"
+#include "CommandStream.h"
+#include "JobSystem.h"
+
+#include <thread>
+
+namespace CommandStreamBenchmark
+{
+	static constexpr uint32_t passCount = 1 << 14; //split over the threads
+	static constexpr uint32_t drawsPerPassCount = 16;
+	static constexpr uint32_t streamReservedSizeBytes = 64 * 1024 * 1024;
+
+	//never dereferenced, the streams are only decoded on the CPU
+	static ID3D12PipelineState* FakePso(uint32_t index)
+	{
+		return reinterpret_cast<ID3D12PipelineState*>(static_cast<uintptr_t>(index + 1) * 256);
+	}
+
+	static ID3D12Resource* FakeResource(uint32_t index)
+	{
+		return reinterpret_cast<ID3D12Resource*>(static_cast<uintptr_t>(index + 1) * 4096);
+	}
+
+	//shaped like DispatchComputePass() followed by the transitions of a per pixel pass
+	static void RecordComputePass(CommandStream& commandStream, uint32_t passIndex)
+	{
+		const uint32_t rootConstants[4] = { passIndex, passIndex + 1, passIndex + 2, 0 };
+
+		commandStream.BeginEvent(L"Compute Pass");
+		commandStream.SetPipelineState(FakePso(passIndex % 32));
+		commandStream.SetComputeRoot32BitConstants(0, _countof(rootConstants), rootConstants, 0);
+		commandStream.Dispatch(240, 135, 1);
+
+		const D3D12_TEXTURE_BARRIER barriers[] =
+		{
+			{
+				.SyncBefore = D3D12_BARRIER_SYNC_COMPUTE_SHADING,
+				.SyncAfter = D3D12_BARRIER_SYNC_COMPUTE_SHADING,
+				.AccessBefore = D3D12_BARRIER_ACCESS_UNORDERED_ACCESS,
+				.AccessAfter = D3D12_BARRIER_ACCESS_SHADER_RESOURCE,
+				.LayoutBefore = D3D12_BARRIER_LAYOUT_DIRECT_QUEUE_UNORDERED_ACCESS,
+				.LayoutAfter = D3D12_BARRIER_LAYOUT_DIRECT_QUEUE_SHADER_RESOURCE,
+				.pResource = FakeResource(passIndex % 64)
+			},
+			{
+				.SyncBefore = D3D12_BARRIER_SYNC_COMPUTE_SHADING,
+				.SyncAfter = D3D12_BARRIER_SYNC_COMPUTE_SHADING,
+				.AccessBefore = D3D12_BARRIER_ACCESS_SHADER_RESOURCE,
+				.AccessAfter = D3D12_BARRIER_ACCESS_UNORDERED_ACCESS,
+				.LayoutBefore = D3D12_BARRIER_LAYOUT_DIRECT_QUEUE_SHADER_RESOURCE,
+				.LayoutAfter = D3D12_BARRIER_LAYOUT_DIRECT_QUEUE_UNORDERED_ACCESS,
+				.pResource = FakeResource((passIndex + 1) % 64)
+			}
+		};
+		const D3D12_BARRIER_GROUP barrierGroup = { .Type = D3D12_BARRIER_TYPE_TEXTURE, .NumBarriers = _countof(barriers), .pTextureBarriers = barriers };
+		commandStream.Barrier(1, &barrierGroup);
+		commandStream.EndEvent();
+	}
+
+	//shaped like Draw::Opaque(), one set of root constants per mesh
+	static void RecordDrawPass(CommandStream& commandStream, uint32_t passIndex)
+	{
+		const D3D12_CPU_DESCRIPTOR_HANDLE renderTarget = { 4096 };
+		const D3D12_CPU_DESCRIPTOR_HANDLE depthStencil = { 8192 };
+		const D3D12_VIEWPORT viewport = { 0.0f, 0.0f, 1920.0f, 1080.0f, 0.0f, 1.0f };
+		const D3D12_RECT scissorRect = { 0, 0, 1920, 1080 };
+		const D3D12_INDEX_BUFFER_VIEW indexBufferView = { .BufferLocation = 65536, .SizeInBytes = 1 << 20, .Format = DXGI_FORMAT_R32_UINT };
+
+		commandStream.BeginEvent(L"Draw Pass");
+		commandStream.OMSetRenderTargets(1, &renderTarget, FALSE, &depthStencil);
+		commandStream.RSSetViewports(1, &viewport);
+		commandStream.RSSetScissorRects(1, &scissorRect);
+		commandStream.IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		commandStream.IASetIndexBuffer(&indexBufferView);
+		for (uint32_t i = 0; i < drawsPerPassCount; i++)
+		{
+			const uint32_t rootConstants[6] = { passIndex, i, 0, 0, 0, 0 };
+			commandStream.SetPipelineState(FakePso(i % 4));
+			commandStream.SetGraphicsRoot32BitConstants(0, _countof(rootConstants), rootConstants, 0);
+			commandStream.DrawIndexedInstanced(3 * 1024, 1, i * 3 * 1024, 0, 0);
+		}
+		commandStream.EndEvent();
+	}
+
+	//one stream per thread, each one records its share of the passes
+	static void RecordPasses(std::vector<CommandStream>& commandStreams, void (*recordPass)(CommandStream&, uint32_t))
+	{
+		const uint32_t streamCount = static_cast<uint32_t>(commandStreams.size());
+		JobSystem::ParallelFor(streamCount, 1, [&commandStreams, streamCount, recordPass](uint32_t begin, uint32_t end)
+			{
+				for (uint32_t streamIndex = begin; streamIndex < end; streamIndex++)
+				{
+					CommandStream& commandStream = commandStreams[streamIndex];
+					commandStream.Reset();
+					for (uint32_t passIndex = streamIndex; passIndex < passCount; passIndex += streamCount)
+					{
+						recordPass(commandStream, passIndex);
+					}
+				}
+			});
+	}
+
+	static uint32_t ReplayPasses(const std::vector<CommandStream>& commandStreams)
+	{
+		std::atomic<uint32_t> validationErrorCount = 0;
+		JobSystem::ParallelFor(static_cast<uint32_t>(commandStreams.size()), 1, [&commandStreams, &validationErrorCount](uint32_t begin, uint32_t end)
+			{
+				for (uint32_t i = begin; i < end; i++)
+				{
+					validationErrorCount.fetch_add(ReplayOnCpu(commandStreams[i]).validationErrorCount, std::memory_order_relaxed);
+				}
+			});
+		return validationErrorCount.load(std::memory_order_relaxed);
+	}
+
+	std::vector<Result> Run(uint32_t maxThreadCount)
+	{
+		maxThreadCount = Min(maxThreadCount > 0 ? maxThreadCount : Max(std::thread::hardware_concurrency(), 1u), JobSystem::workersMaxCount + 1);
+
+		struct Workload
+		{
+			const char* name;
+			const char* replayName;
+			void (*recordPass)(CommandStream&, uint32_t);
+		};
+
+		const Workload workloads[] =
+		{
+			{ "ComputePasses", "ComputePasses ReplayOnCpu", RecordComputePass },
+			{ "DrawPasses", "DrawPasses ReplayOnCpu", RecordDrawPass },
+		};
+
+		std::vector<Result> results;
+		for (const Workload& workload : workloads)
+		{
+			double singleThreadRecordMs = 0.0;
+			double singleThreadReplayMs = 0.0;
+			for (uint32_t threadCount = 1; threadCount <= maxThreadCount; threadCount++)
+			{
+				std::vector<CommandStream> commandStreams(threadCount);
+				for (CommandStream& commandStream : commandStreams)
+				{
+					commandStream.Init(streamReservedSizeBytes);
+				}
+
+				JobSystem::Init({ .workerCount = threadCount - 1 });
+				const double recordMs = Benchmark::MeasureBest([&commandStreams, &workload]() { RecordPasses(commandStreams, workload.recordPass); });
+				uint32_t validationErrorCount = 0;
+				const double replayMs = Benchmark::MeasureBest([&commandStreams, &validationErrorCount]() { validationErrorCount = ReplayPasses(commandStreams); });
+				JobSystem::Shutdown();
+
+				//the synthetic passes set every state they use
+				assert(validationErrorCount == 0);
+
+				uint64_t commandCount = 0;
+				uint64_t streamSizeBytes = 0;
+				for (CommandStream& commandStream : commandStreams)
+				{
+					commandCount += commandStream.commandCount;
+					streamSizeBytes += commandStream.GetSizeBytes();
+					commandStream.Destroy();
+				}
+
+				singleThreadRecordMs = threadCount == 1 ? recordMs : singleThreadRecordMs;
+				singleThreadReplayMs = threadCount == 1 ? replayMs : singleThreadReplayMs;
+				results.push_back(
+					{
+						.workload = workload.name,
+						.threadCount = threadCount,
+						.commandCount = commandCount,
+						.streamSizeBytes = streamSizeBytes,
+						.totalMs = recordMs,
+						.speedup = singleThreadRecordMs / recordMs
+					});
+				results.push_back(
+					{
+						.workload = workload.replayName,
+						.threadCount = threadCount,
+						.commandCount = commandCount,
+						.streamSizeBytes = streamSizeBytes,
+						.totalMs = replayMs,
+						.speedup = singleThreadReplayMs / replayMs
+					});
+			}
+		}
+
+		return results;
+	}
+
+	void WriteCsv(FILE* file, std::span<const Result> results)
+	{
+		fprintf(file, "workload,threads,commands,stream_kb,total_ms,ns_per_command,speedup\n");
+		for (const Result& result : results)
+		{
+			fprintf(file, "%s,%u,%llu,%llu,%.3f,%.2f,%.2f\n",
+				result.workload,
+				result.threadCount,
+				result.commandCount,
+				result.streamSizeBytes / 1024,
+				result.totalMs,
+				result.totalMs * 1e6 / result.commandCount,
+				result.speedup);
+		}
+	}
+
+	bool RunAndWriteCsv(const char* filePath, uint32_t maxThreadCount)
+	{
+		return Benchmark::WriteCsvFile(filePath, Run(maxThreadCount), WriteCsv);
+	}
+}
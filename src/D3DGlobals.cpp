@@ -26,9 +26,11 @@ namespace D3D
 	static const uint32_t dsvHeapSize = 1024;
 	static const uint32_t rtvHeapSize = 2 * 4096;
 	static const uint32_t descriptorHeapSize = 16 * 1024;
-	static const uint32_t globalStaticBufferSize = 100 * 1024 * 1024;
-	static const uint32_t stackAllocatorChunkSizeByte = 128 * 1024 * 1024; 
+	static const uint32_t globalStaticBufferInitialBlockSize = 64 * 1024 * 1024;
+	static const uint32_t globalStaticBufferGrowBlockSize = 64 * 1024 * 1024;
+	static const uint32_t stackAllocatorReservedSizeByte = 1280u * 1024 * 1024; 
 	static const uint32_t persistentAllocatorSize = 128 * 1024 * 1024;
+	static const bool useSmallAllocationSlabs = true;
 
 	static const uint32_t temporaryHdrTexturesCount = 3;
 
@@ -61,9 +63,14 @@ namespace D3D
 		dsvHeap.Init(device, dsvHeapSize);
 
 		// Reserve general purpose GPU and main memory
-		globalStaticBuffer.Init(device, globalStaticBufferSize, L"Global Static Buffer");
-		stackAllocator.Init(stackAllocatorChunkSizeByte, 10);
+		globalStaticBuffer.Init(device, descriptorHeap, globalStaticBufferInitialBlockSize, globalStaticBufferGrowBlockSize, L"Global Static Buffer");
+		stackAllocator.InitVirtual(stackAllocatorReservedSizeByte);
 		persistentAllocator.Init(persistentAllocatorSize);
+		if (useSmallAllocationSlabs)
+		{
+			globalStaticBuffer.EnableSlabs();
+			persistentAllocator.EnableSlabs();
+		}
 
 		//reserve DescriptorId 0 for debug buffer
 		debugBuffer = CreateRWBufferResource(device,
@@ -113,8 +120,8 @@ namespace D3D
 
 		commandList->SetComputeRootSignature(D3D::rootSignature.Get());
 
-		//Bind global buffer memory
-		commandList->SetGraphicsRootShaderResourceView(1, globalStaticBuffer.parentBuffer.resource->GetGPUVirtualAddress());
-		commandList->SetComputeRootShaderResourceView(1, globalStaticBuffer.parentBuffer.resource->GetGPUVirtualAddress());
+		//Bind first block of global buffer memory, further blocks are accessed through the block table
+		commandList->SetGraphicsRootShaderResourceView(1, globalStaticBuffer.GPUAddress(0));
+		commandList->SetComputeRootShaderResourceView(1, globalStaticBuffer.GPUAddress(0));
 	}
 }
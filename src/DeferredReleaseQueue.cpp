@@ -0,0 +1,137 @@
+#include "stdafx.h"
+#include "DeferredReleaseQueue.h"
+
+//Bounded ring after Vyukov: the sequence of a slot tells whether it is free for the enqueue position (sequence == position),
+//published (sequence == position + 1) or not yet released by the consumer of the previous round
+void DeferredReleaseQueue::Init(uint32_t capacity)
+{
+	assert(std::has_single_bit(capacity));
+	Destroy();
+
+	entries = std::make_unique<Entry[]>(capacity);
+	this->capacity = capacity;
+	for (uint32_t i = 0; i < capacity; i++)
+	{
+		entries[i].sequence.store(i, std::memory_order_relaxed);
+	}
+	enqueuePosition.store(0, std::memory_order_relaxed);
+	dequeuePosition = 0;
+	overflowCount.store(0, std::memory_order_relaxed);
+}
+
+void DeferredReleaseQueue::Destroy()
+{
+	if (entries)
+	{
+		for (uint64_t position = dequeuePosition; ; position++)
+		{
+			Entry& entry = entries[position & (capacity - 1)];
+			if (entry.sequence.load(std::memory_order_acquire) != position + 1)
+			{
+				break;
+			}
+			entry.release(entry.payload, false);
+			entry.sequence.store(position + capacity, std::memory_order_relaxed);
+		}
+		entries.reset();
+		capacity = 0;
+	}
+
+	std::lock_guard lock(overflowMutex);
+	for (OverflowEntry& entry : overflowEntries)
+	{
+		assert(entry.isPublished);
+		entry.release(entry.payload, false);
+	}
+	overflowEntries.clear();
+}
+
+void* DeferredReleaseQueue::BeginEnqueue(uint64_t fenceValue, ReleaseFunction release)
+{
+	assert(entries);
+	uint64_t position = enqueuePosition.load(std::memory_order_relaxed);
+	for (;;)
+	{
+		Entry& entry = entries[position & (capacity - 1)];
+		const uint64_t sequence = entry.sequence.load(std::memory_order_acquire);
+		const int64_t difference = static_cast<int64_t>(sequence - position);
+		if (difference == 0)
+		{
+			if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+			{
+				entry.fenceValue = fenceValue;
+				entry.release = release;
+				return entry.payload;
+			}
+		}
+		else if (difference < 0)
+		{
+			break; //ring is full
+		}
+		else
+		{
+			position = enqueuePosition.load(std::memory_order_relaxed);
+		}
+	}
+
+	overflowCount.fetch_add(1, std::memory_order_relaxed);
+	std::lock_guard lock(overflowMutex);
+	//references to deque elements stay valid on push_back and pop_front, so the entry can be constructed outside of the lock
+	OverflowEntry& entry = overflowEntries.emplace_back();
+	entry.fenceValue = fenceValue;
+	entry.release = release;
+	return entry.payload;
+}
+
+void DeferredReleaseQueue::EndEnqueue(void* payload)
+{
+	const bool isRingEntry = payload >= static_cast<void*>(&entries[0]) && payload < static_cast<void*>(&entries[capacity]);
+	if (!isRingEntry)
+	{
+		OverflowEntry& entry = *reinterpret_cast<OverflowEntry*>(static_cast<uint8_t*>(payload) - offsetof(OverflowEntry, payload));
+		entry.isPublished.store(true, std::memory_order_release);
+		return;
+	}
+
+	Entry& entry = *reinterpret_cast<Entry*>(static_cast<uint8_t*>(payload) - offsetof(Entry, payload));
+	const uint64_t position = entry.sequence.load(std::memory_order_relaxed);
+	entry.sequence.store(position + 1, std::memory_order_release);
+}
+
+uint32_t DeferredReleaseQueue::Retire(uint64_t completedFenceValue)
+{
+	uint32_t releasedCount = 0;
+	for (;;)
+	{
+		Entry& entry = entries[dequeuePosition & (capacity - 1)];
+		//stops at the first entry which is empty, still being written or not completed yet
+		if (entry.sequence.load(std::memory_order_acquire) != dequeuePosition + 1 || entry.fenceValue > completedFenceValue)
+		{
+			break;
+		}
+
+		entry.release(entry.payload, true);
+		entry.sequence.store(dequeuePosition + capacity, std::memory_order_release);
+		dequeuePosition++;
+		releasedCount++;
+	}
+
+	if (overflowCount.load(std::memory_order_relaxed) > 0)
+	{
+		std::lock_guard lock(overflowMutex);
+		while (!overflowEntries.empty() && overflowEntries.front().isPublished.load(std::memory_order_acquire) && overflowEntries.front().fenceValue <= completedFenceValue)
+		{
+			overflowEntries.front().release(overflowEntries.front().payload, true);
+			overflowEntries.pop_front();
+			releasedCount++;
+		}
+	}
+
+	return releasedCount;
+}
+
+uint32_t DeferredReleaseQueue::GetPendingCount() const
+{
+	std::lock_guard lock(overflowMutex);
+	return static_cast<uint32_t>(enqueuePosition.load(std::memory_order_relaxed) - dequeuePosition) + static_cast<uint32_t>(overflowEntries.size());
+}
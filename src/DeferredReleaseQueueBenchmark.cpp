@@ -0,0 +1,180 @@
+#include "stdafx.h"
+#include "DeferredReleaseQueueBenchmark.h"
+
+#include "BenchmarkHelpers.h"
+#include "DeferredReleaseQueue.h"
+#include "JobSystem.h"
+
+#include <thread>
+
+namespace DeferredReleaseQueueBenchmark
+{
+	static constexpr uint32_t frameCount = 4096;
+	static constexpr uint32_t framesInFlightCount = 3; //the fake fence completes this many frames behind the producers
+	static constexpr uint32_t releasesPerFrameCount = 64;
+	static constexpr uint32_t releasesGrainSize = 4;
+	static constexpr uint32_t releaseTotalCount = frameCount * releasesPerFrameCount;
+
+	//bookkeeping of the releases. Only touched by the consumer thread, since releases only run inside Retire()
+	struct Validation
+	{
+		std::vector<uint32_t> releaseCounts; //per entry, the id is the frame index times releasesPerFrameCount plus the index within the frame
+		uint64_t completedFenceValue = 0;
+		uint32_t releasedCount = 0;
+		bool isOrdered = false;
+
+		uint32_t orderViolationCount = 0;
+		uint32_t earlyReleaseCount = 0;
+		uint32_t lateReleaseCount = 0;
+		uint32_t missingReleaseCount = 0;
+	};
+
+	static void Release(Validation& validation, uint32_t id, uint64_t fenceValue)
+	{
+		validation.earlyReleaseCount += fenceValue > validation.completedFenceValue;
+		//a single producer enqueues the ids in increasing order, so in order they get released as 0, 1, 2...
+		validation.orderViolationCount += validation.isOrdered && id != validation.releasedCount;
+		validation.releaseCounts[id]++;
+		validation.releasedCount++;
+	}
+
+	//returns the overflow count of the queue
+	static uint32_t RunFrames(DeferredReleaseQueue& queue, Validation& validation, uint32_t capacity, bool isMultiProducer)
+	{
+		queue.Init(capacity);
+		validation.releaseCounts.assign(releaseTotalCount, 0);
+		validation.completedFenceValue = 0;
+		validation.releasedCount = 0;
+
+		for (uint32_t frame = 0; frame < frameCount; frame++)
+		{
+			const uint64_t fenceValue = frame + 1;
+			const uint32_t firstId = frame * releasesPerFrameCount;
+			auto Enqueue = [&queue, &validation, fenceValue, firstId](uint32_t begin, uint32_t end)
+			{
+				for (uint32_t i = begin; i < end; i++)
+				{
+					Validation* validationPtr = &validation;
+					const uint32_t id = firstId + i;
+					queue.Enqueue(fenceValue, [validationPtr, id, fenceValue]() { Release(*validationPtr, id, fenceValue); });
+				}
+			};
+
+			if (isMultiProducer)
+			{
+				JobSystem::ParallelFor(releasesPerFrameCount, releasesGrainSize, Enqueue);
+			}
+			else
+			{
+				Enqueue(0, releasesPerFrameCount);
+			}
+
+			validation.completedFenceValue = fenceValue > framesInFlightCount ? fenceValue - framesInFlightCount : 0;
+			queue.Retire(validation.completedFenceValue);
+
+			//all producers of the completed frames are done, so each of their entries has to be released by now
+			const uint64_t completedReleaseCount = validation.completedFenceValue * releasesPerFrameCount;
+			validation.lateReleaseCount += static_cast<uint32_t>(completedReleaseCount - Min<uint64_t>(validation.releasedCount, completedReleaseCount));
+		}
+
+		validation.completedFenceValue = frameCount;
+		queue.Retire(validation.completedFenceValue);
+		validation.missingReleaseCount += static_cast<uint32_t>(std::count_if(validation.releaseCounts.begin(), validation.releaseCounts.end(), [](uint32_t count) { return count != 1; }));
+
+		const uint32_t overflowCount = queue.overflowCount.load(std::memory_order_relaxed);
+		queue.Destroy();
+		return overflowCount;
+	}
+
+	std::vector<Result> Run(uint32_t maxThreadCount)
+	{
+		maxThreadCount = Min(maxThreadCount > 0 ? maxThreadCount : Max(std::thread::hardware_concurrency(), 1u), JobSystem::workersMaxCount + 1);
+
+		struct Workload
+		{
+			const char* name;
+			uint32_t capacity;
+			bool isMultiProducer;
+			bool isOverflowExpected;
+		};
+
+		//the large ring holds all frames in flight and wraps around every few frames, the small one holds a single frame
+		static constexpr uint32_t ringCapacity = std::bit_ceil((framesInFlightCount + 1) * releasesPerFrameCount);
+		static constexpr uint32_t overflowRingCapacity = releasesPerFrameCount;
+
+		const Workload workloads[] =
+		{
+			{ "SingleProducer", ringCapacity, false, false },
+			{ "SingleProducer overflow", overflowRingCapacity, false, true },
+			{ "MultiProducer", ringCapacity, true, false },
+			{ "MultiProducer overflow", overflowRingCapacity, true, true },
+		};
+
+		std::vector<Result> results;
+		for (const Workload& workload : workloads)
+		{
+			//a single producer only runs on the calling thread
+			const uint32_t workloadMaxThreadCount = workload.isMultiProducer ? maxThreadCount : 1;
+			for (uint32_t threadCount = 1; threadCount <= workloadMaxThreadCount; threadCount++)
+			{
+				DeferredReleaseQueue queue;
+				Validation validation;
+				//releases of the overflow list run after the ones of the ring, so the order is only defined without overflow
+				validation.isOrdered = !workload.isMultiProducer && !workload.isOverflowExpected;
+				uint32_t overflowCount = 0;
+
+				JobSystem::Init({ .workerCount = threadCount - 1 });
+				const double totalMs = Benchmark::MeasureBest([&queue, &validation, &workload, &overflowCount]() { overflowCount = RunFrames(queue, validation, workload.capacity, workload.isMultiProducer); });
+				JobSystem::Shutdown();
+
+				results.push_back(
+					{
+						.workload = workload.name,
+						.threadCount = threadCount,
+						.capacity = workload.capacity,
+						.releaseCount = releaseTotalCount,
+						.totalMs = totalMs,
+						.overflowCount = overflowCount,
+						.isOverflowExpected = workload.isOverflowExpected,
+						.orderViolationCount = validation.orderViolationCount,
+						.earlyReleaseCount = validation.earlyReleaseCount,
+						.lateReleaseCount = validation.lateReleaseCount,
+						.missingReleaseCount = validation.missingReleaseCount
+					});
+			}
+		}
+
+		return results;
+	}
+
+	void WriteCsv(FILE* file, std::span<const Result> results)
+	{
+		fprintf(file, "workload,threads,capacity,releases,total_ms,ns_per_release,overflows,order_violations,early_releases,late_releases,missing_releases\n");
+		for (const Result& result : results)
+		{
+			fprintf(file, "%s,%u,%u,%llu,%.3f,%.2f,%u,%u,%u,%u,%u\n",
+				result.workload,
+				result.threadCount,
+				result.capacity,
+				result.releaseCount,
+				result.totalMs,
+				result.totalMs * 1e6 / result.releaseCount,
+				result.overflowCount,
+				result.orderViolationCount,
+				result.earlyReleaseCount,
+				result.lateReleaseCount,
+				result.missingReleaseCount);
+		}
+	}
+
+	bool RunAndWriteCsv(const char* filePath, uint32_t maxThreadCount)
+	{
+		const std::vector<Result> results = Run(maxThreadCount);
+		const bool isValid = std::all_of(results.begin(), results.end(), [](const Result& result)
+			{
+				return result.orderViolationCount == 0 && result.earlyReleaseCount == 0 && result.lateReleaseCount == 0 && result.missingReleaseCount == 0
+					&& (result.overflowCount > 0) == result.isOverflowExpected;
+			});
+		return Benchmark::WriteCsvFile(filePath, results, WriteCsv) && isValid;
+	}
+}
@@ -1,6 +1,8 @@
 #include "stdafx.h"
 #include "DescriptorHeap.h"
 
+#include "Frame.h"
+
 DescriptorHeap* const DescriptorHeap::Allocation::parentHeapPtr = &D3D::descriptorHeap;
 
 static ComPtr<ID3D12DescriptorHeap> CreateDescriptorHeap(ComPtr<ID3D12Device> device, 
@@ -17,12 +19,22 @@ void DescriptorHeapBase::Init(ID3D12Device10* device, uint32_t elementMaxCount,
 	this->device = device;
 }
 
-DescriptorHeap::Allocation DescriptorHeap::Allocate(uint32_t elementCount)
+DescriptorHeap::Allocation DescriptorHeap::Allocate(uint32_t elementCount, MemoryTelemetry::Tag tag)
 {
-	return
+	std::lock_guard lock(mutex);
+	Allocation allocation =
 	{
 		.allocation = allocator.allocate(elementCount),
+		.tag = tag
 	};
+
+	if (allocation.IsValid())
+	{
+		MemoryTelemetry::RecordAllocation(MemoryTelemetry::Heap::DescriptorHeap, tag, allocator.allocationSize(allocation.allocation));
+		MemoryTelemetry::TraceAllocation(MemoryTelemetry::Heap::DescriptorHeap, this, allocation.allocation.offset, elementCount, 1);
+	}
+
+	return allocation;
 }
 
 void DescriptorHeap::Init(ID3D12Device10* device, uint32_t elementMaxCount, D3D12_DESCRIPTOR_HEAP_FLAGS flag)
@@ -53,6 +65,7 @@ void RtvHeap::Init(ID3D12Device10* device, uint32_t elementMaxCount)
 
 RtvHeap::Allocation RtvHeap::Allocate(uint32_t elementCount)
 {
+	std::lock_guard lock(mutex);
 	return
 	{
 		.allocation = allocator.allocate(elementCount),
@@ -74,6 +87,7 @@ void DsvHeap::Init(ID3D12Device10* device, uint32_t elementMaxCount)
 
 DsvHeap::Allocation DsvHeap::Allocate(uint32_t elementCount)
 {
+	std::lock_guard lock(mutex);
 	return
 	{
 		.allocation = allocator.allocate(elementCount),
@@ -134,14 +148,44 @@ void TemporaryDescriptorHeap::Init(DescriptorHeap& parentHeap, uint32_t chunkSiz
 	);
 }
 
+void TemporaryDescriptorHeap::InitRing(DescriptorHeap& parentHeap, RingAllocator& ring)
+{
+	this->parentHeap = &parentHeap;
+	this->ring = &ring;
+}
+
 DescriptorHeap::Id TemporaryDescriptorHeap::Allocate(uint32_t elementCount)
 {
+	if (ring)
+	{
+		const DescriptorHeap::Id id = ring->AllocateOrWait(elementCount, 1, Frame::WaitForFence);
+		if (id != RingAllocator::InvalidOffset)
+		{
+			return id;
+		}
+
+		//the frame alone does not fit into the ring, the overflow comes from the parent heap and lives until the GPU finished the frame
+		ring->stats.overflowCount++;
+		DescriptorHeap::Allocation overflowAllocation = parentHeap->Allocate(elementCount, MemoryTelemetry::Tag::Frame);
+		const DescriptorHeap::Id overflowId = overflowAllocation.Id();
+		Frame::SafeRelease(overflowAllocation);
+		return overflowId;
+	}
+
 	auto allocation = allocator.Allocate(elementCount);
 	assert(allocation.chunk.offset != uint32_t(-1));
 
 	return allocation.chunk.offset + allocation.offset;
 }
 
+void TemporaryDescriptorHeap::Reset()
+{
+	if (!ring)
+	{
+		allocator.Reset();
+	}
+}
+
 DescriptorHandle TemporaryDescriptorHeap::GetDescriptorHandleAt(uint32_t offset) const
 {
 	return parentHeap->baseHandle.Offset(offset);
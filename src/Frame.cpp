@@ -1,13 +1,19 @@
 #include "stdafx.h"
 #include "Frame.h"
 
+#include "HeapTracking.h"
+
 static void WaitForFenceValue(ID3D12Fence* fence, uint64_t value);
 
 namespace Frame
 {
 	static FrameData frameResources[framesInFlightCount];
 	static ComPtr<ID3D12Fence> fence;
-	static uint32_t currentFrameCount = 0;
+	static std::atomic<uint64_t> currentFrameCount = 0;
+
+	static ThreadArena threadArenas[workerThreadsMaxCount];
+	static std::atomic<uint32_t> threadArenasCount = 0;
+	static std::mutex threadArenasMutex;
 
 	static void UpdateTimingData(float forceCpuFrameTime);
 	static std::chrono::high_resolution_clock clock;
@@ -17,16 +23,48 @@ namespace Frame
 
 	static Average<float> averageFrameTime{ 60 };
 
+	static BufferHeap::Allocation gpuMemoryRingAllocation;
+	static DescriptorHeap::Allocation descriptorRingAllocation;
+
 	void Init(ID3D12Device10* device, BufferHeap& parentBufferHeap, DescriptorHeap& parentDescriptorHeap)
 	{
+		if (useGpuMemoryRing)
+		{
+			gpuMemoryRingAllocation = parentBufferHeap.Allocate(gpuMemoryRingSize, 4, MemoryTelemetry::Tag::Frame);
+			gpuMemoryRing.Init(gpuMemoryRingAllocation.offset, gpuMemoryRingSize);
+		}
+
+		if (useDescriptorRing)
+		{
+			descriptorRingAllocation = parentDescriptorHeap.Allocate(descriptorRingSize, MemoryTelemetry::Tag::Frame);
+			descriptorRing.Init(descriptorRingAllocation.Id(), descriptorRingSize);
+		}
+
 		for (uint32_t i = 0; i < framesInFlightCount; i++)
 		{
 			FrameData& frame = frameResources[i];
 			CheckForErrors(device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&frame.commandAllocator)));
 			frame.fenceWaitValue = 0;
-			frame.cpuMemory.Init(cpuMemoryChunkSize);
-			frame.gpuMemory.Init(parentBufferHeap, 1024 * 1024);
-			frame.descriptorHeap.Init(parentDescriptorHeap);
+			frame.cpuMemory.InitVirtual(cpuMemoryReservedSize, cpuMemoryDesc);
+			frame.cpuMemory.telemetryHeap = MemoryTelemetry::Heap::FrameArena;
+
+			if (useGpuMemoryRing)
+			{
+				frame.gpuMemory.InitRing(parentBufferHeap, gpuMemoryRing);
+			}
+			else
+			{
+				frame.gpuMemory.Init(parentBufferHeap, gpuMemoryChunkSize);
+			}
+
+			if (useDescriptorRing)
+			{
+				frame.descriptorHeap.InitRing(parentDescriptorHeap, descriptorRing);
+			}
+			else
+			{
+				frame.descriptorHeap.Init(parentDescriptorHeap);
+			}
 		}
 
 		historyData.frameTime = averageFrameTime.sampleHistory.data();
@@ -34,15 +72,56 @@ namespace Frame
 
 		current = &frameResources[0];
 
+		releaseQueue.Init(deferredReleaseCapacity);
+
 		CheckForErrors(device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&fence)));
 
 		mCreationTime = clock.now();
 	}
 
+	void RegisterWorkerThread()
+	{
+		if (threadArena)
+		{
+			return;
+		}
+
+		std::lock_guard lock(threadArenasMutex);
+		const uint32_t arenaIndex = threadArenasCount.load(std::memory_order_relaxed);
+		assert(arenaIndex < workerThreadsMaxCount);
+
+		ThreadArena& arena = threadArenas[arenaIndex];
+		for (auto& cpuMemory : arena.cpuMemory)
+		{
+			cpuMemory.InitVirtual(workerCpuMemoryReservedSize, cpuMemoryDesc);
+			cpuMemory.telemetryHeap = MemoryTelemetry::Heap::FrameArena;
+		}
+		arena.stackMemory.InitVirtual(workerStackMemoryReservedSize);
+
+		threadArena = &arena;
+		D3D::threadStackAllocator = &arena.stackMemory;
+
+		//publish only after initialization, End() may iterate the arenas concurrently
+		threadArenasCount.store(arenaIndex + 1, std::memory_order_release);
+	}
+
 	void FlushCommandQueue()
 	{
 		WaitForFenceValue(fence.Get(), currentFrameCount);
+		releaseQueue.Retire(fence->GetCompletedValue());
+	}
+
+	uint64_t GetPendingFenceValue()
+	{
+		return currentFrameCount.load(std::memory_order_relaxed) + 1;
 	}
+
+	uint64_t WaitForFence(uint64_t fenceValue)
+	{
+		WaitForFenceValue(fence.Get(), fenceValue);
+		return fence->GetCompletedValue();
+	}
+
 	void Begin()
 	{
 		mBeginFrameTime = clock.now();
@@ -52,48 +131,38 @@ namespace Frame
 	{
 		current->fenceWaitValue = ++currentFrameCount;
 		CheckForErrors(commandQueue->Signal(fence.Get(), current->fenceWaitValue));
+		gpuMemoryRing.EndFrame(current->fenceWaitValue);
+		descriptorRing.EndFrame(current->fenceWaitValue);
 
-		uint32_t currentIndex = currentFrameCount % framesInFlightCount;
+		uint32_t currentIndex = static_cast<uint32_t>(currentFrameCount % framesInFlightCount);
 		current = &frameResources[currentIndex];
 		current->index = currentIndex;
 
 		WaitForFenceValue(fence.Get(), current->fenceWaitValue);
 
-		//now it is safe to release this frame's resources
-		current->releasedResources.clear();
-		current->releasedPsos.clear();
+		const uint64_t completedFenceValue = fence->GetCompletedValue();
+		gpuMemoryRing.Retire(completedFenceValue);
+		descriptorRing.Retire(completedFenceValue);
 
-		for (auto& allocation : current->releasedBufferHeapAllocations)
-		{
-			allocation.Free();
-		}
-		current->releasedBufferHeapAllocations.clear();
+		//now it is safe to release everything the GPU finished with
+		releaseQueue.Retire(completedFenceValue);
 
-		for (auto& allocation : current->releasedDescriptorHeapAllocations)
-		{
-			allocation.Free();
-		}
-		current->releasedDescriptorHeapAllocations.clear();
-
-		for (auto& allocation : current->releasedRtvHeapAllocations)
-		{
-			allocation.Free();
-		}
-		current->releasedRtvHeapAllocations.clear();
+		current->commandAllocator->Reset();
+		current->cpuMemory.Reset();
 
-		for (auto& allocation : current->releasedDsvHeapAllocations)
+		const uint32_t registeredThreadArenasCount = threadArenasCount.load(std::memory_order_acquire);
+		for (uint32_t i = 0; i < registeredThreadArenasCount; i++)
 		{
-			allocation.Free();
+			threadArenas[i].cpuMemory[currentIndex].Reset();
+			threadArenas[i].stackMemory.Reset();
 		}
-		current->releasedDsvHeapAllocations.clear();
-
-		current->commandAllocator->Reset();
-		current->cpuMemory.allocator.Reset();
-		current->gpuMemory.allocator.Reset();
-		current->descriptorHeap.allocator.Reset();
+		current->gpuMemory.Reset();
+		current->descriptorHeap.Reset();
 
 		commandList->Reset(Frame::current->commandAllocator.Get(), nullptr);
 
+		MemoryTelemetry::EndFrame(timingData.frameId);
+		HeapTracking::EndFrame(timingData.frameId);
 		UpdateTimingData(forceCpuFrameTime);
 	}
 
@@ -121,7 +190,7 @@ namespace Frame
 	{
 		if (resource)
 		{
-			current->releasedResources.push_back(std::move(resource));
+			DeferRelease([resource = std::move(resource)]() mutable { resource.Reset(); });
 		}
 	}
 
@@ -129,7 +198,7 @@ namespace Frame
 	{
 		if (pso)
 		{
-			current->releasedPsos.push_back(std::move(pso));
+			DeferRelease([pso = std::move(pso)]() mutable { pso.Reset(); });
 		}
 	}
 
@@ -137,16 +206,24 @@ namespace Frame
 	{
 		if (bufferHeapAllocation.IsValid())
 		{
-			current->releasedBufferHeapAllocations.push_back(bufferHeapAllocation);
+			bufferHeapAllocation.allocator->OnFree(bufferHeapAllocation);
+			DeferRelease([allocation = bufferHeapAllocation]() mutable { allocation.Free(); });
 			bufferHeapAllocation.offset = BufferHeap::InvalidOffset;
 		}
 	}
 
+	void SafeRelease(MirroredBufferBase& mirroredBuffer)
+	{
+		//pending writes are dropped, the shadow copy is never read by the GPU and can go immediately
+		SafeRelease(mirroredBuffer.gpuAllocation);
+		mirroredBuffer.Free();
+	}
+
 	void SafeRelease(DescriptorHeap::Allocation& descriptorHeapAllocation)
 	{
 		if (descriptorHeapAllocation.IsValid())
 		{
-			current->releasedDescriptorHeapAllocations.push_back(descriptorHeapAllocation);
+			DeferRelease([allocation = descriptorHeapAllocation]() mutable { allocation.Free(); });
 			descriptorHeapAllocation = {};
 		}
 	}
@@ -155,7 +232,7 @@ namespace Frame
 	{
 		if (rtvHeapAllocation.IsValid())
 		{
-			current->releasedRtvHeapAllocations.push_back(rtvHeapAllocation);
+			DeferRelease([allocation = rtvHeapAllocation]() mutable { allocation.Free(); });
 			rtvHeapAllocation = {};
 		}
 	}
@@ -164,7 +241,7 @@ namespace Frame
 	{
 		if (dsvHeapAllocation.IsValid())
 		{
-			current->releasedDsvHeapAllocations.push_back(dsvHeapAllocation);
+			DeferRelease([allocation = dsvHeapAllocation]() mutable { allocation.Free(); });
 			dsvHeapAllocation = {};
 		}
 	}
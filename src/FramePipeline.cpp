@@ -0,0 +1,251 @@
+#include "stdafx.h"
+#include "FramePipeline.h"
+
+void FramePipeline::Init(const Desc& desc)
+{
+	assert(!isRunning && desc.simulate);
+	assert(desc.snapshotCount >= 2 && desc.snapshotCount <= snapshotsMaxCount);
+	assert(desc.backPressure != BackPressure::DropOldest || desc.snapshotCount == snapshotsMaxCount);
+	assert(desc.maxFramesAhead >= 1 && desc.maxFramesAhead < desc.snapshotCount);
+
+	this->desc = desc;
+	for (uint32_t i = 0; i < desc.snapshotCount; i++)
+	{
+		snapshots[i].arena.InitVirtual(desc.arenaReservedSizeBytes);
+		snapshots[i].state = State::Free;
+	}
+
+	initTime = std::chrono::steady_clock::now();
+	simulatedFrameCount = 0;
+	lastSimulationBeginMs = 0.0;
+	ResetStatistics();
+
+	isRunning = true;
+	if (desc.mode == Mode::Pipelined)
+	{
+		simulationThread = std::thread(&FramePipeline::SimulationThreadMain, this);
+	}
+}
+
+void FramePipeline::Shutdown()
+{
+	if (!isRunning)
+	{
+		return;
+	}
+
+	{
+		std::lock_guard lock(mutex);
+		assert(CountInState(State::Rendering) == 0);
+		isRunning = false;
+	}
+	snapshotReleased.notify_all();
+	if (simulationThread.joinable())
+	{
+		simulationThread.join();
+	}
+
+	for (uint32_t i = 0; i < desc.snapshotCount; i++)
+	{
+		snapshots[i].arena.Destroy();
+		snapshots[i].data = nullptr;
+		snapshots[i].state = State::Free;
+	}
+}
+
+double FramePipeline::GetTimeMs() const
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - initTime).count();
+}
+
+uint32_t FramePipeline::CountInState(State state) const
+{
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < desc.snapshotCount; i++)
+	{
+		count += snapshots[i].state == state ? 1 : 0;
+	}
+	return count;
+}
+
+FramePipeline::Snapshot* FramePipeline::FindReady(bool isNewest) const
+{
+	const Snapshot* result = nullptr;
+	for (uint32_t i = 0; i < desc.snapshotCount; i++)
+	{
+		const Snapshot& snapshot = snapshots[i];
+		if (snapshot.state == State::Ready && (!result || (snapshot.frameId > result->frameId) == isNewest))
+		{
+			result = &snapshot;
+		}
+	}
+	return const_cast<Snapshot*>(result);
+}
+
+FramePipeline::Snapshot* FramePipeline::AcquireForSimulation(std::unique_lock<std::mutex>& lock)
+{
+	const double waitBeginMs = GetTimeMs();
+	Snapshot* snapshot = nullptr;
+	while (isRunning && !snapshot)
+	{
+		for (uint32_t i = 0; i < desc.snapshotCount && !snapshot; i++)
+		{
+			snapshot = snapshots[i].state == State::Free ? &snapshots[i] : nullptr;
+		}
+
+		if (desc.backPressure == BackPressure::Block)
+		{
+			snapshot = CountInState(State::Ready) < desc.maxFramesAhead ? snapshot : nullptr;
+		}
+		else if (!snapshot)
+		{
+			//the render thread would skip the oldest one anyway
+			snapshot = FindReady(false);
+			statistics.droppedCount += snapshot ? 1 : 0;
+		}
+
+		if (!snapshot && isRunning)
+		{
+			snapshotReleased.wait(lock);
+		}
+	}
+
+	if (!snapshot)
+	{
+		return nullptr;
+	}
+
+	const double nowMs = GetTimeMs();
+	statistics.simulationBlockedMs += nowMs - waitBeginMs;
+
+	snapshot->state = State::Simulating;
+	snapshot->frameId = simulatedFrameCount++;
+	snapshot->elapsedTimeMs = nowMs;
+	snapshot->deltaTimeMs = snapshot->frameId > 0 ? static_cast<float>(nowMs - lastSimulationBeginMs) : 0.0f;
+	snapshot->simulationBeginMs = nowMs;
+	lastSimulationBeginMs = nowMs;
+	return snapshot;
+}
+
+void FramePipeline::Simulate(Snapshot& snapshot)
+{
+	//the snapshot is owned by the calling thread, so this happens without the lock
+	snapshot.arena.Reset();
+	snapshot.data = nullptr;
+	desc.simulate(snapshot);
+}
+
+void FramePipeline::SimulationThreadMain()
+{
+	if (desc.onSimulationThreadStart)
+	{
+		desc.onSimulationThreadStart();
+	}
+
+	std::unique_lock lock(mutex);
+	while (Snapshot* snapshot = AcquireForSimulation(lock))
+	{
+		lock.unlock();
+		Simulate(*snapshot);
+		lock.lock();
+
+		snapshot->simulationEndMs = GetTimeMs();
+		snapshot->state = State::Ready;
+		statistics.simulatedCount++;
+		snapshotReady.notify_one();
+	}
+}
+
+FramePipeline::Snapshot* FramePipeline::AcquireForRender()
+{
+	std::unique_lock lock(mutex);
+	assert(isRunning && CountInState(State::Rendering) == 0);
+
+	if (desc.mode == Mode::Lockstep)
+	{
+		Snapshot* snapshot = AcquireForSimulation(lock);
+		lock.unlock();
+		Simulate(*snapshot);
+		lock.lock();
+
+		snapshot->simulationEndMs = GetTimeMs();
+		snapshot->renderBeginMs = snapshot->simulationEndMs;
+		snapshot->state = State::Rendering;
+		statistics.simulatedCount++;
+		return snapshot;
+	}
+
+	const double waitBeginMs = GetTimeMs();
+	snapshotReady.wait(lock, [this]() { return FindReady(false) != nullptr; });
+
+	Snapshot* snapshot = FindReady(desc.backPressure == BackPressure::DropOldest);
+	if (desc.backPressure == BackPressure::DropOldest)
+	{
+		for (uint32_t i = 0; i < desc.snapshotCount; i++)
+		{
+			if (snapshots[i].state == State::Ready && &snapshots[i] != snapshot)
+			{
+				snapshots[i].state = State::Free;
+				statistics.droppedCount++;
+			}
+		}
+	}
+
+	snapshot->state = State::Rendering;
+	snapshot->renderBeginMs = GetTimeMs();
+	statistics.renderStarvedMs += snapshot->renderBeginMs - waitBeginMs;
+	totalFramesAhead += simulatedFrameCount - 1 - snapshot->frameId;
+
+	lock.unlock();
+	snapshotReleased.notify_one();
+	return snapshot;
+}
+
+void FramePipeline::Release(Snapshot* snapshot)
+{
+	{
+		std::lock_guard lock(mutex);
+		assert(snapshot->state == State::Rendering);
+
+		const double latencyMs = GetTimeMs() - snapshot->simulationBeginMs;
+		totalLatencyMs += latencyMs;
+		statistics.maxLatencyMs = Max(statistics.maxLatencyMs, latencyMs);
+		statistics.renderedCount++;
+
+		snapshot->state = State::Free;
+	}
+	snapshotReleased.notify_one();
+}
+
+FramePipeline::Statistics FramePipeline::GetStatistics() const
+{
+	std::lock_guard lock(mutex);
+	Statistics result = statistics;
+	if (result.renderedCount > 0)
+	{
+		result.averageLatencyMs = totalLatencyMs / result.renderedCount;
+		result.averageFramesAhead = static_cast<double>(totalFramesAhead) / result.renderedCount;
+	}
+	return result;
+}
+
+void FramePipeline::ResetStatistics()
+{
+	std::lock_guard lock(mutex);
+	statistics = {};
+	totalLatencyMs = 0.0;
+	totalFramesAhead = 0;
+}
+
+void FramePipeline::WriteStatistics(FILE* file) const
+{
+	const Statistics result = GetStatistics();
+	fprintf(file, "mode: %s, back-pressure: %s, snapshots: %u, max frames ahead: %u\n",
+		desc.mode == Mode::Lockstep ? "lockstep" : "pipelined",
+		desc.backPressure == BackPressure::Block ? "block" : "drop oldest",
+		desc.snapshotCount,
+		desc.maxFramesAhead);
+	fprintf(file, "simulated: %llu, rendered: %llu, dropped: %llu\n", result.simulatedCount, result.renderedCount, result.droppedCount);
+	fprintf(file, "simulation blocked: %.3f ms, render starved: %.3f ms\n", result.simulationBlockedMs, result.renderStarvedMs);
+	fprintf(file, "latency: %.3f ms average, %.3f ms max, %.2f frames ahead on average\n", result.averageLatencyMs, result.maxLatencyMs, result.averageFramesAhead);
+}
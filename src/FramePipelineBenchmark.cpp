@@ -0,0 +1,195 @@
+#include "stdafx.h"
+#include "FramePipelineBenchmark.h"
+
+#include "BenchmarkHelpers.h"
+
+namespace FramePipelineBenchmark
+{
+	static constexpr uint32_t frameCount = 500;
+	static constexpr uint32_t simulationValueCount = 256;
+	static constexpr uint32_t arenaReservedSizeBytes = 1024 * 1024;
+	//the statistics take their timestamps inside of the pipeline lock, a bit later than the render thread
+	static constexpr double latencyToleranceMs = 1.0;
+
+	struct Workload
+	{
+		const char* name;
+		FramePipeline::Mode mode;
+		FramePipeline::BackPressure backPressure;
+		uint32_t snapshotCount;
+		uint32_t maxFramesAhead;
+		double simulationMs; //busy cost of a simulated frame
+		double renderMs; //busy cost of a rendered frame
+	};
+
+	//stands in for RenderData, every value depends on the frame id so a snapshot of another frame or a partially overwritten one is detected
+	struct SimulationData
+	{
+		uint64_t frameId;
+		uint32_t values[simulationValueCount];
+	};
+
+	static uint32_t GetValue(uint64_t frameId, uint32_t index)
+	{
+		return static_cast<uint32_t>(frameId * 2654435761u) ^ index;
+	}
+
+	static bool IsValid(const FramePipeline::Snapshot& snapshot)
+	{
+		const SimulationData& data = snapshot.Get<SimulationData>();
+		bool isValid = data.frameId == snapshot.frameId;
+		for (uint32_t i = 0; i < simulationValueCount; i++)
+		{
+			isValid &= data.values[i] == GetValue(snapshot.frameId, i);
+		}
+		return isValid;
+	}
+
+	static void Spin(double durationMs)
+	{
+		const auto end = std::chrono::steady_clock::now() + std::chrono::duration<double, std::milli>(durationMs);
+		while (std::chrono::steady_clock::now() < end)
+		{
+		}
+	}
+
+	static Result RunWorkload(const Workload& workload)
+	{
+		FramePipeline pipeline;
+		pipeline.Init(
+			{
+				.mode = workload.mode,
+				.backPressure = workload.backPressure,
+				.snapshotCount = workload.snapshotCount,
+				.maxFramesAhead = workload.maxFramesAhead,
+				.arenaReservedSizeBytes = arenaReservedSizeBytes,
+				.simulate = [simulationMs = workload.simulationMs](FramePipeline::Snapshot& snapshot)
+				{
+					SimulationData* data = snapshot.arena.AllocateUninitialized<SimulationData>();
+					data->frameId = snapshot.frameId;
+					for (uint32_t i = 0; i < simulationValueCount; i++)
+					{
+						data->values[i] = GetValue(snapshot.frameId, i);
+					}
+					Spin(simulationMs);
+					snapshot.data = data;
+				}
+			});
+
+		uint32_t handoffViolationCount = 0;
+		double totalLatencyMs = 0.0;
+		double maxLatencyMs = 0.0;
+		uint32_t shortLatencyCount = 0;
+		uint64_t lastFrameId = 0;
+		const bool isDropping = workload.mode == FramePipeline::Mode::Pipelined && workload.backPressure == FramePipeline::BackPressure::DropOldest;
+
+		const double beginMs = pipeline.GetTimeMs();
+		for (uint32_t frame = 0; frame < frameCount; frame++)
+		{
+			FramePipeline::Snapshot* snapshot = pipeline.AcquireForRender();
+			handoffViolationCount += snapshot->state != FramePipeline::State::Rendering || !IsValid(*snapshot);
+
+			//newer than the last rendered frame, and without DropOldest every simulated frame gets rendered in order
+			handoffViolationCount += isDropping ? frame > 0 && snapshot->frameId <= lastFrameId : snapshot->frameId != frame;
+			lastFrameId = snapshot->frameId;
+
+			Spin(workload.renderMs);
+			//the simulation must not have recycled the snapshot while it was rendered
+			handoffViolationCount += !IsValid(*snapshot);
+
+			const double latencyMs = pipeline.GetTimeMs() - snapshot->simulationBeginMs;
+			totalLatencyMs += latencyMs;
+			maxLatencyMs = Max(maxLatencyMs, latencyMs);
+			//at least both stages have run since the simulation of the snapshot began
+			shortLatencyCount += latencyMs < workload.simulationMs + workload.renderMs;
+			pipeline.Release(snapshot);
+		}
+		const double totalMs = pipeline.GetTimeMs() - beginMs;
+
+		pipeline.Shutdown();
+		const FramePipeline::Statistics statistics = pipeline.GetStatistics();
+
+		uint32_t accountingViolationCount = shortLatencyCount;
+		accountingViolationCount += statistics.renderedCount != frameCount;
+		accountingViolationCount += statistics.averageLatencyMs < totalLatencyMs / frameCount || statistics.averageLatencyMs > totalLatencyMs / frameCount + latencyToleranceMs;
+		accountingViolationCount += statistics.maxLatencyMs < maxLatencyMs || statistics.maxLatencyMs > maxLatencyMs + latencyToleranceMs;
+		if (workload.mode == FramePipeline::Mode::Lockstep)
+		{
+			accountingViolationCount += statistics.simulatedCount != frameCount || statistics.droppedCount != 0 || statistics.averageFramesAhead != 0.0;
+		}
+		else
+		{
+			//snapshots simulated but neither rendered nor dropped were still ready at shutdown
+			const uint64_t handledCount = statistics.renderedCount + statistics.droppedCount;
+			accountingViolationCount += statistics.simulatedCount < handledCount || statistics.simulatedCount > handledCount + workload.snapshotCount;
+			if (workload.backPressure == FramePipeline::BackPressure::Block)
+			{
+				accountingViolationCount += statistics.droppedCount != 0 || statistics.averageFramesAhead > workload.maxFramesAhead;
+			}
+			else
+			{
+				//the simulation is faster than the render thread, so there is always something to drop
+				accountingViolationCount += statistics.droppedCount == 0;
+			}
+		}
+
+		return
+		{
+			.workload = workload.name,
+			.frameCount = frameCount,
+			.totalMs = totalMs,
+			.frameMs = totalMs / frameCount,
+			.statistics = statistics,
+			.handoffViolationCount = handoffViolationCount,
+			.accountingViolationCount = accountingViolationCount
+		};
+	}
+
+	std::vector<Result> Run()
+	{
+		const Workload workloads[] =
+		{
+			{ "Lockstep", FramePipeline::Mode::Lockstep, FramePipeline::BackPressure::Block, 2, 1, 1.0, 1.0 },
+			{ "Block (1 frame ahead)", FramePipeline::Mode::Pipelined, FramePipeline::BackPressure::Block, 2, 1, 1.0, 1.0 },
+			{ "Block (2 frames ahead)", FramePipeline::Mode::Pipelined, FramePipeline::BackPressure::Block, 3, 2, 1.0, 1.0 },
+			{ "Block (simulation bound)", FramePipeline::Mode::Pipelined, FramePipeline::BackPressure::Block, 3, 1, 1.0, 0.25 },
+			{ "DropOldest", FramePipeline::Mode::Pipelined, FramePipeline::BackPressure::DropOldest, 3, 1, 0.25, 1.0 },
+		};
+
+		std::vector<Result> results;
+		for (const Workload& workload : workloads)
+		{
+			results.push_back(RunWorkload(workload));
+		}
+		return results;
+	}
+
+	void WriteCsv(FILE* file, std::span<const Result> results)
+	{
+		fprintf(file, "workload,frames,total_ms,frame_ms,simulated,dropped,simulation_blocked_ms,render_starved_ms,average_latency_ms,max_latency_ms,average_frames_ahead,handoff_violations,accounting_violations\n");
+		for (const Result& result : results)
+		{
+			fprintf(file, "%s,%u,%.3f,%.3f,%llu,%llu,%.3f,%.3f,%.3f,%.3f,%.2f,%u,%u\n",
+				result.workload,
+				result.frameCount,
+				result.totalMs,
+				result.frameMs,
+				result.statistics.simulatedCount,
+				result.statistics.droppedCount,
+				result.statistics.simulationBlockedMs,
+				result.statistics.renderStarvedMs,
+				result.statistics.averageLatencyMs,
+				result.statistics.maxLatencyMs,
+				result.statistics.averageFramesAhead,
+				result.handoffViolationCount,
+				result.accountingViolationCount);
+		}
+	}
+
+	bool RunAndWriteCsv(const char* filePath)
+	{
+		const std::vector<Result> results = Run();
+		const bool isValid = std::all_of(results.begin(), results.end(), [](const Result& result) { return result.handoffViolationCount == 0 && result.accountingViolationCount == 0; });
+		return Benchmark::WriteCsvFile(filePath, results, WriteCsv) && isValid;
+	}
+}
@@ -2,11 +2,17 @@
 #include "Geometry.h"
 
 #include "Frame.h"
+#include "JobSystem.h"
+#include "MeshCache.h"
+#include "Meshlets.h"
 #include "Raytracing.h"
 #include "SharedDefines.h"
 
-static Geometry LoadGeometryData(BufferHeap& bufferHeap, const rapidobj::Result& model, std::span<PbrMesh::Submesh> submeshes = {});
-static void LoadMeshMaterials(ID3D12Device10* device, std::span<PbrMesh::MaterialConstants> materialConstants, std::vector<Texture>& textures, DescriptorHeap& descriptorHeap, const rapidobj::Materials& materials);
+static Geometry LoadGeometryData(BufferHeap& bufferHeap, const MeshCache::View& meshCache);
+static void AllocateMeshlets(PbrMesh& mesh, PersistentAllocator& allocator, BufferHeap& bufferHeap, const MeshCache::View& meshCache);
+static void LoadMeshlets(PbrMesh& mesh, PersistentAllocator& allocator, BufferHeap& bufferHeap, const MeshCache::View& meshCache);
+static void LoadMeshMaterials(ID3D12Device10* device, std::span<PbrMesh::MaterialConstants> materialConstants, std::vector<Texture>& textures, DescriptorHeap& descriptorHeap, const MeshCache::View& meshCache);
+static void WriteSubmeshData(PbrMesh& mesh);
 
 const DirectX::XMFLOAT4X4 PbrMesh::InstanceData::identity4x4 = DirectX::XMFLOAT4X4(
 	1.0f, 0.0f, 0.0f, 0.0f,
@@ -67,7 +73,36 @@ BufferHeap::Offset Geometry::GetIndexBufferOffset() const
 
 D3D12_GPU_VIRTUAL_ADDRESS Geometry::GetIndexBufferAddress() const
 {
-	return memory.offset + memory.allocator->parentBuffer.resource->GetGPUVirtualAddress();
+	return memory.allocator->GPUAddress(memory.offset);
+}
+
+void MeshletGeometry::Free()
+{
+	Frame::SafeRelease(memory);
+	memory.offset = BufferHeap::InvalidOffset;
+	meshletCount = 0;
+	vertexCount = 0;
+	triangleCount = 0;
+}
+
+BufferHeap::Offset MeshletGeometry::GetMeshletsOffset() const
+{
+	return memory.offset;
+}
+
+BufferHeap::Offset MeshletGeometry::GetBoundsOffset() const
+{
+	return GetMeshletsOffset() + meshletCount * sizeof(Meshlets::Meshlet);
+}
+
+BufferHeap::Offset MeshletGeometry::GetVerticesOffset() const
+{
+	return GetBoundsOffset() + meshletCount * sizeof(Meshlets::Bounds);
+}
+
+BufferHeap::Offset MeshletGeometry::GetTrianglesOffset() const
+{
+	return GetVerticesOffset() + vertexCount * sizeof(uint32_t);
 }
 
 void PbrMesh::Draw(ID3D12GraphicsCommandList10* commandList) const
@@ -129,9 +164,11 @@ void PbrMesh::CompactBlas()
 void PbrMesh::Free()
 {
 	geometry.Free();
+	meshlets.Free();
 	Frame::SafeRelease(std::move(rayTracingBlas.resource));
 
 	submeshes.Free();
+	submeshMeshletOffsets.Free();
 	std::vector<Texture> textures;
 	for (auto& texture : textures)
 	{
@@ -139,46 +176,58 @@ void PbrMesh::Free()
 	}
 
 	Frame::SafeRelease(materialConstantsBuffer);
-	Frame::SafeRelease(instanceDataBuffer);
+	Frame::SafeRelease(instanceData);
 	Frame::SafeRelease(submeshDataBuffer);
 
-	instanceData.Free();
 	instanceDataOffset = BufferHeap::InvalidOffset;
 	instanceCount = 1;
 	instanceDataPtr = nullptr;
 }
 
-void LoadMeshMaterials(ID3D12Device10* device, std::span<PbrMesh::MaterialConstants> materialConstants, std::vector<Texture>& textures, DescriptorHeap& descriptorHeap, const rapidobj::Materials& materials)
+//translates the material indices of the submeshes to the offsets of their material constants and uploads them
+void WriteSubmeshData(PbrMesh& mesh)
+{
+	for (uint32_t i = 0; i < mesh.submeshes.Count(); i++)
+	{
+		PbrMesh::Submesh& submesh = mesh.submeshes.Get(i);
+		submesh.materialConstantsOffset = submesh.materialConstantsOffset != BufferHeap::InvalidOffset ? mesh.materialConstantsBuffer.Offset(submesh.materialConstantsOffset) : BufferHeap::InvalidOffset;
+
+		mesh.submeshDataBuffer.Write(submesh, i);
+	}
+}
+
+void LoadMeshMaterials(ID3D12Device10* device, std::span<PbrMesh::MaterialConstants> materialConstants, std::vector<Texture>& textures, DescriptorHeap& descriptorHeap, const MeshCache::View& meshCache)
 {
+	const std::span<const MeshCache::Material> materials = meshCache.materials;
 	assert(materialConstants.size() == 1 || materialConstants.size() == materials.size());
 	for (int i = 0; i < materials.size(); i++)
 	{
 		const auto& material = materials[i];
 		auto& materialConstant = materialConstants[i];
-		if (material.diffuse_texname.compare("") != 0)
+		if (const char* textureName = meshCache.GetTextureName(material.albedoTexture))
 		{
-			Texture&& texture = LoadTexture(AnsiToWString(material.diffuse_texname.c_str()).c_str(), device, descriptorHeap, ColorMode::ForceSRGB);
+			Texture&& texture = LoadTexture(AnsiToWString(textureName).c_str(), device, descriptorHeap, ColorMode::ForceSRGB);
 			materialConstant.albedoTextureId = texture.srvId;
 			textures.push_back(std::move(texture));
 		}
 
-		if (material.bump_texname.compare("") != 0)
+		if (const char* textureName = meshCache.GetTextureName(material.normalTexture))
 		{
-			Texture&& texture = LoadTexture(AnsiToWString(material.bump_texname.c_str()).c_str(), device, descriptorHeap, ColorMode::ForceLinear);
+			Texture&& texture = LoadTexture(AnsiToWString(textureName).c_str(), device, descriptorHeap, ColorMode::ForceLinear);
 			materialConstant.normalTextureId = texture.srvId;
 			textures.push_back(std::move(texture));
 		}
 
-		if (material.roughness_texname.compare("") != 0)
+		if (const char* textureName = meshCache.GetTextureName(material.roughnessTexture))
 		{
-			Texture&& texture = LoadTexture(AnsiToWString(material.roughness_texname.c_str()).c_str(), device, descriptorHeap, ColorMode::ForceLinear);
+			Texture&& texture = LoadTexture(AnsiToWString(textureName).c_str(), device, descriptorHeap, ColorMode::ForceLinear);
 			materialConstant.roughnessTextureId = texture.srvId;
 			textures.push_back(std::move(texture));
 		}
 
-		if (material.metallic_texname.compare("") != 0)
+		if (const char* textureName = meshCache.GetTextureName(material.metallicTexture))
 		{
-			Texture&& texture = LoadTexture(AnsiToWString(material.metallic_texname.c_str()).c_str(), device, descriptorHeap, ColorMode::ForceLinear);
+			Texture&& texture = LoadTexture(AnsiToWString(textureName).c_str(), device, descriptorHeap, ColorMode::ForceLinear);
 			materialConstant.metallicTextureId = texture.srvId;
 			textures.push_back(std::move(texture));
 		}
@@ -190,12 +239,34 @@ Geometry CreateGeometry(BufferHeap& heap,
 	std::span<const DirectX::XMFLOAT3> positions,
 	std::span<const DirectX::XMFLOAT3> normals,
 	std::span<const DirectX::XMFLOAT2> uvs)
+{
+	Geometry geometry = AllocateGeometry(heap, static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(positions.size()));
+	WriteGeometry(geometry, indices, positions, normals, uvs);
+	return geometry;
+}
+
+Geometry AllocateGeometry(BufferHeap& heap, uint32_t indexCount, uint32_t vertexCount)
 {
 	Geometry geometryData
 	{
-		.indexCount = static_cast<uint32_t>(indices.size()),
-		.vertexCount = static_cast<uint32_t>(positions.size())
+		.indexCount = indexCount,
+		.vertexCount = vertexCount
 	};
+
+	//create GPU resources for index and vertex buffers
+	const uint32_t totalRequiredMemoryBytes = static_cast<uint32_t>(indexCount * sizeof(uint32_t) + vertexCount * (2 * sizeof(DirectX::XMFLOAT3) + sizeof(DirectX::XMFLOAT2)));
+	geometryData.memory = heap.Allocate(totalRequiredMemoryBytes);
+
+	return geometryData;
+}
+
+void WriteGeometry(Geometry& geometry,
+	std::span<const uint32_t> indices,
+	std::span<const DirectX::XMFLOAT3> positions,
+	std::span<const DirectX::XMFLOAT3> normals,
+	std::span<const DirectX::XMFLOAT2> uvs)
+{
+	assert(indices.size() == geometry.indexCount && positions.size() == geometry.vertexCount);
 	assert(normals.size() == positions.size() && uvs.size() == positions.size());
 
 	uint32_t indicesSizeBytes = static_cast<uint32_t>(indices.size_bytes());
@@ -203,24 +274,46 @@ Geometry CreateGeometry(BufferHeap& heap,
 	uint32_t normalsSizeBytes = static_cast<uint32_t>(normals .size_bytes());
 	uint32_t uvsSizeBytes = static_cast<uint32_t>(uvs.size_bytes());
 
-	//create GPU resources for index and vertex buffers
-	const uint32_t totalRequiredMemoryBytes = indicesSizeBytes + positionsSizeBytes + normalsSizeBytes + uvsSizeBytes;
-	geometryData.memory = heap.Allocate(totalRequiredMemoryBytes);
-
-	uint32_t positionsBufferOffset = geometryData.memory.offset + indicesSizeBytes;
+	uint32_t positionsBufferOffset = geometry.memory.offset + indicesSizeBytes;
 	uint32_t normalsBufferOffset = positionsBufferOffset + positionsSizeBytes;
 	uint32_t uvBufferOffset = normalsBufferOffset + normalsSizeBytes;
 
 	//copy to GPU
-	heap.WriteRaw(geometryData.memory.offset, indices.data(), indicesSizeBytes);
+	const BufferHeap& heap = *geometry.memory.allocator;
+	heap.WriteRaw(geometry.memory.offset, indices.data(), indicesSizeBytes);
 	heap.WriteRaw(positionsBufferOffset, positions.data(), positionsSizeBytes);
 	heap.WriteRaw(normalsBufferOffset, normals.data(), normalsSizeBytes);
 	heap.WriteRaw(uvBufferOffset, uvs.data(), uvsSizeBytes);
 
 	//Calculate geometry aabb
-	DirectX::BoundingBox::CreateFromPoints(geometryData.aabb, geometryData.vertexCount, positions.data(), sizeof(DirectX::XMFLOAT3));
+	DirectX::BoundingBox::CreateFromPoints(geometry.aabb, geometry.vertexCount, positions.data(), sizeof(DirectX::XMFLOAT3));
+}
 
-	return geometryData;
+void WriteGeometry(Geometry& geometry, std::span<const uint8_t> streams, const DirectX::BoundingBox& aabb)
+{
+	assert(streams.size() == geometry.indexCount * sizeof(uint32_t) + geometry.vertexCount * (2 * sizeof(DirectX::XMFLOAT3) + sizeof(DirectX::XMFLOAT2)));
+
+	geometry.memory.allocator->WriteRaw(geometry.memory.offset, streams.data(), static_cast<uint32_t>(streams.size()));
+	geometry.aabb = aabb;
+}
+
+MeshletGeometry AllocateMeshletGeometry(BufferHeap& heap, uint32_t meshletCount, uint32_t vertexCount, uint32_t triangleCount)
+{
+	MeshletGeometry meshletGeometry
+	{
+		.meshletCount = meshletCount,
+		.vertexCount = vertexCount,
+		.triangleCount = triangleCount
+	};
+	meshletGeometry.memory = heap.Allocate(static_cast<uint32_t>(Meshlets::GetStreamsSizeBytes(meshletCount, vertexCount, triangleCount)));
+	return meshletGeometry;
+}
+
+void WriteMeshletGeometry(MeshletGeometry& meshletGeometry, std::span<const uint8_t> streams)
+{
+	assert(streams.size() == Meshlets::GetStreamsSizeBytes(meshletGeometry.meshletCount, meshletGeometry.vertexCount, meshletGeometry.triangleCount));
+
+	meshletGeometry.memory.allocator->WriteRaw(meshletGeometry.memory.offset, streams.data(), static_cast<uint32_t>(streams.size()));
 }
 
 //helper struct to identify unique vertices from vertex data loaded from obj file. A vertex is implicitly defined by an index into each of the position, texture coordinate, and normal lists.
@@ -270,12 +363,21 @@ void SetTemporaryInstanceData(PbrMesh& mesh, LinearAllocator& allocator, Scratch
 	mesh.instanceDataOffset = WriteTemporaryData(bufferHeap, instanceData);
 }
 
+void ApplyInstanceDataUpdates(std::span<const InstanceDataUpdate> updates, ScratchHeap& bufferHeap)
+{
+	for (const InstanceDataUpdate& update : updates)
+	{
+		update.mesh->instanceCount = static_cast<uint32_t>(update.instanceData.size());
+		update.mesh->instanceDataPtr = update.instanceData.data();
+		update.mesh->instanceDataOffset = WriteTemporaryData(bufferHeap, update.instanceData);
+	}
+}
+
 void InitPersistentInstanceData(PbrMesh& mesh, PersistentAllocator& allocator, BufferHeap& bufferHeap, std::span<PbrMesh::InstanceData> instanceData)
 {
 	mesh.instanceCount = static_cast<uint32_t>(instanceData.size());
 
-	mesh.instanceDataBuffer = CreatePersistentBuffer<PbrMesh::InstanceData>(bufferHeap, mesh.instanceCount);
-	mesh.instanceData = AllocatePersistentMemory<PbrMesh::InstanceData>(allocator, mesh.instanceCount);
+	mesh.instanceData = CreateMirroredBuffer<PbrMesh::InstanceData>(bufferHeap, allocator, mesh.instanceCount);
 
 	UpdatePersistentInstanceData(mesh, instanceData);
 }
@@ -283,22 +385,17 @@ void InitPersistentInstanceData(PbrMesh& mesh, PersistentAllocator& allocator, B
 void UpdatePersistentInstanceData(PbrMesh& mesh, const PbrMesh::InstanceData& instanceData, uint32_t elementIndex)
 {
 	assert(elementIndex < mesh.instanceCount);
-	assert(mesh.instanceData.allocation.IsValid() && mesh.instanceDataPtr != nullptr);
-
-	mesh.instanceData.Get(elementIndex) = instanceData;
+	assert(mesh.instanceData.IsValid() && mesh.instanceDataPtr != nullptr);
 
-	mesh.instanceDataBuffer.Write(instanceData, elementIndex);
+	mesh.instanceData.Write(instanceData, elementIndex);
 }
 
 void UpdatePersistentInstanceData(PbrMesh& mesh, std::span<const PbrMesh::InstanceData> instanceData)
 {
 	assert(instanceData.size() == mesh.instanceCount);
-	mesh.instanceDataBuffer.Write(instanceData);
-	mesh.instanceDataOffset = mesh.instanceDataBuffer.Offset();
-
+	mesh.instanceData.Write(instanceData);
+	mesh.instanceDataOffset = mesh.instanceData.Offset();
 	mesh.instanceDataPtr = &mesh.instanceData.Get();
-	std::memcpy(mesh.instanceDataPtr, instanceData.data(), instanceData.size_bytes());
-
 }
 
 PbrMesh LoadMesh(ID3D12Device10* device,
@@ -308,55 +405,141 @@ PbrMesh LoadMesh(ID3D12Device10* device,
 	LPCWSTR fileName)
 {
 	StackContext stackContext;
-	//Load model using rapidobj library
-	rapidobj::Result model;
+	MeshCache::View meshCache;
+	if (!MeshCache::OpenOrCook(meshCache, fileName))
 	{
-		model = rapidobj::ParseFile(fileName);
+		assert(false);
+		return {};
 	}
 
 	PbrMesh mesh;
-	uint32_t submeshCount = static_cast<uint32_t>(model.shapes.size());
+	uint32_t submeshCount = meshCache.header->submeshCount;
 	mesh.submeshes = AllocatePersistentMemory<PbrMesh::Submesh>(allocator, submeshCount);
-	mesh.geometry = LoadGeometryData(bufferHeap, model, { &mesh.submeshes.Get(), submeshCount });
+	std::copy(meshCache.submeshes.begin(), meshCache.submeshes.end(), &mesh.submeshes.Get());
+	mesh.geometry = LoadGeometryData(bufferHeap, meshCache);
+	LoadMeshlets(mesh, allocator, bufferHeap, meshCache);
 
 	//@todo: at the moment, if several materials use the same texture the texture will be uploaded several times
-	const uint32_t materialConstantsCount = Max(static_cast<uint32_t>(model.materials.size()), 1u);//always reserve at least on material constant element for PbrMeshes
+	const uint32_t materialConstantsCount = Max(meshCache.header->materialCount, 1u);//always reserve at least on material constant element for PbrMeshes
 	PbrMesh::MaterialConstants* materialConstants = stackContext.Allocate<PbrMesh::MaterialConstants>(materialConstantsCount);
 	auto materialConstantsSpan = std::span{ materialConstants, materialConstantsCount };
-	LoadMeshMaterials(device, materialConstantsSpan, mesh.textures, descriptorHeap, model.materials);
-	mesh.materialConstantsBuffer = CreatePersistentBuffer<PbrMesh::MaterialConstants>(bufferHeap, materialConstantsCount); 
+	LoadMeshMaterials(device, materialConstantsSpan, mesh.textures, descriptorHeap, meshCache);
+	mesh.materialConstantsBuffer = CreateMirroredBuffer<PbrMesh::MaterialConstants>(bufferHeap, allocator, materialConstantsCount); 
 	mesh.materialConstantsBuffer.Write(materialConstantsSpan);
+	meshCache.Close();
 
 	mesh.submeshDataBuffer = CreatePersistentBuffer<PbrMesh::Submesh>(bufferHeap, submeshCount);
+	WriteSubmeshData(mesh);
 
-	for (uint32_t i = 0; i < submeshCount; i++)
+	return mesh;
+}
+
+static AssetStreaming::Task StreamMesh(AssetStreaming::AssetHandle<PbrMesh> handle, PersistentAllocator& allocator, DescriptorHeap& descriptorHeap, BufferHeap& bufferHeap, std::wstring fileName)
+{
+	co_await AssetStreaming::ResumeOnStreamingThread();
+	//the mapping stays open until the streams are written, @note: a stale cache gets cooked right here on the streaming thread
+	MeshCache::View meshCache;
+	if (!MeshCache::OpenOrCook(meshCache, fileName))
 	{
-		PbrMesh::Submesh& submesh = mesh.submeshes.Get(i);
-		submesh.materialConstantsOffset = submesh.materialConstantsOffset != BufferHeap::InvalidOffset ? mesh.materialConstantsBuffer.Offset(submesh.materialConstantsOffset) : BufferHeap::InvalidOffset;
+		assert(false);
+		co_return;
+	}
 
-		mesh.submeshDataBuffer.Write(submesh, i);
+	//the textures get decoded by the other streaming threads while this one builds the geometry
+	struct MaterialTexture
+	{
+		uint32_t materialIndex;
+		DescriptorHeap::Id PbrMesh::MaterialConstants::* textureId;
+		AssetStreaming::AssetHandle<Texture> texture;
+	};
+	std::vector<MaterialTexture> materialTextures;
+	for (uint32_t i = 0; i < meshCache.materials.size(); i++)
+	{
+		const MeshCache::Material& material = meshCache.materials[i];
+		auto AddTexture = [&](uint32_t textureName, DescriptorHeap::Id PbrMesh::MaterialConstants::* textureId, ColorMode colorMode)
+		{
+			if (meshCache.GetTextureName(textureName))
+			{
+				materialTextures.push_back({ i, textureId, LoadTextureAsync(AnsiToWString(meshCache.GetTextureName(textureName)), descriptorHeap, colorMode) });
+			}
+		};
+		AddTexture(material.albedoTexture, &PbrMesh::MaterialConstants::albedoTextureId, ColorMode::ForceSRGB);
+		AddTexture(material.normalTexture, &PbrMesh::MaterialConstants::normalTextureId, ColorMode::ForceLinear);
+		AddTexture(material.roughnessTexture, &PbrMesh::MaterialConstants::roughnessTextureId, ColorMode::ForceLinear);
+		AddTexture(material.metallicTexture, &PbrMesh::MaterialConstants::metallicTextureId, ColorMode::ForceLinear);
 	}
 
-	return mesh;
+	PbrMesh& mesh = handle.Get();
+	const uint32_t submeshCount = meshCache.header->submeshCount;
+	const uint32_t materialConstantsCount = Max(meshCache.header->materialCount, 1u);
+
+	co_await AssetStreaming::ResumeOnRenderThread();
+	mesh.geometry = AllocateGeometry(bufferHeap, meshCache.header->indexCount, meshCache.header->vertexCount);
+	mesh.submeshes = AllocatePersistentMemory<PbrMesh::Submesh>(allocator, submeshCount);
+	std::copy(meshCache.submeshes.begin(), meshCache.submeshes.end(), &mesh.submeshes.Get());
+	mesh.materialConstantsBuffer = CreateMirroredBuffer<PbrMesh::MaterialConstants>(bufferHeap, allocator, materialConstantsCount);
+	mesh.submeshDataBuffer = CreatePersistentBuffer<PbrMesh::Submesh>(bufferHeap, submeshCount);
+	AllocateMeshlets(mesh, allocator, bufferHeap, meshCache);
+
+	//not registered as relocatable before it is published, so the allocations stay in place while they get written
+	co_await AssetStreaming::ResumeOnStreamingThread();
+	WriteGeometry(mesh.geometry, meshCache.geometry, meshCache.header->aabb);
+	if (mesh.meshlets.IsValid())
+	{
+		WriteMeshletGeometry(mesh.meshlets, meshCache.meshlets);
+	}
+	meshCache.Close();
+
+	const AssetStreaming::RenderThreadContext& context = co_await AssetStreaming::ResumeOnRenderThread();
+	//placeholder material until the textures arrive: the default constants without any texture
+	const std::vector<PbrMesh::MaterialConstants> materialConstants(materialConstantsCount);
+	mesh.materialConstantsBuffer.Write(materialConstants);
+	WriteSubmeshData(mesh);
+	RegisterRelocatable(mesh);
+	mesh.BuildBlas(context.device, context.commandList, *context.scratchBuffer);
+	handle.Publish();
+
+	for (MaterialTexture& materialTexture : materialTextures)
+	{
+		Texture& texture = co_await materialTexture.texture;
+		//textures get published on the render thread, so this usually continues right away
+		co_await AssetStreaming::ResumeOnRenderThread();
+
+		PbrMesh::MaterialConstants constants = mesh.materialConstantsBuffer.Get(materialTexture.materialIndex);
+		constants.*materialTexture.textureId = texture.srvId;
+		mesh.materialConstantsBuffer.Write(constants, materialTexture.materialIndex);
+		mesh.textures.push_back(std::move(texture));
+	}
+}
+
+AssetStreaming::AssetHandle<PbrMesh> LoadMeshAsync(PersistentAllocator& allocator, DescriptorHeap& descriptorHeap, BufferHeap& bufferHeap, std::wstring fileName)
+{
+	AssetStreaming::AssetHandle<PbrMesh> handle = AssetStreaming::AssetHandle<PbrMesh>::Create();
+	StreamMesh(handle, allocator, descriptorHeap, bufferHeap, std::move(fileName));
+	return handle;
 }
 
 Geometry LoadGeometryData(BufferHeap& bufferHeap, LPCWSTR fileName)
 {
-	//Load model using rapidobj library
-	rapidobj::Result model;
+	MeshCache::View meshCache;
+	if (!MeshCache::OpenOrCook(meshCache, fileName))
 	{
-		model = rapidobj::ParseFile(fileName);
+		assert(false);
+		return {};
 	}
 
-	return LoadGeometryData(bufferHeap, model);
+	Geometry geometry = LoadGeometryData(bufferHeap, meshCache);
+	meshCache.Close();
+	return geometry;
 }
 
 void Free(PbrMesh& mesh)
 {
 	mesh.geometry.memory.Free();
+	mesh.meshlets.memory.Free();
+	mesh.submeshMeshletOffsets.Free();
 
 	mesh.materialConstantsBuffer.Free();
-	mesh.instanceDataBuffer.Free();
 	mesh.submeshDataBuffer.Free();
 
 	mesh.instanceData.Free();
@@ -375,110 +558,391 @@ void SetMaterial(PbrMesh& mesh, const PbrMesh::MaterialConstants& material)
 	mesh.submeshDataBuffer.Write(submesh);
 }
 
-Geometry LoadGeometryData(BufferHeap& bufferHeap, const rapidobj::Result& model, std::span<PbrMesh::Submesh> submeshes)
+void RegisterRelocatable(PbrMesh& mesh)
 {
-	assert(submeshes.empty() || submeshes.size() == model.shapes.size());
-	Geometry geometry;
-	StackContext stackContext;
-	DirectX::XMFLOAT3* positions = nullptr;
-	DirectX::XMFLOAT3* normals = nullptr;
-	DirectX::XMFLOAT2* uvs = nullptr;
-	uint32_t* indices = nullptr;
+	BufferHeap& heap = *mesh.geometry.memory.allocator;
+	heap.RegisterRelocatable(mesh.geometry.memory);
+	if (mesh.meshlets.IsValid())
+	{
+		heap.RegisterRelocatable(mesh.meshlets.memory);
+	}
+	//the submeshes are the CPU copy of submeshDataBuffer, which gets rewritten by the callback below
+	heap.RegisterRelocatable(mesh.submeshDataBuffer, {}, std::as_bytes(std::span(&mesh.submeshes.Get(0), mesh.submeshes.Count())));
+
+	heap.RegisterRelocatable(mesh.materialConstantsBuffer.gpuAllocation,
+		[&mesh](BufferHeap::Offset oldOffset, BufferHeap::Offset newOffset)
+		{
+			for (uint32_t i = 0; i < mesh.submeshes.Count(); i++)
+			{
+				PbrMesh::Submesh& submesh = mesh.submeshes.Get(i);
+				if (submesh.materialConstantsOffset != BufferHeap::InvalidOffset)
+				{
+					submesh.materialConstantsOffset = submesh.materialConstantsOffset - oldOffset + newOffset;
+					mesh.submeshDataBuffer.Write(submesh, i);
+				}
+			}
+		},
+		mesh.materialConstantsBuffer.Shadow());
+
+	if (mesh.instanceData.IsValid())
+	{
+		heap.RegisterRelocatable(mesh.instanceData.gpuAllocation,
+			[&mesh](BufferHeap::Offset oldOffset, BufferHeap::Offset newOffset)
+			{
+				if (mesh.instanceDataOffset == oldOffset)
+				{
+					mesh.instanceDataOffset = newOffset;
+				}
+			},
+			mesh.instanceData.Shadow());
+	}
+}
 
-	//For simplicity, determine total number of indices in all submeshes first
-	uint32_t indexTotalCount = 0;
-	for (int shapeIndex = 0; shapeIndex < model.shapes.size(); shapeIndex++)
+Geometry LoadGeometryData(BufferHeap& bufferHeap, const MeshCache::View& meshCache)
+{
+	Geometry geometry = AllocateGeometry(bufferHeap, meshCache.header->indexCount, meshCache.header->vertexCount);
+	WriteGeometry(geometry, meshCache.geometry, meshCache.header->aabb);
+	return geometry;
+}
+
+//the part of loading the meshlets which has to happen on the render thread
+void AllocateMeshlets(PbrMesh& mesh, PersistentAllocator& allocator, BufferHeap& bufferHeap, const MeshCache::View& meshCache)
+{
+	const MeshCache::Header& header = *meshCache.header;
+	mesh.submeshMeshletOffsets = AllocatePersistentMemory<uint32_t>(allocator, header.submeshCount + 1);
+	std::copy(meshCache.submeshMeshletOffsets.begin(), meshCache.submeshMeshletOffsets.end(), &mesh.submeshMeshletOffsets.Get());
+	if (header.meshletCount > 0)
+	{
+		mesh.meshlets = AllocateMeshletGeometry(bufferHeap, header.meshletCount, header.meshletVertexCount, header.meshletTriangleCount);
+	}
+}
+
+void LoadMeshlets(PbrMesh& mesh, PersistentAllocator& allocator, BufferHeap& bufferHeap, const MeshCache::View& meshCache)
+{
+	AllocateMeshlets(mesh, allocator, bufferHeap, meshCache);
+	if (mesh.meshlets.IsValid())
 	{
-		const auto& loadedIndices = model.shapes[shapeIndex].mesh.m_indices;
-		indexTotalCount += static_cast<uint32_t>(loadedIndices.size());
+		WriteMeshletGeometry(mesh.meshlets, meshCache.meshlets);
 	}
+}
 
-	indices = stackContext.Allocate<uint32_t>(indexTotalCount);
-	//Use indexCount as worst case estimate for size of vertex Buffers
-	positions = stackContext.Allocate<DirectX::XMFLOAT3>(indexTotalCount);
-	normals = stackContext.Allocate<DirectX::XMFLOAT3>(indexTotalCount);
-	uvs = stackContext.Allocate<DirectX::XMFLOAT2>(indexTotalCount);
+static uint32_t HashIndices(uint64_t a, uint64_t b, uint64_t c)
+{
+	//murmur3 finalizer over a multiplicative combination
+	uint64_t hash = a * 0x9E3779B185EBCA87ull ^ b * 0xC2B2AE3D27D4EB4Full ^ c * 0x165667B19E3779F9ull;
+	hash ^= hash >> 33;
+	hash *= 0xFF51AFD7ED558CCDull;
+	hash ^= hash >> 33;
+	return static_cast<uint32_t>(hash);
+}
 
-	uint32_t indexCount = 0;
-	uint32_t vertexCount = 0;
+//bucket in [0, capacity) without requiring a power of two capacity
+static uint32_t GetBucket(uint32_t hash, uint32_t capacity)
+{
+	return static_cast<uint32_t>((static_cast<uint64_t>(hash) * capacity) >> 32);
+}
+
+//maps every position of the model to the first position in the same grid cell, the hash table comes from the scratch context
+static void WeldPositions(StackContext& scratchContext, const rapidobj::Result& model, float epsilon, int* positionRemap)
+{
+	const auto& loadedPositions = model.attributes.positions;
+	const uint32_t positionCount = static_cast<uint32_t>(loadedPositions.size() / 3);
 
-	for (int shapeIndex = 0; shapeIndex < model.shapes.size(); shapeIndex++)
+	auto GetCell = [&loadedPositions, epsilon](int position, uint32_t component)
+	{
+		return static_cast<int64_t>(std::floor(loadedPositions[position * 3 + component] / epsilon));
+	};
+	auto IsSameCell = [&GetCell](int a, int b)
 	{
-		//list of triangle indices determines assembly of primitves in mesh. However, index saved in .obj file is multicomponent index, where each component is an index into a separate respective list of positions, texture coordinates, and normals
-		const auto& loadedIndices = model.shapes[shapeIndex].mesh.m_indices;
+		return GetCell(a, 0) == GetCell(b, 0) && GetCell(a, 1) == GetCell(b, 1) && GetCell(a, 2) == GetCell(b, 2);
+	};
 
-		PbrMesh::Submesh subMesh;
-		subMesh.materialConstantsOffset = model.shapes[shapeIndex].mesh.material_ids.front(); //assumption: materialId constant for each shape
-		subMesh.indexCount = static_cast<uint32_t>(loadedIndices.size());
-		subMesh.startIndexLocation = indexCount;
-		uint32_t baseVertexLocation = vertexCount;
-		indexCount += subMesh.indexCount;
+	//holds position indices, -1 for empty slots
+	const uint32_t tableCapacity = 2 * positionCount;
+	int* table = scratchContext.AllocateUninitialized<int>(tableCapacity);
+	std::fill(table, table + tableCapacity, -1);
+	for (int position = 0; position < static_cast<int>(positionCount); position++)
+	{
+		uint32_t bucket = GetBucket(HashIndices(GetCell(position, 0), GetCell(position, 1), GetCell(position, 2)), tableCapacity);
+		while (table[bucket] != -1 && !IsSameCell(table[bucket], position))
+		{
+			bucket = bucket + 1 < tableCapacity ? bucket + 1 : 0;
+		}
+		if (table[bucket] == -1)
+		{
+			table[bucket] = position;
+		}
+		positionRemap[position] = table[bucket];
+	}
+}
 
-		const auto& loadedPositions = model.attributes.positions;
-		const auto& loadedNormals = model.attributes.normals;
-		const auto& loadedUvs = model.attributes.texcoords;
+//the implicit vertex of an index of a shape, with the position index remapped if positions get welded
+static ImplicitVertex GetImplicitVertex(const rapidobj::Index& loadedIndex, uint32_t index, const int* positionRemap)
+{
+	const int position = positionRemap ? positionRemap[loadedIndex.position_index] : loadedIndex.position_index;
+	return { index, position, loadedIndex.texcoord_index, loadedIndex.normal_index };
+}
 
-		//In order to use this with d3d api index buffer and vertex streams, unique vertices  (i.e. unique combination of position, texture coordinate, and normal indices) need to be identified
+static void GetImplicitVertices(const rapidobj::Result& model, uint32_t shapeIndex, const int* positionRemap, ImplicitVertex* implicitVertices)
+{
+	const auto& loadedIndices = model.shapes[shapeIndex].mesh.m_indices;
+	for (uint32_t i = 0; i < loadedIndices.size(); i++)
+	{
+		implicitVertices[i] = GetImplicitVertex(loadedIndices[i], i, positionRemap);
+	}
+}
+
+//Both weld functions write shape local indices, with the unique vertices ordered by their .obj indices, and return the unique vertex count. uniqueVertices is scratch memory of the shape's index count
+static uint32_t WeldShapeSort(const rapidobj::Result& model, uint32_t shapeIndex, const int* positionRemap, uint32_t* indices, ImplicitVertex* uniqueVertices)
+{
+	const uint32_t implicitVertexCount = static_cast<uint32_t>(model.shapes[shapeIndex].mesh.m_indices.size());
+	if (implicitVertexCount == 0)
+	{
+		return 0;
+	}
+
+	//copy vertices defined by the three indices to own sortable helper struct, also remembering their original position in index list in order to rebuild topology correctly.
+	ImplicitVertex* implicitVertices = uniqueVertices;
+	GetImplicitVertices(model, shapeIndex, positionRemap, implicitVertices);
+
+	//sort the list using Index::operator< for comparison to put duplicate vertices adjacent to one another
+	std::sort(implicitVertices, implicitVertices + implicitVertexCount);
 
-		//copy vertices defined by the three indices to own sortable helper struct, also remembering their original position in index list in order to rebuild topology correctly.
-		ImplicitVertex* implicitVertices;
-		implicitVertices = stackContext.Allocate<ImplicitVertex>(subMesh.indexCount);
-		uint32_t implicitVertexCount = 0;
-		for (unsigned int i = subMesh.startIndexLocation; i < indexCount; i++, implicitVertexCount++)
+	//remove duplicates from list (more precisely: rebuild list without duplicates in place) and also build final index buffer holding the correct index of the unique vertex
+	ImplicitVertex lastUniqueVertex = implicitVertices[0];
+	uint32_t uniqueVertexCount = 1;
+	for (uint32_t i = 0; i < implicitVertexCount; i++)
+	{
+		ImplicitVertex& thisVertex = implicitVertices[i];
+		//this vertex is unique, if it is different from the previous unique vertex
+		if (lastUniqueVertex != thisVertex)
 		{
-			implicitVertices[i - subMesh.startIndexLocation] = { i, loadedIndices[i - subMesh.startIndexLocation].position_index, loadedIndices[i - subMesh.startIndexLocation].texcoord_index, loadedIndices[i - subMesh.startIndexLocation].normal_index };
+			//uniqueVertexCount is always smaller or equal i, and elements with position <= i in indexVector are not needed any more and can be overwritten to build unique vertex vector in place
+			implicitVertices[uniqueVertexCount++] = thisVertex;
+			lastUniqueVertex = thisVertex;
 		}
+		//put index of the current unique vertex at correct position in index buffer
+		indices[thisVertex.originalIndexListPosition] = uniqueVertexCount - 1;
+	}
+	return uniqueVertexCount;
+}
+
+//table holds indices into uniqueVertices, ~0u for empty slots. Emits the unique vertices in the order of their first use, they get sorted afterwards
+static uint32_t WeldShapeHash(const rapidobj::Result& model, uint32_t shapeIndex, const int* positionRemap, uint32_t* indices, ImplicitVertex* uniqueVertices, uint32_t* table, uint32_t tableCapacity)
+{
+	static constexpr uint32_t emptySlot = ~0u;
+	std::fill(table, table + tableCapacity, emptySlot);
 
-		//sort the list using Index::operator< for comparison to put duplicate vertices adjacent to one another
-		std::sort(implicitVertices, implicitVertices + implicitVertexCount);
+	const auto& loadedIndices = model.shapes[shapeIndex].mesh.m_indices;
+	uint32_t uniqueVertexCount = 0;
+	for (uint32_t i = 0; i < loadedIndices.size(); i++)
+	{
+		const ImplicitVertex vertex = GetImplicitVertex(loadedIndices[i], i, positionRemap);
 
-		//remove duplicates from list (more precisely: rebuild list without duplicates in place) and also build final index buffer holding the correct index of the unique vertex
-		uint32_t uniqueVertexCount = 0;
+		uint32_t bucket = GetBucket(HashIndices(vertex.position, vertex.coordinate, vertex.normal), tableCapacity);
+		while (table[bucket] != emptySlot && uniqueVertices[table[bucket]] != vertex)
+		{
+			bucket = bucket + 1 < tableCapacity ? bucket + 1 : 0;
+		}
+		if (table[bucket] == emptySlot)
 		{
-			//create index buffer with the same size as loaded index Buffer
-			ImplicitVertex lastUniqueVertex = implicitVertices[0];
-			uniqueVertexCount = 1;
-			for (size_t i = 0; i < implicitVertexCount; i++)
+			table[bucket] = uniqueVertexCount;
+			uniqueVertices[uniqueVertexCount++] = vertex;
+		}
+		indices[i] = table[bucket];
+	}
+
+	//sorting only the unique vertices is much cheaper than sorting all implicit vertices like WeldShapeSort() does, the table is not needed anymore and maps old to new vertex indices
+	for (uint32_t i = 0; i < uniqueVertexCount; i++)
+	{
+		uniqueVertices[i].originalIndexListPosition = i;
+	}
+	std::sort(uniqueVertices, uniqueVertices + uniqueVertexCount);
+	for (uint32_t i = 0; i < uniqueVertexCount; i++)
+	{
+		table[uniqueVertices[i].originalIndexListPosition] = i;
+	}
+	for (uint32_t i = 0; i < loadedIndices.size(); i++)
+	{
+		indices[i] = table[indices[i]];
+	}
+
+	return uniqueVertexCount;
+}
+
+//per shape work goes wide if the calling thread may use the job system, e.g. not on the streaming threads
+template <typename F>
+static void ForEachShape(uint32_t shapeCount, const F& function)
+{
+	if (JobSystem::IsJobThread())
+	{
+		JobSystem::ParallelFor(shapeCount, 1, [&function](uint32_t begin, uint32_t end)
 			{
-				ImplicitVertex& thisVertex = implicitVertices[i];
-				//this vertex is unique, if it is different from the previous unique vertex
-				if (lastUniqueVertex != thisVertex)
+				for (uint32_t shapeIndex = begin; shapeIndex < end; shapeIndex++)
 				{
-					//uniqueVertexCount is always smaller or equal i, and elements with position <= i in indexVector are not needed any more and can be overwritten to build unique vertex vector in place
-					implicitVertices[uniqueVertexCount++] = thisVertex;
-					lastUniqueVertex = thisVertex;
+					function(shapeIndex);
 				}
-				//put index of the current unique vertex at correct position in index buffer
-				indices[thisVertex.originalIndexListPosition] = baseVertexLocation + uniqueVertexCount - 1;
-			}
-			//index buffer is made up of only unique vertices
-			vertexCount += uniqueVertexCount;
+			});
+	}
+	else
+	{
+		for (uint32_t shapeIndex = 0; shapeIndex < shapeCount; shapeIndex++)
+		{
+			function(shapeIndex);
 		}
+	}
+}
 
-		//now implicitVertices truly contains only unique vertices
-		implicitVertexCount = uniqueVertexCount; 
-		ImplicitVertex* uniqueVertices = implicitVertices;
+GeometryData BuildGeometryData(StackContext& stackContext, const rapidobj::Result& model, std::span<PbrMesh::Submesh> submeshes, const VertexWeldingDesc& weldingDesc, const MeshOptimizer::Desc& optimizationDesc)
+{
+	assert(submeshes.empty() || submeshes.size() == model.shapes.size());
+	const uint32_t shapeCount = static_cast<uint32_t>(model.shapes.size());
+	const bool isHashWelding = weldingDesc.welding == VertexWelding::Hash;
+
+	//index ranges of the shapes are known upfront, the vertex ranges only once the shapes are welded. Prefix sums with one more element than shapes, the last one is the total
+	uint32_t* shapeIndexOffsets = stackContext.AllocateUninitialized<uint32_t>(shapeCount + 1);
+	uint32_t* shapeVertexOffsets = stackContext.AllocateUninitialized<uint32_t>(shapeCount + 1);
+	uint32_t* shapeTableOffsets = stackContext.AllocateUninitialized<uint32_t>(shapeCount + 1);
+	shapeIndexOffsets[0] = 0;
+	shapeTableOffsets[0] = 0;
+	for (uint32_t shapeIndex = 0; shapeIndex < shapeCount; shapeIndex++)
+	{
+		const uint32_t shapeIndexCount = static_cast<uint32_t>(model.shapes[shapeIndex].mesh.m_indices.size());
+		shapeIndexOffsets[shapeIndex + 1] = shapeIndexOffsets[shapeIndex] + shapeIndexCount;
+		//load factor of at most 0.5
+		shapeTableOffsets[shapeIndex + 1] = shapeTableOffsets[shapeIndex] + (isHashWelding ? 2 * shapeIndexCount : 0);
+	}
+	const uint32_t indexCount = shapeIndexOffsets[shapeCount];
 
+	//every element gets written exactly once below, so none of the arrays needs to be initialized
+	uint32_t* indices = stackContext.AllocateUninitialized<uint32_t>(indexCount);
+	int* positionRemap = weldingDesc.positionEpsilon > 0.0f ? stackContext.AllocateUninitialized<int>(static_cast<uint32_t>(model.attributes.positions.size() / 3)) : nullptr;
 
-		//use indices stored in unique vertices to load actual position, texture coordinate, and normal data from loaded lists.
-		for (unsigned int i = 0; i < uniqueVertexCount; i++)
+	{
+		//Welding scratch memory, released before the vertex streams get allocated. The unique vertices are only needed for welding, the vertex streams get filled through the indices.
+		//@note: nothing may be allocated from stackContext while the scratch context is alive
+		StackContext scratchContext(stackContext.allocator);
+		//a shape has at most as many unique vertices as indices, so each one welds into the part matching its index range
+		ImplicitVertex* uniqueVertices = scratchContext.AllocateUninitialized<ImplicitVertex>(indexCount);
+		uint32_t* tables = isHashWelding ? scratchContext.AllocateUninitialized<uint32_t>(shapeTableOffsets[shapeCount]) : nullptr;
+		if (positionRemap)
 		{
-			//The loaded lists are flat, thus  * 3,2 + 0,1,2
-			positions[i + baseVertexLocation] = { loadedPositions[uniqueVertices[i].position * 3 + 0], loadedPositions[uniqueVertices[i].position * 3 + 1], loadedPositions[uniqueVertices[i].position * 3 + 2] };
-			normals[i + baseVertexLocation] = { loadedNormals[uniqueVertices[i].normal * 3 + 0], loadedNormals[uniqueVertices[i].normal * 3 + 1], loadedNormals[uniqueVertices[i].normal * 3 + 2] };
-			uvs[i + baseVertexLocation] = { loadedUvs[uniqueVertices[i].coordinate * 2 + 0], 1.0f - loadedUvs[uniqueVertices[i].coordinate * 2 + 1] }; //need to do 1.0f - v, because of in d3d v axis points down but in blender up (?)
+			WeldPositions(scratchContext, model, weldingDesc.positionEpsilon, positionRemap);
 		}
 
-		if (!submeshes.empty())
+		//shape vertex counts, turned into offsets below
+		ForEachShape(shapeCount, [&](uint32_t shapeIndex)
+			{
+				const uint32_t indexOffset = shapeIndexOffsets[shapeIndex];
+				shapeVertexOffsets[shapeIndex] = isHashWelding ?
+					WeldShapeHash(model, shapeIndex, positionRemap, indices + indexOffset, uniqueVertices + indexOffset, tables + shapeTableOffsets[shapeIndex], shapeTableOffsets[shapeIndex + 1] - shapeTableOffsets[shapeIndex]) :
+					WeldShapeSort(model, shapeIndex, positionRemap, indices + indexOffset, uniqueVertices + indexOffset);
+			});
+	}
+
+	uint32_t vertexCount = 0;
+	for (uint32_t shapeIndex = 0; shapeIndex < shapeCount; shapeIndex++)
+	{
+		const uint32_t shapeVertexCount = shapeVertexOffsets[shapeIndex];
+		shapeVertexOffsets[shapeIndex] = vertexCount;
+		vertexCount += shapeVertexCount;
+	}
+	shapeVertexOffsets[shapeCount] = vertexCount;
+
+	DirectX::XMFLOAT3* positions = stackContext.AllocateUninitialized<DirectX::XMFLOAT3>(vertexCount);
+	DirectX::XMFLOAT3* normals = stackContext.AllocateUninitialized<DirectX::XMFLOAT3>(vertexCount);
+	DirectX::XMFLOAT2* uvs = stackContext.AllocateUninitialized<DirectX::XMFLOAT2>(vertexCount);
+
+	const auto& loadedPositions = model.attributes.positions;
+	const auto& loadedNormals = model.attributes.normals;
+	const auto& loadedUvs = model.attributes.texcoords;
+
+	ForEachShape(shapeCount, [&](uint32_t shapeIndex)
+		{
+			const uint32_t indexOffset = shapeIndexOffsets[shapeIndex];
+			const uint32_t baseVertexLocation = shapeVertexOffsets[shapeIndex];
+
+			//every index writes the attributes of its vertex, duplicates of a vertex write the same data since they have the same .obj indices
+			const auto& loadedIndices = model.shapes[shapeIndex].mesh.m_indices;
+			for (uint32_t i = 0; i < loadedIndices.size(); i++)
+			{
+				const ImplicitVertex vertex = GetImplicitVertex(loadedIndices[i], i, positionRemap);
+				const uint32_t vertexIndex = baseVertexLocation + indices[indexOffset + i];
+				//The loaded lists are flat, thus  * 3,2 + 0,1,2
+				positions[vertexIndex] = { loadedPositions[vertex.position * 3 + 0], loadedPositions[vertex.position * 3 + 1], loadedPositions[vertex.position * 3 + 2] };
+				normals[vertexIndex] = { loadedNormals[vertex.normal * 3 + 0], loadedNormals[vertex.normal * 3 + 1], loadedNormals[vertex.normal * 3 + 2] };
+				uvs[vertexIndex] = { loadedUvs[vertex.coordinate * 2 + 0], 1.0f - loadedUvs[vertex.coordinate * 2 + 1] }; //need to do 1.0f - v, because of in d3d v axis points down but in blender up (?)
+			}
+		});
+
+	//on the shape local indices
+	const bool isOptimized = optimizationDesc.optimizeVertexCache || optimizationDesc.optimizeOverdraw || optimizationDesc.optimizeVertexFetch;
+	const auto OptimizeShape = [&](StackContext& optimizerContext, uint32_t shapeIndex)
+		{
+			const uint32_t indexOffset = shapeIndexOffsets[shapeIndex];
+			const uint32_t baseVertexLocation = shapeVertexOffsets[shapeIndex];
+			const uint32_t shapeVertexCount = shapeVertexOffsets[shapeIndex + 1] - baseVertexLocation;
+			MeshOptimizer::Optimize(optimizerContext, optimizationDesc,
+				{ indices + indexOffset, shapeIndexOffsets[shapeIndex + 1] - indexOffset },
+				{ positions + baseVertexLocation, shapeVertexCount },
+				{ normals + baseVertexLocation, shapeVertexCount },
+				{ uvs + baseVertexLocation, shapeVertexCount });
+		};
+	if (isOptimized)
+	{
+		//Every thread takes the scratch from its own stack allocator. Shapes too large for the worker's remaining stack memory, or running on a thread without one
+		//since the global stack allocator is shared, are left to the calling thread's stack context afterwards
+		bool* isDeferred = stackContext.AllocateUninitialized<bool>(shapeCount);
+		ForEachShape(shapeCount, [&](uint32_t shapeIndex)
+			{
+				const size_t scratchSize = size_t(shapeIndexOffsets[shapeIndex + 1] - shapeIndexOffsets[shapeIndex]) * MeshOptimizer::scratchBytesPerIndex + MeshOptimizer::scratchBaseSize;
+				isDeferred[shapeIndex] = !D3D::threadStackAllocator || D3D::threadStackAllocator->GetAvailableBytes() < scratchSize;
+				if (!isDeferred[shapeIndex])
+				{
+					StackContext optimizerContext(*D3D::threadStackAllocator);
+					OptimizeShape(optimizerContext, shapeIndex);
+				}
+			});
+
+		for (uint32_t shapeIndex = 0; shapeIndex < shapeCount; shapeIndex++)
 		{
-			submeshes[shapeIndex] = subMesh;
+			if (isDeferred[shapeIndex])
+			{
+				OptimizeShape(stackContext, shapeIndex);
+			}
 		}
 	}
 
-	//CalculateTangentFrame();
-	geometry = CreateGeometry(bufferHeap, { indices, indexCount }, { positions, vertexCount }, { normals, vertexCount }, { uvs, vertexCount });
+	ForEachShape(shapeCount, [&](uint32_t shapeIndex)
+		{
+			const uint32_t baseVertexLocation = shapeVertexOffsets[shapeIndex];
+			for (uint32_t i = shapeIndexOffsets[shapeIndex]; i < shapeIndexOffsets[shapeIndex + 1]; i++)
+			{
+				indices[i] += baseVertexLocation;
+			}
+		});
 
-	return geometry;
+	if (!submeshes.empty())
+	{
+		for (uint32_t shapeIndex = 0; shapeIndex < shapeCount; shapeIndex++)
+		{
+			submeshes[shapeIndex] =
+			{
+				.materialConstantsOffset = static_cast<BufferHeap::Offset>(model.shapes[shapeIndex].mesh.material_ids.front()), //assumption: materialId constant for each shape
+				.startIndexLocation = shapeIndexOffsets[shapeIndex],
+				.indexCount = shapeIndexOffsets[shapeIndex + 1] - shapeIndexOffsets[shapeIndex]
+			};
+		}
+	}
+
+	//CalculateTangentFrame();
+	return
+	{
+		.indices = { indices, indexCount },
+		.positions = { positions, vertexCount },
+		.normals = { normals, vertexCount },
+		.uvs = { uvs, vertexCount }
+	};
 }
 
 D3D12_RAYTRACING_GEOMETRY_DESC GetRaytracingGeometryDesc(const Geometry & geometry, RaytracingGeometryType type)
@@ -538,10 +1002,9 @@ RaytracingInstanceGeometryData GetRaytracingInstanceGeometryData(const PbrMesh&
 	};
 }
 
-template <template<typename> typename BufferType> // PersistentBuffer or TemporaryBuffer
-static void WriteTlasInstanceData(BufferType<D3D12_RAYTRACING_INSTANCE_DESC>& instanceBuffer, BufferType<RaytracingInstanceGeometryData>& instanceGeometryDataBuffer, const RaytracingInstanceGeometryData& instanceGeometryData, const DirectX::XMFLOAT4X4& transform, D3D12_GPU_VIRTUAL_ADDRESS asAddress, uint32_t elementIndex)
+static void WriteTlasInstanceData(UploadWriter& instanceWriter, UploadWriter& instanceGeometryDataWriter, const RaytracingInstanceGeometryData& instanceGeometryData, const DirectX::XMFLOAT4X4& transform, D3D12_GPU_VIRTUAL_ADDRESS asAddress, uint32_t elementIndex)
 {
-	instanceGeometryDataBuffer.Write(instanceGeometryData, elementIndex);
+	instanceGeometryDataWriter.Write(elementIndex * sizeof(RaytracingInstanceGeometryData), instanceGeometryData);
 
 	D3D12_RAYTRACING_INSTANCE_DESC instanceDesc =
 	{
@@ -553,7 +1016,7 @@ static void WriteTlasInstanceData(BufferType<D3D12_RAYTRACING_INSTANCE_DESC>& in
 		.AccelerationStructure = asAddress
 	};
 
-	instanceBuffer.Write(instanceDesc, elementIndex);
+	instanceWriter.Write(elementIndex * sizeof(D3D12_RAYTRACING_INSTANCE_DESC), instanceDesc);
 }
 
 static uint32_t CountInstances(std::span<const PbrMesh*> meshes)
@@ -568,14 +1031,15 @@ static uint32_t CountInstances(std::span<const PbrMesh*> meshes)
 }
 
 template <template<typename> typename BufferType> // PersistentBuffer or TemporaryBuffer
-static void BuildTlasHelper(BufferResource& accelerationStructureBuffer,
-	ID3D12Device10* device,
-	ID3D12GraphicsCommandList10* commandList,
+static uint32_t WriteTlasInstances(BufferHeap& bufferHeap,
 	BufferType<D3D12_RAYTRACING_INSTANCE_DESC>& instanceDataBuffer,
 	BufferType<RaytracingInstanceGeometryData>& instanceGeometryDataBuffer,
-	const RWBufferResource& scratchBuffer,
 	std::span<const PbrMesh*> meshes)
 {
+	const uint32_t maxInstanceCount = CountInstances(meshes);
+	UploadWriter instanceWriter(bufferHeap.CpuPtr(instanceDataBuffer.Offset()), maxInstanceCount * sizeof(D3D12_RAYTRACING_INSTANCE_DESC));
+	UploadWriter instanceGeometryDataWriter(bufferHeap.CpuPtr(instanceGeometryDataBuffer.Offset()), maxInstanceCount * sizeof(RaytracingInstanceGeometryData));
+
 	uint32_t instanceCount = 0;
 	for (const auto* mesh : meshes)
 	{
@@ -587,12 +1051,24 @@ static void BuildTlasHelper(BufferResource& accelerationStructureBuffer,
 
 		for (uint32_t i = 0; i < mesh->instanceCount; i++)
 		{
-			WriteTlasInstanceData(instanceDataBuffer, instanceGeometryDataBuffer, GetRaytracingInstanceGeometryData(*mesh), mesh->GetInstanceData(i).transforms, mesh->rayTracingBlas.resource->GetGPUVirtualAddress(), instanceCount);
+			WriteTlasInstanceData(instanceWriter, instanceGeometryDataWriter, GetRaytracingInstanceGeometryData(*mesh), mesh->GetInstanceData(i).transforms, mesh->rayTracingBlas.resource->GetGPUVirtualAddress(), instanceCount);
 			instanceCount++;
 		}
 	}
+	instanceWriter.Flush();
+	instanceGeometryDataWriter.Flush();
 
-	BuildAccelerationStructure(accelerationStructureBuffer, device, commandList, GetTlasInputs(instanceDataBuffer.GPUAddress(), instanceCount), scratchBuffer, L"TLAS");
+	return instanceCount;
+}
+
+static void BuildTlasHelper(BufferResource& accelerationStructureBuffer,
+	ID3D12Device10* device,
+	ID3D12GraphicsCommandList10* commandList,
+	D3D12_GPU_VIRTUAL_ADDRESS instanceDataAddress,
+	uint32_t instanceCount,
+	const RWBufferResource& scratchBuffer)
+{
+	BuildAccelerationStructure(accelerationStructureBuffer, device, commandList, GetTlasInputs(instanceDataAddress, instanceCount), scratchBuffer, L"TLAS");
 
 	ResourceTransitions(commandList, { accelerationStructureBuffer.Barrier(ResourceState::Any, ResourceState::RayTracing) });
 }
@@ -613,28 +1089,43 @@ void PersistentTlas::Build(ID3D12Device10* device,
 	Frame::SafeRelease(instanceGeometryDataBuffer);
 	instanceGeometryDataBuffer = CreatePersistentBuffer<RaytracingInstanceGeometryData>(bufferHeap, instanceCount);
 
-	BuildTlasHelper(accelerationStructureBuffer, device, commandList, instanceDataBuffer, instanceGeometryDataBuffer, scratchBuffer, meshes);
+	const uint32_t writtenInstanceCount = WriteTlasInstances(bufferHeap, instanceDataBuffer, instanceGeometryDataBuffer, meshes);
+	BuildTlasHelper(accelerationStructureBuffer, device, commandList, instanceDataBuffer.GPUAddress(), writtenInstanceCount, scratchBuffer);
 
 	Frame::SafeRelease(srvId);
 	srvId = CreateSrvOnHeap(descriptorHeap, nullptr, GetBufferAccelerationStructureSrvDesc(accelerationStructureBuffer.resource->GetGPUVirtualAddress()));
 }
 
-void TemporaryTlas::Build(ID3D12Device10* device,
-	ID3D12GraphicsCommandList10* commandList,
-	TemporaryDescriptorHeap& descriptorHeap,
-	ScratchHeap& bufferHeap,
-	const RWBufferResource& scratchBuffer,
-	std::span<const PbrMesh*> meshes)
+void TemporaryTlas::WriteInstances(ScratchHeap& bufferHeap, std::span<const PbrMesh*> meshes)
 {
-	uint32_t instanceCount = CountInstances(meshes);
+	const uint32_t maxInstanceCount = CountInstances(meshes);
 
-	TemporaryBuffer instanceDataBuffer = CreateTemporaryBuffer<D3D12_RAYTRACING_INSTANCE_DESC>(bufferHeap, instanceCount, D3D12_RAYTRACING_INSTANCE_DESCS_BYTE_ALIGNMENT);
+	TemporaryBuffer instanceDataBuffer = CreateTemporaryBuffer<D3D12_RAYTRACING_INSTANCE_DESC>(bufferHeap, maxInstanceCount, D3D12_RAYTRACING_INSTANCE_DESCS_BYTE_ALIGNMENT);
 
-	TemporaryBuffer instanceGeometryDataBuffer = CreateTemporaryBuffer<RaytracingInstanceGeometryData>(bufferHeap, instanceCount);
+	TemporaryBuffer instanceGeometryDataBuffer = CreateTemporaryBuffer<RaytracingInstanceGeometryData>(bufferHeap, maxInstanceCount);
 	instanceGeometryDataOffset = instanceGeometryDataBuffer.offset;
 
-	BuildTlasHelper(accelerationStructureBuffer, device, commandList, instanceDataBuffer, instanceGeometryDataBuffer, scratchBuffer, meshes);
+	instanceCount = WriteTlasInstances(*bufferHeap.parentHeap, instanceDataBuffer, instanceGeometryDataBuffer, meshes);
+	instanceDataAddress = instanceDataBuffer.GPUAddress();
+}
+
+void TemporaryTlas::Build(ID3D12Device10* device,
+	ID3D12GraphicsCommandList10* commandList,
+	TemporaryDescriptorHeap& descriptorHeap,
+	const RWBufferResource& scratchBuffer)
+{
+	BuildTlasHelper(accelerationStructureBuffer, device, commandList, instanceDataAddress, instanceCount, scratchBuffer);
 
 	srvId = CreateSrvOnHeap(descriptorHeap, nullptr, GetBufferAccelerationStructureSrvDesc(accelerationStructureBuffer.resource->GetGPUVirtualAddress()));
 }
 
+void TemporaryTlas::Build(ID3D12Device10* device,
+	ID3D12GraphicsCommandList10* commandList,
+	TemporaryDescriptorHeap& descriptorHeap,
+	ScratchHeap& bufferHeap,
+	const RWBufferResource& scratchBuffer,
+	std::span<const PbrMesh*> meshes)
+{
+	WriteInstances(bufferHeap, meshes);
+	Build(device, commandList, descriptorHeap, scratchBuffer);
+}
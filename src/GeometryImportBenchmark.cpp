@@ -0,0 +1,104 @@
+#include "stdafx.h"
+#include "GeometryImportBenchmark.h"
+
+#include "BenchmarkHelpers.h"
+#include "Geometry.h"
+#include "JobSystem.h"
+
+#include <thread>
+
+namespace GeometryImportBenchmark
+{
+	static constexpr float positionWeldEpsilon = 1e-4f;
+	//welding only, the optimization stages have their own benchmark
+	static constexpr MeshOptimizer::Desc noOptimizationDesc = { .optimizeVertexCache = false, .optimizeOverdraw = false, .optimizeVertexFetch = false };
+
+	std::vector<Result> Run(uint32_t maxThreadCount)
+	{
+		maxThreadCount = Min(maxThreadCount > 0 ? maxThreadCount : Max(std::thread::hardware_concurrency(), 1u), JobSystem::workersMaxCount + 1);
+
+		struct Workload
+		{
+			const char* name;
+			VertexWeldingDesc weldingDesc;
+		};
+
+		const Workload workloads[] =
+		{
+			{ "Sort welding", { .welding = VertexWelding::Sort } },
+			{ "Hash welding", { .welding = VertexWelding::Hash } },
+			{ "Hash welding with position epsilon", { .welding = VertexWelding::Hash, .positionEpsilon = positionWeldEpsilon } },
+		};
+
+		//the main thread is not registered with Frame, so it gets its own stack allocator. The workers don't need one, optimization is off and the welding only allocates on the calling thread
+		StackAllocator stackAllocator;
+		stackAllocator.InitVirtual(Benchmark::stackMemoryReservedSize);
+
+		std::vector<Result> results;
+		for (const wchar_t* meshFileName : Benchmark::meshFileNames)
+		{
+			const rapidobj::Result model = rapidobj::ParseFile(meshFileName);
+			if (model.error)
+			{
+				continue;
+			}
+
+			const std::string name = WStringToAnsi(meshFileName);
+			double singleThreadSortMs = 0.0;
+			for (uint32_t threadCount = 1; threadCount <= maxThreadCount; threadCount++)
+			{
+				JobSystem::Init({ .workerCount = threadCount - 1 });
+				for (const Workload& workload : workloads)
+				{
+					uint64_t triangleCount = 0;
+					uint64_t vertexCount = 0;
+					const double totalMs = Benchmark::MeasureBest([&]()
+						{
+							StackContext stackContext(stackAllocator);
+							const GeometryData data = BuildGeometryData(stackContext, model, {}, workload.weldingDesc, noOptimizationDesc);
+							triangleCount = data.indices.size() / 3;
+							vertexCount = data.positions.size();
+						});
+
+					singleThreadSortMs = threadCount == 1 && workload.weldingDesc.welding == VertexWelding::Sort ? totalMs : singleThreadSortMs;
+					results.push_back(
+						{
+							.workload = workload.name,
+							.meshFileName = name,
+							.threadCount = threadCount,
+							.triangleCount = triangleCount,
+							.vertexCount = vertexCount,
+							.totalMs = totalMs,
+							.speedup = singleThreadSortMs / totalMs
+						});
+				}
+				JobSystem::Shutdown();
+			}
+		}
+
+		stackAllocator.Destroy();
+		return results;
+	}
+
+	void WriteCsv(FILE* file, std::span<const Result> results)
+	{
+		fprintf(file, "workload,mesh,threads,triangles,vertices,total_ms,mtri_per_s,speedup\n");
+		for (const Result& result : results)
+		{
+			fprintf(file, "%s,%s,%u,%llu,%llu,%.3f,%.2f,%.2f\n",
+				result.workload,
+				result.meshFileName.c_str(),
+				result.threadCount,
+				result.triangleCount,
+				result.vertexCount,
+				result.totalMs,
+				result.triangleCount * 1e-3 / result.totalMs,
+				result.speedup);
+		}
+	}
+
+	bool RunAndWriteCsv(const char* filePath, uint32_t maxThreadCount)
+	{
+		return Benchmark::WriteCsvFile(filePath, Run(maxThreadCount), WriteCsv);
+	}
+}
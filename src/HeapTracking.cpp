@@ -0,0 +1,416 @@
+#include "stdafx.h"
+#include "HeapTracking.h"
+
+#include <crtdbg.h>
+#include <dbghelp.h>
+#include <new>
+
+//set by the replaced operator new and delete, so the CRT allocation hook does not count the malloc() underneath a second time
+static thread_local bool isInsideOperatorNew = false;
+
+namespace HeapTracking
+{
+	struct FrameRecord
+	{
+		uint64_t frameId;
+		uint64_t allocationCount;
+		uint64_t allocatedBytes;
+	};
+
+	static Desc desc;
+	static ThreadCounters threadCounters[threadsMaxCount];
+	static std::atomic<uint32_t> threadCountersCount = 0;
+
+	static Sample samples[samplesMaxCount];
+	static std::atomic<uint64_t> sampleCount = 0;
+
+	static FrameRecord frameHistory[frameHistoryCount];
+	static uint64_t trackedFrameCount = 0;
+	static uint64_t lastAllocationCount = 0;
+	static uint64_t lastAllocatedBytes = 0;
+	static std::atomic<uint64_t> currentFrameId = 0;
+	static std::atomic<bool> isSteadyState = false;
+	static std::atomic<uint32_t> violationCount = 0;
+
+	//all thread locals are trivial, so touching them from within operator new does not allocate
+	static thread_local ThreadCounters* localCounters = nullptr;
+	static thread_local uint32_t localThreadIndex = 0;
+	static thread_local bool isInsideHook = false;
+	static thread_local const char* zeroAllocationRegionName = nullptr; //of the outermost region
+	static thread_local uint64_t zeroAllocationRegionBegin = 0;
+	static thread_local uint32_t zeroAllocationRegionDepth = 0;
+
+	static ThreadCounters& GetThreadCounters()
+	{
+		if (!localCounters)
+		{
+			localThreadIndex = Min(threadCountersCount.fetch_add(1, std::memory_order_relaxed), threadsMaxCount - 1);
+			localCounters = &threadCounters[localThreadIndex];
+		}
+		return *localCounters;
+	}
+
+	static void CaptureSample(size_t size)
+	{
+		Sample& sample = samples[sampleCount.fetch_add(1, std::memory_order_relaxed) % samplesMaxCount];
+		sample.frameId = currentFrameId.load(std::memory_order_relaxed);
+		sample.size = size;
+		sample.threadIndex = localThreadIndex;
+		sample.isInsideZeroAllocationRegion = zeroAllocationRegionName != nullptr;
+		//skips this function and RecordAllocation()
+		sample.backtraceDepth = CaptureStackBackTrace(2, backtraceMaxDepth, sample.backtrace, nullptr);
+	}
+
+#ifdef _DEBUG
+	static int CrtAllocationHook(int allocationType, void* userData, size_t size, int blockType, long requestNumber, const unsigned char* fileName, int lineNumber)
+	{
+		//blocks of the CRT itself are not of interest, operator new reports its allocations on its own
+		if (blockType == _CRT_BLOCK || isInsideOperatorNew)
+		{
+			return TRUE;
+		}
+
+		if (allocationType == _HOOK_ALLOC || allocationType == _HOOK_REALLOC)
+		{
+			RecordAllocation(size);
+		}
+		else if (allocationType == _HOOK_FREE)
+		{
+			RecordFree();
+		}
+		return TRUE;
+	}
+#endif
+
+	void Enable(const Desc& desc)
+	{
+		assert(desc.sampleInterval > 0);
+		HeapTracking::desc = desc;
+		trackedFrameCount = 0;
+		lastAllocationCount = GetAllocationCount();
+		lastAllocatedBytes = GetAllocatedBytes();
+		isSteadyState.store(desc.warmupFrameCount == 0, std::memory_order_relaxed);
+#ifdef _DEBUG
+		_CrtSetAllocHook(CrtAllocationHook);
+#endif
+		isTracking.store(true, std::memory_order_relaxed);
+	}
+
+	void Disable()
+	{
+		isTracking.store(false, std::memory_order_relaxed);
+#ifdef _DEBUG
+		_CrtSetAllocHook(nullptr);
+#endif
+	}
+
+	void RecordAllocation(size_t size)
+	{
+		if (!isTracking.load(std::memory_order_relaxed) || isInsideHook)
+		{
+			return;
+		}
+		isInsideHook = true;
+
+		//counters are only written by their own thread, except for the shared overflow counters
+		ThreadCounters& counters = GetThreadCounters();
+		const uint64_t allocationCount = counters.allocationCount.fetch_add(1, std::memory_order_relaxed) + 1;
+		counters.allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+
+		const bool isViolation = zeroAllocationRegionName && isSteadyState.load(std::memory_order_relaxed);
+		if (isViolation || allocationCount % desc.sampleInterval == 0)
+		{
+			CaptureSample(size);
+		}
+
+		isInsideHook = false;
+	}
+
+	void RecordFree()
+	{
+		if (!isTracking.load(std::memory_order_relaxed) || isInsideHook)
+		{
+			return;
+		}
+		GetThreadCounters().freeCount.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	uint64_t GetAllocationCount()
+	{
+		uint64_t allocationCount = 0;
+		const uint32_t count = Min(threadCountersCount.load(std::memory_order_relaxed), threadsMaxCount);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			allocationCount += threadCounters[i].allocationCount.load(std::memory_order_relaxed);
+		}
+		return allocationCount;
+	}
+
+	uint64_t GetAllocatedBytes()
+	{
+		uint64_t allocatedBytes = 0;
+		const uint32_t count = Min(threadCountersCount.load(std::memory_order_relaxed), threadsMaxCount);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			allocatedBytes += threadCounters[i].allocatedBytes.load(std::memory_order_relaxed);
+		}
+		return allocatedBytes;
+	}
+
+	void BeginZeroAllocationRegion(const char* name)
+	{
+		if (zeroAllocationRegionDepth++ > 0)
+		{
+			return;
+		}
+		zeroAllocationRegionName = name;
+		zeroAllocationRegionBegin = GetThreadCounters().allocationCount.load(std::memory_order_relaxed);
+	}
+
+	void EndZeroAllocationRegion()
+	{
+		assert(zeroAllocationRegionDepth > 0);
+		if (--zeroAllocationRegionDepth > 0)
+		{
+			return;
+		}
+
+		const uint64_t allocationCount = GetThreadCounters().allocationCount.load(std::memory_order_relaxed) - zeroAllocationRegionBegin;
+		if (allocationCount > 0 && isTracking.load(std::memory_order_relaxed) && isSteadyState.load(std::memory_order_relaxed))
+		{
+			violationCount.fetch_add(static_cast<uint32_t>(allocationCount), std::memory_order_relaxed);
+
+			char message[256];
+			sprintf_s(message, "HeapTracking: %llu allocations in zero allocation region %s of frame %llu\n", allocationCount, zeroAllocationRegionName, currentFrameId.load(std::memory_order_relaxed));
+			OutputDebugStringA(message);
+		}
+		zeroAllocationRegionName = nullptr;
+	}
+
+	void EndFrame(uint64_t frameId)
+	{
+		if (!isTracking.load(std::memory_order_relaxed))
+		{
+			return;
+		}
+
+		const uint64_t allocationCount = GetAllocationCount();
+		const uint64_t allocatedBytes = GetAllocatedBytes();
+		frameHistory[trackedFrameCount % frameHistoryCount] =
+		{
+			.frameId = frameId,
+			.allocationCount = allocationCount - lastAllocationCount,
+			.allocatedBytes = allocatedBytes - lastAllocatedBytes
+		};
+		lastAllocationCount = allocationCount;
+		lastAllocatedBytes = allocatedBytes;
+
+		trackedFrameCount++;
+		currentFrameId.store(frameId + 1, std::memory_order_relaxed);
+		isSteadyState.store(trackedFrameCount >= desc.warmupFrameCount, std::memory_order_relaxed);
+	}
+
+	static uint64_t GetFreeCount()
+	{
+		uint64_t freeCount = 0;
+		for (const ThreadCounters& counters : threadCounters)
+		{
+			freeCount += counters.freeCount.load(std::memory_order_relaxed);
+		}
+		return freeCount;
+	}
+
+	uint32_t GetViolationCount()
+	{
+		return violationCount.load(std::memory_order_relaxed);
+	}
+
+	static void WriteSymbol(FILE* file, HANDLE process, void* address)
+	{
+		alignas(SYMBOL_INFO) uint8_t symbolStorage[sizeof(SYMBOL_INFO) + MAX_SYM_NAME];
+		SYMBOL_INFO* symbol = reinterpret_cast<SYMBOL_INFO*>(symbolStorage);
+		symbol->SizeOfStruct = sizeof(SYMBOL_INFO);
+		symbol->MaxNameLen = MAX_SYM_NAME;
+
+		//falls back to the address if symbols are not available
+		DWORD64 displacement = 0;
+		if (!SymFromAddr(process, reinterpret_cast<DWORD64>(address), &displacement, symbol))
+		{
+			fprintf(file, "\t\t0x%p\n", address);
+			return;
+		}
+
+		IMAGEHLP_LINE64 line = { .SizeOfStruct = sizeof(IMAGEHLP_LINE64) };
+		DWORD lineDisplacement = 0;
+		if (SymGetLineFromAddr64(process, reinterpret_cast<DWORD64>(address), &lineDisplacement, &line))
+		{
+			fprintf(file, "\t\t%s (%s:%lu)\n", symbol->Name, line.FileName, line.LineNumber);
+		}
+		else
+		{
+			fprintf(file, "\t\t%s\n", symbol->Name);
+		}
+	}
+
+	void WriteReport(FILE* file)
+	{
+		const bool wasInsideHook = isInsideHook;
+		isInsideHook = true;
+
+		const uint64_t recordedFrameCount = Min(trackedFrameCount, static_cast<uint64_t>(frameHistoryCount));
+		uint64_t steadyStateFramesWithAllocations = 0;
+		uint64_t maxFrameAllocationCount = 0;
+		for (uint64_t i = 0; i < recordedFrameCount; i++)
+		{
+			const FrameRecord& frame = frameHistory[(trackedFrameCount - recordedFrameCount + i) % frameHistoryCount];
+			const bool isWarmup = trackedFrameCount - recordedFrameCount + i < desc.warmupFrameCount;
+			steadyStateFramesWithAllocations += !isWarmup && frame.allocationCount > 0;
+			maxFrameAllocationCount = isWarmup ? maxFrameAllocationCount : Max(maxFrameAllocationCount, frame.allocationCount);
+		}
+
+		fprintf(file, "Heap allocations: %llu (%llu bytes), frees: %llu, threads: %u\n", GetAllocationCount(), GetAllocatedBytes(), GetFreeCount(), Min(threadCountersCount.load(), threadsMaxCount));
+		fprintf(file, "Frames: %llu (warmup %u), steady state frames with allocations: %llu, max allocations per steady state frame: %llu\n", trackedFrameCount, desc.warmupFrameCount, steadyStateFramesWithAllocations, maxFrameAllocationCount);
+		fprintf(file, "Allocations in zero allocation regions: %u\n\n", GetViolationCount());
+
+		fprintf(file, "Allocating frames (last %llu frames):\n", recordedFrameCount);
+		for (uint64_t i = 0; i < recordedFrameCount; i++)
+		{
+			const FrameRecord& frame = frameHistory[(trackedFrameCount - recordedFrameCount + i) % frameHistoryCount];
+			if (frame.allocationCount > 0)
+			{
+				fprintf(file, "\tframe %llu: %llu allocations, %llu bytes\n", frame.frameId, frame.allocationCount, frame.allocatedBytes);
+			}
+		}
+
+		//group the samples by call site
+		std::vector<const Sample*> sortedSamples;
+		const uint64_t validSampleCount = Min(sampleCount.load(std::memory_order_relaxed), static_cast<uint64_t>(samplesMaxCount));
+		for (uint64_t i = 0; i < validSampleCount; i++)
+		{
+			sortedSamples.push_back(&samples[i]);
+		}
+		const auto isSameCallSite = [](const Sample* a, const Sample* b)
+		{
+			return a->backtraceDepth == b->backtraceDepth && std::equal(a->backtrace, a->backtrace + a->backtraceDepth, b->backtrace);
+		};
+		std::sort(sortedSamples.begin(), sortedSamples.end(), [](const Sample* a, const Sample* b)
+			{
+				return std::lexicographical_compare(a->backtrace, a->backtrace + a->backtraceDepth, b->backtrace, b->backtrace + b->backtraceDepth);
+			});
+
+		struct CallSite
+		{
+			const Sample* sample;
+			uint32_t sampleCount;
+			uint64_t bytes;
+			bool isInsideZeroAllocationRegion;
+		};
+		std::vector<CallSite> callSites;
+		for (const Sample* sample : sortedSamples)
+		{
+			if (callSites.empty() || !isSameCallSite(callSites.back().sample, sample))
+			{
+				callSites.push_back({ .sample = sample });
+			}
+			CallSite& callSite = callSites.back();
+			callSite.sampleCount++;
+			callSite.bytes += sample->size;
+			callSite.isInsideZeroAllocationRegion |= sample->isInsideZeroAllocationRegion;
+		}
+		std::sort(callSites.begin(), callSites.end(), [](const CallSite& a, const CallSite& b)
+			{
+				return a.isInsideZeroAllocationRegion != b.isInsideZeroAllocationRegion ? a.isInsideZeroAllocationRegion : a.sampleCount > b.sampleCount;
+			});
+
+		fprintf(file, "\nSampled call sites (every %u-th allocation per thread and all allocations in zero allocation regions, marked with *):\n", desc.sampleInterval);
+		const HANDLE process = GetCurrentProcess();
+		SymSetOptions(SYMOPT_UNDNAME | SYMOPT_DEFERRED_LOADS | SYMOPT_LOAD_LINES);
+		const bool hasSymbols = SymInitialize(process, nullptr, TRUE);
+		for (const CallSite& callSite : callSites)
+		{
+			fprintf(file, "%s%u samples, %llu bytes, e.g. in frame %llu\n", callSite.isInsideZeroAllocationRegion ? "* " : "", callSite.sampleCount, callSite.bytes, callSite.sample->frameId);
+			for (uint32_t i = 0; i < callSite.sample->backtraceDepth; i++)
+			{
+				WriteSymbol(file, process, callSite.sample->backtrace[i]);
+			}
+		}
+		if (hasSymbols)
+		{
+			SymCleanup(process);
+		}
+
+		isInsideHook = wasInsideHook;
+	}
+
+	bool DumpReport(const char* filePath)
+	{
+		FILE* file;
+		if (fopen_s(&file, filePath, "w") != 0)
+		{
+			return false;
+		}
+
+		WriteReport(file);
+		fclose(file);
+		return true;
+	}
+}
+
+//Replacements of the global allocation functions
+
+static void* AllocateTracked(size_t size, size_t alignment)
+{
+	HeapTracking::RecordAllocation(size);
+
+	const bool wasInsideOperatorNew = isInsideOperatorNew;
+	isInsideOperatorNew = true;
+	void* ptr = alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__ ? _aligned_malloc(Max(size, size_t(1)), alignment) : malloc(Max(size, size_t(1)));
+	isInsideOperatorNew = wasInsideOperatorNew;
+	return ptr;
+}
+
+static void FreeTracked(void* ptr, size_t alignment)
+{
+	if (!ptr)
+	{
+		return;
+	}
+	HeapTracking::RecordFree();
+
+	const bool wasInsideOperatorNew = isInsideOperatorNew;
+	isInsideOperatorNew = true;
+	alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__ ? _aligned_free(ptr) : free(ptr);
+	isInsideOperatorNew = wasInsideOperatorNew;
+}
+
+static void* AllocateTrackedOrThrow(size_t size, size_t alignment)
+{
+	void* ptr = AllocateTracked(size, alignment);
+	if (!ptr)
+	{
+		throw std::bad_alloc();
+	}
+	return ptr;
+}
+
+void* operator new(size_t size) { return AllocateTrackedOrThrow(size, 0); }
+void* operator new[](size_t size) { return AllocateTrackedOrThrow(size, 0); }
+void* operator new(size_t size, std::align_val_t alignment) { return AllocateTrackedOrThrow(size, static_cast<size_t>(alignment)); }
+void* operator new[](size_t size, std::align_val_t alignment) { return AllocateTrackedOrThrow(size, static_cast<size_t>(alignment)); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return AllocateTracked(size, 0); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return AllocateTracked(size, 0); }
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return AllocateTracked(size, static_cast<size_t>(alignment)); }
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return AllocateTracked(size, static_cast<size_t>(alignment)); }
+
+void operator delete(void* ptr) noexcept { FreeTracked(ptr, 0); }
+void operator delete[](void* ptr) noexcept { FreeTracked(ptr, 0); }
+void operator delete(void* ptr, size_t) noexcept { FreeTracked(ptr, 0); }
+void operator delete[](void* ptr, size_t) noexcept { FreeTracked(ptr, 0); }
+void operator delete(void* ptr, std::align_val_t alignment) noexcept { FreeTracked(ptr, static_cast<size_t>(alignment)); }
+void operator delete[](void* ptr, std::align_val_t alignment) noexcept { FreeTracked(ptr, static_cast<size_t>(alignment)); }
+void operator delete(void* ptr, size_t, std::align_val_t alignment) noexcept { FreeTracked(ptr, static_cast<size_t>(alignment)); }
+void operator delete[](void* ptr, size_t, std::align_val_t alignment) noexcept { FreeTracked(ptr, static_cast<size_t>(alignment)); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { FreeTracked(ptr, 0); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { FreeTracked(ptr, 0); }
+void operator delete(void* ptr, std::align_val_t alignment, const std::nothrow_t&) noexcept { FreeTracked(ptr, static_cast<size_t>(alignment)); }
+void operator delete[](void* ptr, std::align_val_t alignment, const std::nothrow_t&) noexcept { FreeTracked(ptr, static_cast<size_t>(alignment)); }
@@ -154,19 +154,35 @@ void UI::DrawGlobalInformationWindow(bool& open)
 
 	const float averageFPS = 1000.0f / Frame::timingData.averageDeltaTimeMs;
 	const float deltaTimeMs = Frame::timingData.deltaTimeMs;
-	const uint32_t globalBufferSize = D3D::globalStaticBuffer.parentBuffer.size;
-	const uint32_t globalBufferUsed = D3D::globalStaticBuffer.parentBuffer.size - D3D::globalStaticBuffer.allocator.storageReport().totalFreeSpace;
+	const uint32_t globalBufferSize = D3D::globalStaticBuffer.GetSize();
+	const uint32_t globalBufferUsed = D3D::globalStaticBuffer.GetUsedSize();
+	const uint32_t globalBufferBlockCount = D3D::globalStaticBuffer.blockCount;
 	const uint32_t descriptorHeapSize = D3D::descriptorHeap.elementMaxCount;
 	const uint32_t descriptorHeapUsed = D3D::descriptorHeap.elementMaxCount - D3D::descriptorHeap.allocator.storageReport().totalFreeSpace;
 	const uint32_t persistentAllocatorSize = D3D::persistentAllocator.totalSize;
 	const uint32_t persistentAllocatorUsed = D3D::persistentAllocator.totalSize - D3D::persistentAllocator.allocator.storageReport().totalFreeSpace;
-	const uint32_t stackAllocatorMaxUsage = D3D::stackAllocator.GetMaxUsageBytes();
-	const uint32_t stackAllocatorReservedMemory = D3D::stackAllocator.GetReservedMemoryBytes();
-	const uint32_t linearAllocatorMaxUsage = Frame::current->cpuMemory.diagnosis.maxSizeInUseByte;
-	const uint32_t linearAllocatorReservedMemory = Frame::current->cpuMemory.allocator.GetReservedMemoryBytes();
+	const uint32_t persistentAllocatorCommittedMemory = static_cast<uint32_t>(D3D::persistentAllocator.virtualMemory.committedBytes);
+	const uint32_t stackAllocatorMaxUsage = static_cast<uint32_t>(D3D::stackAllocator.GetMaxUsageBytes());
+	const uint32_t stackAllocatorReservedMemory = static_cast<uint32_t>(D3D::stackAllocator.GetReservedMemoryBytes());
+	const uint32_t stackAllocatorCommittedMemory = static_cast<uint32_t>(D3D::stackAllocator.GetCommittedMemoryBytes());
+	const uint32_t linearAllocatorMaxUsage = static_cast<uint32_t>(Frame::current->cpuMemory.diagnosis.maxSizeInUseByte);
+	const uint32_t linearAllocatorReservedMemory = static_cast<uint32_t>(Frame::current->cpuMemory.GetReservedMemoryBytes());
+	const uint32_t linearAllocatorCommittedMemory = static_cast<uint32_t>(Frame::current->cpuMemory.GetCommittedMemoryBytes());
 
 	ImGui::Begin("Information: ", &open);
-	char textBuffer[64];
+	char textBuffer[128];
+
+	auto slabStatsText = [&textBuffer](const auto& allocator)
+	{
+		if (!allocator.useSlabs)
+		{
+			return;
+		}
+
+		const auto stats = allocator.GetSlabStats();
+		sprintf_s(textBuffer, "  Slabs: %u (%llu bytes), Live Slots: %llu bytes, Metadata: %llu bytes", stats.slabCount, stats.slabBytes, stats.liveSlotBytes, stats.metadataBytes);
+		ImGui::Text(textBuffer);
+	};
 
 	ImGui::Text("Frame Time");
 	sprintf_s(textBuffer, "%f fps\n %f ms \n", averageFPS, deltaTimeMs);
@@ -177,8 +193,11 @@ void UI::DrawGlobalInformationWindow(bool& open)
 
 	{
 		float progress = static_cast<float>(globalBufferUsed) / globalBufferSize;
-		sprintf_s(textBuffer, "Global Buffer: %u / %u bytes (%.1f %%)", globalBufferUsed, globalBufferSize, 100 * progress);
+		sprintf_s(textBuffer, "Global Buffer: %u / %u bytes in %u blocks (%.1f %%)", globalBufferUsed, globalBufferSize, globalBufferBlockCount, 100 * progress);
 		ImGui::ProgressBar(progress, ImVec2(-1.0, 0), textBuffer);
+		sprintf_s(textBuffer, "  Largest Free Block / Total Free: %.2f", D3D::globalStaticBuffer.GetLargestFreeBlockRatio());
+		ImGui::Text(textBuffer);
+		slabStatsText(D3D::globalStaticBuffer);
 	}
 
 	{
@@ -191,18 +210,71 @@ void UI::DrawGlobalInformationWindow(bool& open)
 		float progress = static_cast<float>(persistentAllocatorUsed) / persistentAllocatorSize;
 		sprintf_s(textBuffer, "Persistent Allocator Usage / Reserved: %u / %u (%.1f %%)", persistentAllocatorUsed, persistentAllocatorSize, 100 * progress);
 		ImGui::ProgressBar(progress, ImVec2(-1.0, 0), textBuffer);
+		sprintf_s(textBuffer, "  Committed: %u bytes", persistentAllocatorCommittedMemory);
+		ImGui::Text(textBuffer);
+		slabStatsText(D3D::persistentAllocator);
 	}
 
 	{
 		float progress = static_cast<float>(linearAllocatorMaxUsage) / linearAllocatorReservedMemory;
 		sprintf_s(textBuffer, "Linear Allocator Usage / Reserved: %u / %u (%.1f %%)", linearAllocatorMaxUsage, linearAllocatorReservedMemory, 100 * progress);
 		ImGui::ProgressBar(progress, ImVec2(-1.0, 0), textBuffer);
+		sprintf_s(textBuffer, "  Committed: %u bytes", linearAllocatorCommittedMemory);
+		ImGui::Text(textBuffer);
 	}
 
 	{
 		float progress = static_cast<float>(stackAllocatorMaxUsage) / stackAllocatorReservedMemory;
 		sprintf_s(textBuffer, "Stack Allocator Usage / Reserved: %u / %u (%.1f %%)", stackAllocatorMaxUsage, stackAllocatorReservedMemory, 100 * progress);
 		ImGui::ProgressBar(progress, ImVec2(-1.0, 0), textBuffer);
+		sprintf_s(textBuffer, "  Committed: %u bytes", stackAllocatorCommittedMemory);
+		ImGui::Text(textBuffer);
+	}
+
+	auto ringStatsText = [&textBuffer](const char* name, const RingAllocator& ring)
+	{
+		const RingAllocator::Stats& stats = ring.stats;
+		float progress = static_cast<float>(stats.maxUsedSize) / ring.size;
+		sprintf_s(textBuffer, "%s Peak / Size: %u / %u (%.1f %%)", name, stats.maxUsedSize, ring.size, 100 * progress);
+		ImGui::ProgressBar(progress, ImVec2(-1.0, 0), textBuffer);
+		sprintf_s(textBuffer, "  Last Frame: %u (padding %u), Max Frame: %u, Wraps: %u, Waits: %u, Overflows: %u", stats.lastFrameSize, stats.lastFramePaddingSize, stats.maxFrameSize, stats.wrapCount, stats.waitCount, stats.overflowCount);
+		ImGui::Text(textBuffer);
+	};
+
+	if (Frame::useGpuMemoryRing)
+	{
+		ringStatsText("Scratch Memory Ring", Frame::gpuMemoryRing);
+	}
+
+	if (Frame::useDescriptorRing)
+	{
+		ringStatsText("Temporary Descriptor Ring", Frame::descriptorRing);
+	}
+
+	if (ImGui::CollapsingHeader("Memory Telemetry"))
+	{
+		if (ImGui::Button("Dump JSON"))
+		{
+			MemoryTelemetry::DumpJson("MemoryTelemetry.json", Frame::timingData.frameId);
+		}
+
+		for (uint32_t heapIndex = 0; heapIndex < MemoryTelemetry::heapCount; heapIndex++)
+		{
+			const MemoryTelemetry::Heap heap = static_cast<MemoryTelemetry::Heap>(heapIndex);
+			ImGui::Text(MemoryTelemetry::GetName(heap));
+			for (uint32_t tagIndex = 0; tagIndex < MemoryTelemetry::tagCount; tagIndex++)
+			{
+				const MemoryTelemetry::Tag tag = static_cast<MemoryTelemetry::Tag>(tagIndex);
+				const MemoryTelemetry::Counters& counters = MemoryTelemetry::GetCounters(heap, tag);
+				if (counters.allocationCount == 0)
+				{
+					continue;
+				}
+
+				sprintf_s(textBuffer, "  %s: live %llu, peak %llu, allocations %llu", MemoryTelemetry::GetName(tag), counters.liveBytes.load(), counters.peakBytes.load(), counters.allocationCount.load());
+				ImGui::Text(textBuffer);
+			}
+		}
 	}
 	ImGui::End();
 }
@@ -9,6 +9,10 @@ namespace Input
 	static float mPreviousMouseX;
 	static float mPreviousMouseY;
 
+	static std::mutex pendingMouseDeltaMutex;
+	static float pendingMouseDeltaX;
+	static float pendingMouseDeltaY;
+
 	void Init(HWND hwnd)
 	{
 		window = hwnd;
@@ -21,6 +25,10 @@ namespace Input
 
 		mMouseX = mouseX;
 		mMouseY = mouseY;
+
+		std::lock_guard lock(pendingMouseDeltaMutex);
+		pendingMouseDeltaX += mMouseX - mPreviousMouseX;
+		pendingMouseDeltaY += mMouseY - mPreviousMouseY;
 	}
 
 	int GetTwoWayAction(int posKey, int negKey)
@@ -42,6 +50,15 @@ namespace Input
 		velocityY = (mMouseY - mPreviousMouseY);
 	}
 
+	void ConsumeMouseDelta(float& deltaX, float& deltaY)
+	{
+		std::lock_guard lock(pendingMouseDeltaMutex);
+		deltaX = pendingMouseDeltaX;
+		deltaY = pendingMouseDeltaY;
+		pendingMouseDeltaX = 0.0f;
+		pendingMouseDeltaY = 0.0f;
+	}
+
 	bool IsPressed(MouseButton button)
 	{
 		switch (button)
@@ -0,0 +1,335 @@
+#include "stdafx.h"
+#include "JobSystem.h"
+
+#include <thread>
+
+namespace JobSystem
+{
+	static constexpr uint32_t InvalidThreadIndex = ~0u;
+
+	struct ThreadData
+	{
+		JobQueue queue;
+		Job jobPool[jobPoolSize];
+		uint32_t allocatedJobCount = 0;
+	};
+
+	static std::unique_ptr<ThreadData[]> threadData;
+	static std::vector<std::thread> workers;
+	static uint32_t threadCount = 0;
+
+	static std::atomic<bool> isRunning = false;
+	//bumped on every submit, idle workers sleep on it
+	static std::atomic<uint32_t> jobGeneration = 0;
+	static std::atomic<uint32_t> sleepingWorkerCount = 0;
+
+	static thread_local uint32_t threadIndex = InvalidThreadIndex;
+	static thread_local uint32_t randomState = 0;
+
+	bool JobQueue::Push(Job* job)
+	{
+		const int64_t bottomIndex = bottom.load(std::memory_order_relaxed);
+		const int64_t topIndex = top.load(std::memory_order_acquire);
+		if (bottomIndex - topIndex >= jobQueueCapacity)
+		{
+			return false;
+		}
+
+		jobs[bottomIndex & (jobQueueCapacity - 1)].store(job, std::memory_order_relaxed);
+		//publishes the job and its payload to thieves
+		bottom.store(bottomIndex + 1, std::memory_order_release);
+		return true;
+	}
+
+	Job* JobQueue::Pop()
+	{
+		const int64_t bottomIndex = bottom.load(std::memory_order_relaxed) - 1;
+		bottom.store(bottomIndex, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t topIndex = top.load(std::memory_order_relaxed);
+
+		if (topIndex > bottomIndex)
+		{
+			//empty
+			bottom.store(bottomIndex + 1, std::memory_order_relaxed);
+			return nullptr;
+		}
+
+		Job* job = jobs[bottomIndex & (jobQueueCapacity - 1)].load(std::memory_order_relaxed);
+		if (topIndex == bottomIndex)
+		{
+			//last job, races with thieves
+			if (!top.compare_exchange_strong(topIndex, topIndex + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			{
+				job = nullptr;
+			}
+			bottom.store(bottomIndex + 1, std::memory_order_relaxed);
+		}
+		return job;
+	}
+
+	Job* JobQueue::Steal()
+	{
+		int64_t topIndex = top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		const int64_t bottomIndex = bottom.load(std::memory_order_acquire);
+		if (topIndex >= bottomIndex)
+		{
+			return nullptr;
+		}
+
+		Job* job = jobs[topIndex & (jobQueueCapacity - 1)].load(std::memory_order_relaxed);
+		if (!top.compare_exchange_strong(topIndex, topIndex + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		{
+			return nullptr;
+		}
+		return job;
+	}
+
+	static void WakeWorker()
+	{
+		jobGeneration.fetch_add(1, std::memory_order_seq_cst);
+		if (sleepingWorkerCount.load(std::memory_order_seq_cst) > 0)
+		{
+			jobGeneration.notify_one();
+		}
+	}
+
+	static void Execute(Job* job);
+
+	static ThreadData& GetThreadData()
+	{
+		assert(threadIndex < threadCount);
+		return threadData[threadIndex];
+	}
+
+	//the job's counter is already incremented
+	static void Enqueue(Job* job)
+	{
+		if (!GetThreadData().queue.Push(job))
+		{
+			Execute(job);
+			return;
+		}
+		WakeWorker();
+	}
+
+	void Execute(Job* job)
+	{
+		Counter* counter = job->counter;
+		job->function(job->payload);
+		if (!counter)
+		{
+			return;
+		}
+
+		//the decrement happens under the lock, so Wait() can tell when the counter is no longer touched
+		Job* dependents[counterDependentsMaxCount];
+		uint32_t dependentsCount = 0;
+		while (counter->dependentsLock.test_and_set(std::memory_order_acquire));
+		if (counter->pendingCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			dependentsCount = counter->dependentsCount;
+			std::copy_n(counter->dependents, dependentsCount, dependents);
+			counter->dependentsCount = 0;
+		}
+		counter->dependentsLock.clear(std::memory_order_release);
+
+		for (uint32_t i = 0; i < dependentsCount; i++)
+		{
+			Enqueue(dependents[i]);
+		}
+	}
+
+	static uint32_t NextRandom()
+	{
+		randomState ^= randomState << 13;
+		randomState ^= randomState >> 17;
+		randomState ^= randomState << 5;
+		return randomState;
+	}
+
+	bool RunPendingJob()
+	{
+		Job* job = GetThreadData().queue.Pop();
+		if (!job)
+		{
+			//one round over all other threads, starting at a random victim
+			const uint32_t firstVictim = NextRandom() % threadCount;
+			for (uint32_t i = 0; i < threadCount && !job; i++)
+			{
+				const uint32_t victim = (firstVictim + i) % threadCount;
+				if (victim != threadIndex)
+				{
+					job = threadData[victim].queue.Steal();
+				}
+			}
+		}
+
+		if (!job)
+		{
+			return false;
+		}
+
+		Execute(job);
+		return true;
+	}
+
+	static void WorkerMain(uint32_t index, void(*onWorkerStart)(uint32_t))
+	{
+		threadIndex = index;
+		randomState = 0x9E3779B9u * index;
+		if (onWorkerStart)
+		{
+			onWorkerStart(index);
+		}
+
+		constexpr uint32_t spinCount = 64;
+		uint32_t idleCount = 0;
+		while (isRunning.load(std::memory_order_relaxed))
+		{
+			if (RunPendingJob())
+			{
+				idleCount = 0;
+				continue;
+			}
+
+			if (++idleCount < spinCount)
+			{
+				std::this_thread::yield();
+				continue;
+			}
+
+			//a submit after reading the generation changes it, so the wait returns right away
+			const uint32_t generation = jobGeneration.load(std::memory_order_seq_cst);
+			if (RunPendingJob())
+			{
+				idleCount = 0;
+				continue;
+			}
+			sleepingWorkerCount.fetch_add(1, std::memory_order_seq_cst);
+			if (isRunning.load(std::memory_order_relaxed))
+			{
+				jobGeneration.wait(generation, std::memory_order_seq_cst);
+			}
+			sleepingWorkerCount.fetch_sub(1, std::memory_order_seq_cst);
+			idleCount = 0;
+		}
+	}
+
+	void Init(const Desc& desc)
+	{
+		assert(!isRunning);
+		const uint32_t hardwareThreadCount = Max(std::thread::hardware_concurrency(), 1u);
+		const uint32_t workerCount = Min(desc.workerCount != workerCountAuto ? desc.workerCount : hardwareThreadCount - 1, workersMaxCount);
+
+		threadCount = workerCount + 1;
+		threadData = std::make_unique<ThreadData[]>(threadCount);
+		threadIndex = 0;
+		randomState = 0x2545F491u;
+
+		isRunning.store(true, std::memory_order_relaxed);
+		workers.reserve(workerCount);
+		for (uint32_t i = 1; i <= workerCount; i++)
+		{
+			workers.emplace_back(WorkerMain, i, desc.onWorkerStart);
+		}
+	}
+
+	void Shutdown()
+	{
+		if (!isRunning)
+		{
+			return;
+		}
+
+		//run what is left, so no job gets lost
+		while (RunPendingJob());
+
+		isRunning.store(false, std::memory_order_relaxed);
+		jobGeneration.fetch_add(1, std::memory_order_seq_cst);
+		jobGeneration.notify_all();
+		for (std::thread& worker : workers)
+		{
+			worker.join();
+		}
+		workers.clear();
+
+		threadData.reset();
+		threadCount = 0;
+		threadIndex = InvalidThreadIndex;
+	}
+
+	uint32_t GetWorkerCount()
+	{
+		return threadCount > 0 ? threadCount - 1 : 0;
+	}
+
+	uint32_t GetThreadIndex()
+	{
+		return threadIndex;
+	}
+
+	bool IsJobThread()
+	{
+		return threadIndex != InvalidThreadIndex;
+	}
+
+	Job* AllocateJob()
+	{
+		ThreadData& data = GetThreadData();
+		return &data.jobPool[data.allocatedJobCount++ % jobPoolSize];
+	}
+
+	void Submit(Job* job, Counter* counter)
+	{
+		job->counter = counter;
+		if (counter)
+		{
+			counter->pendingCount.fetch_add(1, std::memory_order_relaxed);
+		}
+		Enqueue(job);
+	}
+
+	void SubmitAfter(Job* job, Counter* counter, Counter& dependency)
+	{
+		//counted right away, so waiting for counter covers the deferred job as well
+		job->counter = counter;
+		if (counter)
+		{
+			counter->pendingCount.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		while (dependency.dependentsLock.test_and_set(std::memory_order_acquire));
+		const bool isDependencyDone = dependency.pendingCount.load(std::memory_order_acquire) == 0;
+		if (!isDependencyDone)
+		{
+			assert(dependency.dependentsCount < counterDependentsMaxCount);
+			dependency.dependents[dependency.dependentsCount++] = job;
+		}
+		dependency.dependentsLock.clear(std::memory_order_release);
+
+		if (isDependencyDone)
+		{
+			Enqueue(job);
+		}
+	}
+
+	void Wait(Counter& counter, WaitMode waitMode)
+	{
+		while (counter.pendingCount.load(std::memory_order_acquire) > 0)
+		{
+			if (waitMode == WaitMode::Help && RunPendingJob())
+			{
+				continue;
+			}
+			std::this_thread::yield();
+		}
+
+		//the last finishing job may still hold the lock, the counter must not go out of scope before
+		while (counter.dependentsLock.test(std::memory_order_acquire))
+		{
+			std::this_thread::yield();
+		}
+	}
+}
@@ -0,0 +1,180 @@
+#include "stdafx.h"
+#include "JobSystemBenchmark.h"
+
+#include "BenchmarkHelpers.h"
+#include "JobSystem.h"
+#include "TaskGraph.h"
+
+#include <thread>
+
+namespace JobSystemBenchmark
+{
+	static constexpr uint32_t parallelForItemCount = 1 << 20;
+	static constexpr uint32_t independentJobCount = 4000; //below JobSystem::jobPoolSize, all jobs are in flight at once
+	static constexpr uint32_t dependencyRoundCount = 200;
+	static constexpr uint32_t dependencyJobCount = JobSystem::counterDependentsMaxCount;
+
+	//keeps the compiler from removing the work
+	static std::atomic<uint32_t> sink;
+
+	//a few dozen ns of dependent arithmetic per item, roughly a light or instance transform
+	static float Work(uint32_t index, uint32_t iterationCount)
+	{
+		float value = static_cast<float>(index) * 1e-3f;
+		for (uint32_t i = 0; i < iterationCount; i++)
+		{
+			value = value * 0.999f + std::sqrt(value + 1.0f);
+		}
+		return value;
+	}
+
+	static void RunParallelFor(std::vector<float>& output, uint32_t grainSize, uint32_t iterationCount)
+	{
+		JobSystem::ParallelFor(static_cast<uint32_t>(output.size()), grainSize, [&output, iterationCount](uint32_t begin, uint32_t end)
+			{
+				for (uint32_t i = begin; i < end; i++)
+				{
+					output[i] = Work(i, iterationCount);
+				}
+			});
+	}
+
+	static void RunIndependentJobs()
+	{
+		JobSystem::Counter counter;
+		for (uint32_t i = 0; i < independentJobCount; i++)
+		{
+			JobSystem::Run([i]() { sink.fetch_add(static_cast<uint32_t>(Work(i, 256)), std::memory_order_relaxed); }, &counter);
+		}
+		JobSystem::Wait(counter);
+	}
+
+	//two stages per round, the second one only starts once the first one is done, like consecutive passes of a frame
+	static void RunDependencies()
+	{
+		for (uint32_t round = 0; round < dependencyRoundCount; round++)
+		{
+			JobSystem::Counter firstStage;
+			JobSystem::Counter secondStage;
+			for (uint32_t i = 0; i < dependencyJobCount; i++)
+			{
+				JobSystem::Run([i]() { sink.fetch_add(static_cast<uint32_t>(Work(i, 512)), std::memory_order_relaxed); }, &firstStage);
+			}
+			for (uint32_t i = 0; i < dependencyJobCount; i++)
+			{
+				JobSystem::RunAfter(firstStage, [i]() { sink.fetch_add(static_cast<uint32_t>(Work(i, 512)), std::memory_order_relaxed); }, &secondStage);
+			}
+			JobSystem::Wait(secondStage);
+			//done already, but the last job of the first stage may still be releasing the second one
+			JobSystem::Wait(firstStage);
+		}
+	}
+
+	//stub stages shaped like the frame preparation graph in main.cpp, costs are in Work() iterations
+	static void BuildFramePreparationGraph(TaskGraph& graph)
+	{
+		const TaskGraph::ResourceId camera = graph.AddResource("Camera");
+		const TaskGraph::ResourceId frameConstants = graph.AddResource("FrameConstants");
+		const TaskGraph::ResourceId tlasInstances = graph.AddResource("TlasInstances");
+		const TaskGraph::ResourceId shadowCastersBounds = graph.AddResource("ShadowCastersBounds");
+		const TaskGraph::ResourceId cascadeData = graph.AddResource("CascadeData");
+		const TaskGraph::ResourceId shadowedPointLights = graph.AddResource("ShadowedPointLights");
+		const TaskGraph::ResourceId pointLights = graph.AddResource("PointLights");
+
+		auto Stage = [](uint32_t iterationCount)
+		{
+			return [iterationCount]() { sink.fetch_add(static_cast<uint32_t>(Work(iterationCount, iterationCount)), std::memory_order_relaxed); };
+		};
+
+		graph.AddNode("Camera", {}, { camera }, Stage(2000));
+		graph.AddNode("FrameConstants", { camera }, { frameConstants }, Stage(1000));
+		graph.AddNode("TlasInstances", {}, { tlasInstances }, Stage(40000));
+		graph.AddNode("ShadowCastersBounds", {}, { shadowCastersBounds }, Stage(20000));
+		graph.AddNode("CascadeData", { camera, shadowCastersBounds }, { cascadeData }, Stage(10000));
+		graph.AddNode("ShadowedPointLights", {}, { shadowedPointLights }, Stage(20000));
+		graph.AddNode("PointLights", {}, { pointLights }, Stage(5000));
+		graph.Compile();
+	}
+
+	std::vector<Result> Run(uint32_t maxThreadCount)
+	{
+		maxThreadCount = Min(maxThreadCount > 0 ? maxThreadCount : Max(std::thread::hardware_concurrency(), 1u), JobSystem::workersMaxCount + 1);
+
+		struct Workload
+		{
+			const char* name;
+			uint64_t itemCount;
+			std::function<void()> function;
+		};
+
+		std::vector<float> output(parallelForItemCount);
+		TaskGraph framePreparationGraph;
+		BuildFramePreparationGraph(framePreparationGraph);
+		//checked after every run, a broken dependency order fails the benchmark
+		uint32_t orderViolationCount = 0;
+		auto RunGraph = [&framePreparationGraph, &orderViolationCount]()
+		{
+			framePreparationGraph.Run();
+			orderViolationCount += framePreparationGraph.CountOrderViolations();
+		};
+
+		const Workload workloads[] =
+		{
+			{ "ParallelFor (grain 1024)", parallelForItemCount, [&output]() { RunParallelFor(output, 1024, 32); } },
+			{ "ParallelFor (grain 64)", parallelForItemCount, [&output]() { RunParallelFor(output, 64, 32); } },
+			{ "IndependentJobs", independentJobCount, []() { RunIndependentJobs(); } },
+			{ "Dependencies", uint64_t(dependencyRoundCount) * dependencyJobCount * 2, []() { RunDependencies(); } },
+			{ "TaskGraph (frame preparation stubs)", framePreparationGraph.nodes.size(), RunGraph },
+			{ "TaskGraph serial (frame preparation stubs)", framePreparationGraph.nodes.size(), [&framePreparationGraph]() { framePreparationGraph.RunSerial(); } },
+		};
+
+		std::vector<Result> results;
+		for (const Workload& workload : workloads)
+		{
+			double singleThreadMs = 0.0;
+			for (uint32_t threadCount = 1; threadCount <= maxThreadCount; threadCount++)
+			{
+				orderViolationCount = 0;
+				JobSystem::Init({ .workerCount = threadCount - 1 });
+				const double totalMs = Benchmark::MeasureBest(workload.function);
+				JobSystem::Shutdown();
+
+				singleThreadMs = threadCount == 1 ? totalMs : singleThreadMs;
+				results.push_back(
+					{
+						.workload = workload.name,
+						.threadCount = threadCount,
+						.itemCount = workload.itemCount,
+						.totalMs = totalMs,
+						.speedup = singleThreadMs / totalMs,
+						.orderViolationCount = orderViolationCount
+					});
+			}
+		}
+
+		return results;
+	}
+
+	void WriteCsv(FILE* file, std::span<const Result> results)
+	{
+		fprintf(file, "workload,threads,items,total_ms,ns_per_item,speedup,order_violations\n");
+		for (const Result& result : results)
+		{
+			fprintf(file, "%s,%u,%llu,%.3f,%.2f,%.2f,%u\n",
+				result.workload,
+				result.threadCount,
+				result.itemCount,
+				result.totalMs,
+				result.totalMs * 1e6 / result.itemCount,
+				result.speedup,
+				result.orderViolationCount);
+		}
+	}
+
+	bool RunAndWriteCsv(const char* filePath, uint32_t maxThreadCount)
+	{
+		const std::vector<Result> results = Run(maxThreadCount);
+		const bool isOrderRespected = std::all_of(results.begin(), results.end(), [](const Result& result) { return result.orderViolationCount == 0; });
+		return Benchmark::WriteCsvFile(filePath, results, WriteCsv) && isOrderRespected;
+	}
+}
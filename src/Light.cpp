@@ -36,11 +36,11 @@ void ShadowMaps::Init(ID3D12Device10* device,
 
 	for (auto& element : lightsBuffer)
 	{
-		element = CreatePersistentBuffer<ShadowedLight>(bufferHeap, arraySize);
+		element = CreateWriteOnlyMirroredBuffer<ShadowedLight>(bufferHeap, arraySize);
 	}
 	for (auto& element : transformsBuffer)
 	{
-		element = CreatePersistentBuffer<DirectX::XMFLOAT4X4>(bufferHeap, arraySize);
+		element = CreateWriteOnlyMirroredBuffer<DirectX::XMFLOAT4X4>(bufferHeap, arraySize);
 	}
 
 	depthBuffer = CreateDepthBuffer(device,
@@ -188,9 +188,9 @@ void UpdateLightDataCascade(std::span<const Light> lights,
 	const uint32_t cascadeCount = static_cast<uint32_t>(boundingSpheresFrusta.size());
 	const uint32_t lightsCount = static_cast<uint32_t>(lights.size());
 
-	//CPU resident staging buffers in order to not work with gpu resident memory diectly
-	ShadowedLight* activeLights = context.Allocate<ShadowedLight>(lightsCount);
-	XMFLOAT4X4* transforms = context.Allocate<XMFLOAT4X4>(cascadeCount * lightsCount);
+	//CPU resident staging buffers in order to not work with gpu resident memory diectly. Every element gets written below, so they are left uninitialized
+	ShadowedLight* activeLights = context.AllocateUninitialized<ShadowedLight>(lightsCount);
+	XMFLOAT4X4* transforms = context.AllocateUninitialized<XMFLOAT4X4>(cascadeCount * lightsCount);
 
 	for (uint32_t i = 0; i < lightsCount; i++)
 	{
@@ -230,10 +230,10 @@ void UpdateShadowedPointLightsData(std::span<const Light> lights, ShadowMaps& sh
 	StackContext context;
 	const uint32_t lightsCount = static_cast<uint32_t>(lights.size());
 	
-	//CPU resident staging buffers in order to not work with gpu resident memory diectly
-	ShadowedLight* activeLights = context.Allocate<ShadowedLight>(lightsCount);
+	//CPU resident staging buffers in order to not work with gpu resident memory diectly. Every element gets written below, so they are left uninitialized
+	ShadowedLight* activeLights = context.AllocateUninitialized<ShadowedLight>(lightsCount);
 
-	XMFLOAT4X4* transforms = context.Allocate<XMFLOAT4X4>(lightsCount * 6);
+	XMFLOAT4X4* transforms = context.AllocateUninitialized<XMFLOAT4X4>(lightsCount * 6);
 
 	for (uint32_t i = 0; i < lightsCount; i++)
 	{
@@ -241,6 +241,7 @@ void UpdateShadowedPointLightsData(std::span<const Light> lights, ShadowMaps& sh
 
 		//prepare data for upload to GPU
 		static_cast<Light&>(activeLights[i]) = lights[i];
+		activeLights[i].shadowDataOffsest = shadowMaps.transformsBuffer->Offset(i * 6);
 		activeLights[i].shadowMapArrayIndex = i;
 
 		for (uint32_t j = 0; j < 6; j++)
@@ -258,14 +259,11 @@ void UpdateShadowedPointLightsData(std::span<const Light> lights, ShadowMaps& sh
 	shadowMaps.transformsBuffer->Write({ transforms, lightsCount * 6 });
 }
 
-LightsData ComputeLightsData(ScratchHeap& bufferHeap,
+BufferHeap::Offset UpdateCascadeData(ScratchHeap& bufferHeap,
 	const Camera& camera,
 	std::span<const Light> directionalLights,
-	std::span<const Light> shadowedPointLights,
-	std::span<const Light> pointLights,
 	const DirectX::BoundingBox& boundingBoxGeometry,
-	ShadowMaps& cascadedShadowMaps,
-	ShadowMaps& pointLightShadowMaps)
+	ShadowMaps& cascadedShadowMaps)
 {
 	using namespace DirectX;
 
@@ -278,25 +276,49 @@ LightsData ComputeLightsData(ScratchHeap& bufferHeap,
 	cascadeBoundingBoxBuffer.Write(subFrustaBoundingBoxes);
 
 	UpdateLightDataCascade(directionalLights, boundingBoxGeometry, subFrustaBoundingSpheres, cascadedShadowMaps);
-	UpdateShadowedPointLightsData(shadowedPointLights, pointLightShadowMaps);
 
-	BufferHeap::Offset pointsLightsBufferOffset = WriteTemporaryData(bufferHeap, pointLights);
+	return cascadeBoundingBoxBuffer.Offset();
+}
 
+LightsData GetLightsData(std::span<const Light> directionalLights,
+	std::span<const Light> shadowedPointLights,
+	std::span<const Light> pointLights,
+	const ShadowMaps& cascadedShadowMaps,
+	const ShadowMaps& pointLightShadowMaps)
+{
 	return
 	{
 		.pointLightsCount = static_cast<uint32_t>(pointLights.size()),
-		.pointLightsBufferOffset = pointsLightsBufferOffset,
+		.pointLightsBufferOffset = BufferHeap::InvalidOffset,
 		.shadowedPointLightsCount = static_cast<uint32_t>(shadowedPointLights.size()),
 		.shadowedPointLightsBufferOffset = pointLightShadowMaps.lightsBuffer->Offset(),
 		.omnidirectionalShadowMapsSrvId = pointLightShadowMaps.depthBufferCubeArraySrvId,
 		.directionalLightsCount = static_cast<uint32_t>(directionalLights.size()),
 		.directionalLightsBufferOffset = cascadedShadowMaps.lightsBuffer->Offset(),
 		.cascadedShadowMapsSrvId = cascadedShadowMaps.depthBuffer.srvId,
-		.cascadeDataOffset = cascadeBoundingBoxBuffer.Offset(),
+		.cascadeDataOffset = BufferHeap::InvalidOffset,
 		.cascadeCount = cascadeCount,
 	};
 }
 
+LightsData ComputeLightsData(ScratchHeap& bufferHeap,
+	const Camera& camera,
+	std::span<const Light> directionalLights,
+	std::span<const Light> shadowedPointLights,
+	std::span<const Light> pointLights,
+	const DirectX::BoundingBox& boundingBoxGeometry,
+	ShadowMaps& cascadedShadowMaps,
+	ShadowMaps& pointLightShadowMaps)
+{
+	LightsData lightsData = GetLightsData(directionalLights, shadowedPointLights, pointLights, cascadedShadowMaps, pointLightShadowMaps);
+
+	lightsData.cascadeDataOffset = UpdateCascadeData(bufferHeap, camera, directionalLights, boundingBoxGeometry, cascadedShadowMaps);
+	UpdateShadowedPointLightsData(shadowedPointLights, pointLightShadowMaps);
+	lightsData.pointLightsBufferOffset = WriteTemporaryData(bufferHeap, pointLights);
+
+	return lightsData;
+}
+
 void ComputeWorldSpaceSubFrustaBoundingBoxes(const float(&splitRatios)[cascadeCount],
 	const Camera& camera,
 	DirectX::CXMMATRIX inverseView,
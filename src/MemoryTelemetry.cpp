@@ -0,0 +1,199 @@
+#include "stdafx.h"
+#include "MemoryTelemetry.h"
+
+namespace MemoryTelemetry
+{
+	static FILE* perFrameDumpFile = nullptr;
+	static FILE* allocationTraceFile = nullptr;
+	static std::mutex allocationTraceMutex;
+
+	static const char* heapNames[heapCount] = { "GlobalBuffer", "PersistentAllocator", "DescriptorHeap", "ScratchHeap", "FrameArena" };
+	static const char* heapUnits[heapCount] = { "bytes", "bytes", "descriptors", "bytes", "bytes" };
+	static const char* tagNames[tagCount] = { "Untagged", "Engine", "Frame", "Scene", "Rendering", "Shadows", "GlobalIllumination", "Debug", "Ui" };
+
+	const char* GetName(Heap heap)
+	{
+		return heapNames[static_cast<uint32_t>(heap)];
+	}
+
+	const char* GetName(Tag tag)
+	{
+		return tagNames[static_cast<uint32_t>(tag)];
+	}
+
+	//sums and clears the slots, the live counters become the usage of the frame
+	static void FoldThreadFrameCounters()
+	{
+		const uint64_t usedSlotsMask = usedThreadSlotsMask.load(std::memory_order_relaxed);
+		for (uint32_t transientHeapIndex = 0; transientHeapIndex < transientHeapCount; transientHeapIndex++)
+		{
+			for (uint32_t tagIndex = 0; tagIndex < tagCount; tagIndex++)
+			{
+				uint64_t frameBytes = 0;
+				uint64_t frameAllocationCount = 0;
+				Counters& entry = counters[static_cast<uint32_t>(Heap::ScratchHeap) + transientHeapIndex][tagIndex];
+				for (uint32_t slot = 0; slot <= threadSlotsMaxCount; slot++)
+				{
+					if (slot != sharedThreadSlot && (usedSlotsMask & (1ull << slot)) == 0)
+					{
+						continue;
+					}
+
+					FrameCounters& frameEntry = threadFrameCounters[slot].counters[transientHeapIndex][tagIndex];
+					const uint64_t allocationCount = frameEntry.allocationCount.load(std::memory_order_relaxed);
+					if (allocationCount == 0)
+					{
+						continue;
+					}
+
+					frameBytes += frameEntry.bytes.load(std::memory_order_relaxed);
+					frameAllocationCount += allocationCount;
+					for (uint32_t bucketIndex = 0; bucketIndex < histogramBucketCount; bucketIndex++)
+					{
+						entry.histogram[bucketIndex].fetch_add(frameEntry.histogram[bucketIndex].load(std::memory_order_relaxed), std::memory_order_relaxed);
+						frameEntry.histogram[bucketIndex].store(0, std::memory_order_relaxed);
+					}
+					frameEntry.bytes.store(0, std::memory_order_relaxed);
+					frameEntry.allocationCount.store(0, std::memory_order_relaxed);
+				}
+
+				entry.liveBytes.store(frameBytes, std::memory_order_relaxed);
+				entry.peakBytes.store(Max(entry.peakBytes.load(std::memory_order_relaxed), frameBytes), std::memory_order_relaxed);
+				entry.allocationCount.fetch_add(frameAllocationCount, std::memory_order_relaxed);
+				entry.liveAllocationCount.store(frameAllocationCount, std::memory_order_relaxed);
+			}
+		}
+	}
+
+	void EndFrame(uint64_t frameId)
+	{
+		if constexpr (!isEnabled)
+		{
+			return;
+		}
+
+		FoldThreadFrameCounters();
+
+		if (perFrameDumpFile)
+		{
+			WriteJson(perFrameDumpFile, frameId);
+		}
+	}
+
+	bool OpenPerFrameDump(const char* filePath)
+	{
+		ClosePerFrameDump();
+		return fopen_s(&perFrameDumpFile, filePath, "w") == 0;
+	}
+
+	void ClosePerFrameDump()
+	{
+		if (perFrameDumpFile)
+		{
+			fclose(perFrameDumpFile);
+			perFrameDumpFile = nullptr;
+		}
+	}
+
+	void WriteJson(FILE* file, uint64_t frameId)
+	{
+		fprintf(file, "{\"frame\":%llu,\"heaps\":[", frameId);
+		for (uint32_t heapIndex = 0; heapIndex < heapCount; heapIndex++)
+		{
+			fprintf(file, "%s{\"name\":\"%s\",\"unit\":\"%s\",\"tags\":[", heapIndex > 0 ? "," : "", heapNames[heapIndex], heapUnits[heapIndex]);
+
+			bool isFirstTag = true;
+			for (uint32_t tagIndex = 0; tagIndex < tagCount; tagIndex++)
+			{
+				const Counters& entry = counters[heapIndex][tagIndex];
+				const uint64_t allocationCount = entry.allocationCount.load(std::memory_order_relaxed);
+				if (allocationCount == 0)
+				{
+					continue;
+				}
+
+				fprintf(file, "%s{\"tag\":\"%s\",\"live\":%llu,\"peak\":%llu,\"allocations\":%llu,\"liveAllocations\":%llu,\"histogram\":[",
+					isFirstTag ? "" : ",",
+					tagNames[tagIndex],
+					entry.liveBytes.load(std::memory_order_relaxed),
+					entry.peakBytes.load(std::memory_order_relaxed),
+					allocationCount,
+					entry.liveAllocationCount.load(std::memory_order_relaxed));
+				isFirstTag = false;
+
+				for (uint32_t bucketIndex = 0; bucketIndex < histogramBucketCount; bucketIndex++)
+				{
+					fprintf(file, "%s%llu", bucketIndex > 0 ? "," : "", entry.histogram[bucketIndex].load(std::memory_order_relaxed));
+				}
+				fprintf(file, "]}");
+			}
+			fprintf(file, "]}");
+		}
+		fprintf(file, "]}\n");
+	}
+
+	bool DumpJson(const char* filePath, uint64_t frameId)
+	{
+		FILE* file = nullptr;
+		if (fopen_s(&file, filePath, "w") != 0)
+		{
+			return false;
+		}
+
+		WriteJson(file, frameId);
+		fclose(file);
+		return true;
+	}
+
+	bool OpenAllocationTrace(const char* filePath)
+	{
+		CloseAllocationTrace();
+
+		std::lock_guard lock(allocationTraceMutex);
+		if (fopen_s(&allocationTraceFile, filePath, "wb") != 0)
+		{
+			return false;
+		}
+		isTracingAllocations.store(true, std::memory_order_relaxed);
+		return true;
+	}
+
+	void CloseAllocationTrace()
+	{
+		std::lock_guard lock(allocationTraceMutex);
+		isTracingAllocations.store(false, std::memory_order_relaxed);
+		if (allocationTraceFile)
+		{
+			fclose(allocationTraceFile);
+			allocationTraceFile = nullptr;
+		}
+	}
+
+	void WriteTraceEvent(const TraceEvent& event)
+	{
+		std::lock_guard lock(allocationTraceMutex);
+		if (allocationTraceFile)
+		{
+			fwrite(&event, sizeof(event), 1, allocationTraceFile);
+		}
+	}
+
+	std::vector<TraceEvent> ReadAllocationTrace(const char* filePath)
+	{
+		std::vector<TraceEvent> events;
+		FILE* file = nullptr;
+		if (fopen_s(&file, filePath, "rb") != 0)
+		{
+			return events;
+		}
+
+		TraceEvent event;
+		while (fread(&event, sizeof(event), 1, file) == 1)
+		{
+			events.push_back(event);
+		}
+		fclose(file);
+
+		return events;
+	}
+}
@@ -0,0 +1,348 @@
+#include "stdafx.h"
+#include "MeshCache.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace MeshCache
+{
+	//Cooking reserves its stack memory from the size of the .obj. The peak is reached while optimizing: the index and vertex streams (36 bytes per index if every index is its own vertex)
+	//plus the optimizer scratch of the largest shape (about 64 bytes per index). The welding scratch before that is released once the shapes are welded
+	static constexpr uint64_t cookStackMemoryBytesPerIndex = 128;
+	static constexpr uint64_t cookStackMemoryBytesPerPosition = 12; //position welding
+	static constexpr uint64_t cookStackMemoryBaseSize = 16 * 1024 * 1024;
+
+	static size_t GetCookStackMemorySize(const rapidobj::Result& model)
+	{
+		uint64_t indexCount = 0;
+		for (const rapidobj::Shape& shape : model.shapes)
+		{
+			indexCount += shape.mesh.m_indices.size();
+		}
+		//only address space, above 4 GB for scans of more than about 11M triangles
+		return cookStackMemoryBaseSize + indexCount * cookStackMemoryBytesPerIndex + model.attributes.positions.size() / 3 * cookStackMemoryBytesPerPosition;
+	}
+
+	bool MappedFile::Open(const std::filesystem::path& fileName)
+	{
+		assert(data == nullptr);
+#ifdef _WIN32
+		file = CreateFileW(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		LARGE_INTEGER fileSize = {};
+		if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+		{
+			Close();
+			return false;
+		}
+
+		mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		data = mapping ? static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+		sizeBytes = static_cast<size_t>(fileSize.QuadPart);
+#else
+		const int descriptor = open(fileName.c_str(), O_RDONLY);
+		struct stat fileStatus = {};
+		if (descriptor < 0 || fstat(descriptor, &fileStatus) != 0 || fileStatus.st_size == 0)
+		{
+			if (descriptor >= 0)
+			{
+				close(descriptor);
+			}
+			return false;
+		}
+
+		void* mapping = mmap(nullptr, static_cast<size_t>(fileStatus.st_size), PROT_READ, MAP_PRIVATE, descriptor, 0);
+		close(descriptor); //the mapping keeps the file referenced
+		data = mapping != MAP_FAILED ? static_cast<const uint8_t*>(mapping) : nullptr;
+		sizeBytes = static_cast<size_t>(fileStatus.st_size);
+#endif
+		if (data == nullptr)
+		{
+			Close();
+			return false;
+		}
+		return true;
+	}
+
+	void MappedFile::Close()
+	{
+#ifdef _WIN32
+		if (data)
+		{
+			UnmapViewOfFile(data);
+		}
+		if (mapping)
+		{
+			CloseHandle(mapping);
+			mapping = nullptr;
+		}
+		if (file != INVALID_HANDLE_VALUE)
+		{
+			CloseHandle(file);
+			file = INVALID_HANDLE_VALUE;
+		}
+#else
+		if (data)
+		{
+			munmap(const_cast<uint8_t*>(data), sizeBytes);
+		}
+#endif
+		data = nullptr;
+		sizeBytes = 0;
+	}
+
+	void View::Close()
+	{
+		file.Close();
+		*this = {};
+	}
+
+	//FNV-1a on 8 byte words, the tail byte wise
+	static uint64_t HashBytes(const uint8_t* data, size_t sizeBytes, uint64_t hash)
+	{
+		static constexpr uint64_t prime = 0x100000001b3ull;
+
+		size_t i = 0;
+		for (; i + sizeof(uint64_t) <= sizeBytes; i += sizeof(uint64_t))
+		{
+			uint64_t word;
+			std::memcpy(&word, data + i, sizeof(word));
+			hash = (hash ^ word) * prime;
+		}
+		for (; i < sizeBytes; i++)
+		{
+			hash = (hash ^ data[i]) * prime;
+		}
+		return hash;
+	}
+
+	std::filesystem::path GetCacheFileName(const std::filesystem::path& objFileName)
+	{
+		return std::filesystem::path(objFileName).replace_extension(fileExtension);
+	}
+
+	std::optional<uint64_t> HashSource(const std::filesystem::path& objFileName)
+	{
+		MappedFile obj;
+		if (!obj.Open(objFileName))
+		{
+			return std::nullopt;
+		}
+
+		uint64_t hash = HashBytes(obj.data, obj.sizeBytes, 0xcbf29ce484222325ull);
+
+		//the materials are part of the cache, so edits of the libraries need to invalidate it as well. rapidobj looks them up relative to the .obj
+		const std::string_view source(reinterpret_cast<const char*>(obj.data), obj.sizeBytes);
+		for (size_t lineBegin = 0; lineBegin < source.size();)
+		{
+			const size_t lineEnd = Min(source.find('\n', lineBegin), source.size());
+			std::string_view line = source.substr(lineBegin, lineEnd - lineBegin);
+			if (line.starts_with("mtllib"))
+			{
+				line.remove_prefix(std::string_view("mtllib").size());
+				const size_t nameBegin = line.find_first_not_of(" \t");
+				const size_t nameEnd = line.find_last_not_of(" \t\r");
+				if (nameBegin != std::string_view::npos)
+				{
+					MappedFile library;
+					if (library.Open(objFileName.parent_path() / line.substr(nameBegin, nameEnd - nameBegin + 1)))
+					{
+						hash = HashBytes(library.data, library.sizeBytes, hash);
+						library.Close();
+					}
+				}
+			}
+			lineBegin = lineEnd + 1;
+		}
+
+		obj.Close();
+		return hash;
+	}
+
+	//pads up to the section alignment before writing, returns the offset of the section
+	static uint64_t WriteSection(FILE* file, uint64_t& position, const void* data, size_t sizeBytes)
+	{
+		static constexpr uint8_t zeros[sectionAlignment] = {};
+		const uint64_t sectionOffset = Align(position, sectionAlignment);
+		fwrite(zeros, 1, static_cast<size_t>(sectionOffset - position), file);
+		fwrite(data, 1, sizeBytes, file);
+		position = sectionOffset + sizeBytes;
+		return sectionOffset;
+	}
+
+	bool Cook(const std::filesystem::path& objFileName, const std::filesystem::path& cacheFileName, uint64_t sourceHash)
+	{
+		const rapidobj::Result model = rapidobj::ParseFile(objFileName);
+		if (model.error)
+		{
+			return false;
+		}
+
+		std::string strings;
+		std::vector<Material> materials(model.materials.size());
+		for (size_t i = 0; i < model.materials.size(); i++)
+		{
+			auto AddString = [&strings](const std::string& string)
+			{
+				if (string.empty())
+				{
+					return Material::noTexture;
+				}
+				const uint32_t offset = static_cast<uint32_t>(strings.size());
+				strings.append(string.c_str(), string.size() + 1);
+				return offset;
+			};
+			const rapidobj::Material& material = model.materials[i];
+			materials[i] =
+			{
+				.albedoTexture = AddString(material.diffuse_texname),
+				.normalTexture = AddString(material.bump_texname),
+				.roughnessTexture = AddString(material.roughness_texname),
+				.metallicTexture = AddString(material.metallic_texname)
+			};
+		}
+
+		//own allocator, so cooking works on threads without one and doesn't depend on the size of the thread's
+		StackAllocator stackAllocator;
+		stackAllocator.InitVirtual(GetCookStackMemorySize(model));
+		bool isWritten = false;
+		{
+			StackContext stackContext(stackAllocator);
+			const uint32_t submeshCount = static_cast<uint32_t>(model.shapes.size());
+			PbrMesh::Submesh* submeshes = stackContext.AllocateUninitialized<PbrMesh::Submesh>(submeshCount);
+			const GeometryData data = BuildGeometryData(stackContext, model, { submeshes, submeshCount });
+			const Meshlets::MeshletData meshletData = Meshlets::BuildMeshlets(stackContext, data.indices, data.positions, { submeshes, submeshCount });
+
+			Header header =
+			{
+				.magic = magic,
+				.version = version,
+				.sourceHash = sourceHash,
+				.indexCount = static_cast<uint32_t>(data.indices.size()),
+				.vertexCount = static_cast<uint32_t>(data.positions.size()),
+				.submeshCount = submeshCount,
+				.materialCount = static_cast<uint32_t>(materials.size()),
+				.stringsSizeBytes = strings.size(),
+				.meshletCount = static_cast<uint32_t>(meshletData.meshlets.size()),
+				.meshletVertexCount = static_cast<uint32_t>(meshletData.vertices.size()),
+				.meshletTriangleCount = static_cast<uint32_t>(meshletData.triangles.size())
+			};
+			DirectX::BoundingBox::CreateFromPoints(header.aabb, header.vertexCount, data.positions.data(), sizeof(DirectX::XMFLOAT3));
+
+			std::filesystem::path temporaryFileName = cacheFileName;
+			temporaryFileName += L".tmp";
+			FILE* file = nullptr;
+			if (fopen_s(&file, temporaryFileName.string().c_str(), "wb") == 0)
+			{
+				//the header gets written again once the offsets are known
+				uint64_t position = 0;
+				WriteSection(file, position, &header, sizeof(header));
+				//the streams are contiguous within the section, exactly like in the BufferHeap
+				header.geometryOffset = WriteSection(file, position, data.indices.data(), data.indices.size_bytes());
+				fwrite(data.positions.data(), 1, data.positions.size_bytes(), file);
+				fwrite(data.normals.data(), 1, data.normals.size_bytes(), file);
+				fwrite(data.uvs.data(), 1, data.uvs.size_bytes(), file);
+				position += data.positions.size_bytes() + data.normals.size_bytes() + data.uvs.size_bytes();
+				header.submeshesOffset = WriteSection(file, position, submeshes, submeshCount * sizeof(PbrMesh::Submesh));
+				header.materialsOffset = WriteSection(file, position, materials.data(), materials.size() * sizeof(Material));
+				header.stringsOffset = WriteSection(file, position, strings.data(), strings.size());
+				header.meshletsOffset = WriteSection(file, position, meshletData.meshlets.data(), meshletData.meshlets.size_bytes());
+				fwrite(meshletData.bounds.data(), 1, meshletData.bounds.size_bytes(), file);
+				fwrite(meshletData.vertices.data(), 1, meshletData.vertices.size_bytes(), file);
+				fwrite(meshletData.triangles.data(), 1, meshletData.triangles.size_bytes(), file);
+				position += meshletData.bounds.size_bytes() + meshletData.vertices.size_bytes() + meshletData.triangles.size_bytes();
+				header.submeshMeshletOffsetsOffset = WriteSection(file, position, meshletData.submeshMeshletOffsets.data(), meshletData.submeshMeshletOffsets.size_bytes());
+				header.fileSizeBytes = position;
+
+				fseek(file, 0, SEEK_SET);
+				fwrite(&header, sizeof(header), 1, file);
+				isWritten = ferror(file) == 0;
+				fclose(file);
+			}
+
+			std::error_code error;
+			if (isWritten)
+			{
+				std::filesystem::rename(temporaryFileName, cacheFileName, error);
+				isWritten = !error;
+			}
+			if (!isWritten)
+			{
+				std::filesystem::remove(temporaryFileName, error);
+			}
+		}
+		stackAllocator.Destroy();
+
+		return isWritten;
+	}
+
+	bool Open(View& view, const std::filesystem::path& cacheFileName, uint64_t sourceHash)
+	{
+		assert(view.header == nullptr);
+		if (!view.file.Open(cacheFileName))
+		{
+			return false;
+		}
+
+		const uint8_t* data = view.file.data;
+		const uint64_t fileSizeBytes = view.file.sizeBytes;
+		const Header* header = reinterpret_cast<const Header*>(data);
+		if (fileSizeBytes < sizeof(Header))
+		{
+			view.Close();
+			return false;
+		}
+
+		auto IsInFile = [fileSizeBytes](uint64_t offset, uint64_t sizeBytes)
+		{
+			return offset <= fileSizeBytes && sizeBytes <= fileSizeBytes - offset;
+		};
+
+		const uint64_t geometrySizeBytes = header->indexCount * sizeof(uint32_t) + header->vertexCount * (2 * sizeof(DirectX::XMFLOAT3) + sizeof(DirectX::XMFLOAT2));
+		const uint64_t meshletsSizeBytes = Meshlets::GetStreamsSizeBytes(header->meshletCount, header->meshletVertexCount, header->meshletTriangleCount);
+		const uint64_t submeshMeshletOffsetsSizeBytes = (uint64_t(header->submeshCount) + 1) * sizeof(uint32_t);
+		const bool isValid = header->magic == magic
+			&& header->version == version
+			&& header->sourceHash == sourceHash
+			&& header->fileSizeBytes == fileSizeBytes
+			&& IsInFile(header->geometryOffset, geometrySizeBytes)
+			&& IsInFile(header->submeshesOffset, header->submeshCount * sizeof(PbrMesh::Submesh))
+			&& IsInFile(header->materialsOffset, header->materialCount * sizeof(Material))
+			&& IsInFile(header->stringsOffset, header->stringsSizeBytes)
+			&& IsInFile(header->meshletsOffset, meshletsSizeBytes)
+			&& IsInFile(header->submeshMeshletOffsetsOffset, submeshMeshletOffsetsSizeBytes);
+		if (!isValid)
+		{
+			view.Close();
+			return false;
+		}
+
+		view.header = header;
+		view.geometry = { data + header->geometryOffset, static_cast<size_t>(geometrySizeBytes) };
+		view.submeshes = { reinterpret_cast<const PbrMesh::Submesh*>(data + header->submeshesOffset), header->submeshCount };
+		view.materials = { reinterpret_cast<const Material*>(data + header->materialsOffset), header->materialCount };
+		view.strings = reinterpret_cast<const char*>(data + header->stringsOffset);
+		view.meshlets = { data + header->meshletsOffset, static_cast<size_t>(meshletsSizeBytes) };
+		view.submeshMeshletOffsets = { reinterpret_cast<const uint32_t*>(data + header->submeshMeshletOffsetsOffset), header->submeshCount + 1 };
+		return true;
+	}
+
+	bool OpenOrCook(View& view, const std::filesystem::path& objFileName)
+	{
+		const std::optional<uint64_t> sourceHash = HashSource(objFileName);
+		if (!sourceHash)
+		{
+			return false;
+		}
+
+		const std::filesystem::path cacheFileName = GetCacheFileName(objFileName);
+		if (Open(view, cacheFileName, *sourceHash))
+		{
+			return true;
+		}
+		return Cook(objFileName, cacheFileName, *sourceHash) && Open(view, cacheFileName, *sourceHash);
+	}
+}
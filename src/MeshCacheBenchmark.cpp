@@ -0,0 +1,107 @@
+#include "stdafx.h"
+#include "MeshCacheBenchmark.h"
+
+#include "BenchmarkHelpers.h"
+#include "MeshCache.h"
+
+namespace MeshCacheBenchmark
+{
+	static uint64_t GetFileSize(const std::filesystem::path& fileName)
+	{
+		std::error_code error;
+		const uintmax_t sizeBytes = std::filesystem::file_size(fileName, error);
+		return error ? 0 : sizeBytes;
+	}
+
+	//what LoadMesh() did before the cache: parse, weld the vertices, write the streams like WriteGeometry()
+	static void LoadObj(StackAllocator& stackAllocator, const std::filesystem::path& fileName, std::vector<uint8_t>& destination)
+	{
+		const rapidobj::Result model = rapidobj::ParseFile(fileName);
+		StackContext stackContext(stackAllocator);
+		const uint32_t submeshCount = static_cast<uint32_t>(model.shapes.size());
+		PbrMesh::Submesh* submeshes = stackContext.AllocateUninitialized<PbrMesh::Submesh>(submeshCount);
+		const GeometryData data = BuildGeometryData(stackContext, model, { submeshes, submeshCount });
+
+		destination.resize(data.indices.size_bytes() + data.positions.size_bytes() + data.normals.size_bytes() + data.uvs.size_bytes());
+		uint8_t* streams = destination.data();
+		std::memcpy(streams, data.indices.data(), data.indices.size_bytes());
+		streams += data.indices.size_bytes();
+		std::memcpy(streams, data.positions.data(), data.positions.size_bytes());
+		streams += data.positions.size_bytes();
+		std::memcpy(streams, data.normals.data(), data.normals.size_bytes());
+		streams += data.normals.size_bytes();
+		std::memcpy(streams, data.uvs.data(), data.uvs.size_bytes());
+
+		DirectX::BoundingBox aabb;
+		DirectX::BoundingBox::CreateFromPoints(aabb, static_cast<uint32_t>(data.positions.size()), data.positions.data(), sizeof(DirectX::XMFLOAT3));
+	}
+
+	//what LoadMesh() does with a valid cache file
+	static void LoadCache(const std::filesystem::path& fileName, std::vector<uint8_t>& destination)
+	{
+		MeshCache::View meshCache;
+		if (MeshCache::OpenOrCook(meshCache, fileName))
+		{
+			destination.resize(meshCache.geometry.size() + meshCache.meshlets.size());
+			std::memcpy(destination.data(), meshCache.geometry.data(), meshCache.geometry.size());
+			std::memcpy(destination.data() + meshCache.geometry.size(), meshCache.meshlets.data(), meshCache.meshlets.size());
+			meshCache.Close();
+		}
+	}
+
+	std::vector<Result> Run()
+	{
+		StackAllocator stackAllocator;
+		stackAllocator.InitVirtual(Benchmark::stackMemoryReservedSize);
+		std::vector<uint8_t> destination;
+
+		std::vector<Result> results;
+		for (const wchar_t* meshFileName : Benchmark::meshFileNames)
+		{
+			const std::filesystem::path fileName = meshFileName;
+			const std::filesystem::path cacheFileName = MeshCache::GetCacheFileName(fileName);
+			const std::optional<uint64_t> sourceHash = MeshCache::HashSource(fileName);
+			if (!sourceHash)
+			{
+				continue;
+			}
+
+			const double objMs = Benchmark::MeasureBest([&]() { LoadObj(stackAllocator, fileName, destination); });
+			const double cookMs = Benchmark::MeasureBest([&]() { MeshCache::Cook(fileName, cacheFileName, *sourceHash); });
+			const double hashMs = Benchmark::MeasureBest([&]() { MeshCache::HashSource(fileName); });
+			const double cacheMs = Benchmark::MeasureBest([&]() { LoadCache(fileName, destination); });
+
+			const uint64_t objSizeBytes = GetFileSize(fileName);
+			const uint64_t cacheSizeBytes = GetFileSize(cacheFileName);
+			const std::string name = WStringToAnsi(meshFileName);
+			results.push_back({ .workload = "Obj (parse and build geometry)", .meshFileName = name, .inputSizeBytes = objSizeBytes, .totalMs = objMs, .speedup = 1.0 });
+			results.push_back({ .workload = "Cook", .meshFileName = name, .inputSizeBytes = objSizeBytes, .totalMs = cookMs, .speedup = objMs / cookMs });
+			results.push_back({ .workload = "Cache (hash source, map and copy)", .meshFileName = name, .inputSizeBytes = objSizeBytes + cacheSizeBytes, .totalMs = cacheMs, .speedup = objMs / cacheMs });
+			results.push_back({ .workload = "Hash source only", .meshFileName = name, .inputSizeBytes = objSizeBytes, .totalMs = hashMs, .speedup = objMs / hashMs });
+		}
+
+		stackAllocator.Destroy();
+		return results;
+	}
+
+	void WriteCsv(FILE* file, std::span<const Result> results)
+	{
+		fprintf(file, "workload,mesh,input_mb,total_ms,mb_per_s,speedup\n");
+		for (const Result& result : results)
+		{
+			const double inputMB = result.inputSizeBytes / (1024.0 * 1024.0);
+			fprintf(file, "%s,%s,%.2f,%.3f,%.2f,%.2f\n",
+				result.workload,
+				result.meshFileName.c_str(),
+				inputMB,
+				result.totalMs,
+				inputMB * 1e3 / result.totalMs,
+				result.speedup);
+		}
+	}
+
+	bool RunAndWriteCsv(const char* filePath)
+	{
+		return Benchmark::WriteCsvFile(filePath, Run(), WriteCsv);
+	}
+}
@@ -0,0 +1,404 @@
+#include "stdafx.h"
+#include "MeshOptimizer.h"
+
+namespace MeshOptimizer
+{
+	static constexpr uint32_t fetchCacheLineSizeBytes = 64;
+	static constexpr uint32_t fetchCacheLineCount = 256; //16KB, about the size of a vertex fetch L1
+
+	//FIFO cache of vertex timestamps: a vertex is in the cache if it got inserted less than cacheSize insertions ago
+	struct TimestampCache
+	{
+		uint32_t* timestamps;
+		uint32_t timestamp;
+		uint32_t cacheSize;
+
+		void Init(StackContext& stackContext, uint32_t vertexCount, uint32_t size)
+		{
+			timestamps = stackContext.Allocate<uint32_t>(vertexCount);
+			cacheSize = size;
+			timestamp = cacheSize + 1;
+		}
+
+		bool IsInCache(uint32_t vertex) const
+		{
+			return timestamp - timestamps[vertex] <= cacheSize;
+		}
+
+		//returns true on a miss
+		bool Access(uint32_t vertex)
+		{
+			if (IsInCache(vertex))
+			{
+				return false;
+			}
+			timestamps[vertex] = timestamp++;
+			return true;
+		}
+
+		void Clear()
+		{
+			timestamp += cacheSize + 1;
+		}
+	};
+
+	void OptimizeVertexCache(StackContext& stackContext, std::span<uint32_t> indices, uint32_t vertexCount, uint32_t cacheSize)
+	{
+		assert(indices.size() % 3 == 0);
+		const uint32_t indexCount = static_cast<uint32_t>(indices.size());
+		const uint32_t triangleCount = indexCount / 3;
+		if (triangleCount == 0)
+		{
+			return;
+		}
+
+		//vertex to triangle adjacency, the triangles of vertex v are adjacency[adjacencyOffsets[v], adjacencyOffsets[v + 1])
+		uint32_t* liveTriangleCounts = stackContext.Allocate<uint32_t>(vertexCount);
+		for (uint32_t i = 0; i < indexCount; i++)
+		{
+			liveTriangleCounts[indices[i]]++;
+		}
+		uint32_t* adjacencyOffsets = stackContext.AllocateUninitialized<uint32_t>(vertexCount + 1);
+		adjacencyOffsets[0] = 0;
+		for (uint32_t v = 0; v < vertexCount; v++)
+		{
+			adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangleCounts[v];
+		}
+		uint32_t* adjacencyFill = stackContext.AllocateUninitialized<uint32_t>(vertexCount);
+		std::copy(adjacencyOffsets, adjacencyOffsets + vertexCount, adjacencyFill);
+		uint32_t* adjacency = stackContext.AllocateUninitialized<uint32_t>(indexCount);
+		for (uint32_t i = 0; i < indexCount; i++)
+		{
+			adjacency[adjacencyFill[indices[i]]++] = i / 3;
+		}
+
+		bool* isEmitted = stackContext.Allocate<bool>(triangleCount);
+		uint32_t* output = stackContext.AllocateUninitialized<uint32_t>(indexCount);
+		//every emitted vertex gets pushed once, so both hold at most indexCount vertices
+		uint32_t* deadEndStack = stackContext.AllocateUninitialized<uint32_t>(indexCount);
+		uint32_t* candidates = stackContext.AllocateUninitialized<uint32_t>(indexCount);
+		TimestampCache cache;
+		cache.Init(stackContext, vertexCount, cacheSize);
+
+		uint32_t outputCount = 0;
+		uint32_t deadEndCount = 0;
+		uint32_t cursor = 0;
+		int64_t fanningVertex = indices[0];
+		while (fanningVertex >= 0)
+		{
+			//emit all remaining triangles around the fanning vertex, their vertices are the candidates for the next one
+			uint32_t candidateCount = 0;
+			for (uint32_t a = adjacencyOffsets[fanningVertex]; a < adjacencyOffsets[fanningVertex + 1]; a++)
+			{
+				const uint32_t triangle = adjacency[a];
+				if (isEmitted[triangle])
+				{
+					continue;
+				}
+				isEmitted[triangle] = true;
+				for (uint32_t corner = 0; corner < 3; corner++)
+				{
+					const uint32_t vertex = indices[triangle * 3 + corner];
+					output[outputCount++] = vertex;
+					deadEndStack[deadEndCount++] = vertex;
+					candidates[candidateCount++] = vertex;
+					liveTriangleCounts[vertex]--;
+					cache.Access(vertex);
+				}
+			}
+
+			//the candidate which stays in the cache while its remaining triangles get fanned, preferring the oldest one
+			fanningVertex = -1;
+			int64_t bestPriority = -1;
+			for (uint32_t c = 0; c < candidateCount; c++)
+			{
+				const uint32_t vertex = candidates[c];
+				if (liveTriangleCounts[vertex] == 0)
+				{
+					continue;
+				}
+				int64_t priority = 0;
+				const uint32_t age = cache.timestamp - cache.timestamps[vertex];
+				if (age + 2 * liveTriangleCounts[vertex] <= cacheSize)
+				{
+					priority = age;
+				}
+				if (priority > bestPriority)
+				{
+					bestPriority = priority;
+					fanningVertex = vertex;
+				}
+			}
+
+			//dead end: most recently emitted vertex with remaining triangles, then the next one in input order
+			while (fanningVertex < 0 && deadEndCount > 0)
+			{
+				const uint32_t vertex = deadEndStack[--deadEndCount];
+				fanningVertex = liveTriangleCounts[vertex] > 0 ? static_cast<int64_t>(vertex) : -1;
+			}
+			while (fanningVertex < 0 && cursor < vertexCount)
+			{
+				fanningVertex = liveTriangleCounts[cursor] > 0 ? static_cast<int64_t>(cursor) : -1;
+				cursor++;
+			}
+		}
+		assert(outputCount == indexCount);
+
+		std::copy(output, output + indexCount, indices.begin());
+	}
+
+	void OptimizeOverdraw(StackContext& stackContext, std::span<uint32_t> indices, std::span<const DirectX::XMFLOAT3> positions, uint32_t cacheSize, float threshold)
+	{
+		assert(indices.size() % 3 == 0);
+		const uint32_t indexCount = static_cast<uint32_t>(indices.size());
+		const uint32_t triangleCount = indexCount / 3;
+		if (triangleCount == 0)
+		{
+			return;
+		}
+
+		TimestampCache cache;
+		cache.Init(stackContext, static_cast<uint32_t>(positions.size()), cacheSize);
+		auto GetMissCount = [&cache, &indices](uint32_t triangle)
+		{
+			return static_cast<uint32_t>(cache.Access(indices[triangle * 3 + 0])) + cache.Access(indices[triangle * 3 + 1]) + cache.Access(indices[triangle * 3 + 2]);
+		};
+
+		//hard boundaries: triangles of which no vertex is in the cache, i.e. where the vertex cache order jumped. One more element than clusters, the last one is the triangle count
+		uint32_t* hardClusterOffsets = stackContext.AllocateUninitialized<uint32_t>(triangleCount + 1);
+		uint32_t hardClusterCount = 0;
+		for (uint32_t triangle = 0; triangle < triangleCount; triangle++)
+		{
+			if (GetMissCount(triangle) == 3 || triangle == 0)
+			{
+				hardClusterOffsets[hardClusterCount++] = triangle;
+			}
+		}
+		hardClusterOffsets[hardClusterCount] = triangleCount;
+
+		//soft boundaries: the cache is cold at the start of every cluster once they get reordered, so each one gets simulated from a cleared cache
+		uint32_t* clusterOffsets = stackContext.AllocateUninitialized<uint32_t>(triangleCount + 1);
+		uint32_t clusterCount = 0;
+		for (uint32_t hardCluster = 0; hardCluster < hardClusterCount; hardCluster++)
+		{
+			const uint32_t begin = hardClusterOffsets[hardCluster];
+			const uint32_t end = hardClusterOffsets[hardCluster + 1];
+
+			cache.Clear();
+			uint32_t hardClusterMissCount = 0;
+			for (uint32_t triangle = begin; triangle < end; triangle++)
+			{
+				hardClusterMissCount += GetMissCount(triangle);
+			}
+			const float maxMissCount = threshold * hardClusterMissCount / (end - begin);
+
+			cache.Clear();
+			clusterOffsets[clusterCount++] = begin;
+			uint32_t missCount = 0;
+			uint32_t clusterTriangleCount = 0;
+			for (uint32_t triangle = begin; triangle < end; triangle++)
+			{
+				missCount += GetMissCount(triangle);
+				clusterTriangleCount++;
+				if (triangle + 1 < end && missCount <= maxMissCount * clusterTriangleCount)
+				{
+					cache.Clear();
+					clusterOffsets[clusterCount++] = triangle + 1;
+					missCount = 0;
+					clusterTriangleCount = 0;
+				}
+			}
+		}
+		clusterOffsets[clusterCount] = triangleCount;
+
+		//area weighted centroid and normal of every cluster, the normal is left unnormalized and scaled by twice the area
+		struct Cluster
+		{
+			DirectX::XMFLOAT3 centroid;
+			DirectX::XMFLOAT3 normal;
+			float area;
+			float sortKey;
+		};
+		Cluster* clusters = stackContext.AllocateUninitialized<Cluster>(clusterCount);
+		DirectX::XMFLOAT3 meshCentroid = {};
+		float meshArea = 0.0f;
+		for (uint32_t c = 0; c < clusterCount; c++)
+		{
+			Cluster& cluster = clusters[c];
+			cluster = {};
+			for (uint32_t triangle = clusterOffsets[c]; triangle < clusterOffsets[c + 1]; triangle++)
+			{
+				const DirectX::XMFLOAT3& p0 = positions[indices[triangle * 3 + 0]];
+				const DirectX::XMFLOAT3& p1 = positions[indices[triangle * 3 + 1]];
+				const DirectX::XMFLOAT3& p2 = positions[indices[triangle * 3 + 2]];
+				const DirectX::XMFLOAT3 e1 = { p1.x - p0.x, p1.y - p0.y, p1.z - p0.z };
+				const DirectX::XMFLOAT3 e2 = { p2.x - p0.x, p2.y - p0.y, p2.z - p0.z };
+				const DirectX::XMFLOAT3 normal = { e1.y * e2.z - e1.z * e2.y, e1.z * e2.x - e1.x * e2.z, e1.x * e2.y - e1.y * e2.x };
+				const float area = std::sqrt(normal.x * normal.x + normal.y * normal.y + normal.z * normal.z);
+
+				cluster.centroid.x += area * (p0.x + p1.x + p2.x) / 3.0f;
+				cluster.centroid.y += area * (p0.y + p1.y + p2.y) / 3.0f;
+				cluster.centroid.z += area * (p0.z + p1.z + p2.z) / 3.0f;
+				cluster.normal.x += normal.x;
+				cluster.normal.y += normal.y;
+				cluster.normal.z += normal.z;
+				cluster.area += area;
+			}
+			meshCentroid.x += cluster.centroid.x;
+			meshCentroid.y += cluster.centroid.y;
+			meshCentroid.z += cluster.centroid.z;
+			meshArea += cluster.area;
+		}
+		const float inverseMeshArea = meshArea > 0.0f ? 1.0f / meshArea : 0.0f;
+		meshCentroid = { meshCentroid.x * inverseMeshArea, meshCentroid.y * inverseMeshArea, meshCentroid.z * inverseMeshArea };
+
+		//dot of the offset from the mesh centroid with the cluster normal: clusters on the outside facing outwards get drawn first
+		uint32_t* clusterOrder = stackContext.AllocateUninitialized<uint32_t>(clusterCount);
+		for (uint32_t c = 0; c < clusterCount; c++)
+		{
+			Cluster& cluster = clusters[c];
+			const float inverseArea = cluster.area > 0.0f ? 1.0f / cluster.area : 0.0f;
+			const float normalLength = std::sqrt(cluster.normal.x * cluster.normal.x + cluster.normal.y * cluster.normal.y + cluster.normal.z * cluster.normal.z);
+			const float inverseNormalLength = normalLength > 0.0f ? 1.0f / normalLength : 0.0f;
+			cluster.sortKey = ((cluster.centroid.x * inverseArea - meshCentroid.x) * cluster.normal.x
+				+ (cluster.centroid.y * inverseArea - meshCentroid.y) * cluster.normal.y
+				+ (cluster.centroid.z * inverseArea - meshCentroid.z) * cluster.normal.z) * inverseNormalLength;
+			clusterOrder[c] = c;
+		}
+		std::stable_sort(clusterOrder, clusterOrder + clusterCount, [clusters](uint32_t a, uint32_t b) { return clusters[a].sortKey > clusters[b].sortKey; });
+
+		uint32_t* output = stackContext.AllocateUninitialized<uint32_t>(indexCount);
+		uint32_t outputCount = 0;
+		for (uint32_t c = 0; c < clusterCount; c++)
+		{
+			const uint32_t cluster = clusterOrder[c];
+			for (uint32_t i = clusterOffsets[cluster] * 3; i < clusterOffsets[cluster + 1] * 3; i++)
+			{
+				output[outputCount++] = indices[i];
+			}
+		}
+		std::copy(output, output + indexCount, indices.begin());
+	}
+
+	uint32_t OptimizeVertexFetch(std::span<uint32_t> indices, uint32_t vertexCount, uint32_t* remap)
+	{
+		static constexpr uint32_t unassigned = ~0u;
+		std::fill(remap, remap + vertexCount, unassigned);
+
+		uint32_t nextVertex = 0;
+		for (uint32_t& index : indices)
+		{
+			if (remap[index] == unassigned)
+			{
+				remap[index] = nextVertex++;
+			}
+			index = remap[index];
+		}
+
+		const uint32_t referencedVertexCount = nextVertex;
+		for (uint32_t v = 0; v < vertexCount; v++)
+		{
+			if (remap[v] == unassigned)
+			{
+				remap[v] = nextVertex++;
+			}
+		}
+		return referencedVertexCount;
+	}
+
+	void Optimize(StackContext& stackContext, const Desc& desc, std::span<uint32_t> indices, std::span<DirectX::XMFLOAT3> positions, std::span<DirectX::XMFLOAT3> normals, std::span<DirectX::XMFLOAT2> uvs)
+	{
+		assert(normals.size() == positions.size() && uvs.size() == positions.size());
+		const uint32_t vertexCount = static_cast<uint32_t>(positions.size());
+
+		//every stage releases its scratch memory before the next one
+		if (desc.optimizeVertexCache)
+		{
+			StackContext scratchContext(stackContext.allocator);
+			OptimizeVertexCache(scratchContext, indices, vertexCount, desc.cacheSize);
+		}
+		if (desc.optimizeOverdraw)
+		{
+			StackContext scratchContext(stackContext.allocator);
+			OptimizeOverdraw(scratchContext, indices, positions, desc.cacheSize, desc.overdrawThreshold);
+		}
+		if (desc.optimizeVertexFetch)
+		{
+			StackContext scratchContext(stackContext.allocator);
+			uint32_t* remap = scratchContext.AllocateUninitialized<uint32_t>(vertexCount);
+			OptimizeVertexFetch(indices, vertexCount, remap);
+			RemapVertices(scratchContext, positions, remap);
+			RemapVertices(scratchContext, normals, remap);
+			RemapVertices(scratchContext, uvs, remap);
+		}
+	}
+
+	VertexCacheStatistics AnalyzeVertexCache(std::span<const uint32_t> indices, uint32_t vertexCount, uint32_t cacheSize, CacheModel cacheModel)
+	{
+		assert(cacheSize > 0 && cacheSize <= cacheMaxSize);
+
+		//FIFO: ring buffer, LRU: most recently used first
+		uint32_t cache[cacheMaxSize];
+		std::fill(cache, cache + cacheMaxSize, ~0u);
+		uint32_t fifoHead = 0;
+		uint32_t transformedVertexCount = 0;
+		for (const uint32_t vertex : indices)
+		{
+			uint32_t slot = 0;
+			while (slot < cacheSize && cache[slot] != vertex)
+			{
+				slot++;
+			}
+			const bool isMiss = slot == cacheSize;
+			transformedVertexCount += isMiss;
+
+			if (cacheModel == CacheModel::Fifo)
+			{
+				if (isMiss)
+				{
+					cache[fifoHead] = vertex;
+					fifoHead = fifoHead + 1 < cacheSize ? fifoHead + 1 : 0;
+				}
+			}
+			else
+			{
+				slot = isMiss ? cacheSize - 1 : slot;
+				std::copy_backward(cache, cache + slot, cache + slot + 1);
+				cache[0] = vertex;
+			}
+		}
+
+		const uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+		return
+		{
+			.transformedVertexCount = transformedVertexCount,
+			.acmr = triangleCount > 0 ? static_cast<float>(transformedVertexCount) / triangleCount : 0.0f,
+			.atvr = vertexCount > 0 ? static_cast<float>(transformedVertexCount) / vertexCount : 0.0f
+		};
+	}
+
+	float AnalyzeVertexFetch(std::span<const uint32_t> indices, uint32_t vertexCount, uint32_t vertexStrideBytes)
+	{
+		//line tags of a direct mapped cache
+		uint64_t lines[fetchCacheLineCount];
+		std::fill(lines, lines + fetchCacheLineCount, ~0ull);
+		uint64_t fetchedBytes = 0;
+		for (const uint32_t vertex : indices)
+		{
+			const uint64_t firstLine = uint64_t(vertex) * vertexStrideBytes / fetchCacheLineSizeBytes;
+			const uint64_t lastLine = (uint64_t(vertex + 1) * vertexStrideBytes - 1) / fetchCacheLineSizeBytes;
+			for (uint64_t line = firstLine; line <= lastLine; line++)
+			{
+				uint64_t& cachedLine = lines[line % fetchCacheLineCount];
+				if (cachedLine != line)
+				{
+					cachedLine = line;
+					fetchedBytes += fetchCacheLineSizeBytes;
+				}
+			}
+		}
+
+		const uint64_t streamSizeBytes = uint64_t(vertexCount) * vertexStrideBytes;
+		return streamSizeBytes > 0 ? static_cast<float>(double(fetchedBytes) / streamSizeBytes) : 0.0f;
+	}
+}
@@ -0,0 +1,87 @@
+#include "stdafx.h"
+#include "MeshOptimizerBenchmark.h"
+
+#include "BenchmarkHelpers.h"
+#include "Geometry.h"
+
+namespace MeshOptimizerBenchmark
+{
+	std::vector<Result> Run()
+	{
+		struct Workload
+		{
+			const char* name;
+			MeshOptimizer::Desc optimizationDesc;
+		};
+
+		const Workload workloads[] =
+		{
+			{ "Unoptimized", { .optimizeVertexCache = false, .optimizeOverdraw = false, .optimizeVertexFetch = false } },
+			{ "Vertex cache", { .optimizeVertexCache = true, .optimizeOverdraw = false, .optimizeVertexFetch = false } },
+			{ "Vertex cache and overdraw", { .optimizeVertexCache = true, .optimizeOverdraw = true, .optimizeVertexFetch = false } },
+			{ "Vertex cache, overdraw and fetch", { .optimizeVertexCache = true, .optimizeOverdraw = true, .optimizeVertexFetch = true } },
+		};
+
+		StackAllocator stackAllocator;
+		stackAllocator.InitVirtual(Benchmark::stackMemoryReservedSize);
+
+		std::vector<Result> results;
+		for (const wchar_t* meshFileName : Benchmark::meshFileNames)
+		{
+			const rapidobj::Result model = rapidobj::ParseFile(meshFileName);
+			if (model.error)
+			{
+				continue;
+			}
+
+			const std::string name = WStringToAnsi(meshFileName);
+			for (const Workload& workload : workloads)
+			{
+				Result result = { .workload = workload.name, .meshFileName = name };
+				result.buildMs = Benchmark::MeasureBest([&]()
+					{
+						StackContext stackContext(stackAllocator);
+						BuildGeometryData(stackContext, model, {}, {}, workload.optimizationDesc);
+					});
+
+				//statistics over the whole mesh, the submeshes are drawn one after another
+				StackContext stackContext(stackAllocator);
+				const GeometryData data = BuildGeometryData(stackContext, model, {}, {}, workload.optimizationDesc);
+				const uint32_t vertexCount = static_cast<uint32_t>(data.positions.size());
+				result.triangleCount = data.indices.size() / 3;
+				result.vertexCount = vertexCount;
+				result.fifo = MeshOptimizer::AnalyzeVertexCache(data.indices, vertexCount, workload.optimizationDesc.cacheSize, MeshOptimizer::CacheModel::Fifo);
+				result.lru = MeshOptimizer::AnalyzeVertexCache(data.indices, vertexCount, workload.optimizationDesc.cacheSize, MeshOptimizer::CacheModel::Lru);
+				result.overfetch = MeshOptimizer::AnalyzeVertexFetch(data.indices, vertexCount, sizeof(DirectX::XMFLOAT3));
+				results.push_back(result);
+			}
+		}
+
+		stackAllocator.Destroy();
+		return results;
+	}
+
+	void WriteCsv(FILE* file, std::span<const Result> results)
+	{
+		fprintf(file, "workload,mesh,triangles,vertices,build_ms,acmr_fifo,atvr_fifo,acmr_lru,atvr_lru,overfetch\n");
+		for (const Result& result : results)
+		{
+			fprintf(file, "%s,%s,%llu,%llu,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n",
+				result.workload,
+				result.meshFileName.c_str(),
+				result.triangleCount,
+				result.vertexCount,
+				result.buildMs,
+				result.fifo.acmr,
+				result.fifo.atvr,
+				result.lru.acmr,
+				result.lru.atvr,
+				result.overfetch);
+		}
+	}
+
+	bool RunAndWriteCsv(const char* filePath)
+	{
+		return Benchmark::WriteCsvFile(filePath, Run(), WriteCsv);
+	}
+}
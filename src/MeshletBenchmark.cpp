@@ -0,0 +1,122 @@
+#include "stdafx.h"
+#include "MeshletBenchmark.h"
+
+#include "BenchmarkHelpers.h"
+#include "D3DGlobals.h"
+#include "MeshCache.h"
+
+using namespace DirectX;
+
+namespace MeshletBenchmark
+{
+	static constexpr uint32_t orbitViewCount = 8;
+	static constexpr float orbitDistanceScale = 1.5f; //of the bounding sphere radius of the mesh
+
+	struct View
+	{
+		std::string name;
+		XMFLOAT3 position;
+		XMFLOAT4X4 viewMatrix; //transposed, like Camera::Constants
+	};
+
+	static View CreateView(std::string name, FXMVECTOR position, FXMVECTOR target)
+	{
+		View view = { .name = std::move(name) };
+		XMStoreFloat3(&view.position, position);
+		XMStoreFloat4x4(&view.viewMatrix, XMMatrixTranspose(XMMatrixLookAtLH(position, target, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f))));
+		return view;
+	}
+
+	std::vector<Result> Run()
+	{
+		//the far plane of the renderer is too close for looking at a whole mesh from outside, the frustum planes don't depend on it otherwise
+		Camera camera(0.25f * XM_PI, 16.0f / 9.0f, D3D::nearZ, 1000.0f);
+		camera.Update({});
+		const Camera::FrustumData frustumData = camera.constants.Current().frustumData;
+
+		StackAllocator stackAllocator;
+		stackAllocator.InitVirtual(Benchmark::stackMemoryReservedSize);
+
+		std::vector<Result> results;
+		for (const wchar_t* meshFileName : Benchmark::meshFileNames)
+		{
+			MeshCache::View meshCache;
+			if (!MeshCache::OpenOrCook(meshCache, meshFileName))
+			{
+				continue;
+			}
+
+			//the geometry section starts with the indices followed by the positions
+			const MeshCache::Header& header = *meshCache.header;
+			const std::span<const uint32_t> indices = { reinterpret_cast<const uint32_t*>(meshCache.geometry.data()), header.indexCount };
+			const std::span<const XMFLOAT3> positions = { reinterpret_cast<const XMFLOAT3*>(indices.data() + header.indexCount), header.vertexCount };
+			const double buildMs = Benchmark::MeasureBest([&]()
+				{
+					StackContext stackContext(stackAllocator);
+					Meshlets::BuildMeshlets(stackContext, indices, positions, meshCache.submeshes);
+				});
+			const Meshlets::MeshletData meshletData = meshCache.GetMeshletData();
+
+			BoundingSphere meshSphere;
+			BoundingSphere::CreateFromBoundingBox(meshSphere, header.aabb);
+			const XMVECTOR center = XMLoadFloat3(&meshSphere.Center);
+			std::vector<View> views;
+			for (uint32_t i = 0; i < orbitViewCount; i++)
+			{
+				const float angle = 2.0f * XM_PI * i / orbitViewCount;
+				const XMVECTOR offset = XMVectorSet(std::sin(angle), 0.25f, std::cos(angle), 0.0f) * (orbitDistanceScale * meshSphere.Radius);
+				views.push_back(CreateView("Orbit " + std::to_string(360 * i / orbitViewCount), center + offset, center));
+			}
+			views.push_back(CreateView("Center", center, center + XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f)));
+
+			const std::string name = WStringToAnsi(meshFileName);
+			for (const View& view : views)
+			{
+				Meshlets::CullingStatistics statistics = {};
+				const double cullMs = Benchmark::MeasureBest([&]()
+					{
+						statistics = Meshlets::Cull(meshletData, view.viewMatrix, frustumData, view.position);
+					});
+				results.push_back(
+					{
+						.meshFileName = name,
+						.view = view.name,
+						.meshletCount = header.meshletCount,
+						.triangleCount = statistics.triangleCount,
+						.buildMs = buildMs,
+						.cullUs = cullMs * 1000.0,
+						.statistics = statistics
+					});
+			}
+			meshCache.Close();
+		}
+
+		stackAllocator.Destroy();
+		return results;
+	}
+
+	void WriteCsv(FILE* file, std::span<const Result> results)
+	{
+		fprintf(file, "mesh,view,meshlets,triangles,build_ms,cull_us,frustum_culled_percent,cone_culled_percent,culled_percent\n");
+		for (const Result& result : results)
+		{
+			const double toPercent = result.triangleCount > 0 ? 100.0 / result.triangleCount : 0.0;
+			const Meshlets::CullingStatistics& statistics = result.statistics;
+			fprintf(file, "%s,%s,%u,%llu,%.3f,%.1f,%.1f,%.1f,%.1f\n",
+				result.meshFileName.c_str(),
+				result.view.c_str(),
+				result.meshletCount,
+				result.triangleCount,
+				result.buildMs,
+				result.cullUs,
+				statistics.frustumCulledTriangleCount * toPercent,
+				statistics.coneCulledTriangleCount * toPercent,
+				(statistics.frustumCulledTriangleCount + statistics.coneCulledTriangleCount) * toPercent);
+		}
+	}
+
+	bool RunAndWriteCsv(const char* filePath)
+	{
+		return Benchmark::WriteCsvFile(filePath, Run(), WriteCsv);
+	}
+}
@@ -0,0 +1,256 @@
+#include "stdafx.h"
+#include "Meshlets.h"
+
+namespace Meshlets
+{
+	//a meshlet gets closed when the next triangle doesn't fit, i.e. with at least vertexMaxCount - 2 vertices, and a triangle adds at most 3. Bounds the meshlet count upfront
+	static constexpr uint32_t closedMeshletTriangleMinCount = DivisionRoundUp(vertexMaxCount - 2, 3);
+	//wider cones are hardly ever culled and their apex moves far away, see ComputeBounds()
+	static constexpr float coneMinDot = 0.1f;
+	static constexpr uint8_t noLocalIndex = 0xFF;
+
+	static DirectX::XMFLOAT3 Subtract(const DirectX::XMFLOAT3& a, const DirectX::XMFLOAT3& b)
+	{
+		return { a.x - b.x, a.y - b.y, a.z - b.z };
+	}
+
+	static float Dot(const DirectX::XMFLOAT3& a, const DirectX::XMFLOAT3& b)
+	{
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+
+	static DirectX::XMFLOAT3 Cross(const DirectX::XMFLOAT3& a, const DirectX::XMFLOAT3& b)
+	{
+		return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+	}
+
+	//zero vector if the length is zero
+	static DirectX::XMFLOAT3 Normalize(const DirectX::XMFLOAT3& a)
+	{
+		const float length = std::sqrt(Dot(a, a));
+		const float inverseLength = length > 0.0f ? 1.0f / length : 0.0f;
+		return { a.x * inverseLength, a.y * inverseLength, a.z * inverseLength };
+	}
+
+	static Bounds ComputeBounds(const Meshlet& meshlet, const uint32_t* vertices, const uint32_t* triangles, std::span<const DirectX::XMFLOAT3> positions)
+	{
+		DirectX::XMFLOAT3 meshletPositions[vertexMaxCount];
+		for (uint32_t v = 0; v < meshlet.vertexCount; v++)
+		{
+			meshletPositions[v] = positions[vertices[meshlet.vertexOffset + v]];
+		}
+
+		Bounds bounds = {};
+		DirectX::BoundingSphere sphere;
+		DirectX::BoundingSphere::CreateFromPoints(sphere, meshlet.vertexCount, meshletPositions, sizeof(DirectX::XMFLOAT3));
+		bounds.boundingSphere = { sphere.Center.x, sphere.Center.y, sphere.Center.z, sphere.Radius };
+		DirectX::BoundingBox aabb;
+		DirectX::BoundingBox::CreateFromPoints(aabb, meshlet.vertexCount, meshletPositions, sizeof(DirectX::XMFLOAT3));
+		bounds.aabbCenter = aabb.Center;
+		bounds.aabbExtents = aabb.Extents;
+
+		//front faces are clockwise, so the cross product of the edges points to the front side. Degenerate triangles have no normal and are skipped
+		DirectX::XMFLOAT3 normals[triangleMaxCount];
+		DirectX::XMFLOAT3 corners[triangleMaxCount];
+		uint32_t normalCount = 0;
+		DirectX::XMFLOAT3 normalSum = {};
+		for (uint32_t t = 0; t < meshlet.triangleCount; t++)
+		{
+			const uint32_t triangle = triangles[meshlet.triangleOffset + t];
+			const DirectX::XMFLOAT3& p0 = meshletPositions[GetTriangleCorner(triangle, 0)];
+			const DirectX::XMFLOAT3& p1 = meshletPositions[GetTriangleCorner(triangle, 1)];
+			const DirectX::XMFLOAT3& p2 = meshletPositions[GetTriangleCorner(triangle, 2)];
+			const DirectX::XMFLOAT3 normal = Normalize(Cross(Subtract(p1, p0), Subtract(p2, p0)));
+			if (Dot(normal, normal) == 0.0f)
+			{
+				continue;
+			}
+			normals[normalCount] = normal;
+			corners[normalCount++] = p0;
+			normalSum = { normalSum.x + normal.x, normalSum.y + normal.y, normalSum.z + normal.z };
+		}
+
+		bounds.coneAxis = Normalize(normalSum);
+		float minDot = 1.0f;
+		for (uint32_t n = 0; n < normalCount; n++)
+		{
+			minDot = Min(minDot, Dot(normals[n], bounds.coneAxis));
+		}
+		if (normalCount == 0 || minDot <= coneMinDot)
+		{
+			bounds.coneApex = { sphere.Center.x, sphere.Center.y, sphere.Center.z };
+			bounds.coneCutoff = coneDisabledCutoff;
+			return bounds;
+		}
+		bounds.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+
+		//The apex gets moved back along the axis until it is behind the planes of all triangles. A camera seeing it from the back side of the cone then sees every triangle from its back side,
+		//the cone test is conservative for cameras at finite distances, not just for the view direction
+		float maxDistance = 0.0f;
+		for (uint32_t n = 0; n < normalCount; n++)
+		{
+			const float distance = Dot(Subtract(sphere.Center, corners[n]), normals[n]) / Dot(bounds.coneAxis, normals[n]);
+			maxDistance = Max(maxDistance, distance);
+		}
+		bounds.coneApex =
+		{
+			sphere.Center.x - bounds.coneAxis.x * maxDistance,
+			sphere.Center.y - bounds.coneAxis.y * maxDistance,
+			sphere.Center.z - bounds.coneAxis.z * maxDistance
+		};
+		return bounds;
+	}
+
+	MeshletData BuildMeshlets(StackContext& stackContext, std::span<const uint32_t> indices, std::span<const DirectX::XMFLOAT3> positions, std::span<const PbrMesh::Submesh> submeshes)
+	{
+		static_assert(vertexMaxCount < noLocalIndex && triangleMaxCount >= closedMeshletTriangleMinCount);
+
+		const uint32_t submeshCount = static_cast<uint32_t>(submeshes.size());
+		const uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+		const uint32_t meshletMaxCount = triangleCount / closedMeshletTriangleMinCount + submeshCount;
+
+		Meshlet* meshlets = stackContext.AllocateUninitialized<Meshlet>(meshletMaxCount);
+		//every triangle is in exactly one meshlet, a vertex is at most once in a meshlet per index referencing it
+		uint32_t* vertices = stackContext.AllocateUninitialized<uint32_t>(static_cast<uint32_t>(indices.size()));
+		uint32_t* triangles = stackContext.AllocateUninitialized<uint32_t>(triangleCount);
+		uint32_t* submeshMeshletOffsets = stackContext.AllocateUninitialized<uint32_t>(submeshCount + 1);
+		uint8_t* localIndices = stackContext.AllocateUninitialized<uint8_t>(static_cast<uint32_t>(positions.size()));
+		std::fill(localIndices, localIndices + positions.size(), noLocalIndex);
+
+		uint32_t meshletCount = 0;
+		uint32_t vertexCount = 0;
+		uint32_t meshletTriangleCount = 0;
+		for (uint32_t submeshIndex = 0; submeshIndex < submeshCount; submeshIndex++)
+		{
+			submeshMeshletOffsets[submeshIndex] = meshletCount;
+			Meshlet* meshlet = nullptr;
+			auto CloseMeshlet = [&]()
+			{
+				for (uint32_t v = meshlet->vertexOffset; v < meshlet->vertexOffset + meshlet->vertexCount; v++)
+				{
+					localIndices[vertices[v]] = noLocalIndex;
+				}
+				meshlet = nullptr;
+			};
+
+			const PbrMesh::Submesh& submesh = submeshes[submeshIndex];
+			for (uint32_t i = submesh.startIndexLocation; i < submesh.startIndexLocation + submesh.indexCount; i += 3)
+			{
+				const uint32_t corners[3] = { indices[i], indices[i + 1], indices[i + 2] };
+				const uint32_t newVertexCount = (localIndices[corners[0]] == noLocalIndex)
+					+ (localIndices[corners[1]] == noLocalIndex && corners[1] != corners[0])
+					+ (localIndices[corners[2]] == noLocalIndex && corners[2] != corners[0] && corners[2] != corners[1]);
+				if (meshlet && (meshlet->vertexCount + newVertexCount > vertexMaxCount || meshlet->triangleCount == triangleMaxCount))
+				{
+					CloseMeshlet();
+				}
+				if (!meshlet)
+				{
+					assert(meshletCount < meshletMaxCount);
+					meshlet = &meshlets[meshletCount++];
+					*meshlet = { .vertexOffset = vertexCount, .vertexCount = 0, .triangleOffset = meshletTriangleCount, .triangleCount = 0 };
+				}
+
+				for (uint32_t vertex : corners)
+				{
+					if (localIndices[vertex] == noLocalIndex)
+					{
+						localIndices[vertex] = static_cast<uint8_t>(meshlet->vertexCount++);
+						vertices[vertexCount++] = vertex;
+					}
+				}
+				triangles[meshletTriangleCount++] = PackTriangle(localIndices[corners[0]], localIndices[corners[1]], localIndices[corners[2]]);
+				meshlet->triangleCount++;
+			}
+			if (meshlet)
+			{
+				CloseMeshlet();
+			}
+		}
+		submeshMeshletOffsets[submeshCount] = meshletCount;
+
+		Bounds* bounds = stackContext.AllocateUninitialized<Bounds>(meshletCount);
+		for (uint32_t m = 0; m < meshletCount; m++)
+		{
+			bounds[m] = ComputeBounds(meshlets[m], vertices, triangles, positions);
+		}
+
+		return
+		{
+			.meshlets = { meshlets, meshletCount },
+			.bounds = { bounds, meshletCount },
+			.vertices = { vertices, vertexCount },
+			.triangles = { triangles, meshletTriangleCount },
+			.submeshMeshletOffsets = { submeshMeshletOffsets, submeshCount + 1 }
+		};
+	}
+
+	uint64_t GetStreamsSizeBytes(uint32_t meshletCount, uint32_t vertexCount, uint32_t triangleCount)
+	{
+		return uint64_t(meshletCount) * (sizeof(Meshlet) + sizeof(Bounds)) + (uint64_t(vertexCount) + triangleCount) * sizeof(uint32_t);
+	}
+
+	MeshletData GetMeshletData(std::span<const uint8_t> streams, uint32_t meshletCount, uint32_t vertexCount, uint32_t triangleCount, std::span<const uint32_t> submeshMeshletOffsets)
+	{
+		assert(streams.size() == GetStreamsSizeBytes(meshletCount, vertexCount, triangleCount));
+
+		const uint8_t* meshlets = streams.data();
+		const uint8_t* bounds = meshlets + meshletCount * sizeof(Meshlet);
+		const uint8_t* vertices = bounds + meshletCount * sizeof(Bounds);
+		const uint8_t* triangles = vertices + vertexCount * sizeof(uint32_t);
+		return
+		{
+			.meshlets = { reinterpret_cast<const Meshlet*>(meshlets), meshletCount },
+			.bounds = { reinterpret_cast<const Bounds*>(bounds), meshletCount },
+			.vertices = { reinterpret_cast<const uint32_t*>(vertices), vertexCount },
+			.triangles = { reinterpret_cast<const uint32_t*>(triangles), triangleCount },
+			.submeshMeshletOffsets = submeshMeshletOffsets
+		};
+	}
+
+	CullingStatistics Cull(const MeshletData& meshletData, const DirectX::XMFLOAT4X4& viewMatrix, const Camera::FrustumData& frustumData, const DirectX::XMFLOAT3& cameraPosition, std::span<bool> isVisible)
+	{
+		assert(isVisible.empty() || isVisible.size() == meshletData.meshlets.size());
+
+		const DirectX::XMFLOAT3& normalTop = frustumData.planeTopNormalVS;
+		const DirectX::XMFLOAT3& normalLeft = frustumData.planeLeftNormalVS;
+		const DirectX::XMFLOAT3 normalBottom = { normalTop.x, -normalTop.y, normalTop.z };
+		const DirectX::XMFLOAT3 normalRight = { -normalLeft.x, normalLeft.y, normalLeft.z };
+
+		CullingStatistics statistics = { .meshletCount = static_cast<uint32_t>(meshletData.meshlets.size()) };
+		for (uint32_t m = 0; m < meshletData.meshlets.size(); m++)
+		{
+			const Bounds& bounds = meshletData.bounds[m];
+			const uint32_t triangleCount = meshletData.meshlets[m].triangleCount;
+			statistics.triangleCount += triangleCount;
+
+			//the matrix is stored transposed, like mul(position, viewMatrix) in the shaders
+			const DirectX::XMFLOAT4& sphere = bounds.boundingSphere;
+			const DirectX::XMFLOAT3 centerVS =
+			{
+				sphere.x * viewMatrix._11 + sphere.y * viewMatrix._12 + sphere.z * viewMatrix._13 + viewMatrix._14,
+				sphere.x * viewMatrix._21 + sphere.y * viewMatrix._22 + sphere.z * viewMatrix._23 + viewMatrix._24,
+				sphere.x * viewMatrix._31 + sphere.y * viewMatrix._32 + sphere.z * viewMatrix._33 + viewMatrix._34
+			};
+			const float radius = sphere.w;
+			const bool isWithinFrustum = Dot(centerVS, normalTop) >= -radius
+				&& Dot(centerVS, normalBottom) >= -radius
+				&& Dot(centerVS, normalLeft) >= -radius
+				&& Dot(centerVS, normalRight) >= -radius
+				&& centerVS.z + radius >= frustumData.nearZ
+				&& centerVS.z - radius <= frustumData.farZ;
+
+			const bool isBackfacing = isWithinFrustum && Dot(Normalize(Subtract(bounds.coneApex, cameraPosition)), bounds.coneAxis) >= bounds.coneCutoff;
+
+			statistics.frustumCulledMeshletCount += !isWithinFrustum;
+			statistics.frustumCulledTriangleCount += isWithinFrustum ? 0 : triangleCount;
+			statistics.coneCulledMeshletCount += isBackfacing;
+			statistics.coneCulledTriangleCount += isBackfacing ? triangleCount : 0;
+			if (!isVisible.empty())
+			{
+				isVisible[m] = isWithinFrustum && !isBackfacing;
+			}
+		}
+		return statistics;
+	}
+}
@@ -2,6 +2,7 @@
 #include "SSSR.h"
 
 #include "BufferMemory.h"
+#include "CommandStream.h"
 #include "Texture.h"
 
 namespace SSSR
@@ -36,9 +37,9 @@ namespace SSSR
 		bufferSrvId = specularReflectionBuffer->srvId;
 	}
 
-	void Render(ID3D12GraphicsCommandList10* commandList, DescriptorHeap::Id previousLitBufferSrvId, BufferHeap::Offset lightsDataBufferOffset)
+	void Render(CommandStream* commandList, DescriptorHeap::Id previousLitBufferSrvId, BufferHeap::Offset lightsDataBufferOffset)
 	{
-		PIXScopedEvent(commandList, PIX_COLOR_DEFAULT, "SSSR");
+		ScopedEvent scopedEvent(commandList, L"SSSR");
 		DispatchComputePass(commandList,
 			raymarchPso.Get(),
 			{
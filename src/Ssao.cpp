@@ -1,6 +1,7 @@
 #include "stdafx.h"
 #include "SSAO.h"
 
+#include "CommandStream.h"
 #include "Texture.h"
 
 
@@ -28,9 +29,9 @@ namespace SSAO
 		bufferSrvId = buffer.srvId;
 	}
 
-	void Render(ID3D12GraphicsCommandList10* commandList, BufferHeap::Offset ddgiDataOffset, DescriptorHeap::Id litBufferSrvId)
+	void Render(CommandStream* commandList, BufferHeap::Offset ddgiDataOffset, DescriptorHeap::Id litBufferSrvId)
 	{
-		PIXScopedEvent(commandList, PIX_COLOR_DEFAULT, "SSGI");
+		ScopedEvent scopedEvent(commandList, L"SSGI");
 		DispatchComputePass(commandList,
 			mainPso.Get(),
 			{
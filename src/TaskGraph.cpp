@@ -0,0 +1,267 @@
+#include "stdafx.h"
+#include "TaskGraph.h"
+
+#include "HeapTracking.h"
+
+static constexpr uint32_t InvalidNode = ~0u;
+
+TaskGraph::ResourceId TaskGraph::AddResource(const char* name)
+{
+	assert(!isCompiled);
+	resourceNames.push_back(name);
+	return static_cast<ResourceId>(resourceNames.size() - 1);
+}
+
+TaskGraph::NodeId TaskGraph::AddNode(const char* name, std::initializer_list<ResourceId> reads, std::initializer_list<ResourceId> writes, std::function<void()> function)
+{
+	assert(!isCompiled);
+	nodes.push_back(
+		{
+			.name = name,
+			.function = std::move(function),
+			.reads = reads,
+			.writes = writes
+		});
+	return static_cast<NodeId>(nodes.size() - 1);
+}
+
+void TaskGraph::Compile()
+{
+	assert(!isCompiled);
+	const uint32_t nodeCount = static_cast<uint32_t>(nodes.size());
+
+	auto AddEdge = [this](NodeId from, NodeId to)
+	{
+		if (from == InvalidNode || from == to)
+		{
+			return;
+		}
+		std::vector<NodeId>& predecessors = nodes[to].predecessors;
+		if (std::find(predecessors.begin(), predecessors.end(), from) == predecessors.end())
+		{
+			predecessors.push_back(from);
+			nodes[from].successors.push_back(to);
+		}
+	};
+
+	//edges only point from earlier to later declared nodes, so the graph can't have cycles
+	std::vector<NodeId> lastWriters(resourceNames.size(), InvalidNode);
+	std::vector<std::vector<NodeId>> readersSinceWrite(resourceNames.size());
+	for (NodeId nodeId = 0; nodeId < nodeCount; nodeId++)
+	{
+		const Node& node = nodes[nodeId];
+		for (ResourceId resource : node.reads)
+		{
+			assert(resource < resourceNames.size());
+			AddEdge(lastWriters[resource], nodeId);
+		}
+		for (ResourceId resource : node.writes)
+		{
+			assert(resource < resourceNames.size());
+			AddEdge(lastWriters[resource], nodeId);
+			for (NodeId reader : readersSinceWrite[resource])
+			{
+				AddEdge(reader, nodeId);
+			}
+			readersSinceWrite[resource].clear();
+			lastWriters[resource] = nodeId;
+		}
+		for (ResourceId resource : node.reads)
+		{
+			readersSinceWrite[resource].push_back(nodeId);
+		}
+	}
+
+	//Kahn's algorithm, nodes of the same depth end up next to each other
+	std::vector<uint32_t> predecessorCounts(nodeCount);
+	order.clear();
+	order.reserve(nodeCount);
+	for (NodeId nodeId = 0; nodeId < nodeCount; nodeId++)
+	{
+		predecessorCounts[nodeId] = static_cast<uint32_t>(nodes[nodeId].predecessors.size());
+		if (predecessorCounts[nodeId] == 0)
+		{
+			order.push_back(nodeId);
+		}
+	}
+	roots = order;
+	for (uint32_t i = 0; i < order.size(); i++)
+	{
+		for (NodeId successor : nodes[order[i]].successors)
+		{
+			if (--predecessorCounts[successor] == 0)
+			{
+				order.push_back(successor);
+			}
+		}
+	}
+	assert(order.size() == nodeCount);
+
+	pendingPredecessorCounts = std::make_unique<std::atomic<uint32_t>[]>(nodeCount);
+	timings.assign(nodeCount, {});
+	isCompiled = true;
+}
+
+void TaskGraph::ExecuteNode(NodeId nodeId)
+{
+	//the sequence is only used for checking, the release of the predecessors through pendingPredecessorCounts already orders it
+	const uint32_t beginSequence = sequence.fetch_add(1, std::memory_order_relaxed);
+	const auto begin = std::chrono::high_resolution_clock::now();
+	nodes[nodeId].function();
+	const auto end = std::chrono::high_resolution_clock::now();
+	const uint32_t endSequence = sequence.fetch_add(1, std::memory_order_relaxed);
+
+	timings[nodeId] =
+	{
+		.beginMs = std::chrono::duration<double, std::milli>(begin - runBegin).count(),
+		.endMs = std::chrono::duration<double, std::milli>(end - runBegin).count(),
+		.threadIndex = JobSystem::GetThreadIndex(),
+		.beginSequence = beginSequence,
+		.endSequence = endSequence
+	};
+}
+
+void TaskGraph::RunNode(NodeId nodeId)
+{
+	//the region is thread local, so it needs to be opened on the thread running the node. Covers submitting the successors as well
+	if (isZeroAllocation)
+	{
+		HeapTracking::BeginZeroAllocationRegion(nodes[nodeId].name);
+	}
+
+	ExecuteNode(nodeId);
+
+	//the last predecessor to finish submits the node, the acq_rel decrement makes all predecessors' writes visible to it
+	for (NodeId successor : nodes[nodeId].successors)
+	{
+		if (pendingPredecessorCounts[successor].fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			JobSystem::Run([this, successor]() { RunNode(successor); }, &counter);
+		}
+	}
+
+	if (isZeroAllocation)
+	{
+		HeapTracking::EndZeroAllocationRegion();
+	}
+}
+
+void TaskGraph::Run(JobSystem::WaitMode waitMode)
+{
+	Start();
+	Wait(waitMode);
+}
+
+void TaskGraph::Start()
+{
+	assert(isCompiled);
+	for (NodeId nodeId : order)
+	{
+		pendingPredecessorCounts[nodeId].store(static_cast<uint32_t>(nodes[nodeId].predecessors.size()), std::memory_order_relaxed);
+	}
+
+	sequence.store(0, std::memory_order_relaxed);
+	runBegin = std::chrono::high_resolution_clock::now();
+	for (NodeId root : roots)
+	{
+		JobSystem::Run([this, root]() { RunNode(root); }, &counter);
+	}
+}
+
+void TaskGraph::Wait(JobSystem::WaitMode waitMode)
+{
+	JobSystem::Wait(counter, waitMode);
+	lastRunMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - runBegin).count();
+}
+
+void TaskGraph::RunSerial()
+{
+	assert(isCompiled);
+	sequence.store(0, std::memory_order_relaxed);
+	runBegin = std::chrono::high_resolution_clock::now();
+	for (NodeId nodeId : order)
+	{
+		if (isZeroAllocation)
+		{
+			HeapTracking::BeginZeroAllocationRegion(nodes[nodeId].name);
+		}
+		ExecuteNode(nodeId);
+		if (isZeroAllocation)
+		{
+			HeapTracking::EndZeroAllocationRegion();
+		}
+	}
+	lastRunMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - runBegin).count();
+}
+
+double TaskGraph::ComputeCriticalPath(std::vector<NodeId>* path) const
+{
+	assert(isCompiled);
+	if (order.empty())
+	{
+		return 0.0;
+	}
+
+	//longest path over the topological order, weighted by the measured durations
+	std::vector<double> pathMs(nodes.size());
+	std::vector<NodeId> previous(nodes.size(), InvalidNode);
+	NodeId last = order.front();
+	for (NodeId nodeId : order)
+	{
+		double predecessorMs = 0.0;
+		for (NodeId predecessor : nodes[nodeId].predecessors)
+		{
+			if (pathMs[predecessor] > predecessorMs)
+			{
+				predecessorMs = pathMs[predecessor];
+				previous[nodeId] = predecessor;
+			}
+		}
+		pathMs[nodeId] = predecessorMs + (timings[nodeId].endMs - timings[nodeId].beginMs);
+		last = pathMs[nodeId] > pathMs[last] ? nodeId : last;
+	}
+
+	if (path)
+	{
+		path->clear();
+		for (NodeId nodeId = last; nodeId != InvalidNode; nodeId = previous[nodeId])
+		{
+			path->push_back(nodeId);
+		}
+		std::reverse(path->begin(), path->end());
+	}
+	return pathMs[last];
+}
+
+uint32_t TaskGraph::CountOrderViolations() const
+{
+	assert(isCompiled);
+	uint32_t violationCount = 0;
+	for (NodeId nodeId : order)
+	{
+		for (NodeId predecessor : nodes[nodeId].predecessors)
+		{
+			violationCount += timings[predecessor].endSequence > timings[nodeId].beginSequence;
+		}
+	}
+	return violationCount;
+}
+
+void TaskGraph::WriteTimings(FILE* file) const
+{
+	fprintf(file, "node,thread,begin_ms,end_ms,duration_ms\n");
+	for (NodeId nodeId : order)
+	{
+		const NodeTiming& timing = timings[nodeId];
+		fprintf(file, "%s,%u,%.3f,%.3f,%.3f\n", nodes[nodeId].name, timing.threadIndex, timing.beginMs, timing.endMs, timing.endMs - timing.beginMs);
+	}
+
+	std::vector<NodeId> path;
+	const double criticalPathMs = ComputeCriticalPath(&path);
+	fprintf(file, "\ncritical path %.3f ms of %.3f ms:", criticalPathMs, lastRunMs);
+	for (NodeId nodeId : path)
+	{
+		fprintf(file, " %s", nodes[nodeId].name);
+	}
+	fprintf(file, "\n");
+}
@@ -8,9 +8,8 @@
 D3D12_SRV_DIMENSION GetSrvDimension(const TextureProperties& textureProperties, TextureArrayType arrayType);
 D3D12_UAV_DIMENSION GetUavDimension(const TextureProperties& textureProperties); 
 
-Texture LoadTexture(LPCWSTR filename, ID3D12Device10* device, DescriptorHeap& descriptorHeap, ColorMode colorMode, bool bNoMip)
+DirectX::ScratchImage DecodeTexture(LPCWSTR filename, bool bNoMip)
 {
-	Texture result;
 	DirectX::ScratchImage image;
 
 	std::filesystem::path path(filename);
@@ -45,8 +44,11 @@ Texture LoadTexture(LPCWSTR filename, ID3D12Device10* device, DescriptorHeap& de
 			CheckForErrors(DirectX::GenerateMipMaps(*tempImage.GetImage(0, 0, 0), DirectX::TEX_FILTER_DEFAULT, 0, image, false));
 		}
 	}
+	return image;
+}
 
-	const DirectX::TexMetadata& metadata = image.GetMetadata();
+Texture CreateTexture(ID3D12Device10* device, const DirectX::TexMetadata& metadata, DescriptorHeap& descriptorHeap, LPCWSTR name, ColorMode colorMode)
+{
 	DXGI_FORMAT format = metadata.format;
 	switch (colorMode)
 	{
@@ -61,8 +63,7 @@ Texture LoadTexture(LPCWSTR filename, ID3D12Device10* device, DescriptorHeap& de
 		break;
 	}
 
-
-	result = CreateTexture(device,
+	return CreateTexture(device,
 		{
 			.format = format,
 			.width = (uint32_t)metadata.width,
@@ -72,12 +73,15 @@ Texture LoadTexture(LPCWSTR filename, ID3D12Device10* device, DescriptorHeap& de
 			.mipCount = (uint32_t)metadata.mipLevels
 		},
 		descriptorHeap,
-		filename,
+		name,
 		TextureMemoryType::CPUVisible,
 		D3D12_BARRIER_LAYOUT_DIRECT_QUEUE_SHADER_RESOURCE,
 		metadata.IsCubemap() ? TextureArrayType::CubeMap : TextureArrayType::Unspecified);
+}
 
-	TextureProperties& properties = result.properties;
+void WriteTextureData(const Texture& texture, const DirectX::ScratchImage& image)
+{
+	const TextureProperties& properties = texture.properties;
 	for (unsigned int iArray = 0; iArray < properties.arraySize; iArray++)
 	{
 		for (unsigned int iMip = 0; iMip < properties.mipCount; iMip++)
@@ -87,12 +91,42 @@ Texture LoadTexture(LPCWSTR filename, ID3D12Device10* device, DescriptorHeap& de
 			const DirectX::Image* subImage = image.GetImage(iMip, iArray, 0);
 			const uint8_t* srcImage = subImage->pixels;
 
-			result.ptr->WriteToSubresource(iSubresource, nullptr, srcImage, (uint32_t)subImage->rowPitch, (uint32_t)subImage->slicePitch);
+			texture.ptr->WriteToSubresource(iSubresource, nullptr, srcImage, (uint32_t)subImage->rowPitch, (uint32_t)subImage->slicePitch);
 		}
 	}
+}
+
+Texture LoadTexture(LPCWSTR filename, ID3D12Device10* device, DescriptorHeap& descriptorHeap, ColorMode colorMode, bool bNoMip)
+{
+	DirectX::ScratchImage image = DecodeTexture(filename, bNoMip);
+	Texture result = CreateTexture(device, image.GetMetadata(), descriptorHeap, filename, colorMode);
+	WriteTextureData(result, image);
 	return result;
 }
 
+static AssetStreaming::Task StreamTexture(AssetStreaming::AssetHandle<Texture> handle, std::wstring fileName, DescriptorHeap& descriptorHeap, ColorMode colorMode, bool bNoMip)
+{
+	co_await AssetStreaming::ResumeOnStreamingThread();
+	const DirectX::ScratchImage image = DecodeTexture(fileName.c_str(), bNoMip);
+
+	const AssetStreaming::RenderThreadContext& context = co_await AssetStreaming::ResumeOnRenderThread();
+	handle.Get() = CreateTexture(context.device, image.GetMetadata(), descriptorHeap, fileName.c_str(), colorMode);
+
+	//nothing uses the texture before it is published
+	co_await AssetStreaming::ResumeOnStreamingThread();
+	WriteTextureData(handle.Get(), image);
+
+	co_await AssetStreaming::ResumeOnRenderThread();
+	handle.Publish();
+}
+
+AssetStreaming::AssetHandle<Texture> LoadTextureAsync(std::wstring fileName, DescriptorHeap& descriptorHeap, ColorMode colorMode, bool bNoMip)
+{
+	AssetStreaming::AssetHandle<Texture> handle = AssetStreaming::AssetHandle<Texture>::Create();
+	StreamTexture(handle, std::move(fileName), descriptorHeap, colorMode, bNoMip);
+	return handle;
+}
+
 Texture CreateTexture(ID3D12Device10* device, 
 	const TextureProperties& properties,
 	DescriptorHeap& descriptorHeap, 
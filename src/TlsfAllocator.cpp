@@ -0,0 +1,269 @@
+#include "stdafx.h"
+#include "TlsfAllocator.h"
+
+TlsfAllocator::TlsfAllocator(uint32_t size, uint32_t reservedNodeCount) : size(size)
+{
+	nodes.reserve(reservedNodeCount);
+	reset();
+}
+
+void TlsfAllocator::reset()
+{
+	nodes.clear();
+	firstUnusedNode = InvalidNode;
+	firstLevelMask = 0;
+	std::fill(std::begin(secondLevelMasks), std::end(secondLevelMasks), 0);
+	freeSpace = 0;
+
+	if (size > 0)
+	{
+		InsertFreeNode(CreateNode(0, size));
+	}
+}
+
+void TlsfAllocator::MapSize(uint32_t size, uint32_t& firstLevel, uint32_t& secondLevel)
+{
+	//sizes below secondLevelCount get a class of their own in the first list
+	if (size < secondLevelCount)
+	{
+		firstLevel = 0;
+		secondLevel = size;
+		return;
+	}
+
+	const uint32_t mostSignificantBit = static_cast<uint32_t>(std::bit_width(size)) - 1;
+	firstLevel = mostSignificantBit - secondLevelBitCount + 1;
+	secondLevel = (size >> (mostSignificantBit - secondLevelBitCount)) - secondLevelCount;
+}
+
+uint32_t TlsfAllocator::FindFreeNode(uint32_t size) const
+{
+	//round up to the next class boundary, so every block of the found class is large enough
+	uint64_t roundedSize = size;
+	if (size >= secondLevelCount)
+	{
+		const uint32_t mostSignificantBit = static_cast<uint32_t>(std::bit_width(size)) - 1;
+		roundedSize += (1u << (mostSignificantBit - secondLevelBitCount)) - 1;
+	}
+	if (roundedSize > UINT32_MAX)
+	{
+		return InvalidNode;
+	}
+
+	uint32_t firstLevel;
+	uint32_t secondLevel;
+	MapSize(static_cast<uint32_t>(roundedSize), firstLevel, secondLevel);
+
+	uint32_t secondLevelMask = secondLevelMasks[firstLevel] & (~0u << secondLevel);
+	if (secondLevelMask == 0)
+	{
+		const uint32_t firstLevelMaskAbove = firstLevelMask & (~0u << (firstLevel + 1));
+		if (firstLevelMaskAbove == 0)
+		{
+			return InvalidNode;
+		}
+		firstLevel = std::countr_zero(firstLevelMaskAbove);
+		secondLevelMask = secondLevelMasks[firstLevel];
+	}
+
+	return freeLists[firstLevel][std::countr_zero(secondLevelMask)];
+}
+
+uint32_t TlsfAllocator::CreateNode(uint32_t offset, uint32_t size)
+{
+	uint32_t nodeIndex = firstUnusedNode;
+	if (nodeIndex != InvalidNode)
+	{
+		firstUnusedNode = nodes[nodeIndex].nextFree;
+		nodes[nodeIndex] = {};
+	}
+	else
+	{
+		nodeIndex = static_cast<uint32_t>(nodes.size());
+		nodes.emplace_back();
+	}
+
+	nodes[nodeIndex].offset = offset;
+	nodes[nodeIndex].size = size;
+
+	return nodeIndex;
+}
+
+void TlsfAllocator::ReleaseNode(uint32_t nodeIndex)
+{
+	nodes[nodeIndex].nextFree = firstUnusedNode;
+	firstUnusedNode = nodeIndex;
+}
+
+void TlsfAllocator::InsertFreeNode(uint32_t nodeIndex)
+{
+	Node& node = nodes[nodeIndex];
+	uint32_t firstLevel;
+	uint32_t secondLevel;
+	MapSize(node.size, firstLevel, secondLevel);
+
+	const bool isListEmpty = (secondLevelMasks[firstLevel] & (1u << secondLevel)) == 0;
+	node.isFree = true;
+	node.previousFree = InvalidNode;
+	node.nextFree = isListEmpty ? InvalidNode : freeLists[firstLevel][secondLevel];
+	if (node.nextFree != InvalidNode)
+	{
+		nodes[node.nextFree].previousFree = nodeIndex;
+	}
+
+	freeLists[firstLevel][secondLevel] = nodeIndex;
+	secondLevelMasks[firstLevel] |= 1u << secondLevel;
+	firstLevelMask |= 1u << firstLevel;
+	freeSpace += node.size;
+}
+
+void TlsfAllocator::RemoveFreeNode(uint32_t nodeIndex)
+{
+	Node& node = nodes[nodeIndex];
+	assert(node.isFree);
+	uint32_t firstLevel;
+	uint32_t secondLevel;
+	MapSize(node.size, firstLevel, secondLevel);
+
+	if (node.previousFree != InvalidNode)
+	{
+		nodes[node.previousFree].nextFree = node.nextFree;
+	}
+	else
+	{
+		freeLists[firstLevel][secondLevel] = node.nextFree;
+		if (node.nextFree == InvalidNode)
+		{
+			secondLevelMasks[firstLevel] &= ~(1u << secondLevel);
+			if (secondLevelMasks[firstLevel] == 0)
+			{
+				firstLevelMask &= ~(1u << firstLevel);
+			}
+		}
+	}
+	if (node.nextFree != InvalidNode)
+	{
+		nodes[node.nextFree].previousFree = node.previousFree;
+	}
+
+	node.isFree = false;
+	freeSpace -= node.size;
+}
+
+uint32_t TlsfAllocator::Split(uint32_t nodeIndex, uint32_t splitOffset)
+{
+	const uint32_t tailIndex = CreateNode(splitOffset, nodes[nodeIndex].offset + nodes[nodeIndex].size - splitOffset);
+	Node& node = nodes[nodeIndex];
+	Node& tail = nodes[tailIndex];
+	node.size -= tail.size;
+
+	tail.previousPhysical = nodeIndex;
+	tail.nextPhysical = node.nextPhysical;
+	if (tail.nextPhysical != InvalidNode)
+	{
+		nodes[tail.nextPhysical].previousPhysical = tailIndex;
+	}
+	node.nextPhysical = tailIndex;
+
+	return tailIndex;
+}
+
+OffsetAllocator::Allocation TlsfAllocator::allocateAligned(uint32_t requestedSize, uint32_t alignment)
+{
+	requestedSize = Max(requestedSize, 1u);
+	alignment = Max(alignment, 1u);
+
+	const auto fits = [this, requestedSize, alignment](uint32_t nodeIndex)
+	{
+		const Node& node = nodes[nodeIndex];
+		return Align(node.offset, alignment) - node.offset + requestedSize <= node.size;
+	};
+
+	//most free blocks start aligned already, only search for the worst case padding if the good fit does not
+	uint32_t nodeIndex = FindFreeNode(requestedSize);
+	if (nodeIndex != InvalidNode && !fits(nodeIndex))
+	{
+		nodeIndex = InvalidNode;
+	}
+	if (nodeIndex == InvalidNode && alignment > 1)
+	{
+		const uint64_t paddedSize = static_cast<uint64_t>(requestedSize) + alignment - 1;
+		nodeIndex = paddedSize <= UINT32_MAX ? FindFreeNode(static_cast<uint32_t>(paddedSize)) : InvalidNode;
+	}
+	if (nodeIndex == InvalidNode)
+	{
+		return {};
+	}
+
+	RemoveFreeNode(nodeIndex);
+
+	//the space in front of the aligned offset stays free
+	const uint32_t alignedOffset = static_cast<uint32_t>(Align(nodes[nodeIndex].offset, alignment));
+	if (alignedOffset != nodes[nodeIndex].offset)
+	{
+		const uint32_t alignedIndex = Split(nodeIndex, alignedOffset);
+		InsertFreeNode(nodeIndex);
+		nodeIndex = alignedIndex;
+	}
+
+	if (nodes[nodeIndex].size > requestedSize)
+	{
+		InsertFreeNode(Split(nodeIndex, alignedOffset + requestedSize));
+	}
+
+	return { .offset = alignedOffset, .metadata = nodeIndex };
+}
+
+void TlsfAllocator::free(OffsetAllocator::Allocation allocation)
+{
+	uint32_t nodeIndex = allocation.metadata;
+	assert(nodeIndex < nodes.size() && !nodes[nodeIndex].isFree);
+
+	const uint32_t nextIndex = nodes[nodeIndex].nextPhysical;
+	if (nextIndex != InvalidNode && nodes[nextIndex].isFree)
+	{
+		RemoveFreeNode(nextIndex);
+		nodes[nodeIndex].size += nodes[nextIndex].size;
+		nodes[nodeIndex].nextPhysical = nodes[nextIndex].nextPhysical;
+		if (nodes[nodeIndex].nextPhysical != InvalidNode)
+		{
+			nodes[nodes[nodeIndex].nextPhysical].previousPhysical = nodeIndex;
+		}
+		ReleaseNode(nextIndex);
+	}
+
+	const uint32_t previousIndex = nodes[nodeIndex].previousPhysical;
+	if (previousIndex != InvalidNode && nodes[previousIndex].isFree)
+	{
+		RemoveFreeNode(previousIndex);
+		nodes[previousIndex].size += nodes[nodeIndex].size;
+		nodes[previousIndex].nextPhysical = nodes[nodeIndex].nextPhysical;
+		if (nodes[previousIndex].nextPhysical != InvalidNode)
+		{
+			nodes[nodes[previousIndex].nextPhysical].previousPhysical = previousIndex;
+		}
+		ReleaseNode(nodeIndex);
+		nodeIndex = previousIndex;
+	}
+
+	InsertFreeNode(nodeIndex);
+}
+
+OffsetAllocator::StorageReport TlsfAllocator::storageReport() const
+{
+	OffsetAllocator::StorageReport report = { .totalFreeSpace = freeSpace, .largestFreeRegion = 0 };
+	if (firstLevelMask == 0)
+	{
+		return report;
+	}
+
+	//blocks within a class are not sorted, so the largest one needs a walk over the highest non empty class
+	const uint32_t firstLevel = static_cast<uint32_t>(std::bit_width(firstLevelMask)) - 1;
+	const uint32_t secondLevel = static_cast<uint32_t>(std::bit_width(secondLevelMasks[firstLevel])) - 1;
+	for (uint32_t nodeIndex = freeLists[firstLevel][secondLevel]; nodeIndex != InvalidNode; nodeIndex = nodes[nodeIndex].nextFree)
+	{
+		report.largestFreeRegion = Max(report.largestFreeRegion, nodes[nodeIndex].size);
+	}
+
+	return report;
+}
@@ -0,0 +1,91 @@
+#include "stdafx.h"
+#include "UploadWriter.h"
+
+#include <immintrin.h>
+
+static constexpr size_t streamingCopyMinSize = 256;
+
+void WriteCombinedCopy(void* destination, const void* source, size_t size)
+{
+	uint8_t* destinationBytes = static_cast<uint8_t*>(destination);
+	const uint8_t* sourceBytes = static_cast<const uint8_t*>(source);
+
+	if (size < streamingCopyMinSize)
+	{
+		std::memcpy(destinationBytes, sourceBytes, size);
+		return;
+	}
+
+	//non temporal stores need 16 byte aligned destinations
+	const size_t headSize = (16 - (reinterpret_cast<uintptr_t>(destinationBytes) & 15)) & 15;
+	std::memcpy(destinationBytes, sourceBytes, headSize);
+	destinationBytes += headSize;
+	sourceBytes += headSize;
+	size -= headSize;
+
+	//finish the first line, so the main loop fills every line with four consecutive stores
+	while (size >= 16 && (reinterpret_cast<uintptr_t>(destinationBytes) & (writeCombiningLineSize - 1)) != 0)
+	{
+		_mm_stream_si128(reinterpret_cast<__m128i*>(destinationBytes), _mm_loadu_si128(reinterpret_cast<const __m128i*>(sourceBytes)));
+		destinationBytes += 16;
+		sourceBytes += 16;
+		size -= 16;
+	}
+
+	for (; size >= writeCombiningLineSize; size -= writeCombiningLineSize)
+	{
+		const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sourceBytes));
+		const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sourceBytes + 16));
+		const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sourceBytes + 32));
+		const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sourceBytes + 48));
+		_mm_stream_si128(reinterpret_cast<__m128i*>(destinationBytes), a);
+		_mm_stream_si128(reinterpret_cast<__m128i*>(destinationBytes + 16), b);
+		_mm_stream_si128(reinterpret_cast<__m128i*>(destinationBytes + 32), c);
+		_mm_stream_si128(reinterpret_cast<__m128i*>(destinationBytes + 48), d);
+		destinationBytes += writeCombiningLineSize;
+		sourceBytes += writeCombiningLineSize;
+	}
+
+	for (; size >= 16; size -= 16)
+	{
+		_mm_stream_si128(reinterpret_cast<__m128i*>(destinationBytes), _mm_loadu_si128(reinterpret_cast<const __m128i*>(sourceBytes)));
+		destinationBytes += 16;
+		sourceBytes += 16;
+	}
+
+	std::memcpy(destinationBytes, sourceBytes, size);
+
+	//streaming stores are weakly ordered, make them visible before anything signals the GPU
+	_mm_sfence();
+}
+
+void UploadWriter::Write(size_t offset, const void* source, size_t size)
+{
+	assert(offset + size <= destinationSize);
+
+	const bool isContinuation = stagedSize > 0 && offset == stagedOffset + stagedSize;
+	if (!isContinuation || StagingLineOffset() + stagedSize + size > sizeof(staging))
+	{
+		Flush();
+		if (size >= stagingSize)
+		{
+			WriteCombinedCopy(destination + offset, source, size);
+			return;
+		}
+		stagedOffset = offset;
+	}
+
+	std::memcpy(staging + StagingLineOffset() + stagedSize, source, size);
+	stagedSize += size;
+}
+
+void UploadWriter::Flush()
+{
+	if (stagedSize == 0)
+	{
+		return;
+	}
+
+	WriteCombinedCopy(destination + stagedOffset, staging + StagingLineOffset(), stagedSize);
+	stagedSize = 0;
+}
@@ -0,0 +1,97 @@
+#include "stdafx.h"
+#include "VirtualMemory.h"
+
+void VirtualMemoryRange::Init(size_t sizeBytes, const VirtualMemoryDesc& desc)
+{
+	decommitDelayFrames = desc.decommitDelayFrames;
+	reservedBytes = Align(sizeBytes, commitGranularityBytes);
+	committedBytes = 0;
+	highWaterMarkBytes = 0;
+	windowHighWaterMarkBytes = 0;
+	framesBelowCommittedCount = 0;
+	isLargePages = false;
+	isFallback = false;
+
+	if (desc.useLargePages)
+	{
+		//@note: requires SeLockMemoryPrivilege. If the privilege is not held, allocation fails and we fall back to regular pages
+		if (const size_t largePageSize = GetLargePageMinimum())
+		{
+			const size_t largePagesBytes = Align(sizeBytes, largePageSize);
+			base = static_cast<uint8_t*>(VirtualAlloc(nullptr, largePagesBytes, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE));
+			if (base)
+			{
+				reservedBytes = largePagesBytes;
+				committedBytes = largePagesBytes;
+				isLargePages = true;
+				return;
+			}
+		}
+	}
+
+	base = static_cast<uint8_t*>(VirtualAlloc(nullptr, reservedBytes, MEM_RESERVE, PAGE_NOACCESS));
+	if (!base)
+	{
+		base = static_cast<uint8_t*>(malloc(reservedBytes));
+		assert(base);
+		committedBytes = reservedBytes;
+		isFallback = true;
+	}
+}
+
+void VirtualMemoryRange::Destroy()
+{
+	if (!base)
+	{
+		return;
+	}
+
+	if (isFallback)
+	{
+		free(base);
+	}
+	else
+	{
+		VirtualFree(base, 0, MEM_RELEASE);
+	}
+
+	base = nullptr;
+	reservedBytes = 0;
+	committedBytes = 0;
+}
+
+void VirtualMemoryRange::Grow(size_t endOffsetBytes)
+{
+	assert(endOffsetBytes <= reservedBytes);
+	const size_t newCommittedBytes = Min(Align(endOffsetBytes, commitGranularityBytes), reservedBytes);
+	[[maybe_unused]] void* result = VirtualAlloc(base + committedBytes, newCommittedBytes - committedBytes, MEM_COMMIT, PAGE_READWRITE);
+	assert(result);
+	committedBytes = newCommittedBytes;
+}
+
+void VirtualMemoryRange::Trim()
+{
+	windowHighWaterMarkBytes = Max(windowHighWaterMarkBytes, highWaterMarkBytes);
+	highWaterMarkBytes = 0;
+
+	if (isLargePages || isFallback)
+	{
+		return;
+	}
+
+	const size_t requiredBytes = Align(windowHighWaterMarkBytes, commitGranularityBytes);
+	if (requiredBytes >= committedBytes)
+	{
+		framesBelowCommittedCount = 0;
+		windowHighWaterMarkBytes = 0;
+		return;
+	}
+
+	if (++framesBelowCommittedCount >= decommitDelayFrames)
+	{
+		VirtualFree(base + requiredBytes, committedBytes - requiredBytes, MEM_DECOMMIT);
+		committedBytes = requiredBytes;
+		framesBelowCommittedCount = 0;
+		windowHighWaterMarkBytes = 0;
+	}
+}
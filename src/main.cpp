@@ -1,22 +1,38 @@
 #include "stdafx.h"
 
+#include "AllocatorBenchmark.h"
 #include "App.h"
+#include "AssetStreaming.h"
+#include "AssetStreamingBenchmark.h"
+#include "BufferHeapBenchmark.h"
 #include "Camera.h"
 #include "ClusteredShading.h"
+#include "CommandStream.h"
+#include "CommandStreamBenchmark.h"
 #include "CubeMap.h"
 #include "D3DDrawHelpers.h"
 #include "D3DGlobals.h"
 #include "D3DInitHelpers.h"
 #include "DDGI.h"
 #include "DebugDrawing.h"
+#include "DeferredReleaseQueueBenchmark.h"
 #include "DepthBuffer.h"
 #include "FrameConstants.h"
+#include "FramePipeline.h"
+#include "FramePipelineBenchmark.h"
 #include "GBuffer.h"
 #include "Geometry.h"
+#include "GeometryImportBenchmark.h"
+#include "HeapTracking.h"
 #include "ImguiHelpers.h"
 #include "IndirectDiffuse.h"
 #include "Input.h"
+#include "JobSystem.h"
+#include "JobSystemBenchmark.h"
 #include "Light.h"
+#include "MeshCacheBenchmark.h"
+#include "MeshletBenchmark.h"
+#include "MeshOptimizerBenchmark.h"
 #include "MipGeneration.h"
 #include "PathTracer.h"
 #include "PostProcess.h"
@@ -26,11 +42,73 @@
 #include "SSSR.h"
 #include "SwapChain.h"
 #include "TAA.h"
+#include "TaskGraph.h"
 #include "Texture.h"
 #include "Window.h"
 
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR pCmdLine, int nShowCmd)
 {
+	if (strstr(pCmdLine, "-allocatorbenchmark"))
+	{
+		return AllocatorBenchmark::RunAndWriteCsv("AllocatorBenchmark.csv") ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	if (strstr(pCmdLine, "-jobsystembenchmark"))
+	{
+		return JobSystemBenchmark::RunAndWriteCsv("JobSystemBenchmark.csv") ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	if (strstr(pCmdLine, "-assetstreamingbenchmark"))
+	{
+		return AssetStreamingBenchmark::RunAndWriteCsv("AssetStreamingBenchmark.csv") ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	if (strstr(pCmdLine, "-bufferheapbenchmark"))
+	{
+		return BufferHeapBenchmark::RunAndWriteCsv("BufferHeapBenchmark.csv") ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	if (strstr(pCmdLine, "-commandstreambenchmark"))
+	{
+		return CommandStreamBenchmark::RunAndWriteCsv("CommandStreamBenchmark.csv") ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	if (strstr(pCmdLine, "-deferredreleasequeuebenchmark"))
+	{
+		return DeferredReleaseQueueBenchmark::RunAndWriteCsv("DeferredReleaseQueueBenchmark.csv") ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	if (strstr(pCmdLine, "-framepipelinebenchmark"))
+	{
+		return FramePipelineBenchmark::RunAndWriteCsv("FramePipelineBenchmark.csv") ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	if (strstr(pCmdLine, "-meshcachebenchmark"))
+	{
+		return MeshCacheBenchmark::RunAndWriteCsv("MeshCacheBenchmark.csv") ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	if (strstr(pCmdLine, "-geometryimportbenchmark"))
+	{
+		return GeometryImportBenchmark::RunAndWriteCsv("GeometryImportBenchmark.csv") ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	if (strstr(pCmdLine, "-meshoptimizerbenchmark"))
+	{
+		return MeshOptimizerBenchmark::RunAndWriteCsv("MeshOptimizerBenchmark.csv") ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	if (strstr(pCmdLine, "-meshletbenchmark"))
+	{
+		return MeshletBenchmark::RunAndWriteCsv("MeshletBenchmark.csv") ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	//recorded before any heap gets initialized, so the trace can be replayed from scratch by the allocator benchmark
+	if (strstr(pCmdLine, "-allocationtrace"))
+	{
+		MemoryTelemetry::OpenAllocationTrace(AllocatorBenchmark::allocationTraceFilePath);
+	}
+
 	HWND mainWindow = CreateMainWindow(hInstance, nShowCmd, App::name);
 
 	ComPtr<ID3D12Device10> device = CreateDevice();
@@ -45,7 +123,15 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR pCmdLine,
 	const float aspectRatio = static_cast<float>(renderTargetWidth) / renderTargetHeight;
 	const uint32_t renderTargetMipCount = ComputeMaximumMipLevel(renderTargetWidth, renderTargetHeight);
 
-	D3D::InitGlobalState(device.Get(), renderTargetWidth, renderTargetHeight);
+	{
+		MemoryTelemetry::TagScope tagScope(MemoryTelemetry::Tag::Engine);
+		D3D::InitGlobalState(device.Get(), renderTargetWidth, renderTargetHeight);
+	}
+
+	//workers get their per frame arenas right away, the frame memory exists after D3D::InitGlobalState()
+	JobSystem::Init({ .onWorkerStart = [](uint32_t) { Frame::RegisterWorkerThread(); } });
+	//loads started by App::Init() get published by AssetStreaming::Update() in the frame loop
+	AssetStreaming::Init();
 
 	ComPtr<ID3D12CommandQueue> commandQueue = CreateCommandQueue(device.Get());
 	ComPtr<ID3D12GraphicsCommandList10> commandList;
@@ -53,105 +139,361 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR pCmdLine,
 
 	RWBufferResource scratchBuffer = CreateRWBufferResource(device.Get(), {.size = App::renderSettings.accelerationStructureScratchBufferSizeBytes }, D3D12_HEAP_TYPE_DEFAULT);
 
-	App::Init(device.Get(), commandList.Get(), D3D::persistentAllocator, D3D::descriptorHeap, D3D::globalStaticBuffer, scratchBuffer);
+	//Subsystem inits as task graph, run once. Most of them only load shaders, create PSOs and allocate their resources, which is safe from several threads at once
+	//since device calls are free threaded and the persistent heaps lock. Shared state beyond that is declared as resource.
+	//App::Init() records on the command list and needs COM for texture loading, so it runs on the main thread while the workers run the graph.
+	//-serialstartup runs the graph on the main thread before App::Init() instead, for comparison. -startuptimings writes the per subsystem timings
+	ShadowMaps cascadedShadowMap;
+	ShadowMaps omnidirectionalShadowMaps;
+	CubeMaps cubeMaps;
+	ClusteredShadingContext mainViewClusteredShadingContext;
 
-	// initialize render systems
+	TaskGraph startupGraph;
 	{
-		MipGenerator::Init(device.Get());
-		BlueNoiseGeneration::Init(device.Get(), D3D::descriptorHeap, D3D::globalStaticBuffer);
+		TaskGraph& graph = startupGraph;
+		const TaskGraph::ResourceId clusteredShadingPsosResource = graph.AddResource("ClusteredShadingPsos"); //shared by all clustered shading contexts, created by the first one
 
-		GBuffer::Init(device.Get(),
-			renderTargetWidth,
-			renderTargetHeight,
-			D3D::depthStencilFormat,
-			D3D::descriptorHeap,
-			D3D::globalStaticBuffer);
+		graph.AddNode("MipGenerator", {}, {}, [&]()
+			{
+				MemoryTelemetry::TagScope tagScope(MemoryTelemetry::Tag::Rendering);
+				MipGenerator::Init(device.Get());
+			});
 
-		DDGI::Init(device.Get(),
-			D3D::descriptorHeap,
-			D3D::globalStaticBuffer,
-			{ .probeSpacing = App::renderSettings.ddgiProbeSpacing, .relativeOffset = App::renderSettings.ddgiRelativeOffset });
-
-		SSSR::Init(device.Get(), renderTargetWidth, renderTargetHeight, D3D::descriptorHeap, D3D::globalStaticBuffer);
-		SSAO::Init(device.Get(), D3D::descriptorHeap, renderTargetWidth, renderTargetHeight);
-		IndirectDiffuse::Init(device.Get(), renderTargetWidth, renderTargetHeight, D3D::descriptorHeap);
-		TAA::Init(device.Get(), D3D::HDRRenderTargetFormat, renderTargetWidth, renderTargetHeight, D3D::descriptorHeap);
-		PathTracer::Init(device.Get(), D3D::descriptorHeap, renderTargetWidth, renderTargetHeight);
-		PostProcess::Init(device.Get(), D3D::backbufferFormat);
+		graph.AddNode("BlueNoiseGeneration", {}, {}, [&]()
+			{
+				MemoryTelemetry::TagScope tagScope(MemoryTelemetry::Tag::Rendering);
+				BlueNoiseGeneration::Init(device.Get(), D3D::descriptorHeap, D3D::globalStaticBuffer);
+			});
+
+		graph.AddNode("GBuffer", {}, {}, [&]()
+			{
+				MemoryTelemetry::TagScope tagScope(MemoryTelemetry::Tag::Rendering);
+				GBuffer::Init(device.Get(),
+					renderTargetWidth,
+					renderTargetHeight,
+					D3D::depthStencilFormat,
+					D3D::descriptorHeap,
+					D3D::globalStaticBuffer);
+			});
+
+		graph.AddNode("DDGI", {}, {}, [&]()
+			{
+				MemoryTelemetry::TagScope tagScope(MemoryTelemetry::Tag::GlobalIllumination);
+				DDGI::Init(device.Get(),
+					D3D::descriptorHeap,
+					D3D::globalStaticBuffer,
+					{ .probeSpacing = App::renderSettings.ddgiProbeSpacing, .relativeOffset = App::renderSettings.ddgiRelativeOffset });
+			});
+
+		graph.AddNode("SSSR", {}, {}, [&]()
+			{
+				MemoryTelemetry::TagScope tagScope(MemoryTelemetry::Tag::Rendering);
+				SSSR::Init(device.Get(), renderTargetWidth, renderTargetHeight, D3D::descriptorHeap, D3D::globalStaticBuffer);
+			});
+
+		graph.AddNode("SSAO", {}, {}, [&]()
+			{
+				MemoryTelemetry::TagScope tagScope(MemoryTelemetry::Tag::Rendering);
+				SSAO::Init(device.Get(), D3D::descriptorHeap, renderTargetWidth, renderTargetHeight);
+			});
+
+		graph.AddNode("IndirectDiffuse", {}, {}, [&]()
+			{
+				MemoryTelemetry::TagScope tagScope(MemoryTelemetry::Tag::Rendering);
+				IndirectDiffuse::Init(device.Get(), renderTargetWidth, renderTargetHeight, D3D::descriptorHeap);
+			});
+
+		graph.AddNode("TAA", {}, {}, [&]()
+			{
+				MemoryTelemetry::TagScope tagScope(MemoryTelemetry::Tag::Rendering);
+				TAA::Init(device.Get(), D3D::HDRRenderTargetFormat, renderTargetWidth, renderTargetHeight, D3D::descriptorHeap);
+			});
+
+		graph.AddNode("PathTracer", {}, {}, [&]()
+			{
+				MemoryTelemetry::TagScope tagScope(MemoryTelemetry::Tag::Rendering);
+				PathTracer::Init(device.Get(), D3D::descriptorHeap, renderTargetWidth, renderTargetHeight);
+			});
+
+		graph.AddNode("PostProcess", {}, {}, [&]()
+			{
+				MemoryTelemetry::TagScope tagScope(MemoryTelemetry::Tag::Rendering);
+				PostProcess::Init(device.Get(), D3D::backbufferFormat);
+			});
+
+		graph.AddNode("CascadedShadowMap", {}, {}, [&]()
+			{
+				MemoryTelemetry::TagScope tagScope(MemoryTelemetry::Tag::Shadows);
+				cascadedShadowMap.Init(device.Get(),
+					directionalLightsMaxCount * cascadeCount,
+					App::renderSettings.cascadedShadowMapSize,
+					App::renderSettings.cascadedShadowMapSize,
+					DXGI_FORMAT_D32_FLOAT,
+					D3D::descriptorHeap,
+					D3D::globalStaticBuffer,
+					L"Cascaded Shadow Map");
+			});
+
+		graph.AddNode("OmnidirectionalShadowMaps", {}, {}, [&]()
+			{
+				MemoryTelemetry::TagScope tagScope(MemoryTelemetry::Tag::Shadows);
+				omnidirectionalShadowMaps.Init(device.Get(),
+					App::renderSettings.shadowedPointLightsMaxCount * 6,
+					App::renderSettings.omnidirectionalShadowMapSize,
+					App::renderSettings.omnidirectionalShadowMapSize,
+					App::renderSettings.omndirectionalShadowMapsFormt,
+					D3D::descriptorHeap,
+					D3D::globalStaticBuffer,
+					L"Omnidirectional Shadow Maps");
+			});
+
+		graph.AddNode("CubeMaps", {}, { clusteredShadingPsosResource }, [&]()
+			{
+				MemoryTelemetry::TagScope tagScope(MemoryTelemetry::Tag::GlobalIllumination);
+				const uint32_t cubeMapSize = App::renderSettings.cubeMapSize;
+				cubeMaps.Init(device.Get(),
+					cubeMapSize,
+					App::renderSettings.cubeMapsMaxCount,
+					ComputeMaximumMipLevel(cubeMapSize, cubeMapSize),
+					D3D::HDRRenderTargetFormat,
+					App::renderSettings.cubeMapsFormat,
+					D3D::descriptorHeap,
+					D3D::globalStaticBuffer);
+				cubeMaps.perFrameFaceUpdatesCount = App::renderSettings.cubeMapFacesPerFrameUpdateCount;
+			});
+
+		graph.AddNode("MainViewClusteredShading", {}, { clusteredShadingPsosResource }, [&]()
+			{
+				MemoryTelemetry::TagScope tagScope(MemoryTelemetry::Tag::Rendering);
+				mainViewClusteredShadingContext.Init(device.Get(),
+					D3D::descriptorHeap,
+					D3D::globalStaticBuffer,
+					renderTargetWidth,
+					renderTargetHeight,
+					L"Main View");
+			});
+
+		graph.AddNode("DebugView", {}, {}, [&]()
+			{
+				MemoryTelemetry::TagScope tagScope(MemoryTelemetry::Tag::Debug);
+				DebugView::Init(device.Get(),
+					D3D::descriptorHeap,
+					D3D::globalStaticBuffer,
+					D3D::HDRRenderTargetFormat,
+					D3D::depthStencilFormat,
+					renderTargetWidth,
+					renderTargetHeight);
+			});
+
+		graph.Compile();
 	}
 
-	TemporaryTlas tlas;
-	ResourceTransitions(commandList.Get(), { scratchBuffer.Barrier(ResourceState::ScratchBuildAccelerationStructure, ResourceState::ScratchBuildAccelerationStructure) });
+	const bool isRunningStartupSerial = strstr(pCmdLine, "-serialstartup") != nullptr;
+	const auto startupBegin = std::chrono::high_resolution_clock::now();
+	if (isRunningStartupSerial)
+	{
+		startupGraph.RunSerial();
+	}
+	else
+	{
+		startupGraph.Start();
+	}
 
-	ShadowMaps cascadedShadowMap;
-	cascadedShadowMap.Init(device.Get(),
-		directionalLightsMaxCount * cascadeCount,
-		App::renderSettings.cascadedShadowMapSize,
-		App::renderSettings.cascadedShadowMapSize,
-		DXGI_FORMAT_D32_FLOAT,
-		D3D::descriptorHeap,
-		D3D::globalStaticBuffer,
-		L"Cascaded Shadow Map");
+	const auto appInitBegin = std::chrono::high_resolution_clock::now();
+	{
+		MemoryTelemetry::TagScope tagScope(MemoryTelemetry::Tag::Scene);
+		App::Init(device.Get(), commandList.Get(), D3D::persistentAllocator, D3D::descriptorHeap, D3D::globalStaticBuffer, scratchBuffer);
+	}
+	const auto appInitEnd = std::chrono::high_resolution_clock::now();
 
-	ShadowMaps omnidirectionalShadowMaps;
-	omnidirectionalShadowMaps.Init(device.Get(),
-		App::renderSettings.shadowedPointLightsMaxCount * 6,
-		App::renderSettings.omnidirectionalShadowMapSize,
-		App::renderSettings.omnidirectionalShadowMapSize,
-		App::renderSettings.omndirectionalShadowMapsFormt,
-		D3D::descriptorHeap,
-		D3D::globalStaticBuffer,
-		L"Omnidirectional Shadow Maps");
-
-	const uint32_t cubeMapSize = App::renderSettings.cubeMapSize;
-	CubeMaps cubeMaps;
-	cubeMaps.Init(device.Get(),
-		cubeMapSize,
-		App::renderSettings.cubeMapsMaxCount,
-		ComputeMaximumMipLevel(cubeMapSize, cubeMapSize),
-		D3D::HDRRenderTargetFormat,
-		App::renderSettings.cubeMapsFormat,
-		D3D::descriptorHeap,
-		D3D::globalStaticBuffer); 
-	cubeMaps.perFrameFaceUpdatesCount = App::renderSettings.cubeMapFacesPerFrameUpdateCount;
-
-	ClusteredShadingContext mainViewClusteredShadingContext; 
-	mainViewClusteredShadingContext.Init(device.Get(),
-		D3D::descriptorHeap,
-		D3D::globalStaticBuffer,
-		renderTargetWidth,
-		renderTargetHeight,
-		L"Main View");
+	if (!isRunningStartupSerial)
+	{
+		startupGraph.Wait();
+	}
+	const auto startupEnd = std::chrono::high_resolution_clock::now();
+
+	if (strstr(pCmdLine, "-startuptimings"))
+	{
+		FILE* file = nullptr;
+		if (fopen_s(&file, "StartupTimings.csv", "w") == 0 && file)
+		{
+			fprintf(file, "mode: %s, workers: %u\n", isRunningStartupSerial ? "serial" : "parallel", JobSystem::GetWorkerCount());
+			startupGraph.WriteTimings(file);
+			fprintf(file, "App::Init on main thread: %.3f ms\n", std::chrono::duration<double, std::milli>(appInitEnd - appInitBegin).count());
+			fprintf(file, "startup total: %.3f ms\n", std::chrono::duration<double, std::milli>(startupEnd - startupBegin).count());
+			fclose(file);
+		}
+	}
+
+	TemporaryTlas tlas;
+	ResourceTransitions(commandList.Get(), { scratchBuffer.Barrier(ResourceState::ScratchBuildAccelerationStructure, ResourceState::ScratchBuildAccelerationStructure) });
 
 	SwapChain swapChain;
-	swapChain.Init(device.Get(),
-		CreateDXGIFactory().Get(),
-		commandQueue.Get(),
-		mainWindow,
-		D3D::swapChainBufferCount,
-		D3D::backbufferFormat);
+	{
+		MemoryTelemetry::TagScope tagScope(MemoryTelemetry::Tag::Rendering);
+		swapChain.Init(device.Get(),
+			CreateDXGIFactory().Get(),
+			commandQueue.Get(),
+			mainWindow,
+			D3D::swapChainBufferCount,
+			D3D::backbufferFormat);
+	}
 
 	Camera camera(0.25f * DirectX::XM_PI, aspectRatio, D3D::nearZ, D3D::farZ);
 	Camera debugCamera = camera;
-	DebugView::Init(device.Get(),
-		D3D::descriptorHeap,
-		D3D::globalStaticBuffer,
-		D3D::HDRRenderTargetFormat,
-		D3D::depthStencilFormat,
-		renderTargetWidth,
-		renderTargetHeight);
-
 	Input::Init(mainWindow);
 
-	UI::Init(mainWindow,
-		device.Get(),
-		D3D::descriptorHeap,
-		swapChain.renderTargets[0].properties.width,
-		swapChain.renderTargets[0].properties.height,
-		Frame::framesInFlightCount);
-
 	UI::Context uiContext;
-	uiContext.Init(cascadedShadowMap, *App::menu);
+	{
+		MemoryTelemetry::TagScope tagScope(MemoryTelemetry::Tag::Ui);
+		UI::Init(mainWindow,
+			device.Get(),
+			D3D::descriptorHeap,
+			swapChain.renderTargets[0].properties.width,
+			swapChain.renderTargets[0].properties.height,
+			Frame::framesInFlightCount);
+		uiContext.Init(cascadedShadowMap, *App::menu);
+	}
+
+	if (strstr(pCmdLine, "-memorytelemetry"))
+	{
+		MemoryTelemetry::OpenPerFrameDump("MemoryTelemetry.jsonl");
+	}
+
+	//-zeroallocationframes makes the run fail if the frame preparation allocates from the heap after the warmup frames
+	const bool isCheckingZeroAllocationFrames = strstr(pCmdLine, "-zeroallocationframes") != nullptr;
+	const bool isTrackingHeap = isCheckingZeroAllocationFrames || strstr(pCmdLine, "-heaptracking") != nullptr;
+	if (isTrackingHeap)
+	{
+		HeapTracking::Enable();
+	}
+
+	//CPU side of the frame preparation as task graph, built once. The nodes only write CPU and upload memory, all commands get recorded on the main thread after the graph is done
+	struct FramePreparation
+	{
+		//inputs, set every frame before running the graph
+		const RenderData* renderData = nullptr;
+		ScratchHeap* frameMemory = nullptr;
+		//outputs
+		TemporaryBuffer<FrameConstants> frameConstantsBuffer;
+		DirectX::BoundingBox shadowCastersBoundingBox;
+		LightsData lightsData;
+	} framePreparation;
+
+	TaskGraph framePreparationGraph;
+	{
+		TaskGraph& graph = framePreparationGraph;
+		const TaskGraph::ResourceId cameraResource = graph.AddResource("Camera");
+		const TaskGraph::ResourceId frameConstantsResource = graph.AddResource("FrameConstants");
+		const TaskGraph::ResourceId tlasInstancesResource = graph.AddResource("TlasInstances");
+		const TaskGraph::ResourceId shadowCastersBoundsResource = graph.AddResource("ShadowCastersBounds");
+		const TaskGraph::ResourceId cascadeDataResource = graph.AddResource("CascadeData");
+		const TaskGraph::ResourceId shadowedPointLightsResource = graph.AddResource("ShadowedPointLights");
+		const TaskGraph::ResourceId pointLightsResource = graph.AddResource("PointLights");
+
+		graph.AddNode("Camera", {}, { cameraResource }, [&]()
+			{
+				camera.Update(
+					uiContext.isFocusDebugCameraWindow ? Camera::Transform{} : framePreparation.renderData->cameraTransform,
+					uiContext.taaSettings.useTaa ? HaltonSubPixelJitter(renderTargetWidth, renderTargetHeight, Frame::timingData.frameId) : DirectX::XMFLOAT2{}
+				);
+			});
+
+		graph.AddNode("FrameConstants", { cameraResource }, { frameConstantsResource }, [&]()
+			{
+				framePreparation.frameConstantsBuffer = WriteFrameConstants(*framePreparation.frameMemory,
+					camera,
+					GetTexture2DDimensions(D3D::mainRenderTarget),
+					*BlueNoiseGeneration::texture,
+					GBuffer::GetSrvIds(),
+					Frame::timingData,
+					uiContext.sharedSettings);
+			});
+
+		graph.AddNode("TlasInstances", {}, { tlasInstancesResource }, [&]()
+			{
+				tlas.WriteInstances(*framePreparation.frameMemory, framePreparation.renderData->opaqueMeshes);
+			});
+
+		graph.AddNode("ShadowCastersBounds", {}, { shadowCastersBoundsResource }, [&]()
+			{
+				framePreparation.shadowCastersBoundingBox = ComputeCompoundMeshBoundingBox(framePreparation.renderData->shadowCasters);
+			});
+
+		graph.AddNode("CascadeData", { cameraResource, shadowCastersBoundsResource }, { cascadeDataResource }, [&]()
+			{
+				framePreparation.lightsData.cascadeDataOffset = UpdateCascadeData(*framePreparation.frameMemory,
+					camera,
+					framePreparation.renderData->directionalLights,
+					framePreparation.shadowCastersBoundingBox,
+					cascadedShadowMap);
+			});
+
+		graph.AddNode("ShadowedPointLights", {}, { shadowedPointLightsResource }, [&]()
+			{
+				UpdateShadowedPointLightsData(framePreparation.renderData->shadowedPointLights, omnidirectionalShadowMaps);
+			});
+
+		graph.AddNode("PointLights", {}, { pointLightsResource }, [&]()
+			{
+				framePreparation.lightsData.pointLightsBufferOffset = WriteTemporaryData(*framePreparation.frameMemory, framePreparation.renderData->pointLights);
+			});
+
+		//the nodes run on the workers as well, the region around the graph below only covers the main thread
+		graph.isZeroAllocation = true;
+		graph.Compile();
+	}
+
+	//-serialframepreparation runs the graph on the main thread only, for comparison. -taskgraphtimings writes the node timings of the last frame at shutdown
+	const bool isRunningFramePreparationSerial = strstr(pCmdLine, "-serialframepreparation") != nullptr;
+	const bool isWritingTaskGraphTimings = strstr(pCmdLine, "-taskgraphtimings") != nullptr;
+
+	//The per pixel compute passes record into their own command streams on the job system while the main thread records the geometry passes, the streams get translated into the command list at their place in the frame.
+	//-validatecommandstreams replays every stream on the CPU before it gets translated and logs the errors to CommandStreamValidation.txt
+	FILE* commandStreamValidationLog = nullptr;
+	if (strstr(pCmdLine, "-validatecommandstreams"))
+	{
+		fopen_s(&commandStreamValidationLog, "CommandStreamValidation.txt", "w");
+	}
+	CommandStream sssrCommandStream;
+	CommandStream ssaoCommandStream;
+	sssrCommandStream.Init();
+	ssaoCommandStream.Init();
+
+	//App::Simulate() produces the snapshot of the next frame on its own thread while the current one gets rendered. -lockstepsimulation simulates on the render thread instead,
+	//-simulationdropframes lets the simulation run freely and the renderer take the newest snapshot. -simulationstatistics writes the handoff and latency statistics at shutdown
+	const bool isWritingSimulationStatistics = strstr(pCmdLine, "-simulationstatistics") != nullptr;
+	FramePipeline simulationPipeline;
+	simulationPipeline.Init(
+		{
+			.mode = strstr(pCmdLine, "-lockstepsimulation") ? FramePipeline::Mode::Lockstep : FramePipeline::Mode::Pipelined,
+			.backPressure = strstr(pCmdLine, "-simulationdropframes") ? FramePipeline::BackPressure::DropOldest : FramePipeline::BackPressure::Block,
+			.onSimulationThreadStart = []()
+			{
+				//not registered as frame worker, Frame::End() resets those arenas while the simulation keeps running
+				static StackAllocator simulationStackAllocator;
+				simulationStackAllocator.InitVirtual(Frame::workerStackMemoryReservedSize);
+				D3D::threadStackAllocator = &simulationStackAllocator;
+			},
+			.simulate = [](FramePipeline::Snapshot& snapshot)
+			{
+				const Frame::TimingData timingData =
+				{
+					.frameId = snapshot.frameId,
+					.elapsedTimeMs = snapshot.elapsedTimeMs,
+					.deltaTimeMs = snapshot.deltaTimeMs,
+					.averageDeltaTimeMs = snapshot.deltaTimeMs
+				};
+
+				HeapTracking::BeginZeroAllocationRegion("App::Simulate");
+				snapshot.data = new (snapshot.arena.AllocateUninitialized<RenderData>()) RenderData(App::Simulate(snapshot.arena, timingData));
+				HeapTracking::EndZeroAllocationRegion();
+			}
+		});
+
+	//for automated runs
+	const char* exitAfterFramesArgument = strstr(pCmdLine, "-exitafterframes ");
+	const uint64_t exitAfterFrameCount = exitAfterFramesArgument ? strtoull(exitAfterFramesArgument + strlen("-exitafterframes "), nullptr, 10) : 0;
 
 	MSG msg = { };
 	while (msg.message != WM_QUIT)
@@ -166,6 +508,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR pCmdLine,
 			//Update frame counters
 			PIXScopedEvent(commandList.Get(), PIX_COLOR_DEFAULT, "Frame: %u", Frame::timingData.frameId);
 			Frame::Begin();
+			D3D::globalStaticBuffer.CompactIfFragmented(D3D::globalStaticBufferCompactionThreshold, D3D::globalStaticBufferCompactionBudgetBytes, commandList.Get());
 			swapChain.FrameBegin(commandList.Get());
 			UI::FrameBegin();
 			ScratchHeap& frameMemory = Frame::current->gpuMemory;
@@ -175,43 +518,47 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR pCmdLine,
 
 			//Initialize render state
 			D3D::PrepareCommandList(commandList.Get(), D3D::descriptorHeap, D3D::globalStaticBuffer);
+
+			//before the snapshot gets acquired, so a snapshot which already sees a mesh published now is never rendered without its acceleration structure
+			AssetStreaming::Update({ .device = device.Get(), .commandList = commandList.Get(), .scratchBuffer = &scratchBuffer });
 			
-			const RenderData renderData = App::Update(Frame::current->cpuMemory, Frame::timingData);
+			//owned by the render thread until it gets released after the frame is recorded
+			FramePipeline::Snapshot* simulationSnapshot = simulationPipeline.AcquireForRender();
+			const RenderData& renderData = simulationSnapshot->Get<RenderData>();
+			ApplyInstanceDataUpdates(renderData.instanceDataUpdates, frameMemory);
 
 			uiContext.Update(frameDescriptorHeap);
 			UI::DebugVisualizationSettings& debugVisualizationSettings = uiContext.sharedSettings.debugVisualizationSettings;
 
-			camera.Update(
-				uiContext.isFocusDebugCameraWindow ? Camera::Transform{} : renderData.cameraTransform,
-				uiContext.taaSettings.useTaa ? HaltonSubPixelJitter(renderTargetWidth, renderTargetHeight, Frame::timingData.frameId) : DirectX::XMFLOAT2{}
-			);
-
-			TemporaryBuffer<FrameConstants> frameConstantsBuffer = UpdateFrameConstants(commandList.Get(),
-				frameMemory,
-				camera,
-				GetTexture2DDimensions(D3D::mainRenderTarget),
-				*BlueNoiseGeneration::texture,
-				GBuffer::GetSrvIds(),
-				Frame::timingData,
-				uiContext.sharedSettings);
+			HeapTracking::BeginZeroAllocationRegion("Frame preparation");
+			framePreparation.renderData = &renderData;
+			framePreparation.frameMemory = &frameMemory;
+			framePreparation.lightsData = GetLightsData(renderData.directionalLights,
+				renderData.shadowedPointLights,
+				renderData.pointLights,
+				cascadedShadowMap,
+				omnidirectionalShadowMaps);
+			if (isRunningFramePreparationSerial)
+			{
+				framePreparationGraph.RunSerial();
+			}
+			else
+			{
+				framePreparationGraph.Run();
+			}
+			HeapTracking::EndZeroAllocationRegion();
+			assert(framePreparationGraph.CountOrderViolations() == 0);
 
+			const TemporaryBuffer<FrameConstants>& frameConstantsBuffer = framePreparation.frameConstantsBuffer;
+			BindFrameConstants(commandList.Get(), frameConstantsBuffer);
 			BufferHeap::Offset cameraDataOffset = BufferMemberOffset(frameConstantsBuffer, mainCameraData);
 
-			tlas.Build(device.Get(), commandList.Get(), frameDescriptorHeap, frameMemory, scratchBuffer, renderData.opaqueMeshes);
-
-			BlueNoiseGeneration::Generate(commandList.Get());
+			tlas.Build(device.Get(), commandList.Get(), frameDescriptorHeap, scratchBuffer);
 
 			//Shadow map render pass
-			DirectX::BoundingBox boundingBox = ComputeCompoundMeshBoundingBox(renderData.shadowCasters);
+			const LightsData& lightsData = framePreparation.lightsData;
 
-			LightsData lightsData = ComputeLightsData(frameMemory,
-				camera,
-				renderData.directionalLights,
-				renderData.shadowedPointLights,
-				renderData.pointLights,
-				boundingBox,
-				cascadedShadowMap,
-				omnidirectionalShadowMaps);
+			BlueNoiseGeneration::Generate(commandList.Get());
 
 			cascadedShadowMap.RenderShadowMaps(device.Get(),
 				commandList.Get(),
@@ -234,6 +581,22 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR pCmdLine,
 			};
 			BufferHeap::Offset lightingDataBufferOffset = WriteTemporaryData(frameMemory, lightingData);
 
+			//only depends on state which is final at this point, the passes recorded in between don't touch their resources
+			JobSystem::Counter perPixelPassesCounter;
+			{
+				const DescriptorHeap::Id previousLitBufferSrvId = D3D::mainRenderTarget.Other().srvId;
+				sssrCommandStream.Reset();
+				ssaoCommandStream.Reset();
+				JobSystem::Run([&sssrCommandStream, previousLitBufferSrvId, lightingDataBufferOffset]()
+					{
+						SSSR::Render(&sssrCommandStream, previousLitBufferSrvId, lightingDataBufferOffset);
+					}, &perPixelPassesCounter);
+				JobSystem::Run([&ssaoCommandStream, previousLitBufferSrvId]()
+					{
+						SSAO::Render(&ssaoCommandStream, DDGI::bufferOffset, previousLitBufferSrvId);
+					}, &perPixelPassesCounter);
+			}
+
 			//GBuffer laydown 
 			GBuffer::RenderBegin(commandList.Get(), cameraDataOffset);
 			Draw::Opaque(commandList.Get(), {}, renderData.opaqueMeshes, false);
@@ -258,8 +621,14 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR pCmdLine,
 			DDGI::Render(commandList.Get(), lightingDataBufferOffset, tlas.GetTlasData(), renderData.skyBoxSrvId);
 
 			// per pixel passes
-			SSSR::Render(commandList.Get(), D3D::mainRenderTarget.Other().srvId, lightingDataBufferOffset);
-			SSAO::Render(commandList.Get(), DDGI::bufferOffset, D3D::mainRenderTarget.Other().srvId);
+			JobSystem::Wait(perPixelPassesCounter);
+			if (commandStreamValidationLog)
+			{
+				ReplayOnCpu(sssrCommandStream, commandStreamValidationLog);
+				ReplayOnCpu(ssaoCommandStream, commandStreamValidationLog);
+			}
+			sssrCommandStream.Translate(commandList.Get());
+			ssaoCommandStream.Translate(commandList.Get());
 
 			IndirectDiffuse::Render(commandList.Get(),
 				frameDescriptorHeap,
@@ -411,6 +780,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR pCmdLine,
 			D3D::mainRenderTarget.Flip();
 
 			//Close and submit command list
+			FlushMirroredBuffers();
 			commandList->Close();
 			ID3D12CommandList* commandLists[] = { commandList.Get() };
 			commandQueue->ExecuteCommandLists(1, commandLists);
@@ -419,10 +789,45 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR pCmdLine,
 
 			Frame::End(commandQueue.Get(), commandList.Get()/*, 33*/);
 			D3D::stackAllocator.Reset(); 
+			simulationPipeline.Release(simulationSnapshot);
+
+			if (exitAfterFrameCount > 0 && Frame::timingData.frameId >= exitAfterFrameCount)
+			{
+				PostQuitMessage(0);
+			}
 		}
 	}
 
 	Frame::FlushCommandQueue();
+	AssetStreaming::Shutdown();
+	JobSystem::Shutdown();
+	sssrCommandStream.Destroy();
+	ssaoCommandStream.Destroy();
+	if (commandStreamValidationLog)
+	{
+		fclose(commandStreamValidationLog);
+	}
+
+	if (isWritingSimulationStatistics)
+	{
+		FILE* file = nullptr;
+		if (fopen_s(&file, "SimulationPipeline.txt", "w") == 0)
+		{
+			simulationPipeline.WriteStatistics(file);
+			fclose(file);
+		}
+	}
+	simulationPipeline.Shutdown();
+
+	if (isWritingTaskGraphTimings)
+	{
+		FILE* file = nullptr;
+		if (fopen_s(&file, "TaskGraphTimings.csv", "w") == 0)
+		{
+			framePreparationGraph.WriteTimings(file);
+			fclose(file);
+		}
+	}
 
 	cascadedShadowMap.Free();
 	omnidirectionalShadowMaps.Free();
@@ -431,6 +836,18 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR pCmdLine,
 
 	UI::Shutdown();
 	D3D::Shutdown();
+	MemoryTelemetry::ClosePerFrameDump();
+	MemoryTelemetry::CloseAllocationTrace();
+
+	if (isTrackingHeap)
+	{
+		HeapTracking::Disable();
+		HeapTracking::DumpReport("HeapTracking.txt");
+		if (isCheckingZeroAllocationFrames && HeapTracking::GetViolationCount() > 0)
+		{
+			return 1; //non zero exit code, so automated runs fail
+		}
+	}
 	
 	return (int)msg.wParam;
 }